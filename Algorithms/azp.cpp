@@ -864,6 +864,9 @@ void AZP::LocalImproving()
                             }
                             // release lock for region[move], awake threads[move]
                         }
+                        // randomArea has been erased from areas: don't
+                        // advance area_it
+                        if (moved) break;
                     }
                 }
                 if (nothing_can_do) {
@@ -1194,6 +1197,9 @@ void AZPSA::LocalImproving()
                             }
                             // release lock for region[move], awake threads[move]
                         }
+                        // randomArea has been erased from areas: don't
+                        // advance area_it
+                        if (moved) break;
                     }
                 }
                 if (nothing_can_do) {
@@ -1205,6 +1211,7 @@ void AZPSA::LocalImproving()
     this->objInfo = bestOBJ;
     this->region2Area = region2AreaBest;
     this->area2Region = area2RegionBest;
+    objective_function->UpdateRegions();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1309,15 +1316,10 @@ void AZPTabu::LocalImproving()
             tabuList.insert(tabuList.begin(), std::make_pair(add_tabu, obj4Move));
             if (tabuList.size() > tabuLength) tabuList.pop_back();
 
-            // move
-            region2Area[oldRegion].erase(area);
-            region2Area[region].insert(std::make_pair(area, true));
+            // move and update the running sums of the two regions
+            objective_function->MakeMove(area, oldRegion, region);
             area2Region[area] = region;
 
-            // update
-            objective_function->UpdateRegion(region);
-            objective_function->UpdateRegion(oldRegion);
-
             if (minFound == 1) {
                 this->objInfo = obj4Move;
                 if (aspireOBJ - obj4Move > epsilon) {
@@ -1342,6 +1344,7 @@ void AZPTabu::LocalImproving()
     this->regions = aspireRegions;
     this->region2Area = region2AreaAspire;
     this->area2Region = area2RegionAspire;
+    objective_function->UpdateRegions();
 }
 
 
@@ -25,6 +25,7 @@
 #include <algorithm>
 #include <vector>
 #include <limits>
+#include <stack>
 #include <boost/unordered_map.hpp>
 #include <boost/heap/priority_queue.hpp>
 
@@ -134,16 +135,112 @@ protected:
 
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// RegionStats
+////////////////////////////////////////////////////////////////////////////////
+// RegionStats: sufficient statistics of a region (count, per-variable sum and
+// sum of squares). The sum of squared distances to the region centroid is
+// sum_j(sum_sq[j] - sum[j]^2 / count), so the objective value of a region
+// with one area added or removed is O(m) regardless of the region size.
+class RegionStats
+{
+public:
+    RegionStats(int _m = 0) : count(0), sum(_m, 0), sum_sq(_m, 0) {}
+    virtual ~RegionStats() {}
+
+    void Reset() {
+        count = 0;
+        std::fill(sum.begin(), sum.end(), 0);
+        std::fill(sum_sq.begin(), sum_sq.end(), 0);
+    }
+
+    void Add(const double* x) {
+        count += 1;
+        for (size_t j=0; j<sum.size(); ++j) {
+            sum[j] += x[j];
+            sum_sq[j] += x[j] * x[j];
+        }
+    }
+
+    void Remove(const double* x) {
+        count -= 1;
+        for (size_t j=0; j<sum.size(); ++j) {
+            sum[j] -= x[j];
+            sum_sq[j] -= x[j] * x[j];
+        }
+    }
+
+    // sum of squared distances to the centroid
+    double GetSSD() const {
+        if (count <= 1) return 0;
+        double ss = 0;
+        for (size_t j=0; j<sum.size(); ++j) {
+            double v = sum_sq[j] - sum[j] * sum[j] / count;
+            if (v > 0) ss += v;
+        }
+        return ss;
+    }
+
+    // sum of squared distances to the centroid if x joins the region
+    double GetSSDWith(const double* x) const {
+        int cnt = count + 1;
+        if (cnt <= 1) return 0;
+        double ss = 0;
+        for (size_t j=0; j<sum.size(); ++j) {
+            double s = sum[j] + x[j];
+            double v = sum_sq[j] + x[j] * x[j] - s * s / cnt;
+            if (v > 0) ss += v;
+        }
+        return ss;
+    }
+
+    // sum of squared distances to the centroid if x leaves the region
+    double GetSSDWithout(const double* x) const {
+        int cnt = count - 1;
+        if (cnt <= 1) return 0;
+        double ss = 0;
+        for (size_t j=0; j<sum.size(); ++j) {
+            double s = sum[j] - x[j];
+            double v = sum_sq[j] - x[j] * x[j] - s * s / cnt;
+            if (v > 0) ss += v;
+        }
+        return ss;
+    }
+
+    int count;
+    std::vector<double> sum;
+    std::vector<double> sum_sq;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// ObjectiveFunction
 ////////////////////////////////////////////////////////////////////////////////
 // ObjectiveFunction: the target of the AZP is to minimize the objective function
 // of clustering results. E.g. sum of squares
+//
+// The value of each region is kept as RegionStats, so a trial move (TrySwap,
+// TrySwapSA, TabuSwap) is O(m) and never copies the areas of a region. The
+// data is centered on the column means before it goes into the running sums
+// to keep sum_sq - sum^2/n well conditioned.
 class ObjectiveFunction
 {
 public:
     ObjectiveFunction(int _n, int _m, double** _data, GalElement* _w, REGION_AREAS& _regions)
-    : n(_n), m(_m), data(_data), w(_w), regions(_regions) {}
+    : n(_n), m(_m), data(_data), w(_w), regions(_regions), visit_stamp(_n, 0),
+    stamp(0), area2region(_n, -1)
+    {
+        // centered copy of the data, row-wise and contiguous
+        std::vector<double> mean(m, 0);
+        for (int i=0; i<n; ++i) {
+            for (int j=0; j<m; ++j) mean[j] += data[i][j];
+        }
+        for (int j=0; j<m; ++j) if (n > 0) mean[j] /= n;
+        centered.resize(n * m);
+        for (int i=0; i<n; ++i) {
+            for (int j=0; j<m; ++j) centered[i*m + j] = data[i][j] - mean[j];
+        }
+        UpdateRegions();
+    }
     virtual ~ObjectiveFunction() {}
 
     virtual double GetValue() {
@@ -151,103 +248,58 @@ public:
         double ss = 0; // e.g. sum of squares
         REGION_AREAS::iterator it;
         for (it = regions.begin(); it != regions.end(); ++it) {
-            int region = it->first;
-            if (region_of.find(region) == region_of.end()) {
-                // objective function of region needs to be computed
-                double obj = getObjectiveValue(regions[region]);
-                region_of[region] = obj;
-            }
-            ss += region_of[region];
+            ss += GetStats(it->first).GetSSD();
         }
         return ss;
     }
 
     virtual void UpdateRegions() {
-        // region changes, update it's
+        // region2Area has been changed/replaced, rebuild all running sums
+        std::fill(area2region.begin(), area2region.end(), -1);
         REGION_AREAS::iterator it;
         for (it = regions.begin(); it != regions.end(); ++it) {
-            int region = it->first;
-            double obj = getObjectiveValue(regions[region]);
-            region_of[region] = obj;
+            UpdateRegion(it->first);
         }
     }
 
     virtual void UpdateRegion(int region) {
-        // region changes, update it's
-        REGION_AREAS::iterator it;
-        for (it = regions.begin(); it != regions.end(); ++it) {
-            int r = it->first;
-            if (r == region) {
-                double obj = getObjectiveValue(regions[region]);
-                region_of[region] = obj;
-            }
+        // region changes, rebuild its running sums from its areas
+        RegionStats& stats = GetStats(region);
+        stats.Reset();
+        REGION_AREAS::iterator it = regions.find(region);
+        if (it == regions.end()) return;
+        boost::unordered_map<int, bool>::iterator sit;
+        for (sit = it->second.begin(); sit != it->second.end(); ++sit) {
+            stats.Add(GetRow(sit->first));
+            area2region[sit->first] = region;
         }
     }
 
     virtual double getObjectiveValue(boost::unordered_map<int, bool>& areas) {
-        // compute centroid of this set of areas
-        std::vector<double> dataAvg(m, 0);
+        RegionStats stats(m);
         boost::unordered_map<int, bool>::iterator sit;
         for (sit = areas.begin(); sit != areas.end(); ++sit) {
-            int idx = sit->first;
-            for (int j=0; j<m; ++j) {
-                dataAvg[j] += data[idx][j];
-            }
-        }
-        double n_areas = (double)areas.size();
-        for (int j=0; j<m; ++j) {
-            dataAvg[j] /= n_areas;
+            stats.Add(GetRow(sit->first));
         }
-        // distance from each area in this region to centroid
-        double obj = 0;
-
-        for (sit = areas.begin(); sit != areas.end(); ++sit) {
-            int idx = sit->first;
-            double dist = DataUtils::EuclideanDistance(data[idx], dataAvg);
-            obj += dist;
-        }
-        return obj;
+        return stats.GetSSD();
     }
 
     virtual double TabuSwap(int area, int from_region, int to_region) {
         // try to swap area to region, compute the value of objective function
         // no phyical swap happens
-        boost::unordered_map<int, bool> from_areas = regions[from_region];
-        boost::unordered_map<int, bool> to_areas = regions[to_region];
-        from_areas.erase(area);
-        to_areas[area] = false;
-
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
-        double ss = GetValue();
-        double delta = ss_from + ss_to - region_of[from_region] - region_of[to_region];
-        double new_ss = ss + delta;
-
-        return new_ss;
+        double delta = GetDelta(area, from_region, to_region);
+        return GetValue() + delta;
     }
 
     virtual std::pair<double, bool> TrySwap(int area, int from_region, int to_region) {
         // try to swap area to region, compute the value of objective function
         // phyical swap could happen if contiguity check is passed
-        boost::unordered_map<int, bool> from_areas = regions[from_region];
-        boost::unordered_map<int, bool> to_areas = regions[to_region];
-        from_areas.erase(area);
-        to_areas[area] = false;
-
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
-        double delta = ss_from + ss_to - region_of[from_region] - region_of[to_region];
+        double delta = GetDelta(area, from_region, to_region);
         if (delta <= 0) {
             // improved
             if (checkFeasibility(from_region, area)) {
-                region_of[from_region] = ss_from;
-                region_of[to_region] = ss_to;
-                // confirm swap, lock
-                // update values for two changed regions
-                regions[from_region] = from_areas;
-                regions[to_region] = to_areas;
+                // confirm swap, update the two changed regions
+                MoveArea(area, from_region, to_region);
                 return std::make_pair(delta, true);
             }
         }
@@ -257,27 +309,14 @@ public:
     virtual std::pair<double, bool> TrySwapSA(int area, int from_region, int to_region, double best_of) {
         // try to swap area to region, compute the value of objective function
         // phyical swap could happen if contiguity check is passed
-        boost::unordered_map<int, bool> from_areas = regions[from_region];
-        boost::unordered_map<int, bool> to_areas = regions[to_region];
-        from_areas.erase(area);
-        to_areas[area] = false;
-
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
-        double ss = GetValue();
-        double delta = ss_from + ss_to - region_of[from_region] - region_of[to_region];
-        double new_ss = ss + delta;
+        double delta = GetDelta(area, from_region, to_region);
+        double new_ss = GetValue() + delta;
 
         if (new_ss <= best_of) {
             // improved
             if (checkFeasibility(from_region, area)) {
-                region_of[from_region] = ss_from;
-                region_of[to_region] = ss_to;
-                // confirm swap, lock
-                // update values for two changed regions
-                regions[from_region] = from_areas;
-                regions[to_region] = to_areas;
+                // confirm swap, update the two changed regions
+                MoveArea(area, from_region, to_region);
                 return std::make_pair(new_ss, true);
             }
         }
@@ -285,61 +324,88 @@ public:
     }
 
     virtual double MakeMove(int area, int from_region, int to_region) {
-        // use reference here to make actual change
-        boost::unordered_map<int, bool>& from_areas = regions[from_region];
-        boost::unordered_map<int, bool>& to_areas = regions[to_region];
-        from_areas.erase(area);
-        to_areas[area] = false;
-
-        double ss_from = getObjectiveValue(from_areas);
-        double ss_to = getObjectiveValue(to_areas);
-
-        region_of[from_region] = ss_from;
-        region_of[to_region] = ss_to;
-        // update values for two changed regions
-        regions[from_region] = from_areas;
-        regions[to_region] = to_areas;
-
+        MoveArea(area, from_region, to_region);
         return GetValue();
     }
 
     bool checkFeasibility(int regionID, int areaID, bool is_remove = true)
     {
-        // Check feasibility from a change region
-        boost::unordered_map<int, bool> areas2Eval = regions[regionID];
-
+        // Check feasibility from a change region: walk the region (without
+        // or with areaID) using the area->region array, no copy of the areas
+        boost::unordered_map<int, bool>& areas = regions[regionID];
+        int expected = (int)areas.size();
+        bool has_area = area2region[areaID] == regionID;
         if (is_remove) {
-            // removing an area from a region
-            areas2Eval.erase(areaID);
+            if (has_area) expected -= 1;
         } else {
-            // adding an area from a region)
-            areas2Eval[areaID] = true;
+            if (!has_area) expected += 1;
         }
+        if (expected <= 0) return true;
 
-        // remove the area first
-        int seedArea = areas2Eval.begin()->first;
-
-        // then, start from 1st object, do BFS
+        // start from 1st object, do DFS
+        int seedArea = -1;
+        if (!is_remove) {
+            seedArea = areaID;
+        } else {
+            boost::unordered_map<int, bool>::iterator it;
+            for (it = areas.begin(); it != areas.end(); ++it) {
+                if (it->first != areaID) {
+                    seedArea = it->first;
+                    break;
+                }
+            }
+        }
+        ++stamp;
+        int visited = 1;
         std::stack<int> processed_ids;
         processed_ids.push(seedArea);
+        visit_stamp[seedArea] = stamp;
         while (processed_ids.empty() == false) {
             int fid = processed_ids.top();
             processed_ids.pop();
-            areas2Eval.erase(fid); // remove area from current group as processed
             const std::vector<long>& nbrs = w[fid].GetNbrs();
             for (int i=0; i<nbrs.size(); i++ ) {
-                int nid = nbrs[i];
-                if (areas2Eval.find(nid) != areas2Eval.end()) {
+                int nid = (int)nbrs[i];
+                if (visit_stamp[nid] == stamp) continue;
+                bool in_group = area2region[nid] == regionID;
+                if (nid == areaID) in_group = !is_remove;
+                if (in_group) {
                     // only processed the neighbor in current group
+                    visit_stamp[nid] = stamp;
+                    visited += 1;
                     processed_ids.push(nid);
                 }
             }
         }
-        // all should be removed if all connected
-        return areas2Eval.empty();
+        // all should be visited if all connected
+        return visited == expected;
     }
 
 protected:
+    const double* GetRow(int area) { return &centered[area * m]; }
+
+    RegionStats& GetStats(int region) {
+        if (region >= (int)region_stats.size()) {
+            region_stats.resize(region + 1, RegionStats(m));
+        }
+        return region_stats[region];
+    }
+
+    double GetDelta(int area, int from_region, int to_region) {
+        const double* x = GetRow(area);
+        RegionStats& from = GetStats(from_region);
+        RegionStats& to = GetStats(to_region);
+        return from.GetSSDWithout(x) + to.GetSSDWith(x) - from.GetSSD() - to.GetSSD();
+    }
+
+    void MoveArea(int area, int from_region, int to_region) {
+        regions[from_region].erase(area);
+        regions[to_region][area] = false;
+        GetStats(from_region).Remove(GetRow(area));
+        GetStats(to_region).Add(GetRow(area));
+        area2region[area] = to_region;
+    }
+
     // n: number of observations
     int n;
 
@@ -352,12 +418,23 @@ protected:
     // original row-wise data
     double** data;
 
-    // cache the cetnroids for regions, any change of the region should
-    // call updateRegionCentroids()
-    std::map<int, double > region_of;
+    // row-wise data centered on the column means (n x m)
+    std::vector<double> centered;
+
+    // running sums of each region, indexed by region id; any change of the
+    // region outside MakeMove/TrySwap should call UpdateRegion()
+    std::vector<RegionStats> region_stats;
 
     // a reference to region data: region2Area
     REGION_AREAS& regions;
+
+    // scratch space for checkFeasibility()
+    std::vector<int> visit_stamp;
+
+    int stamp;
+
+    // compact membership: region id of each area (-1 if unassigned)
+    std::vector<int> area2region;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
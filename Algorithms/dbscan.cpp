@@ -1,4 +1,8 @@
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
 #include "../kNN/ANN/ANN.h"
+#include "threadpool.h"
 #include "dbscan.h"
 
 DBSCAN::DBSCAN(unsigned int min_samples, float eps, const double** input_data,
@@ -6,9 +10,9 @@ DBSCAN::DBSCAN(unsigned int min_samples, float eps, const double** input_data,
 : eps(eps), min_samples(min_samples), num_rows(num_rows), num_cols(num_cols),
 averagen(0)
 {
-    ANN_DIST_TYPE = distance_metric;
     // create a kdtree
     kd_tree = new ANNkd_tree((ANNpointArray)input_data, num_rows, num_cols /*dim*/);
+    kd_tree->setDistType(distance_metric);
 
     createNearestNeighbors(input_data);
     
@@ -18,9 +22,6 @@ averagen(0)
 DBSCAN::~DBSCAN()
 {
     if (kd_tree) delete kd_tree;
-
-    // reset this global variable, so it won't impact using ANN in other code
-    ANN_DIST_TYPE = ANNuse_euclidean_dist;
 }
 
 double DBSCAN::getAverageNN()
@@ -86,30 +87,42 @@ void DBSCAN::run()
     }
 }
 
-void DBSCAN::createNearestNeighbors(const double** input_data)
+void DBSCAN::nearest_range(const double** input_data, int start, int end)
 {
-    int total_nn = 0;
-    // This has worst case O(n^2) memory complexity
-    double radius = ANN_POW(eps), w;
-    nn.resize(num_rows);
-    for (size_t i=0; i<num_rows; i++) {
-        std::vector<std::pair<int, double> > nbrs;
-        int k = kd_tree->annkFRSearch((ANNpoint)input_data[i], radius, 0, NULL, NULL);
-        ANNidxArray nnIdx = new ANNidx[k];
-        ANNdistArray dists = new ANNdist[k];
-        total_nn += k;
-        kd_tree->annkFRSearch((ANNpoint)input_data[i], radius, k, nnIdx, dists);
+    // the reentrant search keeps its state on this thread's stack, so the
+    // rows can be searched in parallel on the same tree
+    double radius = kd_tree->distPow(eps), w;
+    std::vector<ANNidx> nnIdx;
+    std::vector<ANNdist> dists;
+    for (int i=start; i<=end; i++) {
+        std::vector<std::pair<int, double> >& nbrs = nn[i];
+        int k = kd_tree->annkFRSearch_r((ANNpoint)input_data[i], radius, 0);
+        if (k == 0) continue;
+        nnIdx.resize(k);
+        dists.resize(k);
+        kd_tree->annkFRSearch_r((ANNpoint)input_data[i], radius, k,
+                                &nnIdx[0], &dists[0]);
+        nbrs.reserve(k);
         for (size_t j=0; j<k; j++) {
             // iter each neighbor
             int nbr_id = nnIdx[j];
-            //if (nbr_id != i) {
-                w = ANN_ROOT(dists[j]);
-                nbrs.push_back(std::make_pair(nbr_id,w));
-            //}
+            w = kd_tree->distRoot(dists[j]);
+            nbrs.push_back(std::make_pair(nbr_id,w));
         }
-        delete[] nnIdx;
-        delete[] dists;
-        nn[i] = nbrs;
     }
-    averagen = total_nn / (double) num_rows;
+}
+
+void DBSCAN::createNearestNeighbors(const double** input_data)
+{
+    // This has worst case O(n^2) memory complexity
+    nn.clear();
+    nn.resize(num_rows);
+
+    run_range_threads(num_rows, 1,
+                      boost::bind(&DBSCAN::nearest_range, this, input_data,
+                                  _1, _2));
+
+    int total_nn = 0;
+    for (size_t i=0; i<num_rows; ++i) total_nn += nn[i].size();
+    averagen = num_rows > 0 ? total_nn / (double) num_rows : 0;
 }
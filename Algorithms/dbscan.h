@@ -29,6 +29,9 @@ protected:
 
     void createNearestNeighbors(const double** input_data);
 
+    // neighbors of rows start..end (inclusive) within eps
+    void nearest_range(const double** input_data, int start, int end);
+
     // eps : float, The maximum distance between two samples for one to be considered
     // as in the neighborhood of the other. This is not a maximum bound
     // on the distances of points within a cluster. This is the most
@@ -43,8 +43,11 @@
 #include <algorithm> // for std::fill_n
 #include <stdexcept> // for std::runtime_error
 #include <string> // for std::string
+#include <vector>
 #include <math.h>
 
+#include "threadpool.h"
+
 // Microsoft Visual Studio does not have fenv.h
 #ifdef _MSC_VER
 #if (_MSC_VER == 1500 || _MSC_VER == 1600)
@@ -238,6 +241,12 @@ namespace fastcluster {
                 ZZ->dist /= denom;
             }
         }
+        
+        void multiply(const t_float factor) const {
+            for (node * ZZ=Z; ZZ!=Z+pos; ++ZZ) {
+                ZZ->dist *= factor;
+            }
+        }
     };
     
     // The size of a node is either 1 (a single point) or is looked up from
@@ -680,11 +689,25 @@ namespace fastcluster {
 #pragma GCC diagnostic ignored "-Weffc++"
 #endif
         python_dissimilarity (t_float * const Xarg,
+                              const t_index N_,
+                              const std::ptrdiff_t dim_,
                               t_index * const members_,
                               const unsigned char method,
                               const unsigned char metric,
                               bool temp_point_array)
+        : Xa(Xarg),
+          dim(dim_),
+          N(N_),
+          members(members_),
+          postprocessfn(NULL),
+          postprocessarg(0),
+          distfn(&python_dissimilarity::sqeuclidean<false>),
+          precomputed2(NULL),
+          V_data(NULL)
         {
+            // Xarg: N x dim observations, row-major; updated in place by
+            // merge_inplace() for the Ward, centroid and median methods
+            if (temp_point_array) Xnew.init((N-1)*dim);
             switch (method) {
                 case METHOD_METR_SINGLE:
                 postprocessfn = NULL; // default
@@ -1705,6 +1728,239 @@ namespace fastcluster {
     }
     
     
+    /*
+     Nearest-neighbor scans for the vector methods, split over a thread pool.
+     
+     The active nodes are kept in an ascending array (removed nodes are
+     skipped and compacted away lazily) so that a scan can be cut into
+     contiguous chunks. Every chunk keeps the first minimum it sees and the
+     chunks are combined in order, so ties go to the smallest index exactly
+     as in the serial loops. Short scans run on the calling thread.
+     */
+    template <typename t_dissimilarity>
+    class vector_nn_scan {
+    public:
+        enum { DIST = 0, WARD = 1, SQEUCLIDEAN = 2 };
+        
+    private:
+        t_dissimilarity & dist;
+        const t_index N;
+        std::vector<t_index> active;
+        std::vector<char> alive;
+        t_index n_removed;
+        
+        thread_pool * pool;
+        int n_chunks;
+        int n_run; // chunks of the current scan
+        
+        // arguments and results of the current scan
+        int op;
+        int kind;
+        t_index x;
+        std::size_t p_start;
+        std::size_t p_end;
+        t_float * d;
+        t_float * out;
+        t_index * nghbr;
+        std::vector<t_float> chunk_min;
+        std::vector<t_index> chunk_idx;
+        std::vector<char> chunk_nan;
+        
+        enum { OP_UPDATE_MIN = 0, OP_NEAREST = 1, OP_VALUES = 2, OP_INIT = 3 };
+        enum { MIN_PARALLEL = 4096 };
+        
+        vector_nn_scan(); // noncopyable
+        vector_nn_scan(vector_nn_scan const &);
+        vector_nn_scan & operator=(vector_nn_scan const &);
+        
+        inline t_float value(const t_index i, const t_index j) const {
+            switch (kind) {
+                case WARD:
+                    return dist.ward(i,j);
+                case SQEUCLIDEAN:
+                    return dist.template sqeuclidean<true>(i,j);
+                default:
+                    return dist(i,j);
+            }
+        }
+        
+        void scan_chunk(const int c) {
+            t_float min = std::numeric_limits<t_float>::infinity();
+            t_index idx = -1;
+            try {
+                if (op == OP_INIT) {
+                    // rows c, c+n_chunks, ... balance the triangular loop
+                    for (t_index i=c; i<N-1; i+=n_run) {
+                        t_float m = std::numeric_limits<t_float>::infinity();
+                        t_index m_idx = i+1;
+                        for (t_index j=i+1; j<N; ++j) {
+                            t_float const tmp = value(i,j);
+                            if (tmp < m) {
+                                m = tmp;
+                                m_idx = j;
+                            }
+                        }
+                        d[i] = m;
+                        nghbr[i] = m_idx;
+                    }
+                } else {
+                    std::size_t n = p_end - p_start;
+                    std::size_t a = p_start + n * c / n_run;
+                    std::size_t b = p_start + n * (c+1) / n_run;
+                    for (std::size_t p=a; p<b; ++p) {
+                        t_index const i = active[p];
+                        if (!alive[i]) continue;
+                        if (op == OP_VALUES) {
+                            out[i] = value(i, x);
+                            continue;
+                        }
+                        t_float const tmp = value(i, x);
+                        if (fc_isnan(tmp)) {
+                            chunk_nan[c] = 1;
+                            continue;
+                        }
+                        if (op == OP_UPDATE_MIN) {
+                            if (d[i] > tmp) d[i] = tmp;
+                            if (d[i] < min || idx < 0) {
+                                min = d[i];
+                                idx = i;
+                            }
+                        } else if (tmp < min || idx < 0) {
+                            min = tmp;
+                            idx = i;
+                        }
+                    }
+                }
+            } catch (nan_error&) {
+                chunk_nan[c] = 1;
+            }
+            chunk_min[c] = min;
+            chunk_idx[c] = idx;
+        }
+        
+        void run(const int _op, const std::size_t _p_start,
+                 const std::size_t _p_end) {
+            op = _op;
+            p_start = _p_start;
+            p_end = _p_end;
+            n_run = n_chunks;
+            if (pool == NULL ||
+                (op != OP_INIT && p_end - p_start < MIN_PARALLEL)) {
+                n_run = 1;
+            }
+            std::fill(chunk_nan.begin(), chunk_nan.end(), 0);
+            for (int c=1; c<n_run; ++c) {
+                pool->enqueue(boost::bind(&vector_nn_scan::scan_chunk, this, c));
+            }
+            scan_chunk(0);
+            if (n_run > 1) pool->wait();
+            for (int c=0; c<n_run; ++c) {
+                if (chunk_nan[c]) throw (nan_error());
+            }
+        }
+        
+        // minimum over the chunks of the last scan, first one wins on ties
+        t_float combine(t_index & idx) const {
+            t_float min = std::numeric_limits<t_float>::infinity();
+            idx = -1;
+            for (int c=0; c<n_run; ++c) {
+                if (chunk_idx[c] < 0) continue;
+                if (idx < 0 || chunk_min[c] < min) {
+                    min = chunk_min[c];
+                    idx = chunk_idx[c];
+                }
+            }
+            return min;
+        }
+        
+        std::size_t first_after(const t_index i) const {
+            return std::upper_bound(active.begin(), active.end(), i)
+                - active.begin();
+        }
+        
+    public:
+        vector_nn_scan(t_dissimilarity & dist_, const t_index N_)
+        : dist(dist_)
+        , N(N_)
+        , active(N_)
+        , alive(N_, 1)
+        , n_removed(0)
+        , pool(NULL)
+        , n_chunks(1)
+        , n_run(1)
+        , op(0), kind(DIST), x(0), p_start(0), p_end(0)
+        , d(NULL), out(NULL), nghbr(NULL)
+        {
+            for (t_index i=0; i<N; ++i) active[i] = i;
+            int cores = boost::thread::hardware_concurrency();
+            if (GdaConst::gda_set_cpu_cores) cores = GdaConst::gda_cpu_cores;
+            if (cores > 1 && N >= MIN_PARALLEL) {
+                pool = new thread_pool();
+                n_chunks = cores;
+            }
+            chunk_min.resize(n_chunks);
+            chunk_idx.resize(n_chunks);
+            chunk_nan.resize(n_chunks);
+        }
+        
+        ~vector_nn_scan() {
+            if (pool) delete pool;
+        }
+        
+        void remove(const t_index i) {
+            alive[i] = 0;
+            n_removed += 1;
+            if (4 * static_cast<std::size_t>(n_removed) > active.size()) {
+                std::size_t k = 0;
+                for (std::size_t p=0; p<active.size(); ++p) {
+                    if (alive[active[p]]) active[k++] = active[p];
+                }
+                active.resize(k);
+                n_removed = 0;
+            }
+        }
+        
+        /* For every active i: d[i] = min(d[i], dist(i, prev)). Returns the
+         smallest d[i] and its index (the MST step of Rohlf's algorithm). */
+        t_float update_min(const t_index prev, t_float * const d_,
+                           t_index & idx) {
+            kind = DIST;
+            x = prev;
+            d = d_;
+            run(OP_UPDATE_MIN, 0, active.size());
+            return combine(idx);
+        }
+        
+        /* Nearest active node j > i under the given kind of distance. */
+        t_float nearest(const int kind_, const t_index i, t_index & idx) {
+            kind = kind_;
+            x = i;
+            std::size_t a = first_after(i);
+            run(OP_NEAREST, a, active.size());
+            return combine(idx);
+        }
+        
+        /* out[j] = distance(j, i) for the active nodes lo <= j < hi. */
+        void values(const int kind_, const t_index i, const t_index lo,
+                    const t_index hi, t_float * const out_) {
+            kind = kind_;
+            x = i;
+            out = out_;
+            std::size_t a = lo > 0 ? first_after(lo-1) : 0;
+            std::size_t b = first_after(hi-1);
+            if (b > a) run(OP_VALUES, a, b);
+        }
+        
+        /* mindist[i] and n_nghbr[i]: nearest j > i for i in [0, N-1). */
+        void initial_nearest(const int kind_, t_float * const mindist,
+                             t_index * const n_nghbr) {
+            kind = kind_;
+            d = mindist;
+            nghbr = n_nghbr;
+            run(OP_INIT, 0, 0);
+        }
+    };
+    
     /*
      Clustering methods for vector data
      */
@@ -1723,63 +1979,22 @@ namespace fastcluster {
          
          F. James Rohlf, Hierarchical clustering using the minimum spanning tree,
          The Computer Journal, vol. 16, 1973, p. 93–95.
+         
+         The scan over the remaining points is split over the available cores.
          */
-        t_index i;
-        t_index idx2;
-        doubly_linked_list active_nodes(N);
-        auto_array_ptr<t_float> d(N);
+        vector_nn_scan<t_dissimilarity> scan(dist, N);
+        auto_array_ptr<t_float> d(N, std::numeric_limits<t_float>::infinity());
         
-        t_index prev_node;
+        t_index prev_node = 0;
+        t_index idx2;
         t_float min;
         
-        // first iteration
-        idx2 = 1;
-        min = std::numeric_limits<t_float>::infinity();
-        for (i=1; i<N; ++i) {
-            d[i] = dist(0,i);
-#if HAVE_DIAGNOSTIC
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wfloat-equal"
-#endif
-            if (d[i] < min) {
-                min = d[i];
-                idx2 = i;
-            }
-            else if (fc_isnan(d[i]))
-                throw (nan_error());
-#if HAVE_DIAGNOSTIC
-#pragma GCC diagnostic pop
-#endif
-        }
-        
-        Z2.append(0, idx2, min);
-        
-        for (t_index j=1; j<N-1; ++j) {
-            prev_node = idx2;
-            active_nodes.remove(prev_node);
-            
-            idx2 = active_nodes.succ[0];
-            min = d[idx2];
-            
-            for (i=idx2; i<N; i=active_nodes.succ[i]) {
-                t_float tmp = dist(i, prev_node);
-#if HAVE_DIAGNOSTIC
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wfloat-equal"
-#endif
-                if (d[i] > tmp)
-                    d[i] = tmp;
-                else if (fc_isnan(tmp))
-                    throw (nan_error());
-#if HAVE_DIAGNOSTIC
-#pragma GCC diagnostic pop
-#endif
-                if (d[i] < min) {
-                    min = d[i];
-                    idx2 = i;
-                }
-            }
+        scan.remove(prev_node);
+        for (t_index j=0; j<N-1; ++j) {
+            min = scan.update_min(prev_node, d, idx2);
             Z2.append(prev_node, idx2, min);
+            prev_node = idx2;
+            scan.remove(prev_node);
         }
     }
     
@@ -1796,6 +2011,9 @@ namespace fastcluster {
          
          This algorithm is valid for the distance update methods
          "Ward", "centroid" and "median" only!
+         
+         The nearest-neighbor searches and the distance updates are split
+         over the available cores.
          */
         const t_index N_1 = N-1;
         t_index i, j; // loop variables
@@ -1810,6 +2028,11 @@ namespace fastcluster {
         // the distance to the nearest neighbor of each point
         t_index node1, node2;     // node numbers in the output
         t_float min; // minimum and row index for nearest-neighbor search
+        vector_nn_scan<t_dissimilarity> scan(dist, N);
+        auto_array_ptr<t_float> new_dist(N); // distances to the merged node
+        const int kind = method == METHOD_METR_WARD ?
+            vector_nn_scan<t_dissimilarity>::WARD :
+            vector_nn_scan<t_dissimilarity>::SQEUCLIDEAN;
         
         for (i=0; i<N; ++i)
             // Build a list of row ↔ node label assignments.
@@ -1819,31 +2042,13 @@ namespace fastcluster {
         // Initialize the minimal distances:
         // Find the nearest neighbor of each point.
         // n_nghbr[i] = argmin_{j>i} D(i,j) for i in range(N-1)
-        for (i=0; i<N_1; ++i) {
-            min = std::numeric_limits<t_float>::infinity();
-            t_index idx;
-            for (idx=j=i+1; j<N; ++j) {
-                t_float tmp;
-                switch (method) {
-                    case METHOD_METR_WARD:
-                        tmp = dist.ward_initial(i,j);
-                        break;
-                    default:
-                        tmp = dist.template sqeuclidean<true>(i,j);
-                }
-                if (tmp<min) {
-                    min = tmp;
-                    idx = j;
-                }
-            }
-            switch (method) {
-                case METHOD_METR_WARD:
-                    mindist[i] = t_dissimilarity::ward_initial_conversion(min);
-                    break;
-                default:
-                    mindist[i] = min;
+        // (ward_initial is the squared euclidean distance)
+        scan.initial_nearest(vector_nn_scan<t_dissimilarity>::SQEUCLIDEAN,
+                             mindist, n_nghbr);
+        if (method == METHOD_METR_WARD) {
+            for (i=0; i<N_1; ++i) {
+                mindist[i] = t_dissimilarity::ward_initial_conversion(mindist[i]);
             }
-            n_nghbr[i] = idx;
         }
         
         // Put the minimal distances into a heap structure to make the repeated
@@ -1856,28 +2061,9 @@ namespace fastcluster {
             
             while ( active_nodes.is_inactive(n_nghbr[idx1]) ) {
                 // Recompute the minimum mindist[idx1] and n_nghbr[idx1].
-                n_nghbr[idx1] = j = active_nodes.succ[idx1]; // exists, maximally N-1
-                switch (method) {
-                    case METHOD_METR_WARD:
-                        min = dist.ward(idx1,j);
-                        for (j=active_nodes.succ[j]; j<N; j=active_nodes.succ[j]) {
-                            t_float const tmp = dist.ward(idx1,j);
-                            if (tmp<min) {
-                                min = tmp;
-                                n_nghbr[idx1] = j;
-                            }
-                        }
-                        break;
-                    default:
-                        min = dist.template sqeuclidean<true>(idx1,j);
-                        for (j=active_nodes.succ[j]; j<N; j=active_nodes.succ[j]) {
-                            t_float const tmp = dist.template sqeuclidean<true>(idx1,j);
-                            if (tmp<min) {
-                                min = tmp;
-                                n_nghbr[idx1] = j;
-                            }
-                        }
-                }
+                // The successor exists, maximally N-1.
+                min = scan.nearest(kind, idx1, j);
+                n_nghbr[idx1] = j;
                 /* Update the heap with the new true minimum and search for the (possibly
                  different) minimal entry. */
                 nn_distances.update_geq(idx1, min);
@@ -1909,6 +2095,7 @@ namespace fastcluster {
             row_repr[idx2] = N+i;
             // Remove idx1 from the list of active indices (active_nodes).
             active_nodes.remove(idx1);  // TBD later!!!
+            scan.remove(idx1);
             
             // Update the distance matrix
             switch (method) {
@@ -1926,8 +2113,9 @@ namespace fastcluster {
                         }
                     }
                     // Update the distance matrix in the range (idx1, idx2).
+                    scan.values(kind, idx2, idx1+1, idx2, new_dist);
                     for ( ; j<idx2; j=active_nodes.succ[j]) {
-                        t_float const tmp = dist.ward(j, idx2);
+                        t_float const tmp = new_dist[j];
                         if (tmp < mindist[j]) {
                             nn_distances.update_leq(j, tmp);
                             n_nghbr[j] = idx2;
@@ -1938,15 +2126,8 @@ namespace fastcluster {
                     }
                     // Find the nearest neighbor for idx2.
                     if (idx2<N_1) {
-                        n_nghbr[idx2] = j = active_nodes.succ[idx2]; // exists, maximally N-1
-                        min = dist.ward(idx2,j);
-                        for (j=active_nodes.succ[j]; j<N; j=active_nodes.succ[j]) {
-                            t_float const tmp = dist.ward(idx2,j);
-                            if (tmp < min) {
-                                min = tmp;
-                                n_nghbr[idx2] = j;
-                            }
-                        }
+                        min = scan.nearest(kind, idx2, j); // exists, maximally N-1
+                        n_nghbr[idx2] = j;
                         nn_distances.update(idx2, min);
                     }
                     break;
@@ -1958,8 +2139,9 @@ namespace fastcluster {
                      Shorter and longer distances can occur, not bigger than max(d1,d2)
                      but maybe smaller than min(d1,d2).
                      */
+                    scan.values(kind, idx2, 0, idx2, new_dist);
                     for (j=active_nodes.start; j<idx2; j=active_nodes.succ[j]) {
-                        t_float const tmp = dist.template sqeuclidean<true>(j, idx2);
+                        t_float const tmp = new_dist[j];
                         if (tmp < mindist[j]) {
                             nn_distances.update_leq(j, tmp);
                             n_nghbr[j] = idx2;
@@ -1969,15 +2151,8 @@ namespace fastcluster {
                     }
                     // Find the nearest neighbor for idx2.
                     if (idx2<N_1) {
-                        n_nghbr[idx2] = j = active_nodes.succ[idx2]; // exists, maximally N-1
-                        min = dist.template sqeuclidean<true>(idx2,j);
-                        for (j=active_nodes.succ[j]; j<N; j=active_nodes.succ[j]) {
-                            t_float const tmp = dist.template sqeuclidean<true>(idx2, j);
-                            if (tmp < min) {
-                                min = tmp;
-                                n_nghbr[idx2] = j;
-                            }
-                        }
+                        min = scan.nearest(kind, idx2, j); // exists, maximally N-1
+                        n_nghbr[idx2] = j;
                         nn_distances.update(idx2, min);
                     }
             }
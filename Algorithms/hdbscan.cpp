@@ -1,7 +1,12 @@
 #include <deque>
 #include <algorithm>
+#include <float.h>
+#include <cmath>
 
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <boost/graph/prim_minimum_spanning_tree.hpp>
+#include "threadpool.h"
 #include "pam.h"
 #include "hdbscan.h"
 
@@ -15,39 +20,376 @@ bool EdgeLess1(SimpleEdge* a,  SimpleEdge* b)
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// HDBSCAN
+// BoruvkaKDTree
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-vector<double> HDBScan::ComputeCoreDistance(double** input_data, int n_pts,
-                                            int n_dim, int min_samples,
-                                            char dist)
+struct CoordLess
+{
+    double** data;
+    int dim;
+
+    CoordLess(double** data, int dim) : data(data), dim(dim) {}
+
+    bool operator()(int a, int b) const { return data[a][dim] < data[b][dim]; }
+};
+
+// orders candidate edges by (length, smaller row, larger row), so that the
+// edge picked for each component does not depend on the thread split
+struct CandidateLess
 {
-    vector<double> core_d;
-    core_d.resize(n_pts);
+    const vector<double>& best_d;
+    const vector<int>& best_j;
+    const vector<int>& idx;
 
-    double eps = 0; // error bound
-    if (dist == 'e') ANN_DIST_TYPE = 2; // euclidean
-    else if (dist == 'b') ANN_DIST_TYPE = 1; // manhattan
+    CandidateLess(const vector<double>& best_d, const vector<int>& best_j,
+                  const vector<int>& idx)
+    : best_d(best_d), best_j(best_j), idx(idx) {}
 
-    // KNN search will always return the query point itself, (self-included)
-    ANNkd_tree* kdTree = new ANNkd_tree(input_data, n_pts, n_dim);
-    ANNidxArray nnIdx = new ANNidx[min_samples];
-    ANNdistArray dists = new ANNdist[min_samples];
-    for (size_t i=0; i<n_pts; ++i) {
-        kdTree->annkSearch(input_data[i], min_samples, nnIdx, dists, eps);
-        core_d[i] = sqrt(dists[min_samples-1]);
+    bool operator()(int a, int b) const {
+        if (best_d[a] != best_d[b]) return best_d[a] < best_d[b];
+        int a1 = idx[a], a2 = idx[best_j[a]];
+        int b1 = idx[b], b2 = idx[best_j[b]];
+        if (a1 > a2) std::swap(a1, a2);
+        if (b1 > b2) std::swap(b1, b2);
+        if (a1 != b1) return a1 < b1;
+        return a2 < b2;
+    }
+};
+
+static int FindRoot(vector<int>& parent, int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+BoruvkaKDTree::BoruvkaKDTree(double** data, int n_pts, int n_dim, char dist)
+: n_pts(n_pts), n_dim(n_dim), dist(dist), alpha(1.0)
+{
+    idx.resize(n_pts);
+    for (int i=0; i<n_pts; i++) idx[i] = i;
+    if (n_pts > 0) Build(data, 0, n_pts);
+
+    pts.resize((size_t)n_pts * n_dim);
+    for (int i=0; i<n_pts; i++) {
+        for (int c=0; c<n_dim; c++) {
+            pts[(size_t)i * n_dim + c] = data[idx[i]][c];
+        }
+    }
+}
+
+BoruvkaKDTree::~BoruvkaKDTree()
+{
+}
+
+int BoruvkaKDTree::Build(double** data, int start, int end)
+{
+    const int leaf_size = 16;
+    int id = (int)nodes.size();
+    Node nd;
+    nd.start = start;
+    nd.end = end;
+    nd.left = -1;
+    nd.right = -1;
+    nodes.push_back(nd);
+    lo.resize(lo.size() + n_dim, DBL_MAX);
+    hi.resize(hi.size() + n_dim, -DBL_MAX);
+
+    double* l = &lo[(size_t)id * n_dim];
+    double* h = &hi[(size_t)id * n_dim];
+    for (int i=start; i<end; i++) {
+        const double* p = data[idx[i]];
+        for (int c=0; c<n_dim; c++) {
+            if (p[c] < l[c]) l[c] = p[c];
+            if (p[c] > h[c]) h[c] = p[c];
+        }
+    }
+    if (end - start <= leaf_size) return id;
+
+    // split the widest dimension at the median
+    int split_dim = 0;
+    double width = -1;
+    for (int c=0; c<n_dim; c++) {
+        if (h[c] - l[c] > width) {
+            width = h[c] - l[c];
+            split_dim = c;
+        }
     }
-    delete[] nnIdx;
-    delete[] dists;
-    delete kdTree;
+    if (width <= 0) return id; // duplicated points
 
+    int mid = (start + end) / 2;
+    std::nth_element(idx.begin() + start, idx.begin() + mid, idx.begin() + end,
+                     CoordLess(data, split_dim));
+    int left = Build(data, start, mid);
+    int right = Build(data, mid, end);
+    nodes[id].left = left;
+    nodes[id].right = right;
+    return id;
+}
+
+double BoruvkaKDTree::MinRDist(int node, const double* q) const
+{
+    const double* l = &lo[(size_t)node * n_dim];
+    const double* h = &hi[(size_t)node * n_dim];
+    double r = 0, g;
+    for (int c=0; c<n_dim; c++) {
+        g = 0;
+        if (q[c] < l[c]) g = l[c] - q[c];
+        else if (q[c] > h[c]) g = q[c] - h[c];
+        r += dist == 'b' ? g : g * g;
+    }
+    return r;
+}
+
+double BoruvkaKDTree::RDist(const double* a, const double* b) const
+{
+    double r = 0, g;
+    for (int c=0; c<n_dim; c++) {
+        g = a[c] - b[c];
+        r += dist == 'b' ? fabs(g) : g * g;
+    }
+    return r;
+}
+
+void BoruvkaKDTree::KNNSearch(int node, const double* q, int k,
+                              vector<double>& heap) const
+{
+    const Node& nd = nodes[node];
+    if (nd.left < 0) {
+        for (int p=nd.start; p<nd.end; p++) {
+            double r = RDist(q, &pts[(size_t)p * n_dim]);
+            if ((int)heap.size() < k) {
+                heap.push_back(r);
+                std::push_heap(heap.begin(), heap.end());
+            } else if (r < heap.front()) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = r;
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+        return;
+    }
+    int first = nd.left, second = nd.right;
+    double d_first = MinRDist(first, q), d_second = MinRDist(second, q);
+    if (d_second < d_first) {
+        std::swap(first, second);
+        std::swap(d_first, d_second);
+    }
+    if ((int)heap.size() < k || d_first < heap.front()) {
+        KNNSearch(first, q, k, heap);
+    }
+    if ((int)heap.size() < k || d_second < heap.front()) {
+        KNNSearch(second, q, k, heap);
+    }
+}
+
+void BoruvkaKDTree::NearestOther(int node, int pos, double& best,
+                                 int& best_pos) const
+{
+    int c = comp[pos];
+    if (node_comp[node] == c) return;
+
+    const double* q = &pts[(size_t)pos * n_dim];
+    const Node& nd = nodes[node];
+    if (nd.left < 0) {
+        for (int p=nd.start; p<nd.end; p++) {
+            if (comp[p] == c) continue;
+            double d = sqrt(RDist(q, &pts[(size_t)p * n_dim])) / alpha;
+            if (d < core[pos]) d = core[pos];
+            if (d < core[p]) d = core[p];
+            if (d < best) {
+                best = d;
+                best_pos = p;
+            }
+        }
+        return;
+    }
+
+    int child[2] = {nd.left, nd.right};
+    double bound[2];
+    for (int i=0; i<2; i++) {
+        bound[i] = sqrt(MinRDist(child[i], q)) / alpha;
+        if (bound[i] < core[pos]) bound[i] = core[pos];
+        if (bound[i] < node_core[child[i]]) bound[i] = node_core[child[i]];
+    }
+    if (bound[1] < bound[0]) {
+        std::swap(child[0], child[1]);
+        std::swap(bound[0], bound[1]);
+    }
+    for (int i=0; i<2; i++) {
+        if (bound[i] < best) NearestOther(child[i], pos, best, best_pos);
+    }
+}
+
+// fewer kd-tree searches than this per thread are not worth a thread
+static const int boruvka_min_per_thread = 250;
+
+void BoruvkaKDTree::core_range(int k, int start, int end,
+                               vector<double>* core_pos)
+{
+    vector<double> heap;
+    heap.reserve(k);
+    for (int pos=start; pos<=end; pos++) {
+        heap.clear();
+        KNNSearch(0, &pts[(size_t)pos * n_dim], k, heap);
+        (*core_pos)[pos] = sqrt(heap.front());
+    }
+}
+
+void BoruvkaKDTree::nearest_range(int start, int end)
+{
+    for (int i=start; i<=end; i++) {
+        int pos = todo[i];
+        double best = DBL_MAX;
+        int best_pos = -1;
+        NearestOther(0, pos, best, best_pos);
+        best_d[pos] = best;
+        best_j[pos] = best_pos;
+    }
+}
+
+vector<double> BoruvkaKDTree::CoreDistances(int k)
+{
+    vector<double> core_d(n_pts, 0);
+    if (n_pts == 0) return core_d;
+    if (k > n_pts) k = n_pts;
+    if (k < 1) k = 1;
+
+    vector<double> core_pos(n_pts);
+    run_range_threads(n_pts, boruvka_min_per_thread,
+                      boost::bind(&BoruvkaKDTree::core_range, this, k, _1, _2,
+                                  &core_pos));
+    for (int pos=0; pos<n_pts; pos++) core_d[idx[pos]] = core_pos[pos];
     return core_d;
 }
 
+vector<SimpleEdge*> BoruvkaKDTree::SpanningTree(const vector<double>& core_dist,
+                                                double _alpha)
+{
+    vector<SimpleEdge*> edges;
+    if (n_pts < 2) return edges;
+    alpha = _alpha;
+
+    core.resize(n_pts);
+    for (int pos=0; pos<n_pts; pos++) core[pos] = core_dist[idx[pos]];
+
+    // children always come after their parent in nodes
+    int n_nodes = (int)nodes.size();
+    node_core.resize(n_nodes);
+    node_comp.resize(n_nodes);
+    for (int i=n_nodes-1; i>=0; i--) {
+        const Node& nd = nodes[i];
+        if (nd.left < 0) {
+            double m = DBL_MAX;
+            for (int p=nd.start; p<nd.end; p++) if (core[p] < m) m = core[p];
+            node_core[i] = m;
+        } else {
+            node_core[i] = std::min(node_core[nd.left], node_core[nd.right]);
+        }
+    }
+
+    vector<int> parent(n_pts);
+    comp.resize(n_pts);
+    todo.resize(n_pts);
+    for (int pos=0; pos<n_pts; pos++) {
+        parent[pos] = pos;
+        comp[pos] = pos;
+        todo[pos] = pos;
+    }
+    best_d.assign(n_pts, DBL_MAX);
+    best_j.assign(n_pts, -1);
+    vector<int> comp_best(n_pts, -1);
+    vector<int> candidates;
+    CandidateLess cand_less(best_d, best_j, idx);
+
+    int n_comp = n_pts;
+    while (n_comp > 1) {
+        for (int i=n_nodes-1; i>=0; i--) {
+            const Node& nd = nodes[i];
+            if (nd.left < 0) {
+                int c = comp[nd.start];
+                for (int p=nd.start+1; p<nd.end && c >= 0; p++) {
+                    if (comp[p] != c) c = -1;
+                }
+                node_comp[i] = c;
+            } else {
+                int c = node_comp[nd.left];
+                node_comp[i] = c == node_comp[nd.right] ? c : -1;
+            }
+        }
+
+        run_range_threads((int)todo.size(), boruvka_min_per_thread,
+                          boost::bind(&BoruvkaKDTree::nearest_range, this,
+                                      _1, _2));
+
+        // the shortest edge out of each component
+        candidates.clear();
+        for (int pos=0; pos<n_pts; pos++) {
+            if (best_j[pos] < 0) continue;
+            int c = comp[pos];
+            if (comp_best[c] < 0) {
+                comp_best[c] = pos;
+                candidates.push_back(c);
+            } else if (cand_less(pos, comp_best[c])) {
+                comp_best[c] = pos;
+            }
+        }
+        for (size_t i=0; i<candidates.size(); i++) {
+            int c = candidates[i];
+            candidates[i] = comp_best[c];
+            comp_best[c] = -1;
+        }
+        std::sort(candidates.begin(), candidates.end(), cand_less);
+
+        int n_added = 0;
+        for (size_t i=0; i<candidates.size(); i++) {
+            int a = candidates[i];
+            int b = best_j[a];
+            int ra = FindRoot(parent, a);
+            int rb = FindRoot(parent, b);
+            if (ra == rb) continue;
+            parent[rb] = ra;
+            edges.push_back(new SimpleEdge(idx[a], idx[b], best_d[a]));
+            n_added += 1;
+        }
+        if (n_added == 0) break;
+        n_comp -= n_added;
+
+        // the nearest point of another component stays valid until that
+        // point joins the component
+        for (int pos=0; pos<n_pts; pos++) comp[pos] = FindRoot(parent, pos);
+        todo.clear();
+        for (int pos=0; pos<n_pts; pos++) {
+            if (best_j[pos] < 0 || comp[best_j[pos]] == comp[pos]) {
+                todo.push_back(pos);
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end(), EdgeLess1);
+    return edges;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// HDBSCAN
+//
+////////////////////////////////////////////////////////////////////////////////
+
+vector<double> HDBScan::ComputeCoreDistance(double** input_data, int n_pts,
+                                            int n_dim, int min_samples,
+                                            char dist)
+{
+    // KNN search always returns the query point itself (self-included)
+    BoruvkaKDTree tree(input_data, n_pts, n_dim, dist);
+    return tree.CoreDistances(min_samples);
+}
+
 HDBScan::HDBScan(int min_cluster_size, int min_samples, double alpha,
                  int _cluster_selection_method, bool _allow_single_cluster,
-                 int rows, int cols, RawDistMatrix* raw_dist,
+                 int rows, int cols, double** data, char dist,
                  vector<double> _core_dist,
                  const vector<bool>& _undefs)
 {
@@ -96,7 +438,8 @@ HDBScan::HDBScan(int min_cluster_size, int min_samples, double alpha,
     }
     mst_edges.clear();
     // MST
-    mst_edges = mst_linkage_core_vector(cols, core_dist, raw_dist, alpha);
+    mst_edges = mst_linkage_core_kdtree(data, rows, cols, dist, core_dist,
+                                        alpha);
     
     // Extract the HDBSCAN hierarchy as a dendrogram from mst
     int N = rows;
@@ -868,3 +1211,12 @@ vector<SimpleEdge*> HDBScan::mst_linkage_core_vector(int num_features,
     std::sort(rtn_mst_edges.begin(), rtn_mst_edges.end(), EdgeLess1);
     return rtn_mst_edges;
 }
+
+vector<SimpleEdge*> HDBScan::mst_linkage_core_kdtree(double** data,
+                                      int rows, int cols, char dist,
+                                      vector<double>& core_distances,
+                                      double alpha)
+{
+    BoruvkaKDTree tree(data, rows, cols, dist);
+    return tree.SpanningTree(core_distances, alpha);
+}
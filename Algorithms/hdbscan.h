@@ -171,6 +171,84 @@ namespace Gda {
     };
     
     
+    /////////////////////////////////////////////////////////////////////////
+    //
+    // BoruvkaKDTree
+    //
+    // kd-tree over the input rows for the core distances and the minimum
+    // spanning tree under the mutual reachability distance
+    //     mrd(a, b) = max(core(a), core(b), d(a, b) / alpha)
+    // without an n x n distance matrix.  d(a, b) is the square root of the
+    // squared euclidean ('e') or of the manhattan ('b') distance, as it was
+    // computed from ANN and from distancematrix().
+    //
+    // The spanning tree is built with Boruvka: every round each point looks
+    // for its nearest point in another component (in parallel), the best edge
+    // of each component is kept, and the components are merged.  Subtrees
+    // that lie in the point's own component, or whose lower bound is above
+    // the best candidate, are skipped.  A point only searches again when its
+    // previous nearest point has joined its component.
+    //
+    /////////////////////////////////////////////////////////////////////////
+    class BoruvkaKDTree
+    {
+    public:
+        BoruvkaKDTree(double** data, int n_pts, int n_dim, char dist);
+        virtual ~BoruvkaKDTree();
+
+        // distance to the k-th nearest neighbor, the point itself included
+        vector<double> CoreDistances(int k);
+
+        // n_pts-1 edges sorted by mutual reachability distance
+        vector<SimpleEdge*> SpanningTree(const vector<double>& core_dist,
+                                         double alpha);
+
+    protected:
+        struct Node {
+            int start; // range of tree positions
+            int end;
+            int left; // -1 for leaves
+            int right;
+        };
+
+        int Build(double** data, int start, int end);
+
+        double MinRDist(int node, const double* q) const;
+
+        double RDist(const double* a, const double* b) const;
+
+        void KNNSearch(int node, const double* q, int k,
+                       vector<double>& heap) const;
+
+        void NearestOther(int node, int pos, double& best, int& best_pos) const;
+
+        // positions start..end, end inclusive
+        void core_range(int k, int start, int end, vector<double>* core);
+
+        // todo items start..end, end inclusive
+        void nearest_range(int start, int end);
+
+        int n_pts;
+        int n_dim;
+        char dist;
+        double alpha;
+
+        vector<double> pts; // coordinates in tree order
+        vector<int> idx; // tree position -> input row
+        vector<Node> nodes;
+        vector<double> lo; // bounding box, n_dim per node
+        vector<double> hi;
+
+        // spanning tree state, by tree position
+        vector<double> core; // core distance
+        vector<double> node_core; // smallest core distance in the node
+        vector<int> comp; // component of each position
+        vector<int> node_comp; // component of the node, -1 if mixed
+        vector<double> best_d; // nearest point in another component
+        vector<int> best_j;
+        vector<int> todo; // positions that need a new search
+    };
+
     /////////////////////////////////////////////////////////////////////////
     //
     // HDBSCAN
@@ -199,7 +277,8 @@ namespace Gda {
                 int cluster_selection_method,
                 bool allow_single_cluster,
                 int rows, int cols,
-                RawDistMatrix* raw_dist,
+                double** data,
+                char dist,
                 vector<double> core_dist,
                 const vector<bool>& undefs
                 //GalElement * w,
@@ -215,6 +294,11 @@ namespace Gda {
                                                     vector<double>& core_distances,
                                                     RawDistMatrix* dist_metric,
                                                     double alpha);
+        static vector<SimpleEdge*> mst_linkage_core_kdtree(double** data,
+                                                    int rows, int cols,
+                                                    char dist,
+                                                    vector<double>& core_distances,
+                                                    double alpha);
         
         void Run();
         
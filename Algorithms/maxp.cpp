@@ -40,6 +40,218 @@
 using namespace boost;
 using namespace std;
 
+MaxpRegionStats::MaxpRegionStats(int num_vars)
+: n(0), floor_sum(0), sum(num_vars, 0), sum_sq(num_vars, 0)
+{
+}
+
+void MaxpRegionStats::add(const vector<double>& x, double floor_val)
+{
+    n += 1;
+    floor_sum += floor_val;
+    for (size_t m=0; m<sum.size(); m++) {
+        sum[m] += x[m];
+        sum_sq[m] += x[m] * x[m];
+    }
+}
+
+void MaxpRegionStats::remove(const vector<double>& x, double floor_val)
+{
+    n -= 1;
+    floor_sum -= floor_val;
+    for (size_t m=0; m<sum.size(); m++) {
+        sum[m] -= x[m];
+        sum_sq[m] -= x[m] * x[m];
+    }
+}
+
+double MaxpRegionStats::ssd() const
+{
+    if (n <= 1) return 0;
+    double ss = 0;
+    for (size_t m=0; m<sum.size(); m++) {
+        double v = sum_sq[m] - sum[m] * sum[m] / n;
+        if (v > 0) ss += v;
+    }
+    return ss;
+}
+
+double MaxpRegionStats::ssd_with(const vector<double>& x) const
+{
+    int nn = n + 1;
+    if (nn <= 1) return 0;
+    double ss = 0;
+    for (size_t m=0; m<sum.size(); m++) {
+        double s = sum[m] + x[m];
+        double v = sum_sq[m] + x[m] * x[m] - s * s / nn;
+        if (v > 0) ss += v;
+    }
+    return ss;
+}
+
+double MaxpRegionStats::ssd_without(const vector<double>& x) const
+{
+    int nn = n - 1;
+    if (nn <= 1) return 0;
+    double ss = 0;
+    for (size_t m=0; m<sum.size(); m++) {
+        double s = sum[m] - x[m];
+        double v = sum_sq[m] - x[m] * x[m] - s * s / nn;
+        if (v > 0) ss += v;
+    }
+    return ss;
+}
+
+MaxpSearchState::MaxpSearchState(const GalElement* _w, const vector<vector<double> >& _z, double _floor, double* _floor_variable, vector<vector<int> >& regions)
+: w(_w), z(_z), floor(_floor), floor_variable(_floor_variable), stamp(0)
+{
+    int num_obs = z.size();
+    int num_vars = num_obs > 0 ? z[0].size() : 0;
+    int nr = regions.size();
+    
+    a2r.resize(num_obs, -1);
+    stats.resize(nr, MaxpRegionStats(num_vars));
+    for (int r=0; r<nr; r++) {
+        for (size_t j=0; j<regions[r].size(); j++) {
+            int area = regions[r][j];
+            a2r[area] = r;
+            stats[r].add(z[area], floor_variable[area]);
+        }
+    }
+    cut_valid.resize(nr, 0);
+    num_components.resize(nr, 0);
+    is_cut.resize(num_obs, 0);
+    disc.resize(num_obs, 0);
+    low.resize(num_obs, 0);
+    visit_stamp.resize(num_obs, 0);
+}
+
+void MaxpSearchState::move(int area, int from_region, int to_region)
+{
+    stats[from_region].remove(z[area], floor_variable[area]);
+    stats[to_region].add(z[area], floor_variable[area]);
+    a2r[area] = to_region;
+    cut_valid[from_region] = 0;
+    cut_valid[to_region] = 0;
+}
+
+double MaxpSearchState::objective() const
+{
+    double wss = 0;
+    for (size_t r=0; r<stats.size(); r++) {
+        wss += stats[r].ssd();
+    }
+    return wss;
+}
+
+double MaxpSearchState::objective_change(int area, int to_region) const
+{
+    int from_region = a2r[area];
+    const MaxpRegionStats& from = stats[from_region];
+    const MaxpRegionStats& to = stats[to_region];
+    double current = from.ssd() + to.ssd();
+    double new_val = from.ssd_without(z[area]) + to.ssd_with(z[area]);
+    return new_val - current;
+}
+
+bool MaxpSearchState::check_floor(int region, int leaver) const
+{
+    return stats[region].floor_sum - floor_variable[leaver] >= floor;
+}
+
+bool MaxpSearchState::check_contiguity(vector<vector<int> >& regions, int leaver)
+{
+    int rid = a2r[leaver];
+    vector<int>& region = regions[rid];
+    if (region.size() <= 2) return true;
+    
+    if (cut_valid[rid] == 0) {
+        update_articulation(region, rid);
+    }
+    if (num_components[rid] != 1) {
+        // region is not connected: the leaver has to be the only area that
+        // does not connect to the rest, check it by a full walk
+        list<int> q;
+        int start = region[0] == leaver ? region[1] : region[0];
+        int visited = 1;
+        q.push_back(start);
+        ++stamp;
+        visit_stamp[start] = stamp;
+        while (!q.empty()) {
+            int node = q.front();
+            q.pop_front();
+            for (int n=0; n<w[node].Size(); n++) {
+                int nbr = w[node][n];
+                if (nbr == leaver || a2r[nbr] != rid) continue;
+                if (visit_stamp[nbr] != stamp) {
+                    visit_stamp[nbr] = stamp;
+                    visited += 1;
+                    q.push_back(nbr);
+                }
+            }
+        }
+        return visited == (int)region.size() - 1;
+    }
+    return is_cut[leaver] == 0;
+}
+
+void MaxpSearchState::update_articulation(const vector<int>& region, int rid)
+{
+    // iterative Tarjan over the subgraph induced by the region
+    ++stamp;
+    for (size_t i=0; i<region.size(); i++) is_cut[region[i]] = 0;
+    
+    int time = 0;
+    int n_comp = 0;
+    // (node, parent, next neighbor index)
+    vector<int> st_node, st_parent, st_next;
+    
+    for (size_t i=0; i<region.size(); i++) {
+        int root = region[i];
+        if (visit_stamp[root] == stamp) continue;
+        n_comp += 1;
+        int root_children = 0;
+        visit_stamp[root] = stamp;
+        disc[root] = low[root] = ++time;
+        st_node.push_back(root);
+        st_parent.push_back(-1);
+        st_next.push_back(0);
+        
+        while (!st_node.empty()) {
+            int u = st_node.back();
+            int k = st_next.back();
+            if (k < w[u].Size()) {
+                st_next.back() += 1;
+                int v = w[u][k];
+                if (a2r[v] != rid) continue;
+                if (visit_stamp[v] == stamp) {
+                    if (v != st_parent.back() && disc[v] < low[u])
+                        low[u] = disc[v];
+                } else {
+                    visit_stamp[v] = stamp;
+                    disc[v] = low[v] = ++time;
+                    if (u == root) root_children += 1;
+                    st_node.push_back(v);
+                    st_parent.push_back(u);
+                    st_next.push_back(0);
+                }
+            } else {
+                int p = st_parent.back();
+                st_node.pop_back();
+                st_parent.pop_back();
+                st_next.pop_back();
+                if (p >= 0) {
+                    if (low[u] < low[p]) low[p] = low[u];
+                    if (p != root && low[u] >= disc[p]) is_cut[p] = 1;
+                }
+            }
+        }
+        if (root_children > 1) is_cut[root] = 1;
+    }
+    num_components[rid] = n_comp;
+    cut_valid[rid] = 1;
+}
+
 Maxp::Maxp(const GalElement* _w,  const vector<vector<double> >& _z, double _floor, double* _floor_variable, int _initial, vector<wxInt64> _seeds, int _method, int _tabu_length, double _cool_rate,int _rnd_seed, char _dist,  bool _test )
 : w(_w), z(_z), floor(_floor), floor_variable(_floor_variable), initial(_initial),  LARGE(1000000), MAX_ATTEMPTS(100), rnd_seed(_rnd_seed), test(_test), initial_wss(_initial), regions_group(_initial), area2region_group(_initial), p_group(_initial), dist(_dist), best_ss(DBL_MAX), method(_method), tabu_length(_tabu_length), cooling_rate(_cool_rate)
 {
@@ -413,6 +625,8 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
     boost::unordered_map<int, int> local_best_area2region;
     double local_best_ssd = 1;
     
+    MaxpSearchState state(w, z, floor, floor_variable, init_regions);
+    
     int nr = init_regions.size();
     vector<int> changed_regions(nr, 1);
    
@@ -462,9 +676,8 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
                 vector<int> candidates;
                 for (n_it=neighbors_dict.begin(); n_it!=neighbors_dict.end(); n_it++) {
                     int nbr = n_it->first;
-                    vector<int>& block = init_regions[ init_area2region[ nbr ] ];
-                    if (check_floor(block, nbr)) {
-                        if (check_contiguity(w, block, nbr)) {
+                    if (state.check_floor(state.a2r[nbr], nbr)) {
+                        if (state.check_contiguity(init_regions, nbr)) {
                             candidates.push_back(nbr);
                         }
                     }
@@ -477,9 +690,7 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
                     bool best_found = false;
                     for (int j=0; j<candidates.size() && best_found == false; j++) {
                         int area = candidates[j];
-                        vector<int>& current_internal = init_regions[seed];
-                        vector<int>& current_outter = init_regions[init_area2region[area]];
-                        double change = objective_function_change(area, current_internal, current_outter);
+                        double change = objective_function_change(area, seed, state);
                         change = -change / (local_best_ssd * T);
                         if (exp(change) > Gda::ThomasWangHashDouble(seed_local++)) {
                             best = area;
@@ -491,11 +702,7 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
                         // make the move
                         int area = best;
                         int old_region = init_area2region[area];
-                        vector<int>& rgn = init_regions[old_region];
-                        rgn.erase(remove(rgn.begin(),rgn.end(), area), rgn.end());
-                        
-                        init_area2region[area] = seed;
-                        init_regions[seed].push_back(area);
+                        move(area, old_region, seed, init_regions, init_area2region, state);
                       
                         moves_made += 1;
                         changed_regions[seed] = 1;
@@ -508,9 +715,7 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
                         bool best_found = false;
                         for (int j=0; j<candidates.size(); j++) {
                             int area = candidates[j];
-                            vector<int>& current_internal = init_regions[seed];
-                            vector<int>& current_outter = init_regions[init_area2region[area]];
-                            double change = objective_function_change(area, current_internal, current_outter);
+                            double change = objective_function_change(area, seed, state);
                             if (change <= cv) {
                                 best = area;
                                 cv = change;
@@ -522,11 +727,7 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
                             // make the move
                             int area = best;
                             int old_region = init_area2region[area];
-                            vector<int>& rgn = init_regions[old_region];
-                            rgn.erase(remove(rgn.begin(),rgn.end(), area), rgn.end());
-                            
-                            init_area2region[area] = seed;
-                            init_regions[seed].push_back(area);
+                            move(area, old_region, seed, init_regions, init_area2region, state);
                             
                             moves_made += 1;
                             changed_regions[seed] = 1;
@@ -538,9 +739,8 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
                             for (int k=0; k<w[area].Size(); k++) {
                                 int nbr = w[area][k];
                                 if (member_dict[nbr] || neighbors_dict[nbr]) continue;
-                                vector<int>& block = init_regions[ init_area2region[ nbr ] ];
-                                if (check_floor(block, nbr)) {
-                                    if (check_contiguity(w, block, nbr)) {
+                                if (state.check_floor(state.a2r[nbr], nbr)) {
+                                    if (state.check_contiguity(init_regions, nbr)) {
                                         candidates.push_back(nbr);
                                         neighbors_dict[nbr] = true;
                                     }
@@ -563,9 +763,9 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
             improved = 1;
             local_best_solution = init_regions;
             local_best_area2region = init_area2region;
-            local_best_ssd = objective_function(init_regions);
+            local_best_ssd = state.objective();
         } else {
-            double current_ssd = objective_function(init_regions);
+            double current_ssd = state.objective();
             if ( current_ssd < local_best_ssd) {
                 improved = 1;
                 local_best_solution = init_regions;
@@ -585,7 +785,7 @@ void Maxp::simulated_annealing(vector<vector<int> >& init_regions, boost::unorde
         }
     }
     // make sure tabu result is no worse than greedy research
-    double search_best_ssd = objective_function(init_regions);
+    double search_best_ssd = state.objective();
     if (local_best_ssd < search_best_ssd) {
         init_regions = local_best_solution;
         init_area2region = local_best_area2region;
@@ -598,6 +798,8 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
     boost::unordered_map<int, int> local_best_area2region;
     double local_best_ssd = 0;
     
+    MaxpSearchState state(w, z, floor, floor_variable, init_regions);
+    
     int nr = init_regions.size();
     
     vector<int> changed_regions(nr, 1);
@@ -641,9 +843,8 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
             vector<int> candidates;
             for (n_it=neighbors_dict.begin(); n_it!=neighbors_dict.end(); n_it++) {
                 int nbr = n_it->first;
-                vector<int>& block = init_regions[ init_area2region[ nbr ] ];
-                if (check_floor(block, nbr)) {
-                    if (check_contiguity(w, block, nbr)) {
+                if (state.check_floor(state.a2r[nbr], nbr)) {
+                    if (state.check_contiguity(init_regions, nbr)) {
                         candidates.push_back(nbr);
                     }
                 }
@@ -655,14 +856,12 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
                 bool best_found = false;
                 for (int j=0; j<candidates.size(); j++) {
                     int area = candidates[j];
-                    vector<int>& current_internal = init_regions[seed];
-                    vector<int>& current_outter = init_regions[init_area2region[area]];
                     if (!tabuList.empty()) {
                         TabuMove tabu(area, init_area2region[area], seed);
                         if ( find(tabuList.begin(), tabuList.end(), tabu) != tabuList.end() )
                             continue;
                     }
-                    double change = objective_function_change(area, current_internal, current_outter);
+                    double change = objective_function_change(area, seed, state);
                     if (change <= cv) {
                         best = area;
                         cv = change;
@@ -675,7 +874,7 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
                     if (init_area2region.find(area) != init_area2region.end()) {
                         int old_region = init_area2region[area];
                         // make the move
-                        move(area, old_region, seed, init_regions, init_area2region, tabuList,tabuLength);
+                        move(area, old_region, seed, init_regions, init_area2region, state, tabuList, tabuLength);
                         num_move ++;
                         changed_regions[seed] = 1;
                         changed_regions[old_region] = 1;
@@ -687,13 +886,11 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
                 bool best_found = false;
                 for (int j=0; j<candidates.size(); j++) {
                     int area = candidates[j];
-                    vector<int>& current_internal = init_regions[seed];
-                    vector<int>& current_outter = init_regions[init_area2region[area]];
                     // prohibit tabu
                     TabuMove tabu(area, init_area2region[area], seed);
                     if ( find(tabuList.begin(), tabuList.end(), tabu) != tabuList.end() )
                         continue;
-                    double change = objective_function_change(area, current_internal, current_outter);
+                    double change = objective_function_change(area, seed, state);
                     if (j ==0 || change <= cv) {
                         best = area;
                         cv = change;
@@ -706,7 +903,7 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
                     if (init_area2region.find(area) != init_area2region.end()) {
                         int old_region = init_area2region[area];
                         // make the move
-                        move(area, old_region, seed, init_regions, init_area2region, tabuList,tabuLength);
+                        move(area, old_region, seed, init_regions, init_area2region, state, tabuList, tabuLength);
                         num_move ++;
                         changed_regions[seed] = 1;
                         changed_regions[old_region] = 1;
@@ -724,9 +921,9 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
             if (local_best_solution.empty()) {
                 local_best_solution = init_regions;
                 local_best_area2region = init_area2region;
-                local_best_ssd = objective_function(init_regions);
+                local_best_ssd = state.objective();
             } else {
-                double current_ssd = objective_function(init_regions);
+                double current_ssd = state.objective();
                 if ( current_ssd < local_best_ssd ) {
                     local_best_solution = init_regions;
                     local_best_area2region = init_area2region;
@@ -743,7 +940,7 @@ void Maxp::tabu_search(vector<vector<int> >& init_regions, boost::unordered_map<
         }
     }
     // make sure tabu result is no worse than greedy research
-    double search_best_ssd = objective_function(init_regions);
+    double search_best_ssd = state.objective();
     if (local_best_ssd < search_best_ssd) {
         init_regions = local_best_solution;
         init_area2region = local_best_area2region;
@@ -760,13 +957,15 @@ void Maxp::move(int area, int from_region, int to_region, vector<vector<int> >&
     _regions[to_region].push_back(area);
 }
 
-void Maxp::move(int area, int from_region, int to_region, vector<vector<int> >& _regions, boost::unordered_map<int, int>& _area2region, vector<TabuMove>& tabu_list, int max_labu_length)
+void Maxp::move(int area, int from_region, int to_region, vector<vector<int> >& _regions, boost::unordered_map<int, int>& _area2region, MaxpSearchState& state)
 {
-    vector<int>& rgn = _regions[from_region];
-    rgn.erase(remove(rgn.begin(),rgn.end(), area), rgn.end());
-    
-    _area2region[area] = to_region;
-    _regions[to_region].push_back(area);
+    move(area, from_region, to_region, _regions, _area2region);
+    state.move(area, from_region, to_region);
+}
+
+void Maxp::move(int area, int from_region, int to_region, vector<vector<int> >& _regions, boost::unordered_map<int, int>& _area2region, MaxpSearchState& state, vector<TabuMove>& tabu_list, int max_labu_length)
+{
+    move(area, from_region, to_region, _regions, _area2region, state);
     
     TabuMove tabu(area, from_region, to_region);
     
@@ -787,6 +986,8 @@ void Maxp::swap(vector<vector<int> >& init_regions, boost::unordered_map<int, in
     int total_move = 0;
     int nr = init_regions.size();
     
+    MaxpSearchState state(w, z, floor, floor_variable, init_regions);
+    
     vector<int>::iterator iter;
     vector<int> changed_regions(nr, 1);
     
@@ -839,9 +1040,8 @@ void Maxp::swap(vector<vector<int> >& init_regions, boost::unordered_map<int, in
             vector<int> candidates;
             for (n_it=neighbors_dict.begin(); n_it!=neighbors_dict.end(); n_it++) {
                 int nbr = n_it->first;
-                vector<int>& block = init_regions[ init_area2region[ nbr ] ];
-                if (check_floor(block, nbr)) {
-                    if (check_contiguity(w, block, nbr)) {
+                if (state.check_floor(state.a2r[nbr], nbr)) {
+                    if (state.check_contiguity(init_regions, nbr)) {
                         candidates.push_back(nbr);
                     }
                 }
@@ -853,9 +1053,7 @@ void Maxp::swap(vector<vector<int> >& init_regions, boost::unordered_map<int, in
                 bool best_found = false;
                 for (int j=0; j<candidates.size(); j++) {
                     int area = candidates[j];
-                    vector<int>& current_internal = init_regions[seed];
-                    vector<int>& current_outter = init_regions[init_area2region[area]];
-                    double change = objective_function_change(area, current_internal, current_outter);
+                    double change = objective_function_change(area, seed, state);
                     if (change <= cv) {
                         //if (check_contiguity(w, current_internal, area)) {
                             best = area;
@@ -869,11 +1067,7 @@ void Maxp::swap(vector<vector<int> >& init_regions, boost::unordered_map<int, in
                     // make the move
                     int area = best;
                     int old_region = init_area2region[area];
-                    vector<int>& rgn = init_regions[old_region];
-                    rgn.erase(remove(rgn.begin(),rgn.end(), area), rgn.end());
-                    
-                    init_area2region[area] = seed;
-                    init_regions[seed].push_back(area);
+                    move(area, old_region, seed, init_regions, init_area2region, state);
                     
                     moves_made += 1;
                     changed_regions[seed] = 1;
@@ -886,9 +1080,8 @@ void Maxp::swap(vector<vector<int> >& init_regions, boost::unordered_map<int, in
                     for (int k=0; k<w[area].Size(); k++) {
                         int nbr = w[area][k];
                         if (member_dict[nbr] || neighbors_dict[nbr]) continue;
-                        vector<int>& block = init_regions[ init_area2region[ nbr ] ];
-                        if (check_floor(block, nbr)) {
-                            if (check_contiguity(w, block, nbr)) {
+                        if (state.check_floor(state.a2r[nbr], nbr)) {
+                            if (state.check_contiguity(init_regions, nbr)) {
                                 candidates.push_back(nbr);
                                 neighbors_dict[nbr] = true;
                             }
@@ -970,40 +1163,6 @@ double Maxp::objective_function(vector<int>& solution)
     return wss;
 }
 
-double Maxp::objective_function(vector<int>& region1, int leaver, vector<int>& region2, int comer )
-{
-    // solution is a list of region ids [1,7,2]
-    double wss = 0;
-    int j=0;
-    int n_size = region1.size();
-    // for every variable, calc the variance using selected neighbors
-    for (int m=0; m<num_vars; m++) {
-        vector<double> selected_z(n_size-1);
-        j = 0;
-        for (int i=0; i<n_size; i++ ) {
-            if (region1[i] == leaver) continue;
-            int selectionID = region1[i];
-            selected_z[j++] =  z[selectionID][m];
-        }
-        double ssd = GenUtils::SumOfSquares(selected_z);
-        wss += ssd;
-    }
-    
-    n_size = region2.size();
-    // for every variable, calc the variance using selected neighbors
-    for (int m=0; m<num_vars; m++) {
-        vector<double> selected_z(n_size+1);
-        for (int i=0; i<n_size; i++ ) {
-            int selectionID = region2[i];
-            selected_z[i] =  z[selectionID][m];
-        }
-        selected_z[n_size] = z[comer][m];
-        double ssd = GenUtils::SumOfSquares(selected_z);
-        wss += ssd;
-    }
-    return wss;
-}
-
 double Maxp::objective_function(vector<vector<int> >& solution)
 {
     // solution is a list of lists of region ids [[1,7,2],[0,4,3],...] such
@@ -1044,12 +1203,10 @@ double Maxp::objective_function(vector<int>& current_internal, vector<int>& curr
 }
 
 
-double Maxp::objective_function_change(int area, vector<int>& current_internal, vector<int>& current_outter)
+double Maxp::objective_function_change(int area, int to_region, MaxpSearchState& state)
 {
-    double current = objective_function(current_internal) + objective_function(current_outter);
-    double new_val = objective_function(current_outter, area, current_internal, area);
-    double change = new_val - current;
-    return change;
+    // O(m) using the running sums of the from/to regions
+    return state.objective_change(area, to_region);
 }
 
 bool Maxp::check_contiguity(const GalElement* w, vector<int>& ids, int leaver)
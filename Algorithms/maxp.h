@@ -65,6 +65,78 @@ struct TabuMove
             t.to_region == to_region;
     }
 };
+
+/*! Sufficient statistics of a region
+ 
+ Count, per-variable sum and sum of squares, plus the total of the floor
+ variable. The within-region sum of squared deviations is
+ sum_m(sum_sq[m] - sum[m]^2 / n), so the change of moving one area in or out
+ of a region is O(m) regardless of the region size.
+ */
+class MaxpRegionStats
+{
+public:
+    MaxpRegionStats(int num_vars=0);
+    
+    void add(const vector<double>& x, double floor_val);
+    void remove(const vector<double>& x, double floor_val);
+    
+    double ssd() const;
+    double ssd_with(const vector<double>& x) const;
+    double ssd_without(const vector<double>& x) const;
+    
+    int n;
+    double floor_sum;
+    vector<double> sum;
+    vector<double> sum_sq;
+};
+
+/*! State of one local search (swap, tabu or SA) over a solution
+ 
+ Keeps the region statistics, a flat area->region array, and a cache of the
+ articulation points of each region: an area can leave its region without
+ breaking contiguity iff it is not an articulation point of the subgraph
+ induced by the region. The cache of a region is rebuilt lazily (Tarjan,
+ O(region size)) only after the region has changed.
+ */
+class MaxpSearchState
+{
+public:
+    MaxpSearchState(const GalElement* w, const vector<vector<double> >& z,
+                    double floor, double* floor_variable,
+                    vector<vector<int> >& regions);
+    
+    void move(int area, int from_region, int to_region);
+    
+    double objective() const;
+    
+    double objective_change(int area, int to_region) const;
+    
+    bool check_floor(int region, int leaver) const;
+    
+    bool check_contiguity(vector<vector<int> >& regions, int leaver);
+    
+    vector<MaxpRegionStats> stats;
+    
+    vector<int> a2r;
+    
+protected:
+    void update_articulation(const vector<int>& region, int rid);
+    
+    const GalElement* w;
+    const vector<vector<double> >& z;
+    double floor;
+    double* floor_variable;
+    
+    vector<char> cut_valid;
+    vector<int> num_components;
+    vector<char> is_cut;
+    vector<int> disc;
+    vector<int> low;
+    vector<int> visit_stamp;
+    int stamp;
+};
+
 /*! A Max-p class */
 
 class Maxp
@@ -256,7 +328,9 @@ protected:
      */
     void move(int area, int from_region, int to_region, vector<vector<int> >& regions, boost::unordered_map<int, int>& area2region);
     
-    void move(int area, int from_region, int to_region, vector<vector<int> >& regions, boost::unordered_map<int, int>& area2region, vector<TabuMove>& tabu_list, int max_tabu_length);
+    void move(int area, int from_region, int to_region, vector<vector<int> >& regions, boost::unordered_map<int, int>& area2region, MaxpSearchState& state);
+    
+    void move(int area, int from_region, int to_region, vector<vector<int> >& regions, boost::unordered_map<int, int>& area2region, MaxpSearchState& state, vector<TabuMove>& tabu_list, int max_tabu_length);
     
     //! A protected member function: init_solution(void). return
     /*!
@@ -271,13 +345,11 @@ protected:
     
     double objective_function(vector<int>& solution);
     
-    double objective_function(vector<int>& region1, int leaver, vector<int>& region2, int comer);
-    
     double objective_function(vector<vector<int> >& solution);
     
     double objective_function(vector<int>& current_internal, vector<int>& current_outter);
     
-    double objective_function_change(int area, vector<int>& current_internal, vector<int>& current_outter);
+    double objective_function_change(int area, int to_region, MaxpSearchState& state);
    
     wxString print_regions(vector<vector<int> >& _regions);
     //! xxx
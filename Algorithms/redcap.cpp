@@ -38,6 +38,7 @@
 #include "../GenUtils.h"
 #include "../GdaConst.h"
 #include "cluster.h"
+#include "threadpool.h"
 #include "redcap.h"
 
 using namespace std;
@@ -67,23 +68,6 @@ bool EdgeLess(Edge* a, Edge* b)
 // SSDUtils
 //
 /////////////////////////////////////////////////////////////////////////
-void SSDUtils::MeasureSplit(double ssd, vector<int> &ids, int split_position,  Measure& result)
-{
-    int start1 = 0;
-    int end1 = split_position;
-    int start2 = split_position;
-    int end2 = (int)ids.size();
-    
-    double ssd1 = ComputeSSD(ids, start1, end1);
-    double ssd2 = ComputeSSD(ids, start2, end2);
-
-    
-    result.measure_reduction = ssd - ssd1 - ssd2;
-    result.ssd = ssd;
-    result.ssd_part1 = ssd1;
-    result.ssd_part2 = ssd2;
-}
-
 double SSDUtils::ComputeSSD(vector<int> &visited_ids, int start, int end)
 {
     int size = end - start;
@@ -103,6 +87,74 @@ double SSDUtils::ComputeSSD(vector<int> &visited_ids, int start, int end)
     return sum_squared / col;
 }
 
+void SSDUtils::SetOrder(const vector<int>& ordered_ids)
+{
+    n = (int)ordered_ids.size();
+    mean.assign(col, 0.0);
+    if (n == 0) return;
+    for (int j = 0; j < n; ++j) {
+        const double* vals = raw_data[ordered_ids[j]];
+        for (int i = 0; i < col; ++i) mean[i] += vals[i];
+    }
+    for (int i = 0; i < col; ++i) mean[i] /= n;
+    
+    // values are centered to keep the differences of prefix sums accurate
+    prefix_sum.resize((n + 1) * col);
+    prefix_sqsum.resize((n + 1) * col);
+    for (int i = 0; i < col; ++i) {
+        prefix_sum[i] = 0;
+        prefix_sqsum[i] = 0;
+    }
+    for (int j = 0; j < n; ++j) {
+        const double* vals = raw_data[ordered_ids[j]];
+        const double* s0 = &prefix_sum[j * col];
+        const double* q0 = &prefix_sqsum[j * col];
+        double* s1 = &prefix_sum[(j + 1) * col];
+        double* q1 = &prefix_sqsum[(j + 1) * col];
+        for (int i = 0; i < col; ++i) {
+            double val = vals[i] - mean[i];
+            s1[i] = s0[i] + val;
+            q1[i] = q0[i] + val * val;
+        }
+    }
+}
+
+double SSDUtils::RangeSSD(int start, int end) const
+{
+    int size = end - start;
+    if (size <= 0) return 0;
+    const double* s0 = &prefix_sum[start * col];
+    const double* q0 = &prefix_sqsum[start * col];
+    const double* s1 = &prefix_sum[end * col];
+    const double* q1 = &prefix_sqsum[end * col];
+    double sum_squared = 0.0;
+    for (int i = 0; i < col; ++i) {
+        double sum = s1[i] - s0[i];
+        double sqsum = q1[i] - q0[i];
+        sum_squared += sqsum - sum * sum / size;
+    }
+    return sum_squared / col;
+}
+
+double SSDUtils::ComplementSSD(int start, int end) const
+{
+    int size = n - (end - start);
+    if (size <= 0) return 0;
+    const double* s0 = &prefix_sum[start * col];
+    const double* q0 = &prefix_sqsum[start * col];
+    const double* s1 = &prefix_sum[end * col];
+    const double* q1 = &prefix_sqsum[end * col];
+    const double* sn = &prefix_sum[n * col];
+    const double* qn = &prefix_sqsum[n * col];
+    double sum_squared = 0.0;
+    for (int i = 0; i < col; ++i) {
+        double sum = sn[i] - (s1[i] - s0[i]);
+        double sqsum = qn[i] - (q1[i] - q0[i]);
+        sum_squared += sqsum - sum * sum / size;
+    }
+    return sum_squared / col;
+}
+
 /////////////////////////////////////////////////////////////////////////
 //
 // Node
@@ -178,7 +230,7 @@ Edge::Edge(Node* a, Node* b, double _length)
 // Tree
 //
 /////////////////////////////////////////////////////////////////////////
-Tree::Tree(vector<int> _ordered_ids, vector<Edge*> _edges, AbstractClusterFactory* _cluster)
+Tree::Tree(const vector<int>& _ordered_ids, const vector<Edge*>& _edges, AbstractClusterFactory* _cluster)
 : ordered_ids(_ordered_ids), edges(_edges), cluster(_cluster)
 {
     ssd_reduce = 0;
@@ -187,58 +239,11 @@ Tree::Tree(vector<int> _ordered_ids, vector<Edge*> _edges, AbstractClusterFactor
     controls = cluster->controls;
     control_thres = cluster->control_thres;
     
-    int size = (int)ordered_ids.size();
-    int edge_size = (int)edges.size();
     this->ssd = 0;
     this->ssd_reduce = 0;
     
     if (ordered_ids.size() > 1) {
-        this->ssd = ssd_utils->ComputeSSD(ordered_ids, 0, size);
-        max_id = -1;
-        for (int i=0; i<size; i++) {
-            if (ordered_ids[i] > max_id) {
-                max_id = ordered_ids[i];
-            }
-        }
-        
-        // use edges and ordered_ids to create nbr_dict and od_array
-        boost::unordered_map<int, vector<int> > nbr_dict;
-        od_array.resize(edge_size);
-        
-        int o_id, d_id;
-        for (int i=0; i<edge_size; i++) {
-            o_id = edges[i]->orig->id;
-            d_id = edges[i]->dest->id;
-            
-            od_array[i].first = o_id;
-            od_array[i].second = d_id;
-            
-            nbr_dict[o_id].push_back(d_id);
-            nbr_dict[d_id].push_back(o_id);
-        }
-        
-        if (size < 1000) {
-            Partition(0, (int)od_array.size()-1, ordered_ids, od_array, nbr_dict);
-        } else {
-            run_threads(ordered_ids, od_array, nbr_dict);
-        }
-        if (!split_cands.empty()) {
-            SplitSolution& ss = split_cands[0];
-            this->split_ids = ss.split_ids;
-            this->split_pos = ss.split_pos;
-            this->ssd = ss.ssd;
-            this->ssd_reduce = ss.ssd_reduce;
-            
-            for (int j=1; j<split_cands.size(); j++) {
-                SplitSolution& tmp_ss = split_cands[j];
-                if (tmp_ss.ssd_reduce > this->ssd_reduce) {
-                    this->split_ids = tmp_ss.split_ids;
-                    this->split_pos = tmp_ss.split_pos;
-                    this->ssd = tmp_ss.ssd;
-                    this->ssd_reduce = tmp_ss.ssd_reduce;
-                }
-            }
-        }
+        FindBestSplit();
     }
 }
 
@@ -246,139 +251,171 @@ Tree::~Tree()
 {
 }
 
-void Tree::run_threads(vector<int>& ids,
-                       vector<pair<int, int> >& od_array,
-                       boost::unordered_map<int, vector<int> >& nbr_dict)
+void Tree::FindBestSplit()
 {
-    int n_jobs = (int)od_array.size();
-    
-    int nCPUs = boost::thread::hardware_concurrency();
-    if (GdaConst::gda_set_cpu_cores) nCPUs = GdaConst::gda_cpu_cores;
-    int quotient = n_jobs / nCPUs;
-    int remainder = n_jobs % nCPUs;
-    int tot_threads = (quotient > 0) ? nCPUs : remainder;
-    
-    boost::thread_group threadPool;
-    for (int i=0; i<tot_threads; i++) {
-        int a=0;
-        int b=0;
-        if (i < remainder) {
-            a = i*(quotient+1);
-            b = a+quotient;
-        } else {
-            a = remainder*(quotient+1) + (i-remainder)*quotient;
-            b = a+quotient-1;
-        }
-        
-        //prunecost(tree, a, b, scores, candidates);
-        boost::thread* worker = new boost::thread(boost::bind(&Tree::Partition, this, a, b, boost::ref(ids), boost::ref(od_array), boost::ref(nbr_dict)));
-        threadPool.add_thread(worker);
+    SplitWorkspace& ws = cluster->workspace;
+    int size = (int)ordered_ids.size();
+    int edge_size = (int)edges.size();
+    
+    if ((int)ws.local_idx.size() < cluster->rows) {
+        ws.local_idx.assign(cluster->rows, -1);
+    }
+    for (int i=0; i<size; i++) {
+        ws.local_idx[ ordered_ids[i] ] = i;
     }
     
-    threadPool.join_all();
-}
-
-void Tree::Partition(int start, int end, vector<int>& ids,
-                           vector<pair<int, int> >& od_array,
-                           boost::unordered_map<int, vector<int> >& nbr_dict)
-{
-    int size = (int)nbr_dict.size();
-    int orig_id, dest_id;
-    int i;
+    // adjacency of the tree in CSR form
+    ws.nbr_start.assign(size + 1, 0);
+    for (int i=0; i<edge_size; i++) {
+        ws.nbr_start[ ws.local_idx[edges[i]->orig->id] + 1 ] += 1;
+        ws.nbr_start[ ws.local_idx[edges[i]->dest->id] + 1 ] += 1;
+    }
+    for (int i=0; i<size; i++) {
+        ws.nbr_start[i+1] += ws.nbr_start[i];
+    }
+    ws.nbr_list.resize(2 * edge_size);
+    ws.next_nbr.assign(ws.nbr_start.begin(), ws.nbr_start.end() - 1);
+    for (int i=0; i<edge_size; i++) {
+        int o = ws.local_idx[edges[i]->orig->id];
+        int d = ws.local_idx[edges[i]->dest->id];
+        ws.nbr_list[ ws.next_nbr[o]++ ] = d;
+        ws.nbr_list[ ws.next_nbr[d]++ ] = o;
+    }
     
-    //int best_edge = -1;
-    int evaluated = 0;
-    int best_pos = -1;
-    double tmp_ssd_reduce = 0, tmp_ssd=0;
+    // iterative DFS; every subtree becomes a contiguous range of pre_order
+    ws.parent.assign(size, -1);
+    ws.tin.assign(size, -1);
+    ws.tout.resize(size);
+    ws.pre_order.resize(size);
+    ws.dfs_stack.clear();
+    vector<int>& next_nbr = ws.next_nbr;
+    int cnt = 0;
+    for (int root=0; root<size; root++) {
+        if (ws.tin[root] != -1) continue;
+        ws.tin[root] = cnt;
+        ws.pre_order[cnt++] = root;
+        next_nbr[root] = ws.nbr_start[root];
+        ws.dfs_stack.push_back(root);
+        while (!ws.dfs_stack.empty()) {
+            int cur = ws.dfs_stack.back();
+            if (next_nbr[cur] < ws.nbr_start[cur+1]) {
+                int nbr = ws.nbr_list[ next_nbr[cur]++ ];
+                if (ws.tin[nbr] == -1) {
+                    ws.parent[nbr] = cur;
+                    ws.tin[nbr] = cnt;
+                    ws.pre_order[cnt++] = nbr;
+                    next_nbr[nbr] = ws.nbr_start[nbr];
+                    ws.dfs_stack.push_back(nbr);
+                }
+            } else {
+                ws.dfs_stack.pop_back();
+                ws.tout[cur] = cnt;
+            }
+        }
+    }
     
-    vector<int> visited_ids(size), best_ids(size);
+    vector<int> dfs_ids(size);
+    for (int i=0; i<size; i++) {
+        dfs_ids[i] = ordered_ids[ ws.pre_order[i] ];
+    }
+    ssd_utils->SetOrder(dfs_ids);
+    this->ssd = ssd_utils->RangeSSD(0, size);
     
-    // cut edge one by one
-    for ( i=start; i<=end; i++) {
-        orig_id = od_array[i].first;
-        dest_id = od_array[i].second;
-        
-        int idx = 0;
-        vector<int> cand_ids(max_id+1, -1);
-        Split(orig_id, dest_id, nbr_dict, cand_ids);
-        
-        for (int j=0; j<ids.size(); j++) {
-            if (cand_ids[ ids[j] ] == 1) {
-                visited_ids[idx] = ids[j];
-                idx++;
+    if (controls) {
+        ws.prefix_control.resize(size + 1);
+        ws.prefix_control[0] = 0;
+        for (int i=0; i<size; i++) {
+            ws.prefix_control[i+1] = ws.prefix_control[i] + controls[dfs_ids[i]];
+        }
+    }
+    
+    // evaluate all cuts, split over the thread pool for large trees
+    double best_reduce = 0;
+    int best_edge = -1;
+    if (cluster->pool == NULL || size < 1000) {
+        EvaluateCuts(0, edge_size, &best_reduce, &best_edge);
+    } else {
+        int tot_threads = num_range_threads(edge_size, 1);
+        vector<double> reduces(tot_threads, 0);
+        vector<int> best_edges(tot_threads, -1);
+        for (int i=0; i<tot_threads; i++) {
+            int a=0;
+            int b=0;
+            split_range(edge_size, tot_threads, i, a, b);
+            cluster->pool->enqueue(boost::bind(&Tree::EvaluateCuts, this, a, b+1, &reduces[i], &best_edges[i]));
+        }
+        cluster->pool->wait();
+        // chunks are in edge order: keep the first best cut
+        for (int i=0; i<tot_threads; i++) {
+            if (best_edges[i] >= 0 && reduces[i] > best_reduce) {
+                best_reduce = reduces[i];
+                best_edge = best_edges[i];
             }
         }
+    }
+    
+    if (best_edge < 0) {
+        // no cut reduces the SSD or satisfies the bound: not splittable
+        this->ssd = 0;
+    } else {
+        int o = ws.local_idx[ edges[best_edge]->orig->id ];
+        int d = ws.local_idx[ edges[best_edge]->dest->id ];
+        int child = ws.parent[d] == o ? d : o;
+        bool orig_in_sub = child == o;
+        int start = ws.tin[child], end = ws.tout[child];
         
-        int tmp_split_pos = idx;
-        
-        if (checkControl(cand_ids, ids, 1)) {
-            evaluated++;
-            for (int j=0; j<ids.size(); j++) {
-                if (cand_ids[ ids[j] ] == -1) {
-                    visited_ids[idx] = ids[j];
-                    idx++;
-                }
-            }
-            if (checkControl(cand_ids, ids, -1)) {
-                Measure result;
-                ssd_utils->MeasureSplit(ssd, visited_ids, tmp_split_pos, result);
-                if (result.measure_reduction > tmp_ssd_reduce) {
-                    tmp_ssd_reduce = result.measure_reduction;
-                    tmp_ssd = result.ssd;
-                    best_pos = tmp_split_pos;
-                    best_ids = visited_ids;
-                }
+        // part of orig first, then part of dest, both in ordered_ids order
+        split_ids.resize(size);
+        int idx = 0;
+        for (int pass=0; pass<2; pass++) {
+            bool want_sub = (pass == 0) == orig_in_sub;
+            for (int i=0; i<size; i++) {
+                bool in_sub = ws.tin[i] >= start && ws.tin[i] < end;
+                if (in_sub == want_sub) split_ids[idx++] = ordered_ids[i];
             }
+            if (pass == 0) split_pos = idx;
         }
+        this->ssd_reduce = best_reduce;
     }
     
-    if (split_pos != -1) {
-        SplitSolution ss;
-        ss.split_pos =  best_pos;
-        ss.split_ids = best_ids;
-        ss.ssd = tmp_ssd;
-        ss.ssd_reduce = tmp_ssd_reduce;
-        mutex.lock();
-        split_cands.push_back(ss);
-        mutex.unlock();
+    for (int i=0; i<size; i++) {
+        ws.local_idx[ ordered_ids[i] ] = -1;
     }
 }
 
-void Tree::Split(int orig, int dest, boost::unordered_map<int, vector<int> >& nbr_dict, vector<int>& cand_ids)
+void Tree::EvaluateCuts(int start, int end, double* best_reduce, int* best_edge)
 {
-    stack<int> visited_ids;
-    int cur_id, i, nbr_size, nbr;
-    
-    visited_ids.push(orig);
-    while (!visited_ids.empty()) {
-        cur_id = visited_ids.top();
-        visited_ids.pop();
-        cand_ids[cur_id] = 1;
-        vector<int>& nbrs = nbr_dict[cur_id];
-        nbr_size = (int)nbrs.size();
-        for (i=0; i<nbr_size; i++) {
-            nbr = nbrs[i];
-            if (nbr != dest && cand_ids[nbr] == -1) {
-                visited_ids.push(nbr);
+    const SplitWorkspace& ws = cluster->workspace;
+    int size = (int)ordered_ids.size();
+    double tmp_ssd_reduce = 0;
+    int tmp_best = -1;
+    
+    for (int i=start; i<end; i++) {
+        int o = ws.local_idx[ edges[i]->orig->id ];
+        int d = ws.local_idx[ edges[i]->dest->id ];
+        // cutting the edge separates the subtree rooted at the child
+        int child = ws.parent[d] == o ? d : o;
+        bool orig_in_sub = child == o;
+        int a = ws.tin[child], b = ws.tout[child];
+        
+        if (controls) {
+            double ctrl_sub = ws.prefix_control[b] - ws.prefix_control[a];
+            double ctrl_rest = ws.prefix_control[size] - ctrl_sub;
+            if (ctrl_sub < control_thres || ctrl_rest < control_thres) {
+                continue;
             }
         }
-    }
-}
-
-bool Tree::checkControl(vector<int>& cand_ids, vector<int>& ids, int flag)
-{
-    if (controls == NULL) {
-        return true;
-    }
-    
-    double val = 0;
-    for (int j=0; j<ids.size(); j++) {
-        if (cand_ids[ ids[j] ] == flag) {
-            val += controls[ ids[j] ];
+        double ssd1 = ssd_utils->RangeSSD(a, b);
+        double ssd2 = ssd_utils->ComplementSSD(a, b);
+        if (!orig_in_sub) std::swap(ssd1, ssd2);
+        double reduction = ssd - ssd1 - ssd2;
+        if (reduction > tmp_ssd_reduce) {
+            tmp_ssd_reduce = reduction;
+            tmp_best = i;
         }
     }
-    
-    return val >= control_thres;
+    *best_reduce = tmp_ssd_reduce;
+    *best_edge = tmp_best;
 }
 
 pair<Tree*, Tree*> Tree::GetSubTrees()
@@ -441,7 +478,7 @@ pair<Tree*, Tree*> Tree::GetSubTrees()
 //
 ////////////////////////////////////////////////////////////////////////////////
 AbstractClusterFactory::AbstractClusterFactory(int row, int col,  double** _distances, double** _data, const vector<bool>& _undefs, GalElement * _w)
-: rows(row), cols(col), dist_matrix(_distances), raw_data(_data), undefs(_undefs), w(_w)
+: rows(row), cols(col), dist_matrix(_distances), raw_data(_data), undefs(_undefs), w(_w), pool(NULL)
 {
 }
 
@@ -507,6 +544,9 @@ void AbstractClusterFactory::Partitioning(int k)
 {
     wxStopWatch sw;
     
+    // one pool of worker threads for all tree splits
+    pool = new thread_pool();
+    
     vector<Tree*> not_split_trees;
     Tree* current_tree = new Tree(ordered_ids, ordered_edges, this);
     PriorityQueue sub_trees;
@@ -563,6 +603,8 @@ void AbstractClusterFactory::Partitioning(int k)
     for (int i = 0; i< not_split_trees.size(); i++) {
         delete not_split_trees[i];
     }
+    delete pool;
+    pool = NULL;
     wxString time = wxString::Format("The long running function took %ldms to execute", sw.Time());
 }
 
@@ -28,7 +28,6 @@
 
 #include "../ShapeOperations/GalWeight.h"
 
-#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/heap/priority_queue.hpp>
 #include <boost/graph/adjacency_list.hpp>
@@ -39,6 +38,8 @@
 using namespace std;
 using namespace boost;
 
+class thread_pool;
+
 namespace SpanningTreeClustering {
     
     class Node;
@@ -51,31 +52,36 @@ namespace SpanningTreeClustering {
     // SSDUtils
     //
     /////////////////////////////////////////////////////////////////////////
-    struct Measure
-    {
-        double ssd;
-        double ssd_part1;
-        double ssd_part2;
-        double measure_reduction;
-    };
-    
     class SSDUtils
     {
         double** raw_data;
         int row;
         int col;
         
+        // prefix sums of the centered values and of their squares over the
+        // ids given to SetOrder(): (n+1) x col, row major
+        int n;
+        vector<double> prefix_sum;
+        vector<double> prefix_sqsum;
+        vector<double> mean;
+        
     public:
         SSDUtils(double** data, int _row, int _col) {
             raw_data = data;
             row = _row;
             col = _col;
+            n = 0;
         }
         ~SSDUtils() {}
         
         double ComputeSSD(vector<int>& visited_ids, int start, int end);
-        void MeasureSplit(double ssd, vector<int>& visited_ids, int split_position, Measure& result);
         
+        // build the prefix sums; the buffers are reused between calls
+        void SetOrder(const vector<int>& ordered_ids);
+        // SSD of ordered_ids[start..end) in O(col)
+        double RangeSSD(int start, int end) const;
+        // SSD of all ordered_ids except [start..end) in O(col)
+        double ComplementSSD(int start, int end) const;
     };
     
     /////////////////////////////////////////////////////////////////////////
@@ -162,39 +168,38 @@ namespace SpanningTreeClustering {
     // Tree
     //
     /////////////////////////////////////////////////////////////////////////
-    struct SplitSolution
+    // Scratch arrays for evaluating the cuts of a tree.  They are owned by
+    // the cluster factory and reused by every tree it splits.
+    struct SplitWorkspace
     {
-        int split_pos;
-        vector<int> split_ids;
-        double ssd;
-        double ssd_reduce;
+        vector<int> local_idx; // record id -> position in ordered_ids, or -1
+        vector<int> nbr_start; // CSR adjacency of the tree (local ids)
+        vector<int> nbr_list;
+        vector<int> next_nbr;
+        vector<int> parent;
+        vector<int> tin; // subtree of k is pre-order positions [tin, tout)
+        vector<int> tout;
+        vector<int> dfs_stack;
+        vector<int> pre_order;
+        vector<double> prefix_control; // control sums in pre-order
     };
     
     class Tree
     {
     public:
-        Tree(vector<int> ordered_ids,
-                   vector<Edge*> _edges,
+        Tree(const vector<int>& ordered_ids,
+                   const vector<Edge*>& _edges,
                    AbstractClusterFactory* cluster);
         
         ~Tree();
         
-        void Partition(int start, int end, vector<int>& ids,
-                       vector<pair<int, int> >& od_array,
-                       boost::unordered_map<int, vector<int> >& nbr_dict);
-        void Split(int orig, int dest,
-                   boost::unordered_map<int, vector<int> >& nbr_dict,
-                   vector<int>& cand_ids);
-        bool checkControl(vector<int>& cand_ids, vector<int>& ids, int flag);
         pair<Tree*, Tree*> GetSubTrees();
         
         double ssd_reduce;
         double ssd;
         
-        vector<pair<int, int> > od_array;
         AbstractClusterFactory* cluster;
         pair<Tree*, Tree*> subtrees;
-        int max_id;
         int split_pos;
         vector<int> split_ids;
         vector<Edge*> edges;
@@ -204,12 +209,13 @@ namespace SpanningTreeClustering {
         double* controls;
         double control_thres;
         
-        // threads
-        boost::mutex mutex;
-        void run_threads(vector<int>& ids,
-                       vector<pair<int, int> >& od_array,
-                       boost::unordered_map<int, vector<int> >& nbr_dict);
-        vector<SplitSolution> split_cands;
+    protected:
+        // Root the tree, order it by DFS so that every subtree is a range
+        // of the pre-order, and evaluate all cuts with prefix sums.
+        void FindBestSplit();
+        // best cut among edges[start..end), written to best_reduce/best_edge
+        void EvaluateCuts(int start, int end, double* best_reduce,
+                          int* best_edge);
     };
     
     ////////////////////////////////////////////////////////////////////////////////
@@ -254,6 +260,10 @@ namespace SpanningTreeClustering {
         
         vector<vector<int> > cluster_ids;
         
+        // shared by all tree splits during Partitioning()
+        SplitWorkspace workspace;
+        thread_pool* pool;
+        
         AbstractClusterFactory(int row, int col,
                        double** distances,
                        double** data,
@@ -0,0 +1,226 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <float.h>
+#include <cmath>
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include "../ShapeOperations/GalWeight.h"
+#include "cluster.h"
+#include "schc.h"
+
+SpatialConstrainedHC::SpatialConstrainedHC(int num_rows, int num_cols,
+                                           double** data, double* weight,
+                                           GalElement* w, char method,
+                                           char dist)
+: num_rows(num_rows), num_cols(num_cols), data(data), weight(weight), w(w),
+method(method), dist(dist)
+{
+}
+
+SpatialConstrainedHC::~SpatialConstrainedHC()
+{
+}
+
+double SpatialConstrainedHC::PointDistance(int i, int j)
+{
+    // same measures as DataUtils::EuclideanDistance (squared) and
+    // DataUtils::ManhattanDistance
+    double d = 0, tmp = 0;
+    for (int c=0; c<num_cols; c++) {
+        tmp = data[i][c] - data[j][c];
+        tmp = dist == 'b' ? fabs(tmp) : tmp * tmp;
+        d += weight ? tmp * weight[c] : tmp;
+    }
+    return d;
+}
+
+double SpatialConstrainedHC::Linkage(int a, int b, const Link& link)
+{
+    if (method == 'w') {
+        double d = 0, tmp = 0;
+        const double* ca = &centroid[a * num_cols];
+        const double* cb = &centroid[b * num_cols];
+        for (int c=0; c<num_cols; c++) {
+            tmp = ca[c] - cb[c];
+            d += weight ? tmp * tmp * weight[c] : tmp * tmp;
+        }
+        double na = size[a], nb = size[b];
+        return 2.0 * na * nb / (na + nb) * d;
+    } else if (method == 'a') {
+        return link.val / link.count;
+    }
+    return link.val;
+}
+
+void SpatialConstrainedHC::Merge(const Link& a_link, const Link& b_link,
+                                 Link& result)
+{
+    double val;
+    if (method == 's') {
+        val = a_link.val < b_link.val ? a_link.val : b_link.val;
+    } else if (method == 'm') {
+        val = a_link.val > b_link.val ? a_link.val : b_link.val;
+    } else {
+        val = a_link.val + b_link.val;
+    }
+    result.count = a_link.count + b_link.count;
+    result.val = val;
+}
+
+int SpatialConstrainedHC::Run(GdaNode* htree)
+{
+    size.assign(num_rows, 1);
+    alive.assign(num_rows, true);
+    links.clear();
+    links.resize(num_rows);
+    if (method == 'w') {
+        centroid.resize(num_rows * num_cols);
+        for (int i=0; i<num_rows; i++) {
+            for (int c=0; c<num_cols; c++) {
+                centroid[i * num_cols + c] = data[i][c];
+            }
+        }
+    }
+
+    std::vector<int> node_id(num_rows); // GdaNode id of each cluster
+    for (int i=0; i<num_rows; i++) node_id[i] = i;
+    std::priority_queue<HeapItem> heap;
+    int stamp = 0;
+
+    for (int i=0; i<num_rows; i++) {
+        const std::vector<long>& nbrs = w[i].GetNbrs();
+        for (size_t j=0; j<nbrs.size(); j++) {
+            int nbr = (int)nbrs[j];
+            if (nbr == i || nbr < 0 || nbr >= num_rows) continue;
+            if (links[i].find(nbr) != links[i].end()) continue;
+            Link l;
+            l.val = PointDistance(i, nbr);
+            l.count = 1;
+            l.stamp = stamp++;
+            links[i][nbr] = l;
+            links[nbr][i] = l;
+            HeapItem item;
+            item.dist = Linkage(i, nbr, l);
+            item.a = i < nbr ? i : nbr;
+            item.b = i < nbr ? nbr : i;
+            item.stamp = l.stamp;
+            heap.push(item);
+        }
+    }
+
+    int n_merges = 0;
+    while (!heap.empty() && n_merges < num_rows - 1) {
+        HeapItem item = heap.top();
+        heap.pop();
+        if (!alive[item.a] || !alive[item.b]) continue;
+        LinkMap::iterator it = links[item.a].find(item.b);
+        if (it == links[item.a].end() || it->second.stamp != item.stamp) {
+            continue;
+        }
+
+        // the cluster with more neighbors survives and absorbs the other
+        int big = item.a, small = item.b;
+        if (links[big].size() < links[small].size()) std::swap(big, small);
+
+        htree[n_merges].left = node_id[item.a];
+        htree[n_merges].right = node_id[item.b];
+        htree[n_merges].distance = item.dist;
+        n_merges += 1;
+        node_id[big] = -n_merges;
+
+        if (method == 'w') {
+            double nb = size[big], ns = size[small];
+            double* cb = &centroid[big * num_cols];
+            const double* cs = &centroid[small * num_cols];
+            for (int c=0; c<num_cols; c++) {
+                cb[c] = (cb[c] * nb + cs[c] * ns) / (nb + ns);
+            }
+        }
+        size[big] += size[small];
+        alive[small] = false;
+
+        LinkMap& big_links = links[big];
+        big_links.erase(small);
+        LinkMap& small_links = links[small];
+        for (LinkMap::iterator s_it = small_links.begin();
+             s_it != small_links.end(); ++s_it)
+        {
+            int x = s_it->first;
+            if (x == big) continue;
+            LinkMap::iterator b_it = big_links.find(x);
+            Link l = s_it->second;
+            if (b_it != big_links.end()) Merge(b_it->second, s_it->second, l);
+            l.stamp = stamp++;
+            big_links[x] = l;
+            LinkMap& x_links = links[x];
+            x_links.erase(small);
+            x_links[big] = l;
+            if (method != 'w') {
+                HeapItem nitem;
+                nitem.dist = Linkage(big, x, l);
+                nitem.a = big < x ? big : x;
+                nitem.b = big < x ? x : big;
+                nitem.stamp = l.stamp;
+                heap.push(nitem);
+            }
+        }
+        LinkMap().swap(small_links);
+
+        if (method == 'w') {
+            // the centroid and size changed: every link of big changes
+            for (LinkMap::iterator b_it = big_links.begin();
+                 b_it != big_links.end(); ++b_it)
+            {
+                int x = b_it->first;
+                b_it->second.stamp = stamp++;
+                links[x][big] = b_it->second;
+                HeapItem nitem;
+                nitem.dist = Linkage(big, x, b_it->second);
+                nitem.a = big < x ? big : x;
+                nitem.b = big < x ? x : big;
+                nitem.stamp = b_it->second.stamp;
+                heap.push(nitem);
+            }
+        }
+        // for single, complete and average the links that big already had
+        // are unchanged, so their heap items stay valid
+    }
+
+    // disconnected parts of the graph are joined last
+    int n_disconnected = 0;
+    int first = -1;
+    for (int i=0; i<num_rows && n_merges < num_rows - 1; i++) {
+        if (!alive[i]) continue;
+        if (first < 0) {
+            first = i;
+            continue;
+        }
+        htree[n_merges].left = node_id[first];
+        htree[n_merges].right = node_id[i];
+        htree[n_merges].distance = DBL_MAX;
+        n_merges += 1;
+        node_id[first] = -n_merges;
+        alive[i] = false;
+        n_disconnected += 1;
+    }
+    return n_disconnected;
+}
@@ -0,0 +1,120 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_SCHC_H___
+#define __GEODA_CENTER_SCHC_H___
+
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+class GalElement;
+struct GdaNode;
+
+/**
+ * Spatially constrained hierarchical clustering on the contiguity graph.
+ *
+ * Only clusters that share a contiguity edge can be merged, so instead of a
+ * dense n(n-1)/2 distance array the linkage is kept for adjacent cluster
+ * pairs only.  A heap holds the linkage of every adjacent pair; merging two
+ * clusters combines their adjacency lists (smaller into larger) and pushes
+ * the new linkage to each neighbor.  Time is O(E log n), memory O(n + E).
+ *
+ * Linkage between adjacent clusters A and B, over the contiguous point pairs
+ * (a, b) with a in A and b in B:
+ *   single   ('s'): min d(a, b)
+ *   complete ('m'): max d(a, b)
+ *   average  ('a'): mean d(a, b)
+ *   ward     ('w'): 2 |A||B| / (|A|+|B|) * |c_A - c_B|^2, from the cluster
+ *                   centroids, which equals the Lance-Williams update on
+ *                   squared euclidean distances
+ *
+ * Cluster ids follow GdaNode: observations are 0..n-1 and the cluster
+ * created by the i-th merge is -(i+1).
+ */
+class SpatialConstrainedHC {
+public:
+    SpatialConstrainedHC(int num_rows, int num_cols, double** data,
+                         double* weight, GalElement* w, char method,
+                         char dist);
+
+    virtual ~SpatialConstrainedHC();
+
+    /**
+     * Fill htree (num_rows-1 nodes) in merge order.  Node distance is the
+     * linkage value; merges between disconnected parts of the graph get
+     * DBL_MAX.  Returns the number of such merges.
+     */
+    int Run(GdaNode* htree);
+
+protected:
+    struct Link {
+        double val; // min, max or sum of the point pair distances
+        int count; // number of contiguous point pairs
+        int stamp; // changes every time the link is updated
+    };
+
+    typedef boost::unordered_map<int, Link> LinkMap;
+
+    struct HeapItem {
+        double dist;
+        int a;
+        int b;
+        int stamp; // stale if the link has been updated since
+        bool operator<(const HeapItem& o) const {
+            // std::priority_queue is a max heap: invert for smallest first
+            if (dist != o.dist) return dist > o.dist;
+            if (a != o.a) return a > o.a;
+            return b > o.b;
+        }
+    };
+
+    double PointDistance(int i, int j);
+
+    double Linkage(int a, int b, const Link& link);
+
+    void Merge(const Link& a_link, const Link& b_link, Link& result);
+
+    int num_rows;
+
+    int num_cols;
+
+    double** data;
+
+    double* weight;
+
+    GalElement* w;
+
+    char method;
+
+    char dist;
+
+    // per cluster, indexed by a member observation: a merged cluster keeps
+    // the index of the side with more neighbors, so links are always moved
+    // from the smaller adjacency list into the larger one
+    std::vector<int> size;
+
+    std::vector<bool> alive;
+
+    std::vector<LinkMap> links;
+
+    // cluster centroids for ward, num_cols per cluster
+    std::vector<double> centroid;
+};
+
+#endif
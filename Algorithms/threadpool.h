@@ -24,6 +24,8 @@ class thread_pool
 private:
     boost::mutex mx;
     boost::condition_variable cv;
+    boost::condition_variable done_cv;
+    int pending; // jobs enqueued but not finished
 
     boost::container::deque<job_t> _queue;
 
@@ -32,15 +34,26 @@ private:
     boost::atomic_bool shutdown;
     static void worker_thread(thread_pool& q)
     {
-        while (boost::optional<job_t> job = q.dequeue())
+        while (boost::optional<job_t> job = q.dequeue()) {
             (*job)();
+            q.finish_job();
+        }
+    }
+
+    void finish_job()
+    {
+        boost::lock_guard<boost::mutex> lk(mx);
+        pending -= 1;
+        if (pending == 0) done_cv.notify_all();
     }
 
 public:
-    thread_pool() : shutdown(false) {
+    thread_pool() : pending(0), shutdown(false) {
         int cores = boost::thread::hardware_concurrency();
         if (GdaConst::gda_set_cpu_cores) cores = GdaConst::gda_cpu_cores;
         if (cores > 1) cores = cores -1;
+        // hardware_concurrency() is 0 when unknown; wait() needs a worker
+        if (cores < 1) cores = 1;
         for (int i = 0; i < cores; ++i)
             pool.create_thread(boost::bind(worker_thread, boost::ref(*this)));
     }
@@ -49,6 +62,7 @@ public:
     {
         boost::lock_guard<boost::mutex> lk(mx);
         _queue.push_back(job);
+        pending += 1;
 
         cv.notify_one();
     }
@@ -69,6 +83,13 @@ public:
         return job;
     }
 
+    // block until all enqueued jobs are finished
+    void wait()
+    {
+        boost::unique_lock<boost::mutex> lk(mx);
+        while (pending > 0) done_cv.wait(lk);
+    }
+
     ~thread_pool()
     {
         shutdown = true;
@@ -81,6 +102,55 @@ public:
     }
 };
 
+/** Number of threads to use for n items, so that each thread gets at least
+ min_per_thread items. Honors the CPU cores set in the preferences. */
+inline int num_range_threads(int n, int min_per_thread)
+{
+    int nCPUs = boost::thread::hardware_concurrency();
+    if (GdaConst::gda_set_cpu_cores) nCPUs = GdaConst::gda_cpu_cores;
+    if (min_per_thread > 1 && nCPUs > n / min_per_thread)
+        nCPUs = n / min_per_thread;
+    if (nCPUs > n) nCPUs = n;
+    if (nCPUs < 1) nCPUs = 1;
+    return nCPUs;
+}
+
+/** Inclusive bounds [start, end] of range i when n items are split into
+ n_ranges contiguous ranges; the first n % n_ranges ranges get one more item */
+inline void split_range(int n, int n_ranges, int i, int& start, int& end)
+{
+    int quotient = n / n_ranges;
+    int remainder = n % n_ranges;
+    if (i < remainder) {
+        start = i*(quotient+1);
+        end = start+quotient;
+    } else {
+        start = remainder*(quotient+1) + (i-remainder)*quotient;
+        end = start+quotient-1;
+    }
+}
+
+/** Split the items 0..n-1 into contiguous ranges of at least min_per_thread
+ items and call worker(start, end), end inclusive, on each range in its own
+ thread. With a single range the worker runs on the calling thread. */
+inline void run_range_threads(int n, int min_per_thread,
+                              boost::function<void (int, int)> worker)
+{
+    if (n <= 0) return;
+    int nCPUs = num_range_threads(n, min_per_thread);
+    if (nCPUs <= 1) {
+        worker(0, n-1);
+        return;
+    }
+    boost::thread_group threadPool;
+    for (int i = 0; i < nCPUs; i++) {
+        int a, b;
+        split_range(n, nCPUs, i, a, b);
+        threadPool.add_thread(new boost::thread(boost::bind(worker, a, b)));
+    }
+    threadPool.join_all();
+}
+
 #else
 
 #include <pthread.h>
@@ -495,9 +495,10 @@ TableBase::TableBase(Project* _project,TemplateFrame* t_frame)
 	table_state(_project->GetTableState()), table_int(_project->GetTableInt()),
 	time_state(_project->GetTimeState()), cols(table_int->GetNumberCols()),
 	rows(_project->GetNumRecords()), row_order(_project->GetNumRecords()),
-	sorting_col(-1), sorting_ascending(false)
+	sorting_col(-1), sorting_ascending(false), table_query(0)
 {
     template_frame = t_frame;
+	table_query = new TableQuery(table_int);
 	SortByDefaultDecending();
 	
     for(int i=0;i<cols;i++) hs_col.push_back(false);
@@ -515,6 +516,7 @@ TableBase::~TableBase()
 	highlight_state->removeObserver(this);
 	table_state->removeObserver(this);
 	time_state->removeObserver(this);
+	delete table_query;
 }
 
 void TableBase::UpdateStatusBar()
@@ -629,6 +631,7 @@ void TableBase::SortByDefaultDecending()
 	}
 	sorting_ascending = false;
 	sorting_col = -1;
+	sort_keys.clear();
 }
 
 void TableBase::SortByDefaultAscending()
@@ -639,70 +642,21 @@ void TableBase::SortByDefaultAscending()
 	}
 	sorting_ascending = true;
 	sorting_col = -1;
+	sort_keys.clear();
 }
 
 
-template <class T>
-class index_pair
-{
-public:
-	int index;
-	T val;
-	static bool less_than(const index_pair& i,
-						  const index_pair& j) {
-		return (i.val<j.val);
-	}
-	static bool greater_than (const index_pair& i,
-							  const index_pair& j) {
-		return (i.val>j.val);
-	}
-};
-
 std::vector<int> TableBase::GetRowOrder()
 {
     return row_order;
 }
 
-template <class T>
-void TableBase::SortColumn(int col, int tm, bool ascending)
+void TableBase::ApplySortKeys()
 {
-    std::vector<T> temp;
-    table_int->GetColData(col, tm, temp);
-    std::vector<bool> undefs;
-    table_int->GetColUndefined(col, tm, undefs);
-    std::vector<int> undef_ids;
-    for (int i=0; i<rows; i++) {
-        if (undefs[i]) undef_ids.push_back(i);
-    }
-    std::vector< index_pair<T> > sort_col(rows - undef_ids.size());
-    int j = 0;
-    for (int i=0; i<rows; i++) {
-        if (undefs[i]) continue;
-        sort_col[j].index = i;
-        sort_col[j].val = temp[i];
-        j++;
-    }
-    if (ascending) {
-        sort(sort_col.begin(), sort_col.end(),
-             index_pair<T>::less_than);
-        for (int i=0; i<undef_ids.size(); i++) {
-            row_order[i] = undef_ids[i];
-        }
-        j = undef_ids.size();
-        for (int i=0; i<sort_col.size(); i++) {
-            row_order[j++] = sort_col[i].index;
-        }
-    } else {
-        sort(sort_col.begin(), sort_col.end(),
-             index_pair<T>::greater_than);
-        for (int i=0; i<sort_col.size(); i++) {
-            row_order[i] = sort_col[i].index;
-        }
-        j = 0;
-        for (int i=sort_col.size(); i<rows; i++) {
-            row_order[i] = undef_ids[j++];
-        }
-    }
+	int tm=time_state->GetCurrTime();
+	table_query->Sort(sort_keys, tm, row_order);
+	sorting_col = sort_keys[0].col;
+	sorting_ascending = sort_keys[0].ascending;
 }
 
 void TableBase::SortByCol(int col, bool ascending)
@@ -715,33 +669,52 @@ void TableBase::SortByCol(int col, bool ascending)
 		}
 		return;
 	}
-	sorting_ascending = ascending;
-	sorting_col = col;
-	int rows = GetNumberRows();
-	
-	int tm=time_state->GetCurrTime();
-	switch (table_int->GetColType(col)) {
-		case GdaConst::date_type:
-		case GdaConst::time_type:
-		case GdaConst::datetime_type:
-		case GdaConst::long64_type:
-		{
-            SortColumn<wxInt64>(col, tm, ascending);
-		}
-			break;
-		case GdaConst::double_type:
-		{
-            SortColumn<double>(col, tm, ascending);
+	sort_keys.clear();
+	sort_keys.push_back(TableSortKey(col, ascending));
+	ApplySortKeys();
+}
+
+void TableBase::AddSortKey(int col, bool ascending)
+{
+	if (col == -1) return;
+	if (sort_keys.empty()) {
+		SortByCol(col, ascending);
+		return;
+	}
+	bool found = false;
+	for (size_t i=0; i<sort_keys.size(); i++) {
+		if (sort_keys[i].col == col) {
+			sort_keys[i].ascending = ascending;
+			found = true;
 		}
-			break;
-		case GdaConst::string_type:
-		{
-            SortColumn<wxString>(col, tm, ascending);
+	}
+	if (!found) sort_keys.push_back(TableSortKey(col, ascending));
+	ApplySortKeys();
+}
+
+bool TableBase::SelectByFilter(const std::vector<TableFilter>& filters,
+							   FilterSelectMode mode,
+							   std::map<wxString, wxString>* meta_data)
+{
+	std::vector<bool> matched;
+	table_query->Filter(filters, matched);
+	
+	bool selection_changed = false;
+	for (int i=0; i<rows && i<(int)matched.size(); i++) {
+		bool sel = matched[i];
+		if (mode == filter_add_select) sel = sel || hs[i];
+		else if (mode == filter_sub_select) sel = sel && hs[i];
+		if (hs[i] != sel) {
+			hs[i] = sel;
+			selection_changed = true;
 		}
-			break;
-		default:
-			break;
 	}
+	if (selection_changed) {
+		if (meta_data) highlight_state->SetMetaData(*meta_data);
+		highlight_state->SetEventType(HLStateInt::delta);
+		highlight_state->notifyObservers();
+	}
+	return selection_changed;
 }
 
 void TableBase::MoveSelectedToTop()
@@ -760,6 +733,7 @@ void TableBase::MoveSelectedToTop()
 		}
 	}
 	sorting_col = -1;
+	sort_keys.clear();
 	if (GetView()) GetView()->Refresh();
 }
 
@@ -826,6 +800,7 @@ void TableBase::SetValue(int row, int col, const wxString &value)
 	int curr_ts = (table_int->IsColTimeVariant(col) ?
 				   time_state->GetCurrTime() : 0);
 	table_int->SetCellFromString(row_order[row], col, curr_ts, value);
+	table_query->InvalidateCol(col);
     if (project->GetSaveButtonManager()) {
 		project->GetSaveButtonManager()->SetMetaDataSaveNeeded(true);
 	}
@@ -860,8 +835,11 @@ wxString TableBase::GetColLabelValue(int col)
 		label << ")";
 	}
 	
-	if (col == sorting_col) {
-        label << (sorting_ascending ? " >" : " <");
+	for (size_t i=0; i<sort_keys.size(); i++) {
+		if (sort_keys[i].col != col) continue;
+		label << (sort_keys[i].ascending ? " >" : " <");
+		// show the key position when sorting by several columns
+		if (sort_keys.size() > 1) label << (int) i+1;
 	}
 	return label;
 }
@@ -877,12 +855,23 @@ void TableBase::update(HLStateInt* o)
 void TableBase::update(TableState* o)
 {
 	using namespace std;
+	if (o->GetEventType() == TableState::col_data_change &&
+		o->GetModifiedColPos() >= 0) {
+		table_query->InvalidateCol(o->GetModifiedColPos());
+	} else if (o->GetEventType() != TableState::col_rename &&
+			   o->GetEventType() != TableState::col_order_change &&
+			   o->GetEventType() != TableState::col_disp_decimals_change) {
+		table_query->InvalidateAll();
+	}
 	if (!GetView()) return;
 	
 	if (o->GetEventType() == TableState::cols_delta) {
 		BOOST_FOREACH(const TableDeltaEntry& e, o->GetTableDeltaListRef()) {
 			if (e.insert) {
 				if (e.pos_at_op <= sorting_col) sorting_col++;
+				for (size_t i=0; i<sort_keys.size(); i++) {
+					if (e.pos_at_op <= sort_keys[i].col) sort_keys[i].col++;
+				}
 				wxGridTableMessage msg(this, wxGRIDTABLE_NOTIFY_COLS_INSERTED,
 									   e.pos_at_op, 1);
 				GetView()->ProcessTableMessage(msg);
@@ -890,8 +879,17 @@ void TableBase::update(TableState* o)
 				if (e.pos_at_op == sorting_col) { 
 					sorting_col = -1;
                     sorting_ascending = true;
+					sort_keys.clear();
                 }
 				if (e.pos_at_op < sorting_col) sorting_col--;
+				for (size_t i=0; i<sort_keys.size(); ) {
+					if (sort_keys[i].col == e.pos_at_op) {
+						sort_keys.erase(sort_keys.begin() + i);
+						continue;
+					}
+					if (e.pos_at_op < sort_keys[i].col) sort_keys[i].col--;
+					i++;
+				}
 				
 				wxGridTableMessage msg(this, wxGRIDTABLE_NOTIFY_COLS_DELETED,
 									   e.pos_at_op, 1);
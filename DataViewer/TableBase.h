@@ -20,11 +20,13 @@
 #ifndef __GEODA_CENTER_TABLE_BASE_H__
 #define __GEODA_CENTER_TABLE_BASE_H__
 
+#include <map>
 #include <vector>
 #include <wx/grid.h>
 #include "../HighlightStateObserver.h"
 #include "TableStateObserver.h"
 #include "TimeStateObserver.h"
+#include "TableQuery.h"
 
 class Project;
 class TableInterface;
@@ -183,6 +185,20 @@ public:
 	virtual void SortByDefaultAscending();
 	virtual void SortByDefaultDecending();
 	virtual void SortByCol(int col, bool ascending);
+	/** Add col as the next sort key, or change its direction if it is
+	 already a key.  The primary key is set by SortByCol. */
+	virtual void AddSortKey(int col, bool ascending);
+	virtual const std::vector<TableSortKey>& GetSortKeys() { return sort_keys; }
+	enum FilterSelectMode { filter_new_select, filter_add_select,
+		filter_sub_select };
+	/** Select the rows that satisfy all filters.  filter_new_select replaces
+	 the current selection, filter_add_select adds the matched rows to it and
+	 filter_sub_select keeps only the selected rows that match.  If
+	 meta_data is given, it is attached to the highlight event.  Returns
+	 true if the selection changed. */
+	virtual bool SelectByFilter(const std::vector<TableFilter>& filters,
+								FilterSelectMode mode=filter_new_select,
+						std::map<wxString, wxString>* meta_data=0);
 	virtual void MoveSelectedToTop();
 	virtual bool IsSortedAscending() { return sorting_ascending; }
 	virtual int GetSortingCol() { return sorting_col; }
@@ -219,12 +235,11 @@ public:
 	
     void UpdateStatusBar();
    
-    template <class T>
-    void SortColumn(int col, int tm, bool ascending);
-    
     std::vector<int> GetRowOrder();
     
 protected:
+	void ApplySortKeys();
+
 	HighlightState* highlight_state;
 	std::vector<bool>& hs; //shortcut to HighlightState::highlight, read only!
     std::vector<bool> hs_col;
@@ -239,6 +254,8 @@ protected:
 	std::vector<int> row_order;
 	int sorting_col;
 	bool sorting_ascending;
+	std::vector<TableSortKey> sort_keys; // sort_keys[0] is sorting_col
+	TableQuery* table_query;
 	std::list<int> anchor_row_stack;
 	std::list<int> anchor_col_stack;
 };
@@ -503,7 +503,16 @@ void TableFrame::OnLabelLeftDClickEvent( wxGridEvent& ev)
 	if (col >= 0 && row < 0) {
 		int sort_col = table_base->GetSortingCol();
 		bool ascending = table_base->IsSortedAscending();
-		if (sort_col == col) {
+		if (ev.ShiftDown() && sort_col >= 0 && sort_col != col) {
+			// shift + double-click adds a secondary sort key or toggles
+			// its direction
+			bool key_ascending = true;
+			const std::vector<TableSortKey>& keys = table_base->GetSortKeys();
+			for (size_t i=0; i<keys.size(); i++) {
+				if (keys[i].col == col) key_ascending = !keys[i].ascending;
+			}
+			table_base->AddSortKey(col, key_ascending);
+		} else if (sort_col == col) {
 			if (!ascending) {
 				table_base->SortByDefaultDecending();
 			} else {
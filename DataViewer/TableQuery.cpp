@@ -0,0 +1,517 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+
+#include "../Algorithms/threadpool.h"
+#include "TableInterface.h"
+#include "TableQuery.h"
+
+using boost::uint64_t;
+
+// fewer rows than this per thread are handled by a single thread
+static const int MIN_ROWS_PER_THREAD = 50000;
+
+// Map a value to an unsigned key with the same ordering
+static uint64_t ToRadixKey(double v)
+{
+	uint64_t u;
+	std::memcpy(&u, &v, sizeof(u));
+	const uint64_t sign = (uint64_t)1 << 63;
+	return (u & sign) ? ~u : (u | sign);
+}
+
+static uint64_t ToRadixKey(wxInt64 v)
+{
+	return (uint64_t)v ^ ((uint64_t)1 << 63);
+}
+
+static void RadixHistogram(const uint64_t* keys, int shift, size_t* hist,
+						   size_t a, size_t b)
+{
+	for (size_t i=a; i<b; i++) hist[(keys[i] >> shift) & 0xFF] += 1;
+}
+
+static void RadixScatter(const uint64_t* keys, const int* ids,
+						 uint64_t* keys_out, int* ids_out,
+						 int shift, size_t* offsets, size_t a, size_t b)
+{
+	for (size_t i=a; i<b; i++) {
+		size_t pos = offsets[(keys[i] >> shift) & 0xFF]++;
+		keys_out[pos] = keys[i];
+		ids_out[pos] = ids[i];
+	}
+}
+
+/** Stable LSD radix sort of ids by keys, 8 bits per pass.  Each thread
+ counts and scatters its own chunk; passes where all keys share the same
+ digit are skipped. */
+static void RadixSort(std::vector<uint64_t>& keys, std::vector<int>& ids)
+{
+	size_t n = keys.size();
+	if (n < 2) return;
+	int n_threads = num_range_threads((int)n, MIN_ROWS_PER_THREAD);
+	std::vector<uint64_t> keys_tmp(n);
+	std::vector<int> ids_tmp(n);
+	std::vector<size_t> hist(n_threads * 256);
+
+	for (int shift=0; shift<64; shift+=8) {
+		std::fill(hist.begin(), hist.end(), 0);
+		if (n_threads == 1) {
+			RadixHistogram(&keys[0], shift, &hist[0], 0, n);
+		} else {
+			boost::thread_group threadPool;
+			for (int t=0; t<n_threads; t++) {
+				int a, b;
+				split_range((int)n, n_threads, t, a, b);
+				b += 1;
+				threadPool.create_thread(boost::bind(&RadixHistogram,
+													 &keys[0], shift,
+													 &hist[t*256], a, b));
+			}
+			threadPool.join_all();
+		}
+		// exclusive prefix sum over (digit, thread)
+		bool skip = false;
+		size_t total = 0;
+		for (int d=0; d<256 && !skip; d++) {
+			size_t cnt = 0;
+			for (int t=0; t<n_threads; t++) cnt += hist[t*256 + d];
+			if (cnt == n) skip = true;
+		}
+		if (skip) continue;
+		for (int d=0; d<256; d++) {
+			for (int t=0; t<n_threads; t++) {
+				size_t c = hist[t*256 + d];
+				hist[t*256 + d] = total;
+				total += c;
+			}
+		}
+		if (n_threads == 1) {
+			RadixScatter(&keys[0], &ids[0], &keys_tmp[0], &ids_tmp[0],
+						 shift, &hist[0], 0, n);
+		} else {
+			boost::thread_group threadPool;
+			for (int t=0; t<n_threads; t++) {
+				int a, b;
+				split_range((int)n, n_threads, t, a, b);
+				b += 1;
+				threadPool.create_thread(boost::bind(&RadixScatter,
+													 &keys[0], &ids[0],
+													 &keys_tmp[0], &ids_tmp[0],
+													 shift, &hist[t*256],
+													 a, b));
+			}
+			threadPool.join_all();
+		}
+		keys.swap(keys_tmp);
+		ids.swap(ids_tmp);
+	}
+}
+
+template <class T>
+struct IndexLess
+{
+	IndexLess(const std::vector<T>& _vals) : vals(_vals) {}
+	bool operator()(int i, int j) const { return vals[i] < vals[j]; }
+	const std::vector<T>& vals;
+};
+
+template <class T>
+static void SortChunk(const std::vector<T>* vals, int* ids, size_t a, size_t b)
+{
+	std::stable_sort(ids + a, ids + b, IndexLess<T>(*vals));
+}
+
+template <class T>
+static void MergeChunks(const std::vector<T>* vals, const int* ids, int* out,
+						size_t a, size_t m, size_t b)
+{
+	std::merge(ids + a, ids + m, ids + m, ids + b, out + a,
+			   IndexLess<T>(*vals));
+}
+
+/** Stable merge sort of ids by vals: chunks are sorted in parallel, then
+ merged pairwise, one thread per pair. */
+template <class T>
+static void MergeSort(const std::vector<T>& vals, std::vector<int>& ids)
+{
+	size_t n = ids.size();
+	if (n < 2) return;
+	int n_threads = num_range_threads((int)n, MIN_ROWS_PER_THREAD);
+	if (n_threads == 1) {
+		SortChunk(&vals, &ids[0], 0, n);
+		return;
+	}
+	std::vector<size_t> bounds(n_threads + 1, n);
+	{
+		boost::thread_group threadPool;
+		for (int t=0; t<n_threads; t++) {
+			int a, b;
+			split_range((int)n, n_threads, t, a, b);
+			b += 1;
+			bounds[t] = a;
+			threadPool.create_thread(boost::bind(&SortChunk<T>, &vals,
+												 &ids[0], a, b));
+		}
+		threadPool.join_all();
+	}
+	std::vector<int> tmp(n);
+	while (bounds.size() > 2) {
+		std::vector<size_t> merged;
+		boost::thread_group threadPool;
+		size_t i = 0;
+		for (; i + 2 < bounds.size(); i += 2) {
+			merged.push_back(bounds[i]);
+			threadPool.create_thread(boost::bind(&MergeChunks<T>, &vals,
+												 &ids[0], &tmp[0], bounds[i],
+												 bounds[i+1], bounds[i+2]));
+		}
+		if (i + 2 == bounds.size()) {
+			// odd chunk left over, copy it as is
+			merged.push_back(bounds[i]);
+			std::copy(ids.begin() + bounds[i], ids.begin() + bounds[i+1],
+					  tmp.begin() + bounds[i]);
+		}
+		threadPool.join_all();
+		merged.push_back(n);
+		ids.swap(tmp);
+		bounds.swap(merged);
+	}
+}
+
+static void SortDefined(const std::vector<double>& vals, std::vector<int>& ids)
+{
+	std::vector<uint64_t> keys(ids.size());
+	for (size_t i=0; i<ids.size(); i++) keys[i] = ToRadixKey(vals[ids[i]]);
+	RadixSort(keys, ids);
+}
+
+static void SortDefined(const std::vector<wxInt64>& vals, std::vector<int>& ids)
+{
+	std::vector<uint64_t> keys(ids.size());
+	for (size_t i=0; i<ids.size(); i++) keys[i] = ToRadixKey(vals[ids[i]]);
+	RadixSort(keys, ids);
+}
+
+static void SortDefined(const std::vector<wxString>& vals,
+						std::vector<int>& ids)
+{
+	MergeSort(vals, ids);
+}
+
+template <class T>
+static void BuildSortedCol(TableInterface* table_int, int col, int time,
+						   std::vector<int>& order, std::vector<int>& rank,
+						   int& num_ranks, int& num_undefs)
+{
+	std::vector<T> vals;
+	std::vector<bool> undefs;
+	table_int->GetColData(col, time, vals, undefs);
+	size_t n = vals.size();
+
+	std::vector<int> ids;
+	ids.reserve(n);
+	order.clear();
+	order.reserve(n);
+	for (size_t i=0; i<n; i++) {
+		if (i < undefs.size() && undefs[i]) {
+			order.push_back((int)i);
+		} else {
+			ids.push_back((int)i);
+		}
+	}
+	num_undefs = (int)order.size();
+
+	SortDefined(vals, ids);
+
+	rank.assign(n, 0);
+	num_ranks = 0;
+	for (size_t i=0; i<ids.size(); i++) {
+		if (i == 0 || vals[ids[i-1]] < vals[ids[i]]) num_ranks += 1;
+		rank[ids[i]] = num_ranks;
+		order.push_back(ids[i]);
+	}
+}
+
+template <class T>
+static void FilterChunk(const std::vector<T>* x, const TableFilter* f,
+						char* out, size_t a, size_t b)
+{
+	const std::vector<T>& v = *x;
+	const double c = f->val;
+	const double c2 = f->val2;
+	switch (f->op) {
+		case TableFilter::EQ:
+			for (size_t i=a; i<b; i++) out[i] = v[i] == c;
+			break;
+		case TableFilter::NE:
+			for (size_t i=a; i<b; i++) out[i] = v[i] != c;
+			break;
+		case TableFilter::LT:
+			for (size_t i=a; i<b; i++) out[i] = v[i] < c;
+			break;
+		case TableFilter::LE:
+			for (size_t i=a; i<b; i++) out[i] = v[i] <= c;
+			break;
+		case TableFilter::GT:
+			for (size_t i=a; i<b; i++) out[i] = v[i] > c;
+			break;
+		case TableFilter::GE:
+			for (size_t i=a; i<b; i++) out[i] = v[i] >= c;
+			break;
+		case TableFilter::BETWEEN:
+			for (size_t i=a; i<b; i++) out[i] = (v[i] >= c) & (v[i] <= c2);
+			break;
+		default:
+			for (size_t i=a; i<b; i++) out[i] = 0;
+			break;
+	}
+}
+
+static void FilterChunk(const std::vector<wxString>* x, const TableFilter* f,
+						char* out, size_t a, size_t b)
+{
+	const std::vector<wxString>& v = *x;
+	const wxString& c = f->str_val;
+	switch (f->op) {
+		case TableFilter::EQ:
+			for (size_t i=a; i<b; i++) out[i] = v[i] == c;
+			break;
+		case TableFilter::NE:
+			for (size_t i=a; i<b; i++) out[i] = v[i] != c;
+			break;
+		case TableFilter::LT:
+			for (size_t i=a; i<b; i++) out[i] = v[i] < c;
+			break;
+		case TableFilter::LE:
+			for (size_t i=a; i<b; i++) out[i] = v[i] <= c;
+			break;
+		case TableFilter::GT:
+			for (size_t i=a; i<b; i++) out[i] = v[i] > c;
+			break;
+		case TableFilter::GE:
+			for (size_t i=a; i<b; i++) out[i] = v[i] >= c;
+			break;
+		case TableFilter::CONTAINS:
+			for (size_t i=a; i<b; i++) out[i] = v[i].Find(c) != wxNOT_FOUND;
+			break;
+		default:
+			for (size_t i=a; i<b; i++) out[i] = 0;
+			break;
+	}
+}
+
+template <class T>
+static void FilterValues(TableInterface* table_int, const TableFilter& f,
+						 std::vector<char>& matched)
+{
+	std::vector<T> vals;
+	std::vector<bool> undefs;
+	table_int->GetColData(f.col, f.time, vals, undefs);
+	size_t n = vals.size();
+	matched.resize(n);
+	if (n == 0) return;
+
+	if (f.op == TableFilter::IS_UNDEFINED || f.op == TableFilter::IS_DEFINED) {
+		bool want = f.op == TableFilter::IS_UNDEFINED;
+		for (size_t i=0; i<n; i++) {
+			bool undef = i < undefs.size() && undefs[i];
+			matched[i] = undef == want;
+		}
+		return;
+	}
+
+	int n_threads = num_range_threads((int)n, MIN_ROWS_PER_THREAD);
+	if (n_threads == 1) {
+		FilterChunk(&vals, &f, &matched[0], 0, n);
+	} else {
+		void (*chunk_fn)(const std::vector<T>*, const TableFilter*, char*,
+						 size_t, size_t) = &FilterChunk;
+		boost::thread_group threadPool;
+		for (int t=0; t<n_threads; t++) {
+			int a, b;
+			split_range((int)n, n_threads, t, a, b);
+			b += 1;
+			threadPool.create_thread(boost::bind(chunk_fn, &vals, &f,
+												 &matched[0], a, b));
+		}
+		threadPool.join_all();
+	}
+	// undefined values never satisfy a comparison
+	for (size_t i=0; i<undefs.size() && i<n; i++) {
+		if (undefs[i]) matched[i] = 0;
+	}
+}
+
+TableQuery::TableQuery(TableInterface* _table_int)
+: table_int(_table_int)
+{
+}
+
+TableQuery::~TableQuery()
+{
+}
+
+void TableQuery::InvalidateCol(int col)
+{
+	std::map<std::pair<int, int>, SortedCol>::iterator it = sort_cache.begin();
+	while (it != sort_cache.end()) {
+		if (it->first.first == col) {
+			sort_cache.erase(it++);
+		} else {
+			++it;
+		}
+	}
+}
+
+void TableQuery::InvalidateAll()
+{
+	sort_cache.clear();
+}
+
+const TableQuery::SortedCol& TableQuery::GetSortedCol(int col, int time)
+{
+	std::pair<int, int> key(col, time);
+	std::map<std::pair<int, int>, SortedCol>::iterator it;
+	it = sort_cache.find(key);
+	if (it != sort_cache.end()) return it->second;
+
+	SortedCol& sc = sort_cache[key];
+	sc.num_ranks = 0;
+	sc.num_undefs = 0;
+	switch (table_int->GetColType(col)) {
+		case GdaConst::date_type:
+		case GdaConst::time_type:
+		case GdaConst::datetime_type:
+		case GdaConst::long64_type:
+			BuildSortedCol<wxInt64>(table_int, col, time, sc.order, sc.rank,
+									sc.num_ranks, sc.num_undefs);
+			break;
+		case GdaConst::double_type:
+			BuildSortedCol<double>(table_int, col, time, sc.order, sc.rank,
+								   sc.num_ranks, sc.num_undefs);
+			break;
+		case GdaConst::string_type:
+			BuildSortedCol<wxString>(table_int, col, time, sc.order, sc.rank,
+									 sc.num_ranks, sc.num_undefs);
+			break;
+		default:
+		{
+			// not sortable: keep the natural order, all values tie
+			int n = table_int->GetNumberRows();
+			sc.order.resize(n);
+			sc.rank.assign(n, 1);
+			for (int i=0; i<n; i++) sc.order[i] = i;
+			sc.num_ranks = n > 0 ? 1 : 0;
+		}
+			break;
+	}
+	return sc;
+}
+
+void TableQuery::Sort(const std::vector<TableSortKey>& keys, int time,
+					  std::vector<int>& row_order)
+{
+	int n = table_int->GetNumberRows();
+	row_order.resize(n);
+	if (keys.empty()) {
+		for (int i=0; i<n; i++) row_order[i] = i;
+		return;
+	}
+
+	if (keys.size() == 1) {
+		const SortedCol& sc = GetSortedCol(keys[0].col, time);
+		if (keys[0].ascending) {
+			row_order = sc.order;
+		} else {
+			// defined values descending, then undefined values
+			int j = 0;
+			for (int i=n-1; i>=sc.num_undefs; i--) row_order[j++] = sc.order[i];
+			for (int i=0; i<sc.num_undefs; i++) row_order[j++] = sc.order[i];
+		}
+		return;
+	}
+
+	// stable counting sort on the ranks, least significant key first
+	std::vector<int> tmp(n);
+	std::vector<int> counts;
+	for (int i=0; i<n; i++) row_order[i] = i;
+	for (int k=(int)keys.size()-1; k>=0; k--) {
+		const SortedCol& sc = GetSortedCol(keys[k].col, time);
+		int R = sc.num_ranks;
+		bool asc = keys[k].ascending;
+		counts.assign(R + 3, 0);
+		for (int i=0; i<n; i++) {
+			int r = sc.rank[i];
+			int key = asc ? r : (r == 0 ? R + 1 : R + 1 - r);
+			counts[key + 1] += 1;
+		}
+		for (int b=1; b<(int)counts.size(); b++) counts[b] += counts[b-1];
+		for (int i=0; i<n; i++) {
+			int row = row_order[i];
+			int r = sc.rank[row];
+			int key = asc ? r : (r == 0 ? R + 1 : R + 1 - r);
+			tmp[counts[key]++] = row;
+		}
+		row_order.swap(tmp);
+	}
+}
+
+void TableQuery::FilterCol(const TableFilter& f, std::vector<char>& matched)
+{
+	switch (table_int->GetColType(f.col)) {
+		case GdaConst::date_type:
+		case GdaConst::time_type:
+		case GdaConst::datetime_type:
+		case GdaConst::long64_type:
+			FilterValues<wxInt64>(table_int, f, matched);
+			break;
+		case GdaConst::double_type:
+			FilterValues<double>(table_int, f, matched);
+			break;
+		case GdaConst::string_type:
+			FilterValues<wxString>(table_int, f, matched);
+			break;
+		default:
+			matched.assign(table_int->GetNumberRows(), 0);
+			break;
+	}
+}
+
+void TableQuery::Filter(const std::vector<TableFilter>& filters,
+						std::vector<bool>& matched)
+{
+	int n = table_int->GetNumberRows();
+	std::vector<char> result(n, 1);
+	std::vector<char> col_result;
+	for (size_t k=0; k<filters.size(); k++) {
+		FilterCol(filters[k], col_result);
+		for (int i=0; i<n && i<(int)col_result.size(); i++) {
+			result[i] &= col_result[i];
+		}
+	}
+	matched.resize(n);
+	for (int i=0; i<n; i++) matched[i] = result[i] != 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_TABLE_QUERY_H__
+#define __GEODA_CENTER_TABLE_QUERY_H__
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <wx/string.h>
+
+class TableInterface;
+
+struct TableSortKey
+{
+	TableSortKey(int _col=-1, bool _ascending=true)
+	: col(_col), ascending(_ascending) {}
+
+	int col;
+	bool ascending;
+};
+
+struct TableFilter
+{
+	enum Operator {
+		EQ, NE, LT, LE, GT, GE,
+		BETWEEN, // val <= x <= val2
+		CONTAINS, // string columns only
+		IS_UNDEFINED, IS_DEFINED
+	};
+
+	TableFilter(int _col=-1, int _time=0, Operator _op=EQ,
+				double _val=0, double _val2=0)
+	: col(_col), time(_time), op(_op), val(_val), val2(_val2) {}
+
+	int col;
+	int time;
+	Operator op;
+	double val;
+	double val2;
+	wxString str_val; // compared against string columns
+};
+
+/**
+ * Sorting and filtering of the rows of a TableInterface for the data table.
+ *
+ * Sorting a column produces an ascending permutation (undefined values
+ * first) and a dense rank per row.  Both are cached per (col, time) until
+ * InvalidateCol() or InvalidateAll() is called, so toggling the direction
+ * or re-sorting an unchanged column does not touch the data again.  A sort
+ * on several keys is done with one stable counting sort per key over the
+ * cached ranks, least significant key first.
+ *
+ * Numeric columns are sorted with an LSD radix sort and string columns
+ * with a merge sort; filters are evaluated over the typed column arrays.
+ * All three split the rows over the available cores.
+ */
+class TableQuery
+{
+public:
+	TableQuery(TableInterface* table_int);
+	virtual ~TableQuery();
+
+	/** Fill row_order with the rows sorted by keys (first key is the
+	 primary key).  Undefined values are placed first in ascending order and
+	 last in descending order. */
+	void Sort(const std::vector<TableSortKey>& keys, int time,
+			  std::vector<int>& row_order);
+
+	/** Evaluate the conjunction of all filters.  matched[i] is true if row i
+	 satisfies every filter.  Undefined values never satisfy a comparison. */
+	void Filter(const std::vector<TableFilter>& filters,
+				std::vector<bool>& matched);
+
+	void InvalidateCol(int col);
+	void InvalidateAll();
+
+protected:
+	struct SortedCol {
+		std::vector<int> order; // ascending, undefined first
+		std::vector<int> rank; // 0 for undefined, 1..num_ranks for values
+		int num_ranks;
+		int num_undefs;
+	};
+
+	const SortedCol& GetSortedCol(int col, int time);
+
+	void FilterCol(const TableFilter& filter, std::vector<char>& matched);
+
+	TableInterface* table_int;
+
+	std::map<std::pair<int, int>, SortedCol> sort_cache;
+};
+
+#endif
@@ -1524,9 +1524,10 @@ void CreatingWeightDlg::CreateWeights()
             wmi.SetToQueen(id, m_ooC, m_check1);
         }
         if (user_xy) {
-            std::vector<std::set<int> > nbr_map;
-            Gda::VoronoiUtils::PointsToContiguity(m_XCOO, m_YCOO, false, nbr_map);
-            Wp->gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_map);
+            std::vector<int> nbr_start, nbr_ids;
+            Gda::VoronoiUtils::PointsToContiguity(m_XCOO, m_YCOO, false,
+                                                  nbr_start, nbr_ids);
+            Wp->gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_start, nbr_ids);
             if (!Wp->gal) {
                 wxString msg = _("There was a problem generating voronoi contiguity neighbors. Please report this.");
                 wxMessageDialog dlg(NULL, msg, _("Voronoi Contiguity Error"),
@@ -1540,13 +1541,13 @@ void CreatingWeightDlg::CreateWeights()
                 project->DisplayPointDupsWarning();
             }
             
-            std::vector<std::set<int> > nbr_map;
+            std::vector<int> nbr_start, nbr_ids;
             if (is_rook) {
-                project->GetVoronoiRookNeighborMap(nbr_map);
+                project->GetVoronoiRookNeighborMap(nbr_start, nbr_ids);
             } else {
-                project->GetVoronoiQueenNeighborMap(nbr_map);
+                project->GetVoronoiQueenNeighborMap(nbr_start, nbr_ids);
             }
-            Wp->gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_map);
+            Wp->gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_start, nbr_ids);
             if (!Wp->gal) {
                 wxString msg = _("There was a problem generating voronoi contiguity neighbors. Please report this.");
                 wxMessageDialog dlg(NULL, msg, _("Voronoi Contiguity Error"),
@@ -509,11 +509,8 @@ bool DBScanDlg::RunStar()
     }
         
     std::vector<double> core_dist = Gda::HDBScan::ComputeCoreDistance(data, rows, columns, m_min_samples, dist);
-    int transpose = 0; // row wise
-    double** raw_dist = distancematrix(rows, columns, data,  mask, weight, dist, transpose);
-    RawDistMatrix dist_matrix(raw_dist);
     double alpha = 1.0;
-    std::vector<Gda::SimpleEdge*> mst_edges = Gda::HDBScan::mst_linkage_core_vector(columns, core_dist, &dist_matrix, alpha);
+    std::vector<Gda::SimpleEdge*> mst_edges = Gda::HDBScan::mst_linkage_core_kdtree(data, rows, columns, dist, core_dist, alpha);
     std::vector<TreeNode> tree(rows-1);
     Gda::UnionFind U(rows);
     for (int i=0; i<mst_edges.size(); i++) {
@@ -480,17 +480,6 @@ bool HClusterDlg::Run(vector<wxInt64>& clusters)
     // get input: weights (auto)
     weight = GetWeights(columns);
 
-    double* pwdist = NULL;
-    if (dist == 'e') {
-        pwdist = DataUtils::getPairWiseDistance(input_data, weight, rows,
-                                                columns,
-                                                DataUtils::EuclideanDistance);
-    } else {
-        pwdist = DataUtils::getPairWiseDistance(input_data, weight, rows,
-                                                columns,
-                                                DataUtils::ManhattanDistance);
-    }
-
     fastcluster::auto_array_ptr<t_index> members;
     if (htree != NULL) {
         delete[] htree;
@@ -499,19 +488,36 @@ bool HClusterDlg::Run(vector<wxInt64>& clusters)
     htree = new GdaNode[rows-1];
     fastcluster::cluster_result Z2(rows-1);
 
-    if (method == 's') {
-        fastcluster::MST_linkage_core(rows, pwdist, Z2);
-    } else if (method == 'w') {
-        members.init(rows, 1);
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_WARD, t_index>(rows, pwdist, members, Z2);
-    } else if (method == 'm') {
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_COMPLETE, t_index>(rows, pwdist, NULL, Z2);
-    } else if (method == 'a') {
-        members.init(rows, 1);
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_AVERAGE, t_index>(rows, pwdist, members, Z2);
-    }
+    if (method == 's' || (method == 'w' && dist == 'e')) {
+        // single and ward linkage work on the observations directly:
+        // O(n*k) memory instead of the n*(n-1)/2 distance array
+        RunVectorLinkage(Z2);
+    } else {
+        double* pwdist = NULL;
+        if (dist == 'e') {
+            pwdist = DataUtils::getPairWiseDistance(input_data, weight, rows,
+                                                    columns,
+                                                    DataUtils::EuclideanDistance);
+        } else {
+            pwdist = DataUtils::getPairWiseDistance(input_data, weight, rows,
+                                                    columns,
+                                                    DataUtils::ManhattanDistance);
+        }
+
+        if (method == 's') {
+            fastcluster::MST_linkage_core(rows, pwdist, Z2);
+        } else if (method == 'w') {
+            members.init(rows, 1);
+            fastcluster::NN_chain_core<fastcluster::METHOD_METR_WARD, t_index>(rows, pwdist, members, Z2);
+        } else if (method == 'm') {
+            fastcluster::NN_chain_core<fastcluster::METHOD_METR_COMPLETE, t_index>(rows, pwdist, NULL, Z2);
+        } else if (method == 'a') {
+            members.init(rows, 1);
+            fastcluster::NN_chain_core<fastcluster::METHOD_METR_AVERAGE, t_index>(rows, pwdist, members, Z2);
+        }
 
-    delete[] pwdist;
+        delete[] pwdist;
+    }
 
     std::stable_sort(Z2[0], Z2[rows-1]);
     t_index node1, node2;
@@ -549,6 +555,55 @@ bool HClusterDlg::Run(vector<wxInt64>& clusters)
 }
 
 
+void HClusterDlg::RunVectorLinkage(fastcluster::cluster_result& Z2)
+{
+    // row-major copy of the data with the weights folded in, so that the
+    // squared euclidean (or manhattan) distance between two rows equals
+    // DataUtils::EuclideanDistance (or ManhattanDistance) used by the
+    // distance array
+    std::vector<t_float> X((size_t)rows * columns);
+    for (int i=0; i<rows; i++) {
+        for (int j=0; j<columns; j++) {
+            double w = 1.0;
+            if (weight) w = dist == 'e' ? sqrt(weight[j]) : weight[j];
+            X[(size_t)i * columns + j] = input_data[i][j] * w;
+        }
+    }
+
+    if (method == 's') {
+        fastcluster::python_dissimilarity dissim(&X[0], rows, columns, NULL,
+                                         fastcluster::METHOD_METR_SINGLE,
+                                         dist == 'e' ?
+                                         fastcluster::METRIC_SQEUCLIDEAN :
+                                         fastcluster::METRIC_CITYBLOCK,
+                                         false);
+        fastcluster::MST_linkage_core_vector(rows, dissim, Z2);
+        return;
+    }
+
+    // ward
+    fastcluster::auto_array_ptr<t_index> members(rows, 1);
+    fastcluster::python_dissimilarity dissim(&X[0], rows, columns, members,
+                                             fastcluster::METHOD_METR_WARD,
+                                             fastcluster::METRIC_EUCLIDEAN,
+                                             false);
+    fastcluster::generic_linkage_vector<fastcluster::METHOD_METR_WARD>(rows, dissim, Z2);
+    // the vector version reports half of the Lance-Williams value used by
+    // NN_chain_core on squared distances
+    Z2.multiply(2);
+
+    // the nodes are labelled as clusters (n+i for the i-th merge): use a
+    // member observation of each cluster instead, as the other cores do
+    std::vector<t_index> repr(2*rows-1);
+    for (int i=0; i<rows; i++) repr[i] = i;
+    for (int i=0; i<rows-1; i++) {
+        fastcluster::node* nd = Z2[i];
+        nd->node1 = repr[nd->node1];
+        nd->node2 = repr[nd->node2];
+        repr[rows+i] = nd->node2;
+    }
+}
+
 void HClusterDlg::OnOKClick(wxCommandEvent& event )
 {
     wxLogMessage("Click HClusterDlg::OnOK");
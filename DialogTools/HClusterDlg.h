@@ -30,6 +30,7 @@
 
 struct GdaNode;
 class Project;
+namespace fastcluster { class cluster_result; }
 class TableInterface;
 
 class RectNode
@@ -275,6 +276,10 @@ protected:
     virtual bool Run(vector<wxInt64>& clusters);
     virtual bool CheckAllInputs();
 
+    // single and ward (euclidean) linkage from the observations, without
+    // the pairwise distance array
+    void RunVectorLinkage(fastcluster::cluster_result& Z2);
+
     GdaNode* htree;
     int n_cluster;
     char dist;
@@ -483,21 +483,15 @@ bool HDBScanDlg::Run(vector<wxInt64>& clusters)
     // compute core distances
     core_dist = Gda::HDBScan::ComputeCoreDistance(data, rows, columns, m_min_samples, dist);
 
-    // compute raw distance matrix: lower triangular part
-    int transpose = 0; // row wise
-    char dist = 'b'; // city-block
-    if (m_distance->GetSelection()== 0) dist = 'e';
-    double** raw_dist = distancematrix(rows, columns, data,  mask, weight, dist, transpose);
-    RawDistMatrix dist_matrix(raw_dist);
-
-    for (int i=0; i<rows; i++) delete[] data[i];
-    delete[] data;
-
-    // call HDBScan
+    // call HDBScan: the minimum spanning tree is built from a kd-tree, no
+    // distance matrix is needed
     Gda::HDBScan hdb(m_min_pts, m_min_samples, m_alpha,
                      m_cluster_selection_method,
                      m_allow_single_cluster, rows, columns,
-                     &dist_matrix, core_dist, undefs);
+                     data, dist, core_dist, undefs);
+
+    for (int i=0; i<rows; i++) delete[] data[i];
+    delete[] data;
     cluster_ids = hdb.GetRegions();
     probabilities = hdb.probabilities;
     outliers = hdb.outliers;
@@ -527,10 +521,6 @@ bool HDBScanDlg::Run(vector<wxInt64>& clusters)
     // Setup condensed tree
     m_condensedtree->Setup(hdb.condensed_tree, hdb.clusters);
     
-    // clean raw dist
-    for (int i=1; i<rows; i++) delete[] raw_dist[i];
-    delete[] raw_dist;
-
     int ncluster = (int)cluster_ids.size();
 
     // sort cluster ids by size
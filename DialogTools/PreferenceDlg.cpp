@@ -118,7 +118,7 @@ void PreferenceDlg::Init()
 	vis_page->SetBackgroundColour(*wxWHITE);
 #endif
 	notebook->AddPage(vis_page, _("System"));
-	wxFlexGridSizer* grid_sizer1 = new wxFlexGridSizer(22, 2, 8, 10);
+	wxFlexGridSizer* grid_sizer1 = new wxFlexGridSizer(23, 2, 8, 10);
 
 	grid_sizer1->Add(new wxStaticText(vis_page, wxID_ANY, _("Maps:")), 1);
 	grid_sizer1->AddSpacer(10);
@@ -210,6 +210,13 @@ void PreferenceDlg::Init()
     cbox_lbl->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnDrawLabels, this);
     txt_lbl_font->Bind(wxEVT_COMMAND_TEXT_UPDATED, &PreferenceDlg::OnLabelFontSizeEnter, this);
 
+    wxString lbl30 = _("Render maps on all CPU cores (tiled renderer):");
+    wxStaticText* lbl_txt30 = new wxStaticText(vis_page, wxID_ANY, lbl30);
+    cbox_tiled = new wxCheckBox(vis_page, XRCID("PREF_USE_TILED_RENDERER"), "", pos);
+    grid_sizer1->Add(lbl_txt30, 1, wxEXPAND);
+    grid_sizer1->Add(cbox_tiled, 0, wxALIGN_RIGHT);
+    cbox_tiled->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnUseTiledRenderer, this);
+
 	grid_sizer1->Add(new wxStaticText(vis_page, wxID_ANY, _("Plots:")), 1,
                      wxTOP | wxBOTTOM, 10);
 	grid_sizer1->AddSpacer(10);
@@ -419,6 +426,13 @@ void PreferenceDlg::Init()
     grid_sizer2->Add(cbox_csvt, 0, wxALIGN_RIGHT);
     cbox_csvt->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnCreateCSVT, this);
 
+    wxString lbl29 = _("Cache geometries for faster reopening of files:");
+    wxStaticText* lbl_txt29 = new wxStaticText(gdal_page, wxID_ANY, lbl29);
+    cbox_snapshot = new wxCheckBox(gdal_page, wxID_ANY, "", pos);
+    grid_sizer2->Add(lbl_txt29, 1, wxEXPAND);
+    grid_sizer2->Add(cbox_snapshot, 0, wxALIGN_RIGHT);
+    cbox_snapshot->Bind(wxEVT_CHECKBOX, &PreferenceDlg::OnUseGeomSnapshot, this);
+
     grid_sizer2->Add(new wxStaticText(gdal_page, wxID_ANY, _("Clustering:")), 1, wxTOP, 10);
     grid_sizer2->AddSpacer(10);
 
@@ -477,6 +491,8 @@ void PreferenceDlg::Init()
 void PreferenceDlg::OnReset(wxCommandEvent& ev)
 {
     GdaConst::gda_create_csvt = false;
+    GdaConst::gda_use_geom_snapshot = false;
+    GdaConst::gda_use_tiled_renderer = false;
     GdaConst::gda_use_gpu = false;
     GdaConst::gda_ui_language = 0;
     GdaConst::gda_eigen_tol = 1.0E-8;
@@ -547,6 +563,8 @@ void PreferenceDlg::OnReset(wxCommandEvent& ev)
     ogr_adapt.AddEntry("gda_autoweight_stop", "0.0001");
     ogr_adapt.AddEntry("gda_enable_set_transparency_windows", "0");
     ogr_adapt.AddEntry("gda_create_csvt", "0");
+    ogr_adapt.AddEntry("gda_use_geom_snapshot", "0");
+    ogr_adapt.AddEntry("gda_use_tiled_renderer", "0");
     ogr_adapt.AddEntry("gda_draw_map_labels", "0");
     ogr_adapt.AddEntry("gda_map_label_font_size", "8");
 }
@@ -604,6 +622,8 @@ void PreferenceDlg::SetupControls()
     cbox26->SetValue(GdaConst::gda_enable_set_transparency_windows);
 
     cbox_csvt->SetValue(GdaConst::gda_create_csvt);
+    cbox_snapshot->SetValue(GdaConst::gda_use_geom_snapshot);
+    cbox_tiled->SetValue(GdaConst::gda_use_tiled_renderer);
     
     cbox_lbl->SetValue(GdaConst::gda_draw_map_labels);
     wxString t_lbl_font_size;
@@ -864,6 +884,30 @@ void PreferenceDlg::ReadFromCache()
         }
     }
 
+    vector<wxString> gda_use_snapshot = ogr_adapt.GetHistory("gda_use_geom_snapshot");
+    if (!gda_use_snapshot.empty()) {
+        long sel_l = 0;
+        wxString sel = gda_use_snapshot[0];
+        if (sel.ToLong(&sel_l)) {
+            if (sel_l == 1)
+                GdaConst::gda_use_geom_snapshot = true;
+            else if (sel_l == 0)
+                GdaConst::gda_use_geom_snapshot = false;
+        }
+    }
+
+    vector<wxString> gda_use_tiled = ogr_adapt.GetHistory("gda_use_tiled_renderer");
+    if (!gda_use_tiled.empty()) {
+        long sel_l = 0;
+        wxString sel = gda_use_tiled[0];
+        if (sel.ToLong(&sel_l)) {
+            if (sel_l == 1)
+                GdaConst::gda_use_tiled_renderer = true;
+            else if (sel_l == 0)
+                GdaConst::gda_use_tiled_renderer = false;
+        }
+    }
+
     vector<wxString> gda_disp_decimals = ogr_adapt.GetHistory("gda_displayed_decimals");
     if (!gda_disp_decimals.empty()) {
         long sel_l = 0;
@@ -1309,3 +1353,27 @@ void PreferenceDlg::OnCreateCSVT(wxCommandEvent& ev)
         OGRDataAdapter::GetInstance().AddEntry("gda_create_csvt", "1");
     }
 }
+void PreferenceDlg::OnUseGeomSnapshot(wxCommandEvent& ev)
+{
+    int sel = ev.GetSelection();
+    if (sel == 0) {
+        GdaConst::gda_use_geom_snapshot = false;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_geom_snapshot", "0");
+    }
+    else {
+        GdaConst::gda_use_geom_snapshot = true;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_geom_snapshot", "1");
+    }
+}
+void PreferenceDlg::OnUseTiledRenderer(wxCommandEvent& ev)
+{
+    int sel = ev.GetSelection();
+    if (sel == 0) {
+        GdaConst::gda_use_tiled_renderer = false;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_tiled_renderer", "0");
+    }
+    else {
+        GdaConst::gda_use_tiled_renderer = true;
+        OGRDataAdapter::GetInstance().AddEntry("gda_use_tiled_renderer", "1");
+    }
+}
@@ -117,6 +117,10 @@ protected:
     wxCheckBox* cbox26;
     // csvt
     wxCheckBox* cbox_csvt;
+    // geometry snapshots
+    wxCheckBox* cbox_snapshot;
+    // tiled map renderer
+    wxCheckBox* cbox_tiled;
     // labels
     wxCheckBox* cbox_lbl;
     wxTextCtrl* txt_lbl_font;
@@ -153,6 +157,8 @@ protected:
     void OnPowerEpsEnter(wxCommandEvent& ev);
     void OnUseGPU(wxCommandEvent& ev);
     void OnCreateCSVT(wxCommandEvent& ev);
+    void OnUseGeomSnapshot(wxCommandEvent& ev);
+    void OnUseTiledRenderer(wxCommandEvent& ev);
     void OnEnableTransparencyWin(wxCommandEvent& ev);
     
     void OnDrawLabels(wxCommandEvent& ev);
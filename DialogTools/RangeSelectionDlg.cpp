@@ -33,6 +33,7 @@
 #include "../Project.h"
 #include "../FramesManager.h"
 #include "../DataViewer/DataViewerAddColDlg.h"
+#include "../DataViewer/TableBase.h"
 #include "../DataViewer/TableInterface.h"
 #include "../DataViewer/TableState.h"
 #include "../ShapeOperations/WeightsManState.h"
@@ -208,63 +209,40 @@ void RangeSelectionDlg::OnRangeTextChange( wxCommandEvent& event )
 void RangeSelectionDlg::OnSelRangeClick( wxCommandEvent& event )
 {
 	wxLogMessage("Entering RangeSelectionDlg::OnApplySelClick");
+	TableBase* table_base = project->FindTableBase();
+	if (!table_base) return;
 	HighlightState& hs = *project->GetHighlightState();
 	std::vector<bool>& h = hs.GetHighlight();
     
     int n = table_int->GetNumberRows();
-	int nh_cnt = 0;
-	int nuh_cnt = 0;
 	if (m_field_choice->GetSelection() == wxNOT_FOUND) return;
 	int mcol = GetSelColInt();
 	int f_tm = GetSelColTmInt();
 
     bool no_hl = true;
-    bool new_select = m_radio_newselect->GetValue();
-    bool sub_select = m_radio_subselect->GetValue();
-    bool append_select = !sub_select;
-
-    if (new_select) {
-        for (int i=0; i<n; i++) {
-            h[i] = false;
-        }
-    }
-    
     for (int i=0; i<n; i++) {
         if (h[i] == true) {
             no_hl = false;
             break;
         }
     }
-    std::vector<bool> cur_sel(n);
+    // a subset of an empty selection starts a new one
+    TableBase::FilterSelectMode mode = TableBase::filter_add_select;
+    if (m_radio_newselect->GetValue() || no_hl) {
+        mode = TableBase::filter_new_select;
+    } else if (m_radio_subselect->GetValue()) {
+        mode = TableBase::filter_sub_select;
+    }
+    
 	double min_dval = 0, max_dval = 1;
 	m_min_text->GetValue().ToDouble(&min_dval);
 	m_max_text->GetValue().ToDouble(&max_dval);
-	std::vector<bool> undefined;
-	table_int->GetColUndefined(mcol, f_tm, undefined);
-    wxString col_name = table_int->GetColName(mcol, f_tm), selection_lbl;
+    wxString col_name = table_int->GetColName(mcol, f_tm), selection_lbl;
 	if (table_int->GetColType(mcol) == GdaConst::long64_type) {
 		wxInt64 min_ival = ceil(min_dval);
 		wxInt64 max_ival = floor(max_dval);
-		std::vector<wxInt64> vec;
-		table_int->GetColData(mcol, f_tm, vec);
-		for (int i=0, iend=table_int->GetNumberRows(); i<iend; i++) {
-			if (!undefined[i] && min_ival <= vec[i] && vec[i] <= max_ival) {
-                cur_sel[i] = true;
-			} else {
-                cur_sel[i] = false;
-            }
-		}
         selection_lbl = wxString::Format("[%lld, %lld]", min_ival, max_ival);
 	} else if (table_int->GetColType(mcol) == GdaConst::double_type) {
-		std::vector<double> vec;
-		table_int->GetColData(mcol, f_tm, vec);
-		for (int i=0, iend=table_int->GetNumberRows(); i<iend; i++) {
-			if (!undefined[i] && min_dval <= vec[i] && vec[i] <= max_dval) {
-                cur_sel[i] = true;
-			} else {
-                cur_sel[i] = false;
-			}
-		}
         selection_lbl = wxString::Format("[%f, %f]", min_dval, max_dval);
 	} else {
 		wxString msg("Selected field is should be numeric.");
@@ -272,36 +250,15 @@ void RangeSelectionDlg::OnSelRangeClick( wxCommandEvent& event )
 		dlg.ShowModal();
 		return;
 	}
-    bool update_flag = false;
-    for (int i=0; i<n; i++) {
-        if (no_hl) {
-            if (cur_sel[i] == true) {
-                h[i] = true;
-                update_flag = true;
-            }
-        } else {
-            if (sub_select) {
-                if (h[i] == true && cur_sel[i] == false) {
-                    h[i] = false;
-                    update_flag = true;
-                }
-            } else if (append_select) {
-                if (h[i] == false && cur_sel[i] == true) {
-                    h[i] = true;
-                    update_flag = true;
-                }
-            }
-        }
-    }
-
-	if (update_flag) {
-        std::map<wxString, wxString> meta_data;
-        meta_data["original_variable"] = col_name;
-        meta_data["selection_range"] = selection_lbl;
-        hs.SetMetaData(meta_data);
-		hs.SetEventType(HLStateInt::delta);
-		hs.notifyObservers();
-	}
+    
+    std::vector<TableFilter> filters(1);
+    filters[0] = TableFilter(mcol, f_tm, TableFilter::BETWEEN,
+                             min_dval, max_dval);
+    std::map<wxString, wxString> meta_data;
+    meta_data["original_variable"] = col_name;
+    meta_data["selection_range"] = selection_lbl;
+    table_base->SelectByFilter(filters, mode, &meta_data);
+    
 	current_sel_mcol = mcol;
 	m_selection_made = true;
 	CheckApplySaveSettings();
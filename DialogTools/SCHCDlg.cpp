@@ -29,7 +29,7 @@
 #include "../GeneralWxUtils.h"
 #include "../GenUtils.h"
 #include "../Algorithms/DataUtils.h"
-#include "../Algorithms/fastcluster.h"
+#include "../Algorithms/schc.h"
 #include "../VarCalc/WeightsManInterface.h"
 #include "../ShapeOperations/WeightUtils.h"
 
@@ -103,70 +103,21 @@ bool SCHCDlg::Run(vector<wxInt64>& clusters)
         return false;
     }
 
-    // get pairwise distance
-    double* pwdist = NULL;
-    if (dist == 'e') {
-        pwdist = DataUtils::getContiguityPairWiseDistance(gw->gal, input_data, weight, rows,
-                                                columns,
-                                                DataUtils::EuclideanDistance);
-    } else {
-        pwdist = DataUtils::getContiguityPairWiseDistance(gw->gal, input_data, weight, rows,
-                                                columns,
-                                                DataUtils::ManhattanDistance);
-    }
-
-    fastcluster::auto_array_ptr<t_index> members;
     if (htree != NULL) {
         delete[] htree;
         htree = NULL;
     }
     htree = new GdaNode[rows-1];
-    fastcluster::cluster_result Z2(rows-1);
-
-    if (method == 's') {
-        fastcluster::MST_linkage_core(rows, pwdist, Z2);
-    } else if (method == 'w') {
-        members.init(rows, 1);
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_WARD, t_index>(rows, pwdist, members, Z2);
-    } else if (method == 'm') {
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_COMPLETE, t_index>(rows, pwdist, NULL, Z2);
-    } else if (method == 'a') {
-        members.init(rows, 1);
-        fastcluster::NN_chain_core<fastcluster::METHOD_METR_AVERAGE, t_index>(rows, pwdist, members, Z2);
-    }
 
-    delete[] pwdist;
-
-    std::stable_sort(Z2[0], Z2[rows-1]);
-    t_index node1, node2;
-    int i=0, clst_cnt=0;
-    fastcluster::union_find nodes(rows);
-
-    n_cluster = 0;
-    for (fastcluster::node const * NN=Z2[0]; NN!=Z2[rows-1]; ++NN, ++i) {
-        if (NN) {
-            // Find the cluster identifiers for these points.
-            node1 = nodes.Find(NN->node1);
-            node2 = nodes.Find(NN->node2);
-            // Merge the nodes in the union-find data structure by making them
-            // children of a new node.
-            nodes.Union(node1, node2);
-            
-            node2 = node2 < rows ? node2 : rows-node2-1;
-            node1 = node1 < rows ? node1 : rows-node1-1;
-            
-            //cout << i<< ":" << node2 <<", " <<  node1 << ", " << Z2[i]->dist <<endl;
-            htree[i].left = node1;
-            htree[i].right = node2;
-
-            double dist = Z2[i]->dist;
-            if (dist == DBL_MAX) {
-                n_cluster += 1;
-            }
-
-            clst_cnt += 1;
-            htree[i].distance = clst_cnt;
-        }
+    // agglomerate along the contiguity graph only
+    SpatialConstrainedHC schc(rows, columns, input_data, weight, gw->gal,
+                              method, dist);
+    // merges between disconnected parts of the weights
+    n_cluster = schc.Run(htree);
+
+    // htree is in merge order: use the order as node distance
+    for (int i=0; i<rows-1; i++) {
+        htree[i].distance = i + 1;
     }
 
     if (n_cluster == 0) n_cluster = 2;
@@ -327,8 +327,6 @@ void NbrMatchDlg::OnOK(wxCommandEvent& event )
 
     // create knn variable weights
     double eps = 0; // error bound
-    if (dist == 'e') ANN_DIST_TYPE = 2; // euclidean
-    else if (dist == 'b') ANN_DIST_TYPE = 1; // manhattan
     
     // since KNN search will always return the query point itself, so add 1
     // to make sure returning min_samples number of results
@@ -336,18 +334,19 @@ void NbrMatchDlg::OnOK(wxCommandEvent& event )
     GalElement* gal = new GalElement[rows];
     
     ANNkd_tree* kdTree = new ANNkd_tree(input_data, rows, columns);
-    ANNidxArray nnIdx = new ANNidx[knn+1];
-    ANNdistArray dists = new ANNdist[knn+1];
+    if (dist == 'e') kdTree->setDistType(2); // euclidean
+    else if (dist == 'b') kdTree->setDistType(1); // manhattan
+    // all rows are searched in parallel, k+1 results per row
+    int k1 = (int)knn + 1;
+    std::vector<ANNidx> nnIdx((size_t)rows * k1);
+    std::vector<ANNdist> dists((size_t)rows * k1);
+    kdTree->annkSearchAll(k1, &nnIdx[0], &dists[0], eps);
     for (size_t i=0; i<rows; ++i) {
-        kdTree->annkSearch(input_data[i], (int)knn+1, nnIdx, dists, eps);
-        //core_d[i] = sqrt(dists[min_samples-1]);
         gal[i].SetSizeNbrs(knn);
         for (size_t j=0; j<knn; j++) {
-            gal[i].SetNbr(j, nnIdx[j+1], 1.0);
+            gal[i].SetNbr(j, nnIdx[i * k1 + j + 1], 1.0);
         }
     }
-    delete[] nnIdx;
-    delete[] dists;
     delete kdTree;
     
     GalWeight* gw = new GalWeight();
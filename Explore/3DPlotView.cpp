@@ -33,6 +33,7 @@
 #include "../VarCalc/WeightsManInterface.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "Geom3D.h"
+#include "3DPointBuffer.h"
 #include "../GdaConst.h"
 #include "../GeneralWxUtils.h"
 #include "../GeoDa.h"
@@ -65,6 +66,9 @@ var_info(v_info),
 data(v_info.size()),
 data_undef(v_info.size()),
 scaled_d(v_info.size()),
+pts_valid(false), pts_index(0), pts_buffer(0), pts_states_valid(false),
+pts_states_gal(0),
+sphere_list(0), sphere_list_quality(0), sphere_list_radius(0),
 c3d_plot_frame(t_frame),
 ShowNeighbors(true),
 ShowConnections(true),
@@ -119,6 +123,10 @@ quality(10), radius(0.03), linewidth(1.0)
 		c3d_plot_frame->AddGroupDependancy(var_info[i].name);
 	}
 	
+	pts_index = new C3DPointIndex();
+	if (num_obs >= GdaConst::three_d_plot_point_buffer_min_obs) {
+		pts_buffer = new C3DPointBuffer();
+	}
 	VarInfoAttributeChange();
 	UpdateScaledData();
 	
@@ -161,6 +169,13 @@ quality(10), radius(0.03), linewidth(1.0)
 C3DPlotCanvas::~C3DPlotCanvas()
 {
 	if (ball) delete ball; ball = 0;	
+	if (isInit) {
+		// the GL objects belong to the context of this canvas
+		wxGLCanvas::SetCurrent(*m_context);
+		if (sphere_list) glDeleteLists(sphere_list, 2);
+	}
+	if (pts_buffer) delete pts_buffer;
+	if (pts_index) delete pts_index;
 	highlight_state->removeObserver(this);
     delete m_context;
     wxLogMessage("Close C3DPlotCanvas.");
@@ -450,14 +465,25 @@ void C3DPlotCanvas::UpdateSelect()
 	int yt = var_info[1].time;
 	int zt = var_info[2].time;
 	
+	// only the points in the grid cells around the box are tested
+	UpdatePoints();
+	double b_min[3] = { minx, miny, minz };
+	double b_max[3] = { maxx, maxy, maxz };
+	std::vector<int> ids;
+	pts_index->QueryBox(b_min, b_max, ids);
+	std::vector<bool> inside(num_obs, false);
+	for (size_t j=0; j<ids.size(); j++) {
+		int i = ids[j];
+		inside[i] = ((scaled_d[0][xt][i] >= minx) &&
+					 (scaled_d[0][xt][i] <= maxx) &&
+					 (scaled_d[1][yt][i] >= miny) &&
+					 (scaled_d[1][yt][i] <= maxy) &&
+					 (scaled_d[2][zt][i] >= minz) &&
+					 (scaled_d[2][zt][i] <= maxz));
+	}
+	
 	for (int i=0; i<num_obs; i++) {
-		bool contains = ((scaled_d[0][xt][i] >= minx) &&
-						 (scaled_d[0][xt][i] <= maxx) &&
-						 (scaled_d[1][yt][i] >= miny) &&
-						 (scaled_d[1][yt][i] <= maxy) &&
-						 (scaled_d[2][zt][i] >= minz) &&
-						 (scaled_d[2][zt][i] <= maxz));
-		if (contains) {
+		if (inside[i]) {
             if (!hs[i]) {
                 hs[i] = true;
                 selection_changed = true;
@@ -475,6 +501,7 @@ void C3DPlotCanvas::UpdateSelect()
 		highlight_state->notifyObservers(this);
     }
     this->hs = hs; // update local hs for rendering
+    if (selection_changed) pts_states_valid = false;
 }
 
 void C3DPlotCanvas::SelectByRect()
@@ -512,12 +539,8 @@ void C3DPlotCanvas::SelectByRect()
 	
 	ball->unapply_transform();
 	
-	SPlane* plane;
-	int i;
-	
-	bool *inside = new bool[num_obs*4];
-	for(i=0; i<num_obs*4; i++) inside[i] = false;
-	double *world1, *world2, *world3, *world4;
+	std::vector<SPlane> planes;
+	double *world1, *world2, *world3;
 	for (int k=0; k<4; k++) {
 		switch(k)
 		{
@@ -525,57 +548,52 @@ void C3DPlotCanvas::SelectByRect()
 				world1 = world11;
 				world2 = world12;
 				world3 = world113;
-				world4 = world123;
 				break;
 			case 1:
 				world1 = world12;
 				world2 = world22;
 				world3 = world123;
-				world4 = world223;
 				break;
 			case 2:
 				world1 = world22;
 				world2 = world21;
 				world3 = world223;
-				world4 = world213;
 				break;
 			case 3:
 				world1 = world21;
 				world2 = world11;
 				world3 = world213;
-				world4 = world113;
 				break;
 			default:
 				break;
 		}
-		
-		plane = new SPlane(world1, world2, world3);
-		
-		Vec3f a1(world1[0], world1[1], world1[2]);
-		Vec3f a2(world2[0], world2[1], world2[2]);
-		Vec3f a3(world3[0], world3[1], world3[2]);
-		Vec3f a4(world4[0], world4[1], world4[2]);
-		Vec3f l1 = a3 - a1;
-		Vec3f l2 = a4 - a2;
-		
-		int xt = var_info[0].time;
-		int yt = var_info[1].time;
-		int zt = var_info[2].time;
-		
-		for (i=0; i<num_obs; i++) {
-			Vec3f cor(scaled_d[0][xt][i], scaled_d[1][yt][i],
-					  scaled_d[2][zt][i]);
-			if (plane->isPositive(cor)) inside[k*num_obs+i] = true;
-		}
-        delete plane;
-    }
+		planes.push_back(SPlane(world1, world2, world3));
+	}
 	
-	delete [] inside;
+	int xt = var_info[0].time;
+	int yt = var_info[1].time;
+	int zt = var_info[2].time;
+	
+	// grid cells inside all four planes are selected whole, only the points
+	// of the cells that cross a plane are tested
+	UpdatePoints();
+	std::vector<int> in_ids, ids;
+	pts_index->QueryPlanes(planes, in_ids, ids);
+	std::vector<bool> inside(num_obs, false);
+	for (size_t j=0; j<in_ids.size(); j++) inside[in_ids[j]] = true;
+	for (size_t j=0; j<ids.size(); j++) {
+		int i = ids[j];
+		Vec3f cor(scaled_d[0][xt][i], scaled_d[1][yt][i],
+				  scaled_d[2][zt][i]);
+		bool contains = true;
+		for (int k=0; k<4 && contains; k++) {
+			contains = planes[k].isPositive(cor);
+		}
+		inside[i] = contains;
+	}
 	
-	for (i=0; i<num_obs; i++) {
-		bool contains = (inside[i] && inside[num_obs+i] && inside[2*num_obs+i]
-						 && inside[3*num_obs+i]);
-		if (contains) {
+	for (int i=0; i<num_obs; i++) {
+		if (inside[i]) {
             if (!hs[i]) {
                 hs[i] = true;
                 selection_changed = true;
@@ -592,6 +610,7 @@ void C3DPlotCanvas::SelectByRect()
 		highlight_state->notifyObservers(this);
     }
     this->hs = hs; // update local hs for rendering
+    if (selection_changed) pts_states_valid = false;
 }
 
 void C3DPlotCanvas::InitGL(void)
@@ -638,12 +657,14 @@ void C3DPlotCanvas::InitGL(void)
 void C3DPlotCanvas::SetSelectableFillColor(wxColour color)
 {
 	selectable_fill_color = color;
+	pts_states_valid = false;
 	Refresh();
 }
 
 void C3DPlotCanvas::SetHighlightColor(wxColour color)
 {
 	highlight_color = color;
+	pts_states_valid = false;
 	Refresh();
 }
 
@@ -662,9 +683,23 @@ void C3DPlotCanvas::RenderScene()
 	int yt = var_info[1].time;
 	int zt = var_info[2].time;
 	
-	GLUquadric* myQuad = 0;
-	myQuad = gluNewQuadric();
-	if (m_d) {
+	UpdatePoints();
+	GalWeight* gal_weights = 0;
+	if (ShowNeighbors) {
+		// weights
+		WeightsManInterface* w_man_int = project->GetWManInt();
+		boost::uuids::uuid weights_id = w_man_int->GetDefault();
+		gal_weights = w_man_int->GetGal(weights_id);
+	}
+	if (pts_buffer) {
+		SetPointStates(gal_weights);
+	} else {
+		UpdateSphereLists();
+	}
+
+	if (m_d && pts_buffer) {
+		RenderPointBuffer(gal_weights);
+	} else if (m_d) {
         std::vector<bool> draw_pts(num_obs, false);
 
         // draw highlighted points
@@ -679,68 +714,35 @@ void C3DPlotCanvas::RenderScene()
 			glPushMatrix();
 			glTranslatef(scaled_d[0][xt][i], scaled_d[1][yt][i],
 						 scaled_d[2][zt][i]);
-			gluSphere(myQuad, radius, quality, quality);
+			glCallList(sphere_list);
 			glPopMatrix();
 		}
 
-        if (ShowNeighbors) {
-            // weights
-            WeightsManInterface* w_man_int = project->GetWManInt();
-            boost::uuids::uuid weights_id = w_man_int->GetDefault();
-            GalWeight* gal_weights = w_man_int->GetGal(weights_id);
-            if (gal_weights) {
-                // Enable blending
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                // connection lines
-                if (ShowConnections) {
-                    glDisable(GL_LIGHTING);
-                    glDepthMask(false);
-                    glColor4f(((GLfloat) linecolor.Red())/((GLfloat) 255.0),
-                              ((GLfloat) linecolor.Green())/((GLfloat) 255.0),
-                              ((GLfloat) linecolor.Blue())/((GLfloat) 255.0),
-                              0.9);
-                    glLineWidth(linewidth);
-                    for (int i=0; i<num_obs; i++) {
-                        if (all_undefs[i]) continue;
-                        if (!hs[i]) continue;
-
-                        GalElement& e = gal_weights->gal[i];
-                        for (int j=0, jend=e.Size(); j<jend; j++) {
-                            int obs = e[j];
-                            if (i != obs) {
-                                glBegin(GL_LINES);
-                                glVertex3f(scaled_d[0][xt][i], scaled_d[1][yt][i],
-                                           scaled_d[2][zt][i]);
-                                glVertex3f(scaled_d[0][xt][obs], scaled_d[1][yt][obs],
-                                           scaled_d[2][zt][obs]);
-                                glEnd();
-                            }
-                        }
-                    }
-                    glDepthMask(true);
-                    glEnable(GL_LIGHTING);
-                }
-                // neighbors
-                glColor4f(((GLfloat) highlight_color.Red())/((GLfloat) 255.0),
-                          ((GLfloat) highlight_color.Green())/((GLfloat) 255.0),
-                          ((GLfloat) highlight_color.Blue())/((GLfloat) 255.0),
-                          0.4);
-                for (int i=0; i<num_obs; i++) {
-                    if (all_undefs[i]) continue;
-                    if (!hs[i]) continue;
-
-                    GalElement& e = gal_weights->gal[i];
-                    for (int j=0, jend=e.Size(); j<jend; j++) {
-                        int obs = e[j];
-                        if (i != obs) {
-                            draw_pts[obs] = true;
-                            glPushMatrix();
-                            glTranslatef(scaled_d[0][xt][obs], scaled_d[1][yt][obs],
-                                         scaled_d[2][zt][obs]);
-                            gluSphere(myQuad, radius, quality, quality);
-                            glPopMatrix();
-                        }
+        if (gal_weights) {
+            // Enable blending
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            // connection lines
+            if (ShowConnections) RenderConnections(gal_weights);
+            // neighbors
+            glColor4f(((GLfloat) highlight_color.Red())/((GLfloat) 255.0),
+                      ((GLfloat) highlight_color.Green())/((GLfloat) 255.0),
+                      ((GLfloat) highlight_color.Blue())/((GLfloat) 255.0),
+                      0.4);
+            for (int i=0; i<num_obs; i++) {
+                if (all_undefs[i]) continue;
+                if (!hs[i]) continue;
+
+                GalElement& e = gal_weights->gal[i];
+                for (int j=0, jend=e.Size(); j<jend; j++) {
+                    int obs = e[j];
+                    if (i != obs) {
+                        draw_pts[obs] = true;
+                        glPushMatrix();
+                        glTranslatef(scaled_d[0][xt][obs], scaled_d[1][yt][obs],
+                                     scaled_d[2][zt][obs]);
+                        glCallList(sphere_list);
+                        glPopMatrix();
                     }
                 }
             }
@@ -759,13 +761,15 @@ void C3DPlotCanvas::RenderScene()
             glPushMatrix();
             glTranslatef(scaled_d[0][xt][i], scaled_d[1][yt][i],
                          scaled_d[2][zt][i]);
-            gluSphere(myQuad, radius, quality, quality);     // radius, slices, stacks
+            glCallList(sphere_list);
             glPopMatrix();
         }
 	}
 
 	glDisable(GL_LIGHTING);
-	if (m_x) {
+	if (m_x && pts_buffer) {
+		RenderPanelPoints(0);
+	} else if (m_x) {
         // draw y-z panel
 		//glColor3f(0.75, 0.75, 0.75);
 		glColor3f(((GLfloat) selectable_fill_color.Red())/((GLfloat) 255.0),
@@ -777,7 +781,7 @@ void C3DPlotCanvas::RenderScene()
 			glPushMatrix();
 			glTranslatef(-1, scaled_d[1][yt][i], scaled_d[2][zt][i]);
 			glRotatef(90, 0.0, 1.0, 0.0);	
-			gluDisk(myQuad, 0, 0.02, 5, 3); // inner, outer, slices, loops
+			glCallList(sphere_list+1);
 			glPopMatrix();
 		}
 		//glColor3f(1.0, 1.0, 0.0);
@@ -790,12 +794,14 @@ void C3DPlotCanvas::RenderScene()
 			glPushMatrix();
 			glTranslatef(-1, scaled_d[1][yt][i], scaled_d[2][zt][i]);
 			glRotatef(90, 0.0, 1.0, 0.0);
-			gluDisk(myQuad, 0, 0.02, 5, 3);
+			glCallList(sphere_list+1);
 			glPopMatrix();
 		}
 	}
 	
-	if (m_y) {
+	if (m_y && pts_buffer) {
+		RenderPanelPoints(1);
+	} else if (m_y) {
 		//glColor3f(0.75, 0.75, 0.75);
 		glColor3f(((GLfloat) selectable_fill_color.Red())/((GLfloat) 255.0),
 				  ((GLfloat) selectable_fill_color.Green())/((GLfloat) 255.0),
@@ -806,7 +812,7 @@ void C3DPlotCanvas::RenderScene()
 			glPushMatrix();
 			glTranslatef(scaled_d[0][xt][i], -1, scaled_d[2][zt][i]);
 			glRotatef(90, 1.0, 0.0, 0.0); 
-			gluDisk(myQuad, 0, 0.02, 5, 3);
+			glCallList(sphere_list+1);
 			glPopMatrix();
 		}
 		//glColor3f(1.0, 1.0, 0.0);
@@ -819,12 +825,14 @@ void C3DPlotCanvas::RenderScene()
 			glPushMatrix();
 			glTranslatef(scaled_d[0][xt][i], -1, scaled_d[2][zt][i]);
 			glRotatef(90, 1.0, 0.0, 0.0); 
-			gluDisk(myQuad, 0, 0.02, 5, 3);
+			glCallList(sphere_list+1);
 			glPopMatrix();
 		}
 	}
 
-	if (m_z) {
+	if (m_z && pts_buffer) {
+		RenderPanelPoints(2);
+	} else if (m_z) {
 		//glColor3f(0.75, 0.75, 0.75);
 		glColor3f(((GLfloat) selectable_fill_color.Red())/((GLfloat) 255.0),
 				  ((GLfloat) selectable_fill_color.Green())/((GLfloat) 255.0),
@@ -834,7 +842,7 @@ void C3DPlotCanvas::RenderScene()
 			if (hs[i]) continue;
 			glPushMatrix();
 			glTranslatef(scaled_d[0][xt][i], scaled_d[1][yt][i], -1);
-			gluDisk(myQuad, 0, 0.02, 5, 3);
+			glCallList(sphere_list+1);
 			glPopMatrix();
 		}
 		//glColor3f(1.0, 1.0, 0.0);
@@ -846,7 +854,7 @@ void C3DPlotCanvas::RenderScene()
 			if (!hs[i]) continue;
 			glPushMatrix();
 			glTranslatef(scaled_d[0][xt][i], scaled_d[1][yt][i], -1);
-			gluDisk(myQuad, 0, 0.02, 5, 3);
+			glCallList(sphere_list+1);
 			glPopMatrix();
 		}
 	}
@@ -964,8 +972,157 @@ void C3DPlotCanvas::RenderScene()
 	glEnd();
 
 	glEnable(GL_LIGHTING);
- 
+}
+
+void C3DPlotCanvas::RenderConnections(GalWeight* gal_weights)
+{
+	int xt = var_info[0].time;
+	int yt = var_info[1].time;
+	int zt = var_info[2].time;
+
+    glDisable(GL_LIGHTING);
+    glDepthMask(false);
+    glColor4f(((GLfloat) linecolor.Red())/((GLfloat) 255.0),
+              ((GLfloat) linecolor.Green())/((GLfloat) 255.0),
+              ((GLfloat) linecolor.Blue())/((GLfloat) 255.0),
+              0.9);
+    glLineWidth(linewidth);
+    glBegin(GL_LINES);
+    for (int i=0; i<num_obs; i++) {
+        if (all_undefs[i]) continue;
+        if (!hs[i]) continue;
+
+        GalElement& e = gal_weights->gal[i];
+        for (int j=0, jend=e.Size(); j<jend; j++) {
+            int obs = e[j];
+            if (i != obs) {
+                glVertex3f(scaled_d[0][xt][i], scaled_d[1][yt][i],
+                           scaled_d[2][zt][i]);
+                glVertex3f(scaled_d[0][xt][obs], scaled_d[1][yt][obs],
+                           scaled_d[2][zt][obs]);
+            }
+        }
+    }
+    glEnd();
+    glDepthMask(true);
+    glEnable(GL_LIGHTING);
+}
+
+/** Diameter in pixels of a sphere of radius r at the center of the scene.
+ The camera of apply_camera shows sqrt(3) above and below the center. */
+static GLfloat point_size(double r, int h)
+{
+	GLfloat s = (GLfloat) (r * h / sqrt(3.0));
+	return (s < 1) ? 1 : s;
+}
+
+/** Highlighted points, neighbors of highlighted points and the rest, as
+ RenderScene draws them with spheres.  Nothing is done unless the
+ highlight, the colours, the points or the weights changed, and then only
+ the colours of the points whose state changed are uploaded again. */
+void C3DPlotCanvas::SetPointStates(GalWeight* gal_weights)
+{
+	if (pts_states_valid && pts_states_gal == gal_weights) return;
+	pts_states_valid = true;
+	pts_states_gal = gal_weights;
+	pts_states.assign(num_obs, C3DPointBuffer::normal_pt);
+	for (int i=0; i<num_obs; i++) {
+		if (hs[i]) pts_states[i] = C3DPointBuffer::highlighted_pt;
+	}
+	if (gal_weights) {
+		for (int i=0; i<num_obs; i++) {
+			if (all_undefs[i]) continue;
+			if (!hs[i]) continue;
+
+			GalElement& e = gal_weights->gal[i];
+			for (int j=0, jend=e.Size(); j<jend; j++) {
+				int obs = e[j];
+				if (i != obs && !hs[obs]) {
+					pts_states[obs] = C3DPointBuffer::neighbor_pt;
+				}
+			}
+		}
+	}
+	pts_buffer->SetColours(selectable_fill_color, highlight_color, 102);
+	pts_buffer->SetStates(pts_states);
+}
+
+void C3DPlotCanvas::RenderPointBuffer(GalWeight* gal_weights)
+{
+	int w, h;
+	GetClientSize(&w, &h);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	if (gal_weights && ShowConnections) RenderConnections(gal_weights);
+
+	glDisable(GL_LIGHTING);
+	glEnable(GL_POINT_SMOOTH);
+	glPointSize(point_size(radius, h));
+	pts_buffer->Draw(false);
+	glDisable(GL_POINT_SMOOTH);
+	glEnable(GL_LIGHTING);
+}
+
+/** Points of the panel at -1 on axis (0: y-z, 1: x-z, 2: x-y panel) */
+void C3DPlotCanvas::RenderPanelPoints(int axis)
+{
+	int w, h;
+	GetClientSize(&w, &h);
+
+	// the same vertex buffer, flattened onto the panel
+	GLfloat t[3] = { 0, 0, 0 };
+	GLfloat sc[3] = { 1, 1, 1 };
+	t[axis] = -1;
+	sc[axis] = 0;
+	glPushMatrix();
+	glTranslatef(t[0], t[1], t[2]);
+	glScalef(sc[0], sc[1], sc[2]);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_POINT_SMOOTH);
+	glPointSize(point_size(0.02, h));
+	pts_buffer->Draw(true);
+	glDisable(GL_POINT_SMOOTH);
+	glPopMatrix();
+}
+
+void C3DPlotCanvas::UpdateSphereLists()
+{
+	if (sphere_list && sphere_list_quality == quality &&
+		sphere_list_radius == radius) return;
+	if (sphere_list == 0) sphere_list = glGenLists(2);
+	GLUquadric* myQuad = gluNewQuadric();
+	glNewList(sphere_list, GL_COMPILE);
+	gluSphere(myQuad, radius, quality, quality);     // radius, slices, stacks
+	glEndList();
+	glNewList(sphere_list+1, GL_COMPILE);
+	gluDisk(myQuad, 0, 0.02, 5, 3); // inner, outer, slices, loops
+	glEndList();
 	gluDeleteQuadric(myQuad);
+	sphere_list_quality = quality;
+	sphere_list_radius = radius;
+}
+
+/** Scaled coordinates of the points at the current times and their grid
+ index, rebuilt only when the data or the times changed. */
+void C3DPlotCanvas::UpdatePoints()
+{
+	int t[3] = { var_info[0].time, var_info[1].time, var_info[2].time };
+	if (pts_valid && t[0] == pts_times[0] && t[1] == pts_times[1] &&
+		t[2] == pts_times[2]) return;
+	pts_xyz.resize(3 * num_obs);
+	for (int i=0; i<num_obs; i++) {
+		for (int k=0; k<3; k++) {
+			pts_xyz[3*i+k] = (float) scaled_d[k][t[k]][i];
+		}
+	}
+	pts_index->Build(pts_xyz, all_undefs);
+	if (pts_buffer) pts_buffer->SetPositions(pts_xyz, all_undefs);
+	// SetPositions resets the states of the points
+	pts_states_valid = false;
+	for (int k=0; k<3; k++) pts_times[k] = t[k];
+	pts_valid = true;
 }
 
 void C3DPlotCanvas::apply_camera()
@@ -1126,6 +1283,7 @@ void C3DPlotCanvas::UpdateScaledData()
 			}
 		}
 	}
+	pts_valid = false;
 }
 
 void C3DPlotCanvas::TimeSyncVariableToggle(int var_index)
@@ -1143,6 +1301,7 @@ void C3DPlotCanvas::TimeSyncVariableToggle(int var_index)
 void C3DPlotCanvas::update(HLStateInt* o)
 {
     hs = highlight_state->GetHighlight();
+    pts_states_valid = false;
     Refresh();
 }
 
@@ -31,6 +31,9 @@
 
 class Arcball;
 class C3DControlPan;
+class C3DPointBuffer;
+class C3DPointIndex;
+class GalWeight;
 class C3DPlotFrame;
 class TableInterface;
 
@@ -111,6 +114,12 @@ public:
 	bool b_select;
 	bool m_brush;
 	void RenderScene();
+	void RenderConnections(GalWeight* gal_weights);
+	void RenderPointBuffer(GalWeight* gal_weights);
+	void SetPointStates(GalWeight* gal_weights);
+	void RenderPanelPoints(int axis);
+	void UpdateSphereLists();
+	void UpdatePoints();
 	void apply_camera();
 	void end_redraw();
 	void begin_redraw();
@@ -131,6 +140,23 @@ public:
     std::vector<bool> all_undefs;
     std::vector<bool> hs;
 	std::vector<d_array_type> scaled_d;
+	// scaled coordinates of the points at the times of pts_times, with the
+	// grid index used for brushing
+	std::vector<float> pts_xyz;
+	int pts_times[3];
+	bool pts_valid;
+	C3DPointIndex* pts_index;
+	// vertex buffers of the points, only for num_obs at or above
+	// GdaConst::three_d_plot_point_buffer_min_obs
+	C3DPointBuffer* pts_buffer;
+	std::vector<unsigned char> pts_states;
+	// pts_states are up to date with hs and the weights pts_states_gal
+	bool pts_states_valid;
+	GalWeight* pts_states_gal;
+	// display lists of a sphere and a panel disk, for fewer points
+	GLuint sphere_list;
+	int sphere_list_quality;
+	double sphere_list_radius;
 	std::vector< std::vector<SampleStatistics> > data_stats;
 	std::vector<double> var_min; // min over time
 	std::vector<double> var_max; // max over time
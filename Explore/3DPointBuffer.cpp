@@ -0,0 +1,364 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <wx/glcanvas.h>
+#include "3DPointBuffer.h"
+
+// the X11 headers define macros that clash with wx, so glx.h comes last
+#if !defined(__WXMAC__) && !defined(__WXMSW__)
+#include <GL/glx.h>
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+// OpenGL 1.5 buffer objects.  The GL headers of Windows only go up to 1.1,
+// so the entry points are looked up at run time like oglpfuncs does.
+#define GDA_GL_ARRAY_BUFFER 0x8892
+#define GDA_GL_STATIC_DRAW 0x88E4
+#define GDA_GL_DYNAMIC_DRAW 0x88E8
+
+typedef void (APIENTRY *gda_glGenBuffers_t)(GLsizei, GLuint*);
+typedef void (APIENTRY *gda_glDeleteBuffers_t)(GLsizei, const GLuint*);
+typedef void (APIENTRY *gda_glBindBuffer_t)(GLenum, GLuint);
+typedef void (APIENTRY *gda_glBufferData_t)(GLenum, ptrdiff_t, const void*,
+											GLenum);
+typedef void (APIENTRY *gda_glBufferSubData_t)(GLenum, ptrdiff_t, ptrdiff_t,
+											   const void*);
+
+static bool gl_buffer_funcs_loaded = false;
+static gda_glGenBuffers_t gda_glGenBuffers = 0;
+static gda_glDeleteBuffers_t gda_glDeleteBuffers = 0;
+static gda_glBindBuffer_t gda_glBindBuffer = 0;
+static gda_glBufferData_t gda_glBufferData = 0;
+static gda_glBufferSubData_t gda_glBufferSubData = 0;
+
+static void* gda_gl_proc_address(const char* name)
+{
+#if defined(__WXMSW__)
+	return (void*) wglGetProcAddress(name);
+#elif defined(__WXMAC__)
+	return 0;
+#else
+	return (void*) glXGetProcAddressARB((const GLubyte*) name);
+#endif
+}
+
+/** Look up the buffer object functions once, with a current context.
+ Returns true if all of them are there. */
+static bool gda_load_gl_buffer_funcs()
+{
+	if (!gl_buffer_funcs_loaded) {
+		gl_buffer_funcs_loaded = true;
+#if defined(__WXMAC__)
+		// the OpenGL framework exports the OpenGL 2.1 functions
+		gda_glGenBuffers = glGenBuffers;
+		gda_glDeleteBuffers = glDeleteBuffers;
+		gda_glBindBuffer = glBindBuffer;
+		gda_glBufferData = (gda_glBufferData_t) glBufferData;
+		gda_glBufferSubData = (gda_glBufferSubData_t) glBufferSubData;
+#else
+		const char* version = (const char*) glGetString(GL_VERSION);
+		int major = 0, minor = 0;
+		if (version) sscanf(version, "%d.%d", &major, &minor);
+		if (major > 1 || (major == 1 && minor >= 5)) {
+			gda_glGenBuffers =
+				(gda_glGenBuffers_t) gda_gl_proc_address("glGenBuffers");
+			gda_glDeleteBuffers =
+				(gda_glDeleteBuffers_t) gda_gl_proc_address("glDeleteBuffers");
+			gda_glBindBuffer =
+				(gda_glBindBuffer_t) gda_gl_proc_address("glBindBuffer");
+			gda_glBufferData =
+				(gda_glBufferData_t) gda_gl_proc_address("glBufferData");
+			gda_glBufferSubData =
+				(gda_glBufferSubData_t) gda_gl_proc_address("glBufferSubData");
+		}
+#endif
+	}
+	return (gda_glGenBuffers && gda_glDeleteBuffers && gda_glBindBuffer &&
+			gda_glBufferData && gda_glBufferSubData);
+}
+
+const int C3DPointIndex::cells_per_axis;
+
+C3DPointIndex::C3DPointIndex()
+{
+}
+
+C3DPointIndex::~C3DPointIndex()
+{
+}
+
+int C3DPointIndex::Cell(double v) const
+{
+	int c = (int) floor((v + 1.0) / 2.0 * cells_per_axis);
+	if (c < 0) c = 0;
+	if (c >= cells_per_axis) c = cells_per_axis-1;
+	return c;
+}
+
+void C3DPointIndex::Build(const std::vector<float>& xyz,
+						  const std::vector<bool>& undef)
+{
+	int n = xyz.size() / 3;
+	int n_cells = cells_per_axis * cells_per_axis * cells_per_axis;
+	std::vector<int> pt_cell(n, -1);
+	cell_start.assign(n_cells+1, 0);
+	for (int i=0; i<n; i++) {
+		if (i < (int) undef.size() && undef[i]) continue;
+		pt_cell[i] = ((Cell(xyz[3*i+2]) * cells_per_axis +
+					   Cell(xyz[3*i+1])) * cells_per_axis + Cell(xyz[3*i]));
+		cell_start[pt_cell[i]+1]++;
+	}
+	for (int c=0; c<n_cells; c++) cell_start[c+1] += cell_start[c];
+	cell_ids.resize(cell_start[n_cells]);
+	std::vector<int> pos(cell_start.begin(), cell_start.end()-1);
+	for (int i=0; i<n; i++) {
+		if (pt_cell[i] >= 0) cell_ids[pos[pt_cell[i]]++] = i;
+	}
+}
+
+void C3DPointIndex::QueryBox(const double* b_min, const double* b_max,
+							 std::vector<int>& ids) const
+{
+	ids.clear();
+	if (cell_start.empty()) return;
+	int lo[3], hi[3];
+	for (int k=0; k<3; k++) {
+		if (b_min[k] > b_max[k]) return;
+		// points on a cell border can be binned on either side of it
+		lo[k] = std::max(Cell(b_min[k]) - 1, 0);
+		hi[k] = std::min(Cell(b_max[k]) + 1, cells_per_axis-1);
+	}
+	for (int z=lo[2]; z<=hi[2]; z++) {
+		for (int y=lo[1]; y<=hi[1]; y++) {
+			int row = (z * cells_per_axis + y) * cells_per_axis;
+			ids.insert(ids.end(), cell_ids.begin() + cell_start[row + lo[0]],
+					   cell_ids.begin() + cell_start[row + hi[0] + 1]);
+		}
+	}
+}
+
+void C3DPointIndex::QueryPlanes(std::vector<SPlane>& planes,
+								std::vector<int>& inside,
+								std::vector<int>& candidates) const
+{
+	inside.clear();
+	candidates.clear();
+	if (cell_start.empty()) return;
+	const double w = 2.0 / cells_per_axis;
+	// grown by a little more than float rounding of the positions
+	const double eps = w * 0.01;
+	for (int z=0; z<cells_per_axis; z++) {
+		for (int y=0; y<cells_per_axis; y++) {
+			for (int x=0; x<cells_per_axis; x++) {
+				int c = (z * cells_per_axis + y) * cells_per_axis + x;
+				if (cell_start[c] == cell_start[c+1]) continue;
+				double lo[3] = { -1.0 + x*w - eps, -1.0 + y*w - eps,
+								 -1.0 + z*w - eps };
+				bool all_in = true;
+				bool all_out = false;
+				for (size_t p=0; p<planes.size() && !all_out; p++) {
+					int n_pos = 0;
+					for (int k=0; k<8; k++) {
+						Vec3f v(lo[0] + ((k & 1) ? w + 2*eps : 0),
+								lo[1] + ((k & 2) ? w + 2*eps : 0),
+								lo[2] + ((k & 4) ? w + 2*eps : 0));
+						if (planes[p].isPositive(v)) n_pos++;
+					}
+					if (n_pos == 0) all_out = true;
+					if (n_pos < 8) all_in = false;
+				}
+				if (all_out) continue;
+				std::vector<int>& dst = all_in ? inside : candidates;
+				dst.insert(dst.end(), cell_ids.begin() + cell_start[c],
+						   cell_ids.begin() + cell_start[c+1]);
+			}
+		}
+	}
+}
+
+C3DPointBuffer::C3DPointBuffer()
+: use_buffers(false), buffers_init(false), pos_dirty(true),
+dirty_start(0), dirty_end(-1), pos_buf(0), colour_buf(0), panel_colour_buf(0)
+{
+	for (int s=0; s<3; s++) {
+		for (int k=0; k<4; k++) clr[s][k] = panel_clr[s][k] = 255;
+	}
+}
+
+C3DPointBuffer::~C3DPointBuffer()
+{
+	if (use_buffers) {
+		GLuint bufs[3] = { pos_buf, colour_buf, panel_colour_buf };
+		gda_glDeleteBuffers(3, bufs);
+	}
+}
+
+void C3DPointBuffer::SetPositions(const std::vector<float>& xyz,
+								  const std::vector<bool>& undef)
+{
+	int n = xyz.size() / 3;
+	vert_obs.clear();
+	pos.clear();
+	for (int i=0; i<n; i++) {
+		if (i < (int) undef.size() && undef[i]) continue;
+		vert_obs.push_back(i);
+		pos.insert(pos.end(), xyz.begin() + 3*i, xyz.begin() + 3*i + 3);
+	}
+	int n_verts = vert_obs.size();
+	states.assign(n_verts, normal_pt);
+	colours.resize(4 * n_verts);
+	panel_colours.resize(4 * n_verts);
+	for (int v=0; v<n_verts; v++) {
+		for (int k=0; k<4; k++) {
+			colours[4*v+k] = clr[normal_pt][k];
+			panel_colours[4*v+k] = panel_clr[normal_pt][k];
+		}
+	}
+	pos_dirty = true;
+	dirty_start = 0;
+	dirty_end = n_verts-1;
+}
+
+void C3DPointBuffer::SetColours(const wxColour& normal,
+								const wxColour& highlight,
+								unsigned char neighbor_alpha)
+{
+	unsigned char c[3][4] = {
+		{ normal.Red(), normal.Green(), normal.Blue(), 255 },
+		{ highlight.Red(), highlight.Green(), highlight.Blue(), 255 },
+		{ highlight.Red(), highlight.Green(), highlight.Blue(), neighbor_alpha }
+	};
+	bool changed = false;
+	for (int s=0; s<3; s++) {
+		for (int k=0; k<4; k++) {
+			if (clr[s][k] != c[s][k]) changed = true;
+			clr[s][k] = c[s][k];
+			panel_clr[s][k] = c[s == neighbor_pt ? normal_pt : s][k];
+		}
+	}
+	if (!changed) return;
+	int n_verts = vert_obs.size();
+	for (int v=0; v<n_verts; v++) {
+		for (int k=0; k<4; k++) {
+			colours[4*v+k] = clr[states[v]][k];
+			panel_colours[4*v+k] = panel_clr[states[v]][k];
+		}
+	}
+	dirty_start = 0;
+	dirty_end = n_verts-1;
+}
+
+void C3DPointBuffer::SetStates(const std::vector<unsigned char>& obs_states)
+{
+	int n_verts = vert_obs.size();
+	for (int v=0; v<n_verts; v++) {
+		unsigned char s = obs_states[vert_obs[v]];
+		if (states[v] == s) continue;
+		states[v] = s;
+		for (int k=0; k<4; k++) {
+			colours[4*v+k] = clr[s][k];
+			panel_colours[4*v+k] = panel_clr[s][k];
+		}
+		if (dirty_start > dirty_end) {
+			dirty_start = dirty_end = v;
+		} else {
+			dirty_start = std::min(dirty_start, v);
+			dirty_end = std::max(dirty_end, v);
+		}
+	}
+}
+
+void C3DPointBuffer::InitBuffers()
+{
+	buffers_init = true;
+	use_buffers = gda_load_gl_buffer_funcs();
+	if (!use_buffers) return;
+	GLuint bufs[3];
+	gda_glGenBuffers(3, bufs);
+	pos_buf = bufs[0];
+	colour_buf = bufs[1];
+	panel_colour_buf = bufs[2];
+}
+
+void C3DPointBuffer::UploadColours(int start, int end)
+{
+	ptrdiff_t offset = 4 * start;
+	ptrdiff_t size = 4 * (end - start + 1);
+	gda_glBindBuffer(GDA_GL_ARRAY_BUFFER, colour_buf);
+	gda_glBufferSubData(GDA_GL_ARRAY_BUFFER, offset, size, &colours[offset]);
+	gda_glBindBuffer(GDA_GL_ARRAY_BUFFER, panel_colour_buf);
+	gda_glBufferSubData(GDA_GL_ARRAY_BUFFER, offset, size,
+						&panel_colours[offset]);
+}
+
+void C3DPointBuffer::Draw(bool panel)
+{
+	if (!buffers_init) InitBuffers();
+	int n_verts = vert_obs.size();
+	if (n_verts == 0) return;
+
+	const GLvoid* pos_ptr = &pos[0];
+	const GLvoid* colour_ptr = panel ? &panel_colours[0] : &colours[0];
+	if (use_buffers) {
+		if (pos_dirty) {
+			gda_glBindBuffer(GDA_GL_ARRAY_BUFFER, pos_buf);
+			gda_glBufferData(GDA_GL_ARRAY_BUFFER, pos.size() * sizeof(float),
+							 &pos[0], GDA_GL_STATIC_DRAW);
+			gda_glBindBuffer(GDA_GL_ARRAY_BUFFER, colour_buf);
+			gda_glBufferData(GDA_GL_ARRAY_BUFFER, colours.size(),
+							 &colours[0], GDA_GL_DYNAMIC_DRAW);
+			gda_glBindBuffer(GDA_GL_ARRAY_BUFFER, panel_colour_buf);
+			gda_glBufferData(GDA_GL_ARRAY_BUFFER, panel_colours.size(),
+							 &panel_colours[0], GDA_GL_DYNAMIC_DRAW);
+		} else if (dirty_start <= dirty_end) {
+			UploadColours(dirty_start, dirty_end);
+		}
+		pos_ptr = 0;
+		colour_ptr = 0;
+	}
+	pos_dirty = false;
+	dirty_start = 0;
+	dirty_end = -1;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	if (use_buffers) gda_glBindBuffer(GDA_GL_ARRAY_BUFFER, pos_buf);
+	glVertexPointer(3, GL_FLOAT, 0, pos_ptr);
+	if (use_buffers) {
+		gda_glBindBuffer(GDA_GL_ARRAY_BUFFER,
+						 panel ? panel_colour_buf : colour_buf);
+	}
+	glColorPointer(4, GL_UNSIGNED_BYTE, 0, colour_ptr);
+	glDrawArrays(GL_POINTS, 0, n_verts);
+	if (use_buffers) gda_glBindBuffer(GDA_GL_ARRAY_BUFFER, 0);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
@@ -0,0 +1,121 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_3D_POINT_BUFFER_H__
+#define __GEODA_CENTER_3D_POINT_BUFFER_H__
+
+#include <vector>
+#include <wx/colour.h>
+#include <wx/glcanvas.h>
+#include "Geom3D.h"
+
+/**
+ Uniform grid over the [-1,1] cube of the scaled 3D plot coordinates.
+
+ The ids of the points are sorted by cell (CSR), so brushing only looks at
+ the points of the cells that meet the select box or the selection frustum
+ instead of every observation.
+ */
+class C3DPointIndex
+{
+public:
+	C3DPointIndex();
+	virtual ~C3DPointIndex();
+
+	/** xyz holds 3 coordinates per observation; undefined observations are
+	 left out of the index. */
+	void Build(const std::vector<float>& xyz, const std::vector<bool>& undef);
+
+	/** Ids of the points in the cells that meet the box [b_min, b_max]
+	 (grown by one cell), to be tested against the box by the caller. */
+	void QueryBox(const double* b_min, const double* b_max,
+				  std::vector<int>& ids) const;
+
+	/** Points on the positive side of all the planes.  Points of cells that
+	 are inside every plane go to inside, points of cells that cross a plane
+	 go to candidates and still have to be tested by the caller. */
+	void QueryPlanes(std::vector<SPlane>& planes, std::vector<int>& inside,
+					 std::vector<int>& candidates) const;
+
+	static const int cells_per_axis = 32;
+
+protected:
+	int Cell(double v) const;
+
+	std::vector<int> cell_start;
+	std::vector<int> cell_ids;
+};
+
+/**
+ Retained vertex data of the points of a 3D plot, drawn as GL_POINTS.
+
+ Positions are uploaded once and again only when the plotted data changes.
+ Colours are kept per point state (normal, highlighted, neighbor of a
+ highlighted point); SetStates only uploads the range of points whose
+ state changed.  Vertex buffer objects (OpenGL 1.5) are used when the
+ driver has them, client side vertex arrays (OpenGL 1.1) otherwise.
+
+ The setters only update the arrays in memory; Draw uploads what changed.
+ Draw and the destructor need the GL context of the canvas to be current.
+ */
+class C3DPointBuffer
+{
+public:
+	enum PointState { normal_pt = 0, highlighted_pt = 1, neighbor_pt = 2 };
+
+	C3DPointBuffer();
+	virtual ~C3DPointBuffer();
+
+	/** xyz holds 3 coordinates per observation */
+	void SetPositions(const std::vector<float>& xyz,
+					  const std::vector<bool>& undef);
+	/** Colours of the three states in the plot and in the side panels,
+	 where neighbors are drawn as normal points. */
+	void SetColours(const wxColour& normal, const wxColour& highlight,
+					unsigned char neighbor_alpha);
+	void SetStates(const std::vector<unsigned char>& states);
+
+	/** Draw the points, with the colours of the side panels if panel */
+	void Draw(bool panel);
+
+protected:
+	void InitBuffers();
+	void UploadColours(int start, int end);
+
+	// observation of every vertex (undefined observations have none)
+	std::vector<int> vert_obs;
+	std::vector<float> pos;
+	std::vector<unsigned char> states;
+	std::vector<unsigned char> colours;
+	std::vector<unsigned char> panel_colours;
+	unsigned char clr[3][4];
+	unsigned char panel_clr[3][4];
+
+	bool use_buffers;
+	bool buffers_init;
+	bool pos_dirty;
+	// range of vertices with colours not yet uploaded, empty if start > end
+	int dirty_start;
+	int dirty_end;
+	GLuint pos_buf;
+	GLuint colour_buf;
+	GLuint panel_colour_buf;
+};
+
+#endif
@@ -752,6 +752,35 @@ void Basemap::LatLngToXY(double lng, double lat, int &x, int &y)
     x = (int)(xx * 256 - leftP) - offsetX;
 }
 
+// Batch version of LatLngToXY(): one call to the coordinate transformation
+// for all points, then the projection in a loop without function calls.
+void Basemap::LatLngToXY(int n, double* lng, double* lat, wxPoint* pts,
+                         double scale_factor)
+{
+    if (n <= 0) return;
+    if (poCT!= NULL) {
+        poCT->Transform(n, lng, lat);
+    }
+    const double nn_256 = nn * 256.0;
+    const double lat_max = 85.0511;
+    for (int i=0; i<n; i++) {
+        double la = lat[i];
+        if (la > lat_max) la = lat_max;
+        if (la < -lat_max) la = -lat_max;
+        double lat_rad = la * M_PI / 180.0;
+        double yy = (1.0 - log(tan(lat_rad) + 1.0 / cos(lat_rad)) / M_PI) / 2.0;
+        double xx = (lng[i] + 180.0 ) / 360.0;
+        pts[i].x = (int)(xx * nn_256 - leftP) - offsetX;
+        pts[i].y = (int)(yy * nn_256 - topP) - offsetY;
+    }
+    if (scale_factor != 1) {
+        for (int i=0; i<n; i++) {
+            pts[i].x = pts[i].x * scale_factor;
+            pts[i].y = pts[i].y * scale_factor;
+        }
+    }
+}
+
 wxString Basemap::GetRandomSubdomain(wxString url)
 {
     unsigned int initseed = (unsigned int) time(0);
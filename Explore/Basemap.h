@@ -399,6 +399,9 @@ namespace Gda {
         XYFraction* LatLngToRawXY(LatLng &latlng);
         LatLng* XYToLatLng(XYFraction &xy, bool isLL=false);
         void LatLngToXY(double lng, double lat, int &x, int &y);
+        // n points at once; lng and lat are overwritten when poCT is set
+        void LatLngToXY(int n, double* lng, double* lat, wxPoint* pts,
+                        double scale_factor = 1.0);
         
         wxString GetTileUrl(int x, int y);
         wxString GetTilePath(int x, int y);
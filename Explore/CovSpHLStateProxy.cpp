@@ -24,8 +24,8 @@
 #include "CovSpHLStateProxy.h"
 
 CovSpHLStateProxy::CovSpHLStateProxy(HighlightState* hl_state,
-																		 const pairs_bimap_type& pairsBiMap)
-: pbm(pairsBiMap)
+																		 const pairs_vec_type& pairs_)
+: pairs(pairs_)
 {
 	delete_self_when_empty = false;
 	highlight_state = hl_state;
@@ -127,22 +127,18 @@ void CovSpHLStateProxy::update(HLStateInt* o)
 	} else if (o->GetEventType() == HLStateInt::delta ||
 						 o->GetEventType() == HLStateInt::invert)
 	{
-		// For each pair (i,j) in pbm, if either i or j is sel in orig_hs,
+		// For each pair (i,j) in pairs, if either i or j is sel in orig_hs,
 		// then pair is now selected.
 		const std::vector<bool>& orig_hs = highlight_state->GetHighlight();
-		for (pairs_bimap_type::const_iterator iter = pbm.begin(), iend = pbm.end();
-				iter != iend; ++iter)
-		{
-			// iter->left  : data : int
-			// iter->right : data : UnOrdIntPair
-			bool new_sel = orig_hs[iter->right.i] || orig_hs[iter->right.j];
-			if (new_sel && !highlight[iter->left]) {
-				highlight[iter->left] = true;
-				newly_highlighted[total_newly_highlighted++] = iter->left;
+		for (int k=0, kend=pairs.size(); k<kend; ++k) {
+			bool new_sel = orig_hs[pairs[k].i] || orig_hs[pairs[k].j];
+			if (new_sel && !highlight[k]) {
+				highlight[k] = true;
+				newly_highlighted[total_newly_highlighted++] = k;
 				++total_highlighted;
-			} else if (!new_sel && highlight[iter->left]) {
-				highlight[iter->left] = false;
-				newly_unhighlighted[total_newly_unhighlighted++] = iter->left;
+			} else if (!new_sel && highlight[k]) {
+				highlight[k] = false;
+				newly_unhighlighted[total_newly_unhighlighted++] = k;
 				--total_highlighted;
 			}
 		}
@@ -175,14 +171,10 @@ void CovSpHLStateProxy::notifyHighlightState()
 		// are selected in the (n-1) pairs, then i is considered selected.
 		// otherwise, i is considered unselected.
 		vector<bool> any_hl(hs.size(), false);
-		for (pairs_bimap_type::const_iterator iter = pbm.begin(), iend = pbm.end();
-				 iter != iend; ++iter)
-		{
-			// iter->left  : data : int
-			// iter->right : data : UnOrdIntPair
-			if (highlight[iter->left]) {
-				any_hl[iter->right.i] = true;
-				any_hl[iter->right.j] = true;
+		for (size_t k=0, kend=pairs.size(); k<kend; ++k) {
+			if (highlight[k]) {
+				any_hl[pairs[k].i] = true;
+				any_hl[pairs[k].j] = true;
 			}
 		}
 		for (size_t i=0, sz=hs.size(); i<sz; ++i) {
@@ -206,7 +198,7 @@ void CovSpHLStateProxy::notifyHighlightState()
 
 void CovSpHLStateProxy::Init()
 {
-	size_t n = pbm.size();
+	size_t n = pairs.size();
 	total_highlighted = 0;
 	highlight.resize(n);
 	newly_highlighted.resize(n);
@@ -215,16 +207,12 @@ void CovSpHLStateProxy::Init()
 	
 	for ( it=highlight.begin(); it != highlight.end(); it++ ) (*it) = false;
 	
-	// For each pair (i,j) in pbm, if either i or j is sel in orig_hs,
+	// For each pair (i,j) in pairs, if either i or j is sel in orig_hs,
 	// then pair is selected.
 	const std::vector<bool>& orig_hs = highlight_state->GetHighlight();
-	for (pairs_bimap_type::const_iterator iter = pbm.begin(), iend = pbm.end();
-			 iter != iend; ++iter)
-	{
-		// iter->left  : data : int
-		// iter->right : data : UnOrdIntPair
-		bool is_sel = orig_hs[iter->right.i] || orig_hs[iter->right.j];
-		highlight[iter->left] = is_sel;
+	for (size_t k=0; k<n; ++k) {
+		bool is_sel = orig_hs[pairs[k].i] || orig_hs[pairs[k].j];
+		highlight[k] = is_sel;
 		if (is_sel) ++total_highlighted;
 	}
 }
@@ -43,7 +43,7 @@ class HighlightState;
 class CovSpHLStateProxy : public HLStateInt, public HighlightStateObserver {
 public:
 	CovSpHLStateProxy(HighlightState* hl_state,
-										const pairs_bimap_type& pairsBiMap);
+										const pairs_vec_type& pairs);
 	virtual ~CovSpHLStateProxy();
 	
 	/** Signal that CovSpHLStateProxy should be closed, but wait until
@@ -75,13 +75,13 @@ public:
 	/** Implement HighlightStateObserver interface */
 	virtual void update(HLStateInt* o);
 	
-	const pairs_bimap_type& GetBiMap() const { return pbm; }
+	const pairs_vec_type& GetPairs() const { return pairs; }
 	
 private:
 	void notifyHighlightState();
 	void Init();
 	HighlightState* highlight_state;
-	const pairs_bimap_type& pbm;
+	const pairs_vec_type& pairs;
 	
 	/** The list of registered HighlightStateObserver objects. */
 	std::list<HighlightStateObserver*> observers;
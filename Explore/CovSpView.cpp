@@ -193,15 +193,13 @@ wxString CovSpFrame::GetUpdateStatusBarString(const vector<int>& hover_obs,
                                               int total_hover_obs)
 {
 	wxString s;
-	const pairs_bimap_type& bimap = project->GetSharedPairsBimap();
+	const pairs_vec_type& pairs = project->GetSharedPairs();
 	int last = std::min(total_hover_obs, (int)hover_obs.size());
 	last = std::min(last, 2);
 	size_t t = var_man.GetTime(0);
-	typedef pairs_bimap_type::left_map::const_iterator left_const_iterator;
 	for (int h=0; h<last; ++h) {
-		left_const_iterator p = bimap.left.find(hover_obs[h]);
-		int i = p->second.i;
-		int j = p->second.j;
+		int i = pairs[hover_obs[h]].i;
+		int j = pairs[hover_obs[h]].j;
 		//s << "sz(Z)=" << Z[t].size() << ", sz(D)=" << D.size(); 
 		//s << ", hover_obs[" << h << "]=" << hover_obs[h];
 		s << "dist(" << i+1 << "," << j+1 << ")=" << D[hover_obs[h]];
@@ -539,7 +537,7 @@ void CovSpFrame::UpdateMessageWin()
 void CovSpFrame::UpdateDataFromVarMan()
 {
 	TableInterface* table_int = project->GetTableInt();
-	const pairs_bimap_type& bimap = project->GetSharedPairsBimap();
+	const pairs_vec_type& pairs = project->GetSharedPairs();
 	
     if (var_man.GetVarsCount() == 0) {
         return;
@@ -572,8 +570,8 @@ void CovSpFrame::UpdateDataFromVarMan()
 		if (Z[t].size() != num_obs) {
 			Z[t].resize(num_obs);
 			Z_undef[t].resize(num_obs);
-			Zprod[t].resize(bimap.size());
-			Zprod_undef[t].resize(bimap.size());
+			Zprod[t].resize(pairs.size());
+			Zprod_undef[t].resize(pairs.size());
 		}
         
         // get data from table
@@ -582,14 +580,11 @@ void CovSpFrame::UpdateDataFromVarMan()
         
         // init Zprod[t]
 		if (GdaConst::placeholder_type == table_int->GetColType(c_id, t)) {
-			for (pairs_bimap_type::const_iterator e=bimap.begin();
-                 e!=bimap.end(); ++e)
-            {
-                int pair_idx = e->left;
+			for (size_t pair_idx=0; pair_idx<pairs.size(); ++pair_idx) {
 				Zprod[t][pair_idx] = 0;
                 
-                int obs_i = e->right.i;
-                int obs_j = e->right.j;
+                int obs_i = pairs[pair_idx].i;
+                int obs_j = pairs[pair_idx].j;
                 Zprod[t][pair_idx]  = Z_undef[t][obs_i] || Z_undef[t][obs_j];
 			}
             wxString str_template;
@@ -650,11 +645,9 @@ void CovSpFrame::UpdateDataFromVarMan()
 			Zprod_min[t] = numeric_limits<double>::max();
 			Zprod_max[t] = numeric_limits<double>::min();
             
-			for (pairs_bimap_type::const_iterator e=bimap.begin();
-                 e!=bimap.end(); ++e)
-            {
-                int idx_i = e->right.i;
-                int idx_j = e->right.j;
+			for (size_t k=0; k<pairs.size(); ++k) {
+                int idx_i = pairs[k].i;
+                int idx_j = pairs[k].j;
                 
                 if (Z_undef[t][idx_i] || Z_undef[t][idx_j])
                     continue;
@@ -663,7 +656,7 @@ void CovSpFrame::UpdateDataFromVarMan()
 				double p = (Z[t][idx_i] - smpl_mn) * (Z[t][idx_j] - smpl_mn);
 				p = p / smpl_var;
                 
-				Zprod[t][e->left] = p;
+				Zprod[t][k] = p;
                 
 				if (p < Zprod_min[t]) Zprod_min[t] = p;
 				if (p > Zprod_max[t]) Zprod_max[t] = p;
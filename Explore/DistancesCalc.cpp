@@ -17,8 +17,16 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cmath>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "../GdaConst.h"
+#include "../GenGeomAlgs.h"
 #include "DistancesCalc.h"
 
+// pairs below this count are handled by a single thread
+static const size_t MIN_PAIRS_PER_THREAD = 20000;
+
 UnOrdIntPair::UnOrdIntPair()
 {
 	i = -1;
@@ -59,3 +67,101 @@ wxString UnOrdIntPair::toStr()
 	s << "(" << i << "," << j << ")";
 	return s;
 }
+
+void DistancesCalc::AllPairs(int n_obs, pairs_vec_type& pairs)
+{
+	pairs.clear();
+	if (n_obs < 2) return;
+	pairs.reserve((size_t)n_obs * (size_t)(n_obs-1) / 2);
+	for (int i=0; i<n_obs; ++i) {
+		for (int j=i+1; j<n_obs; ++j) {
+			pairs.push_back(UnOrdIntPair(i,j));
+		}
+	}
+}
+
+void DistancesCalc::PairDistances(const pairs_vec_type& pairs,
+								  const std::vector<double>& x,
+								  const std::vector<double>& y,
+								  bool is_arc, std::vector<double>& dist)
+{
+	size_t n = pairs.size();
+	dist.resize(n);
+	if (n == 0) return;
+	
+	// per point terms of the haversine formula, computed once
+	std::vector<double> lon_r, lat_r, cos_lat;
+	if (is_arc) {
+		size_t n_pts = x.size();
+		lon_r.resize(n_pts);
+		lat_r.resize(n_pts);
+		cos_lat.resize(n_pts);
+		for (size_t i=0; i<n_pts; ++i) {
+			lon_r[i] = GenGeomAlgs::DegToRad(x[i]);
+			lat_r[i] = GenGeomAlgs::DegToRad(y[i]);
+			cos_lat[i] = cos(lat_r[i]);
+		}
+	}
+	
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (GdaConst::gda_set_cpu_cores) nCPUs = GdaConst::gda_cpu_cores;
+	if (nCPUs < 1) nCPUs = 1;
+	size_t max_threads = n / MIN_PAIRS_PER_THREAD;
+	if (max_threads < 1) max_threads = 1;
+	if ((size_t)nCPUs > max_threads) nCPUs = (int)max_threads;
+	
+	size_t quotient = n / nCPUs;
+	size_t remainder = n % nCPUs;
+	boost::thread_group threadPool;
+	for (int t=0; t<nCPUs; ++t) {
+		size_t tt = (size_t)t;
+		size_t a = tt * quotient + (tt < remainder ? tt : remainder);
+		size_t b = a + quotient + (tt < remainder ? 1 : 0);
+		if (is_arc) {
+			threadPool.create_thread(boost::bind(&DistancesCalc::arc_range,
+												 &pairs, &lon_r, &lat_r,
+												 &cos_lat, &dist[0], a, b));
+		} else {
+			threadPool.create_thread(boost::bind(&DistancesCalc::euc_range,
+												 &pairs, &x, &y, &dist[0],
+												 a, b));
+		}
+	}
+	threadPool.join_all();
+}
+
+void DistancesCalc::arc_range(const pairs_vec_type* pairs,
+							  const std::vector<double>* lon_r,
+							  const std::vector<double>* lat_r,
+							  const std::vector<double>* cos_lat,
+							  double* dist, size_t a, size_t b)
+{
+	// same as GenGeomAlgs::LonLatRadDistRad, with cos(lat) looked up
+	const UnOrdIntPair* p = &(*pairs)[0];
+	const double* lon = &(*lon_r)[0];
+	const double* lat = &(*lat_r)[0];
+	const double* c_lat = &(*cos_lat)[0];
+	for (size_t k=a; k<b; ++k) {
+		int i = p[k].i;
+		int j = p[k].j;
+		double s_lat = sin((lat[j]-lat[i])/2.0);
+		double s_lon = sin((lon[j]-lon[i])/2.0);
+		double h = s_lat*s_lat + c_lat[i]*c_lat[j] * (s_lon*s_lon);
+		dist[k] = 2.0* atan2(sqrt(h),sqrt(1.0-h));
+	}
+}
+
+void DistancesCalc::euc_range(const pairs_vec_type* pairs,
+							  const std::vector<double>* x,
+							  const std::vector<double>* y,
+							  double* dist, size_t a, size_t b)
+{
+	const UnOrdIntPair* p = &(*pairs)[0];
+	const double* px = &(*x)[0];
+	const double* py = &(*y)[0];
+	for (size_t k=a; k<b; ++k) {
+		double dx = px[p[k].j] - px[p[k].i];
+		double dy = py[p[k].j] - py[p[k].i];
+		dist[k] = sqrt(dx*dx + dy*dy);
+	}
+}
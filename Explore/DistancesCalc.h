@@ -20,8 +20,7 @@
 #ifndef __GEODA_CENTER_DISTANCES_CALC_H__
 #define __GEODA_CENTER_DISTANCES_CALC_H__
 
-#include <map>
-#include <boost/bimap.hpp>
+#include <vector>
 #include <wx/string.h>
 
 /** We ultimately need all distance pairs, sorted by distance. */
@@ -36,13 +35,35 @@ struct UnOrdIntPair {
 	wxString toStr();
 };
 
-typedef boost::bimap<int, UnOrdIntPair> pairs_bimap_type;
-typedef std::map<UnOrdIntPair, double> dist_map_type;
+/** Flat list of observation pairs.  The position of a pair in the list is
+ its id: it indexes the pair distances and the CovSpHLStateProxy highlight
+ vector.  Each pair takes two ints, instead of two tree nodes in a bimap. */
+typedef std::vector<UnOrdIntPair> pairs_vec_type;
 
 class DistancesCalc {
 public:
+	/** All n_obs*(n_obs-1)/2 pairs (i,j), i<j, in (i,j) order. */
+	static void AllPairs(int n_obs, pairs_vec_type& pairs);
 	
+	/** dist[k] = distance between the two points of pairs[k].  If is_arc,
+	 x and y are longitude and latitude in degrees and dist is the great
+	 circle distance in radians, otherwise dist is Euclidean.  The pairs are
+	 split across threads. */
+	static void PairDistances(const pairs_vec_type& pairs,
+							  const std::vector<double>& x,
+							  const std::vector<double>& y,
+							  bool is_arc, std::vector<double>& dist);
 	
+protected:
+	static void arc_range(const pairs_vec_type* pairs,
+						  const std::vector<double>* lon_r,
+						  const std::vector<double>* lat_r,
+						  const std::vector<double>* cos_lat,
+						  double* dist, size_t a, size_t b);
+	static void euc_range(const pairs_vec_type* pairs,
+						  const std::vector<double>* x,
+						  const std::vector<double>* y,
+						  double* dist, size_t a, size_t b);
 };
 
 #endif
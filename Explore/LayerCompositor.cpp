@@ -0,0 +1,122 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <wx/defs.h>
+#include "LayerCompositor.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GDA_COMPOSITOR_SSE2
+#include <emmintrin.h>
+#endif
+
+void LayerCompositor::MaskAlpha(const unsigned char* rgb,
+								unsigned char* alpha, int n,
+								unsigned char mask_r, unsigned char mask_g,
+								unsigned char mask_b,
+								unsigned char alpha_value)
+{
+	int i = 0;
+#ifdef GDA_COMPOSITOR_SSE2
+	// 16 pixels are 48 bytes of rgb, compared against the mask colour
+	// repeated 16 times.  A pixel is the mask colour when the bits of all
+	// three of its bytes are set in the 48 bit comparison result.
+	unsigned char pattern[48];
+	for (int k=0; k<16; k++) {
+		pattern[3*k] = mask_r;
+		pattern[3*k+1] = mask_g;
+		pattern[3*k+2] = mask_b;
+	}
+	const __m128i k0 = _mm_loadu_si128((const __m128i*) pattern);
+	const __m128i k1 = _mm_loadu_si128((const __m128i*) (pattern + 16));
+	const __m128i k2 = _mm_loadu_si128((const __m128i*) (pattern + 32));
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i val = _mm_set1_epi8((char) alpha_value);
+	const wxUint64 all_mask = (((wxUint64) 1) << 48) - 1;
+
+	for (; i+16<=n; i+=16) {
+		const unsigned char* p = rgb + 3*i;
+		wxUint64 m0 = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) p), k0));
+		wxUint64 m1 = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p+16)), k1));
+		wxUint64 m2 = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p+32)), k2));
+		wxUint64 m = m0 | (m1 << 16) | (m2 << 32);
+
+		__m128i* a_ptr = (__m128i*) (alpha + i);
+		if (m == all_mask) {
+			_mm_storeu_si128(a_ptr, zero);
+			continue;
+		}
+		// alpha != 0 ? alpha_value : 0
+		__m128i a = _mm_loadu_si128(a_ptr);
+		_mm_storeu_si128(a_ptr, _mm_andnot_si128(_mm_cmpeq_epi8(a, zero), val));
+		if (m == 0) continue;
+		wxUint64 t = m & (m >> 1) & (m >> 2);
+		for (int k=0; k<16; k++) {
+			if ((t >> (3*k)) & 1) alpha[i+k] = 0;
+		}
+	}
+#endif
+	for (; i<n; i++) {
+		const unsigned char* p = rgb + 3*i;
+		if (p[0] == mask_r && p[1] == mask_g && p[2] == mask_b) {
+			alpha[i] = 0;
+		} else if (alpha[i] != 0) {
+			alpha[i] = alpha_value;
+		}
+	}
+}
+
+void LayerCompositor::MaskAlpha(wxImage& image, unsigned char mask_r,
+								unsigned char mask_g, unsigned char mask_b,
+								unsigned char alpha_value)
+{
+	if (!image.HasAlpha()) {
+		image.InitAlpha();
+	}
+	MaskAlpha(image.GetData(), image.GetAlpha(),
+			  image.GetWidth() * image.GetHeight(),
+			  mask_r, mask_g, mask_b, alpha_value);
+}
+
+void LayerCompositor::CopyRect(const wxImage& src, wxImage& dst, int x, int y)
+{
+	int w = src.GetWidth();
+	int h = src.GetHeight();
+	int dst_w = dst.GetWidth();
+	int dst_h = dst.GetHeight();
+	if (x < 0 || y < 0 || x + w > dst_w || y + h > dst_h) return;
+
+	const unsigned char* src_rgb = src.GetData();
+	const unsigned char* src_alpha = src.HasAlpha() ? src.GetAlpha() : NULL;
+	unsigned char* dst_rgb = dst.GetData();
+	unsigned char* dst_alpha = dst.HasAlpha() ? dst.GetAlpha() : NULL;
+	for (int r=0; r<h; r++) {
+		memcpy(dst_rgb + ((y+r)*dst_w + x)*3, src_rgb + r*w*3, w*3);
+		if (dst_alpha == NULL) continue;
+		if (src_alpha) {
+			memcpy(dst_alpha + (y+r)*dst_w + x, src_alpha + r*w, w);
+		} else {
+			memset(dst_alpha + (y+r)*dst_w + x, 255, w);
+		}
+	}
+}
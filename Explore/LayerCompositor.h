@@ -0,0 +1,51 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_LAYER_COMPOSITOR_H__
+#define __GEODA_CENTER_LAYER_COMPOSITOR_H__
+
+#include <wx/gdicmn.h>
+#include <wx/image.h>
+
+/**
+ Pixel operations used to composite the translucent map layers.
+
+ Map layers are drawn over a background of a reserved mask colour, which
+ has to become transparent when the layer is blended over a basemap or
+ the highlighted shapes.  The per-pixel test runs on raw wxImage buffers,
+ 16 pixels at a time with SSE2 where it is available.
+ */
+namespace LayerCompositor {
+	/** For n pixels of rgb (3 bytes each): alpha becomes 0 where the pixel
+	 is the mask colour, alpha_value where alpha is not 0, and stays 0
+	 otherwise. */
+	void MaskAlpha(const unsigned char* rgb, unsigned char* alpha, int n,
+				   unsigned char mask_r, unsigned char mask_g,
+				   unsigned char mask_b, unsigned char alpha_value);
+
+	/** MaskAlpha over a whole image, adding an alpha channel if needed */
+	void MaskAlpha(wxImage& image, unsigned char mask_r, unsigned char mask_g,
+				   unsigned char mask_b, unsigned char alpha_value);
+
+	/** Copy the rgb and alpha of src to dst at (x, y).  Unlike
+	 wxImage::Paste, the alpha of dst is replaced, not blended. */
+	void CopyRect(const wxImage& src, wxImage& dst, int x, int y);
+}
+
+#endif
@@ -38,6 +38,7 @@
 #include "../DialogTools/SaveToTableDlg.h"
 
 #include "LisaCoordinator.h"
+#include "PointDensityGrid.h"
 #include "LisaScatterPlotView.h"
 
 const int ID_RANDDLG = wxID_ANY;
@@ -488,6 +489,9 @@ void LisaScatterPlotCanvas::ResizeSelectableShps(int virtual_scrn_w,
         BOOST_FOREACH( GdaShape* ms, foreground_shps ) {
             ms->applyScaleTrans(last_scale_trans);
         }
+        if (density_grid) {
+            density_grid->ApplyScaleTrans(last_scale_trans, vs_w, vs_h);
+        }
     }
     layer0_valid = false;
     layer1_valid = false;
@@ -513,7 +517,8 @@ void LisaScatterPlotCanvas::PopulateCanvas()
     var_info_orig = var_info;
     var_info = sp_var_info;
 
-    if (selectable_shps.empty() || isResize) {
+    // in density mode the points are in density_grid, not selectable_shps
+    if ((selectable_shps.empty() && !density_grid) || isResize) {
         
         ScatterNewPlotCanvas::PopulateCanvas();
         pre_foreground_shps.clear();
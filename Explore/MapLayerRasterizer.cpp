@@ -0,0 +1,275 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "../GdaConst.h"
+#include "../GdaShape.h"
+#include "../Algorithms/threadpool.h"
+#include "MapLayerRasterizer.h"
+
+// number of sub-scanlines per pixel row of a polygon fill
+static const int n_sub_rows = 4;
+
+const int MapLayerRasterizer::tile_size;
+
+MapLayerRasterizer::MapLayerRasterizer(unsigned char* rgb_, int width_,
+									   int height_)
+: rgb(rgb_), width(width_), height(height_)
+{
+	n_tiles_x = (width + tile_size - 1) / tile_size;
+	n_tiles_y = (height + tile_size - 1) / tile_size;
+	tile_shapes.resize(n_tiles_x * n_tiles_y);
+}
+
+MapLayerRasterizer::~MapLayerRasterizer()
+{
+}
+
+void MapLayerRasterizer::AddPolygon(GdaPolygon* p, const wxColour& fill,
+									const wxColour& pen)
+{
+	if (p == NULL || p->isNull()) return;
+	Shape s;
+	s.poly = p;
+	s.fill[0] = fill.Red();
+	s.fill[1] = fill.Green();
+	s.fill[2] = fill.Blue();
+	s.fill[3] = fill.Alpha();
+	s.pen[0] = pen.Red();
+	s.pen[1] = pen.Green();
+	s.pen[2] = pen.Blue();
+	s.pen[3] = pen.Alpha();
+	if (p->all_points_same || p->draw_n == 0) {
+		s.x_min = s.x_max = p->center.x;
+		s.y_min = s.y_max = p->center.y;
+	} else {
+		s.x_min = s.x_max = p->points[0].x;
+		s.y_min = s.y_max = p->points[0].y;
+		for (int i=1; i<p->draw_n; i++) {
+			const wxPoint& pt = p->points[i];
+			if (pt.x < s.x_min) s.x_min = pt.x;
+			if (pt.x > s.x_max) s.x_max = pt.x;
+			if (pt.y < s.y_min) s.y_min = pt.y;
+			if (pt.y > s.y_max) s.y_max = pt.y;
+		}
+		// antialiased outline can touch the pixels next to the box
+		s.x_min -= 1;
+		s.y_min -= 1;
+		s.x_max += 1;
+		s.y_max += 1;
+	}
+	if (s.x_max < 0 || s.y_max < 0 || s.x_min >= width || s.y_min >= height)
+		return;
+	s.x_min = std::max(s.x_min, 0);
+	s.y_min = std::max(s.y_min, 0);
+	s.x_max = std::min(s.x_max, width-1);
+	s.y_max = std::min(s.y_max, height-1);
+
+	int idx = shapes.size();
+	shapes.push_back(s);
+	for (int ty=s.y_min/tile_size; ty<=s.y_max/tile_size; ty++) {
+		for (int tx=s.x_min/tile_size; tx<=s.x_max/tile_size; tx++) {
+			tile_shapes[ty*n_tiles_x + tx].push_back(idx);
+		}
+	}
+}
+
+void MapLayerRasterizer::Render()
+{
+	int n_tiles = n_tiles_x * n_tiles_y;
+	if (n_tiles == 0 || shapes.empty()) return;
+
+	run_range_threads(n_tiles, 1,
+					  boost::bind(&MapLayerRasterizer::RenderTiles, this, _1, _2));
+}
+
+void MapLayerRasterizer::RenderTiles(int start, int end)
+{
+	TileBuffer t;
+	t.rgb.resize(tile_size * tile_size * 3);
+	t.cov.resize(tile_size + 1);
+	for (int tile=start; tile<=end; tile++) {
+		const std::vector<int>& ids = tile_shapes[tile];
+		if (ids.empty()) continue;
+		t.x0 = (tile % n_tiles_x) * tile_size;
+		t.y0 = (tile / n_tiles_x) * tile_size;
+		t.w = std::min(tile_size, width - t.x0);
+		t.h = std::min(tile_size, height - t.y0);
+		for (int y=0; y<t.h; y++) {
+			memcpy(&t.rgb[y*t.w*3], rgb + ((t.y0+y)*width + t.x0)*3, t.w*3);
+		}
+		for (size_t i=0; i<ids.size(); i++) {
+			const Shape& s = shapes[ids[i]];
+			GdaPolygon* p = s.poly;
+			if (p->all_points_same || p->draw_n_count == 0) {
+				const unsigned char* c = s.pen[3] ? s.pen : s.fill;
+				Blend(t, p->center.x, p->center.y, c, 1.0);
+				continue;
+			}
+			if (s.fill[3]) FillPolygon(s, t);
+			if (s.pen[3]) StrokePolygon(s, t);
+		}
+		for (int y=0; y<t.h; y++) {
+			memcpy(rgb + ((t.y0+y)*width + t.x0)*3, &t.rgb[y*t.w*3], t.w*3);
+		}
+	}
+}
+
+void MapLayerRasterizer::Blend(TileBuffer& t, int x, int y,
+							   const unsigned char* c, double a)
+{
+	x -= t.x0;
+	y -= t.y0;
+	if (x < 0 || y < 0 || x >= t.w || y >= t.h || a <= 0) return;
+	a *= c[3] / 255.0;
+	unsigned char* px = &t.rgb[(y*t.w + x)*3];
+	for (int k=0; k<3; k++) {
+		px[k] = (unsigned char) (px[k] + (c[k] - px[k]) * a + 0.5);
+	}
+}
+
+/** Fill with the even-odd rule, as wxDC::DrawPolyPolygon does.  Vertices
+ are at pixel centers.  Each pixel row is sampled at n_sub_rows
+ sub-scanlines, and the horizontal coverage of every span is exact, so
+ edges are antialiased in both directions. */
+void MapLayerRasterizer::FillPolygon(const Shape& s, TileBuffer& t)
+{
+	GdaPolygon* p = s.poly;
+	int r0 = std::max(s.y_min, t.y0);
+	int r1 = std::min(s.y_max, t.y0 + t.h - 1);
+	int c0 = std::max(s.x_min, t.x0) - t.x0;
+	int c1 = std::min(s.x_max, t.x0 + t.w - 1) - t.x0;
+	if (r0 > r1 || c0 > c1) return;
+
+	// edges that cross the rows of this tile
+	t.edges.clear();
+	for (int c=0, start=0; c<p->draw_n_count; start+=p->draw_count[c], c++) {
+		int cnt = p->draw_count[c];
+		for (int i=0; i<cnt; i++) {
+			const wxPoint& a = p->points[start + i];
+			const wxPoint& b = p->points[start + (i+1) % cnt];
+			if (a.y == b.y) continue;
+			if (std::max(a.y, b.y) < r0 || std::min(a.y, b.y) > r1+1) continue;
+			Edge e;
+			e.xa = a.x + 0.5;
+			e.ya = a.y + 0.5;
+			e.xb = b.x + 0.5;
+			e.yb = b.y + 0.5;
+			t.edges.push_back(e);
+		}
+	}
+	if (t.edges.empty()) return;
+
+	const double sub_w = 1.0 / n_sub_rows;
+	for (int r=r0; r<=r1; r++) {
+		for (int x=c0; x<=c1+1 && x<=t.w; x++) t.cov[x] = 0;
+		bool covered = false;
+		for (int sub=0; sub<n_sub_rows; sub++) {
+			double yy = r + (sub + 0.5) * sub_w;
+			t.xs.clear();
+			for (size_t i=0; i<t.edges.size(); i++) {
+				const Edge& e = t.edges[i];
+				if ((e.ya <= yy) != (e.yb <= yy)) {
+					t.xs.push_back(e.xa + (yy-e.ya) * (e.xb-e.xa) / (e.yb-e.ya));
+				}
+			}
+			if (t.xs.size() < 2) continue;
+			std::sort(t.xs.begin(), t.xs.end());
+			for (size_t i=0; i+1<t.xs.size(); i+=2) {
+				double xa = std::max(t.xs[i] - t.x0, (double) c0);
+				double xb = std::min(t.xs[i+1] - t.x0, (double) c1 + 1);
+				if (xb <= xa) continue;
+				covered = true;
+				int ia = (int) floor(xa);
+				int ib = (int) floor(xb);
+				if (ia == ib) {
+					t.cov[ia] += (float) ((xb - xa) * sub_w);
+					continue;
+				}
+				t.cov[ia] += (float) ((ia + 1 - xa) * sub_w);
+				for (int x=ia+1; x<ib; x++) t.cov[x] += (float) sub_w;
+				if (ib <= c1) t.cov[ib] += (float) ((xb - ib) * sub_w);
+			}
+		}
+		if (!covered) continue;
+		for (int x=c0; x<=c1; x++) {
+			if (t.cov[x] > 0) {
+				Blend(t, x + t.x0, r, s.fill, std::min(t.cov[x], 1.0f));
+			}
+		}
+	}
+}
+
+void MapLayerRasterizer::StrokePolygon(const Shape& s, TileBuffer& t)
+{
+	GdaPolygon* p = s.poly;
+	for (int c=0, start=0; c<p->draw_n_count; start+=p->draw_count[c], c++) {
+		int cnt = p->draw_count[c];
+		for (int i=0; i<cnt; i++) {
+			const wxPoint& a = p->points[start + i];
+			const wxPoint& b = p->points[start + (i+1) % cnt];
+			if (a == b) continue;
+			StrokeLine(a.x, a.y, b.x, b.y, s.pen, t);
+		}
+	}
+}
+
+/** One pixel wide antialiased line (Xiaolin Wu), limited to the tile */
+void MapLayerRasterizer::StrokeLine(int xa, int ya, int xb, int yb,
+									const unsigned char* c, TileBuffer& t)
+{
+	bool steep = abs(yb - ya) > abs(xb - xa);
+	if (steep) {
+		std::swap(xa, ya);
+		std::swap(xb, yb);
+	}
+	if (xa > xb) {
+		std::swap(xa, xb);
+		std::swap(ya, yb);
+	}
+	// range of the major axis inside the tile
+	int lo = steep ? t.y0 : t.x0;
+	int hi = steep ? t.y0 + t.h - 1 : t.x0 + t.w - 1;
+	int m_lo = std::max(xa, lo);
+	int m_hi = std::min(xb, hi);
+	if (m_lo > m_hi) return;
+	// minor axis range inside the tile, with one pixel for the antialiasing
+	int n_lo = (steep ? t.x0 : t.y0) - 1;
+	int n_hi = (steep ? t.x0 + t.w : t.y0 + t.h);
+	if (std::max(ya, yb) < n_lo || std::min(ya, yb) > n_hi) return;
+
+	double gradient = (double) (yb - ya) / (xb - xa);
+	for (int x=m_lo; x<=m_hi; x++) {
+		double y = ya + gradient * (x - xa);
+		int iy = (int) floor(y);
+		double f = y - iy;
+		if (steep) {
+			Blend(t, iy, x, c, 1.0 - f);
+			Blend(t, iy+1, x, c, f);
+		} else {
+			Blend(t, x, iy, c, 1.0 - f);
+			Blend(t, x, iy+1, c, f);
+		}
+	}
+}
@@ -0,0 +1,92 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_MAP_LAYER_RASTERIZER_H__
+#define __GEODA_CENTER_MAP_LAYER_RASTERIZER_H__
+
+#include <vector>
+#include <wx/colour.h>
+
+class GdaPolygon;
+
+/**
+ Software rasterizer for the polygons of a map layer, used by
+ MapCanvas::DrawLayer0 instead of wxDC when
+ GdaConst::gda_use_tiled_renderer is set.
+
+ The image is split into tiles of tile_size x tile_size pixels and every
+ polygon is binned to the tiles its bounding box overlaps.  The tiles are
+ then rasterized in parallel: a thread copies a tile into its own buffer,
+ draws the polygons of that tile in the order they were added (an
+ antialiased even-odd fill and a one pixel antialiased outline) and copies
+ the tile back.  Tiles do not overlap, so no locking is needed and the
+ result does not depend on the number of threads.
+ */
+class MapLayerRasterizer
+{
+public:
+	/** rgb is a width x height image with 3 bytes per pixel, as returned by
+	 wxImage::GetData().  Polygons are drawn over its content. */
+	MapLayerRasterizer(unsigned char* rgb, int width, int height);
+	virtual ~MapLayerRasterizer();
+
+	/** Add a polygon with its screen coordinates already computed.  A
+	 colour with alpha 0 is not drawn. */
+	void AddPolygon(GdaPolygon* p, const wxColour& fill, const wxColour& pen);
+	void Render();
+
+	static const int tile_size = 128;
+
+protected:
+	struct Shape {
+		GdaPolygon* poly;
+		unsigned char fill[4];
+		unsigned char pen[4];
+		// bounding box in pixels, clipped to the image
+		int x_min, y_min, x_max, y_max;
+	};
+	struct Edge {
+		double xa, ya, xb, yb;
+	};
+	// per thread buffers
+	struct TileBuffer {
+		std::vector<unsigned char> rgb;
+		std::vector<float> cov;
+		std::vector<double> xs;
+		std::vector<Edge> edges;
+		int x0, y0, w, h;
+	};
+
+	void RenderTiles(int start, int end);
+	void FillPolygon(const Shape& s, TileBuffer& t);
+	void StrokePolygon(const Shape& s, TileBuffer& t);
+	void StrokeLine(int xa, int ya, int xb, int yb, const unsigned char* c,
+					TileBuffer& t);
+	void Blend(TileBuffer& t, int x, int y, const unsigned char* c, double a);
+
+	unsigned char* rgb;
+	int width;
+	int height;
+	int n_tiles_x;
+	int n_tiles_y;
+	std::vector<Shape> shapes;
+	std::vector<std::vector<int> > tile_shapes;
+};
+
+#endif
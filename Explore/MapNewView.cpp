@@ -18,6 +18,7 @@
  */
 
 #include <algorithm> // std::sort
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <set>
@@ -49,6 +50,8 @@
 #include "CatClassifManager.h"
 #include "MapLayoutView.h"
 #include "MapLayerTree.hpp"
+#include "MapLayerRasterizer.h"
+#include "LayerCompositor.h"
 #include "Basemap.h"
 #include "MapNewView.h"
 
@@ -112,6 +115,10 @@ weights_id(weights_id_s),
 basemap(0),
 isDrawBasemap(false),
 basemap_bm(0),
+hl_bm(0),
+hl_image_valid(false),
+hl_image_alpha(0),
+hl_partial_update(false),
 ref_var_index(-1),
 tran_unhighlighted(GdaConst::transparency_unhighlighted),
 print_detailed_basemap(false),
@@ -627,6 +634,11 @@ void MapCanvas::deleteLayerBms()
         delete basemap_bm;
         basemap_bm = 0;
     }
+    if (hl_bm) {
+        delete hl_bm;
+        hl_bm = 0;
+    }
+    hl_image_valid = false;
     TemplateCanvas::deleteLayerBms();
 }
 
@@ -832,9 +844,7 @@ void MapCanvas::ResizeSelectableShps(int virtual_scrn_w,
         BOOST_FOREACH( GdaShape* ms, foreground_maps ) {
             if (ms) ms->projectToBasemap(basemap);
         }
-        BOOST_FOREACH( GdaShape* ms, selectable_shps ) {
-            if (ms) ms->projectToBasemap(basemap);
-        }
+        GdaShapeAlgs::projectToBasemap(selectable_shps, basemap);
 
         if (!w_graph.empty() && display_weights_graph &&
             boost::uuids::nil_uuid() != weights_id) {
@@ -865,9 +875,7 @@ void MapCanvas::ResizeSelectableShps(int virtual_scrn_w,
             BOOST_FOREACH( GdaShape* ms, foreground_maps ) {
                 if (ms) ms->applyScaleTrans(last_scale_trans);
             }
-            BOOST_FOREACH( GdaShape* ms, selectable_shps ) {
-                if (ms) ms->applyScaleTrans(last_scale_trans);
-            }
+            GdaShapeAlgs::applyScaleTrans(selectable_shps, last_scale_trans);
         }
         layer0_valid = false;
     }
@@ -1053,7 +1061,9 @@ void MapCanvas::DrawLayer0()
         map->paintSelf(dc);
     }
     if (IsHide() == false) {
-        DrawSelectableShapes_dc(dc);
+        if (!RasterizeSelectableShapes(dc)) {
+            DrawSelectableShapes_dc(dc);
+        }
     }
     BOOST_FOREACH( GdaShape* map, foreground_maps ) {
         map->paintSelf(dc);
@@ -1061,6 +1071,7 @@ void MapCanvas::DrawLayer0()
     dc.SelectObject(wxNullBitmap);
     layer0_valid = true;
     layer1_valid = false;
+    hl_image_valid = false;
 }
 
 void MapCanvas::DrawLayer1()
@@ -1116,6 +1127,64 @@ void MapCanvas::DrawLayer2()
     dc.SelectObject(wxNullBitmap);
 }
 
+// Draw the selectable polygons onto layer0_bm with MapLayerRasterizer, which
+// splits the bitmap into tiles and renders them on all CPU cores. Returns
+// false if the wxDC path has to be used instead: the tiled renderer is
+// turned off, the shapes are not polygons, the bitmap is scaled for a high
+// DPI screen, or a category uses a hatched brush or a wide pen.
+bool MapCanvas::RasterizeSelectableShapes(wxMemoryDC& dc)
+{
+    if (!GdaConst::gda_use_tiled_renderer || !display_map_with_graph ||
+        selectable_shps_type != polygons ||
+        (enable_high_dpi_support && scale_factor != 1)) {
+        return false;
+    }
+    int cc_ts = cat_data.curr_canvas_tm_step;
+    int num_cats = cat_data.GetNumCategories(cc_ts);
+    for (int cat=0; cat<num_cats; cat++) {
+        wxBrush brush = cat_data.GetCategoryBrush(cc_ts, cat);
+        if (brush.GetStyle() != wxBRUSHSTYLE_SOLID) return false;
+        if (selectable_outline_visible &&
+            cat_data.GetCategoryPen(cc_ts, cat).GetWidth() > 1) {
+            return false;
+        }
+    }
+    // category colors are only translucent where wxGCDC is used
+    bool use_alpha = true;
+#ifndef __WXOSX__
+    use_alpha = GdaConst::gda_enable_set_transparency_windows;
+#endif
+
+    dc.SelectObject(wxNullBitmap);
+    wxImage image = layer0_bm->ConvertToImage();
+    dc.SelectObject(*layer0_bm);
+    if (image.HasAlpha()) {
+        image.ClearAlpha();
+    }
+    MapLayerRasterizer rasterizer(image.GetData(), image.GetWidth(),
+                                  image.GetHeight());
+    for (int cat=0; cat<num_cats; cat++) {
+        wxColour fill = cat_data.GetCategoryColor(cc_ts, cat);
+        wxColour pen = fill;
+        if (selectable_outline_visible) {
+            pen = cat_data.GetCategoryPen(cc_ts, cat).GetColour();
+        }
+        if (!use_alpha) {
+            fill = wxColour(fill.Red(), fill.Green(), fill.Blue());
+            pen = wxColour(pen.Red(), pen.Green(), pen.Blue());
+        }
+        std::vector<int>& ids = cat_data.GetIdsRef(cc_ts, cat);
+        for (size_t i=0; i<ids.size(); i++) {
+            if (!_IsShpValid(ids[i])) continue;
+            rasterizer.AddPolygon((GdaPolygon*) selectable_shps[ids[i]],
+                                  fill, pen);
+        }
+    }
+    rasterizer.Render();
+    dc.DrawBitmap(wxBitmap(image), 0, 0);
+    return true;
+}
+
 void MapCanvas::TranslucentLayer0(wxMemoryDC& dc)
 {
     wxSize sz = dc.GetSize();
@@ -1133,27 +1202,10 @@ void MapCanvas::TranslucentLayer0(wxMemoryDC& dc)
     }
     if (mask_needed) {
         if (faded_layer_bm == NULL) {
+            // kept until layer0 or the transparency changes
             wxImage image = layer0_bm->ConvertToImage();
-            if (!image.HasAlpha()) {
-                image.InitAlpha();
-            }
-            unsigned char *alpha=image.GetAlpha();
-            unsigned char* pixel_data = image.GetData();
-            int n_pixel = image.GetWidth() * image.GetHeight();
-
-            int pos = 0;
-            for (int i=0; i< n_pixel; i++) {
-                // check rgb
-                pos = i * 3;
-                if (pixel_data[pos] == MASK_R &&
-                    pixel_data[pos+1] == MASK_G &&
-                    pixel_data[pos+2] == MASK_B)
-                {
-                    alpha[i] = 0;
-                } else {
-                    if (alpha[i] !=0 ) alpha[i] = alpha_value;
-                }
-            }
+            LayerCompositor::MaskAlpha(image, MASK_R, MASK_G, MASK_B,
+                                       alpha_value);
             faded_layer_bm = new wxBitmap(image);
         }
         if (enable_high_dpi_support && scale_factor != 1) {
@@ -1166,45 +1218,18 @@ void MapCanvas::TranslucentLayer0(wxMemoryDC& dc)
         int hl_alpha_value = revert ? tran_unhighlighted : GdaConst::transparency_highlighted;
         if ( draw_highlight ) {
             if ( !draw_highlight_in_multilayers && (hl_alpha_value == 255 || GdaConst::use_cross_hatching)) {
+                hl_image_valid = false;
                 DrawHighlightedShapes(dc, revert);
             } else {
                 // draw a highlight with transparency
-                wxBitmap map_hl_bm(sz.GetWidth(), sz.GetHeight());
-                wxMemoryDC _dc;
-                // use a special color for mask transparency: 244, 243, 242c
-                wxColour maskColor(MASK_R, MASK_G, MASK_B);
-                wxBrush maskBrush(maskColor);
-                _dc.SetBackground(maskBrush);
-                _dc.SelectObject(map_hl_bm);
-                _dc.Clear();
-                DrawHighlightedShapes(_dc, revert);
-                _dc.SelectObject(wxNullBitmap);
-                wxImage image = map_hl_bm.ConvertToImage();
-                if (!image.HasAlpha()) {
-                    image.InitAlpha();
-                }
-                unsigned char* alpha_vals = image.GetAlpha();
-                unsigned char* pixel_data = image.GetData();
-                int n_pixel = image.GetWidth() * image.GetHeight();
-                int pos = 0;
-                for (int i=0; i< n_pixel; i++) {
-                    // check rgb
-                    pos = i * 3;
-                    if (pixel_data[pos] == MASK_R &&
-                        pixel_data[pos+1] == MASK_G &&
-                        pixel_data[pos+2] == MASK_B)
-                    {
-                        alpha_vals[i] = 0;
-                    } else {
-                        if (alpha_vals[i] !=0)
-                            alpha_vals[i] = draw_highlight_in_multilayers ? 100: hl_alpha_value;
-                    }
-                }
-                wxBitmap bm(image);
-                dc.DrawBitmap(bm,0,0);
+                int hl_alpha = draw_highlight_in_multilayers ? 100 : hl_alpha_value;
+                DrawTranslucentHighlight(dc, revert, hl_alpha);
             }
+        } else {
+            hl_image_valid = false;
         }
     } else {
+        hl_image_valid = false;
         if (faded_layer_bm) {
             ResetFadedLayer();
         }
@@ -1215,6 +1240,109 @@ void MapCanvas::TranslucentLayer0(wxMemoryDC& dc)
     }
 }
 
+void MapCanvas::DrawTranslucentHighlight(wxMemoryDC& dc, bool revert,
+                                         int hl_alpha)
+{
+    wxSize sz = dc.GetSize();
+    wxRect full_rect(0, 0, sz.GetWidth(), sz.GetHeight());
+    if (hl_bm == NULL || hl_bm->GetWidth() != sz.GetWidth() ||
+        hl_bm->GetHeight() != sz.GetHeight()) {
+        if (hl_bm) delete hl_bm;
+        hl_bm = new wxBitmap(sz.GetWidth(), sz.GetHeight());
+        hl_image_valid = false;
+    }
+    bool partial = hl_image_valid && hl_partial_update &&
+                   hl_image_alpha == hl_alpha;
+    wxRect rect = full_rect;
+    if (partial) {
+        rect = hl_dirty_rect.Intersect(full_rect);
+        if (rect == full_rect) partial = false;
+    }
+    if (!rect.IsEmpty()) {
+        wxMemoryDC _dc;
+        // use a special color for mask transparency: 244, 243, 242c
+        wxColour maskColor(MASK_R, MASK_G, MASK_B);
+        wxBrush maskBrush(maskColor);
+        _dc.SelectObject(*hl_bm);
+        if (partial) {
+            // only the pixels of rect are drawn again and read back: the
+            // rest of hl_bm is not used
+            _dc.SetClippingRegion(rect);
+            _dc.SetPen(wxPen(maskColor));
+            _dc.SetBrush(maskBrush);
+            _dc.DrawRectangle(rect);
+        } else {
+            _dc.SetBackground(maskBrush);
+            _dc.Clear();
+        }
+        DrawHighlightedShapes(_dc, revert);
+        if (partial) _dc.DestroyClippingRegion();
+        _dc.SelectObject(wxNullBitmap);
+        if (partial) {
+            wxImage sub_image = hl_bm->GetSubBitmap(rect).ConvertToImage();
+            LayerCompositor::MaskAlpha(sub_image, MASK_R, MASK_G, MASK_B,
+                                       hl_alpha);
+            LayerCompositor::CopyRect(sub_image, hl_image, rect.x, rect.y);
+        } else {
+            hl_image = hl_bm->ConvertToImage();
+            LayerCompositor::MaskAlpha(hl_image, MASK_R, MASK_G, MASK_B,
+                                       hl_alpha);
+        }
+    }
+    hl_image_valid = true;
+    hl_image_alpha = hl_alpha;
+    hl_partial_update = false;
+    hl_dirty_rect = wxRect();
+
+    wxBitmap bm(hl_image);
+    dc.DrawBitmap(bm,0,0);
+}
+
+// Screen area covered by the first n shapes in ids, with a margin for the
+// outline, or the whole canvas if the extent of the shapes is not known
+wxRect MapCanvas::GetShapesExtent(std::vector<int>& ids, int n)
+{
+    wxRect extent;
+    for (int i=0; i<n; i++) {
+        int id = ids[i];
+        if (id < 0 || id >= (int) selectable_shps.size() || !_IsShpValid(id)) {
+            continue;
+        }
+        wxRect r;
+        if (selectable_shps_type == polygons) {
+            GdaPolygon* p = (GdaPolygon*) selectable_shps[id];
+            if (p->all_points_same || p->draw_n == 0) {
+                r = wxRect(p->center.x, p->center.y, 1, 1);
+            } else {
+                int x_min = p->points[0].x, x_max = p->points[0].x;
+                int y_min = p->points[0].y, y_max = p->points[0].y;
+                for (int j=1; j<p->draw_n; j++) {
+                    if (p->points[j].x < x_min) x_min = p->points[j].x;
+                    if (p->points[j].x > x_max) x_max = p->points[j].x;
+                    if (p->points[j].y < y_min) y_min = p->points[j].y;
+                    if (p->points[j].y > y_max) y_max = p->points[j].y;
+                }
+                r = wxRect(wxPoint(x_min, y_min), wxPoint(x_max, y_max));
+            }
+        } else if (selectable_shps_type == points) {
+            GdaPoint* p = (GdaPoint*) selectable_shps[id];
+            int rad = (int) ceil(p->radius);
+            r = wxRect(p->center.x - rad, p->center.y - rad, 2*rad+1, 2*rad+1);
+        } else if (selectable_shps_type == circles) {
+            GdaCircle* c = (GdaCircle*) selectable_shps[id];
+            int rad = (int) ceil(c->radius);
+            r = wxRect(c->center.x - rad, c->center.y - rad, 2*rad+1, 2*rad+1);
+        } else {
+            int w = 0, h = 0;
+            GetClientSize(&w, &h);
+            return wxRect(0, 0, w, h);
+        }
+        r.Inflate(2);
+        extent.Union(r);
+    }
+    return extent;
+}
+
 void MapCanvas::SetWeightsId(boost::uuids::uuid id)
 {
     weights_id = id;
@@ -3086,15 +3214,18 @@ void MapCanvas::update(HLStateInt* o)
     // if there is any existing highlighted objects in backgroun/foregreound
     // layers, reset them to avoid highligh conflict since this function is
     // called to highlight current layer instead of background/foreground
+    bool layers_highlighted = false;
     for (size_t i=0; i<bg_maps.size(); ++i) {
         BackgroundMapLayer* ml = bg_maps[i];
         if (ml && ml->IsHide() == false) {
+            if (ml->GetHighlightRecords() > 0) layers_highlighted = true;
             ml->ResetHighlight();
         }
     }
     for (size_t i=0; i<fg_maps.size(); ++i) {
         BackgroundMapLayer* ml = fg_maps[i];
         if (ml && ml->IsHide() == false) {
+            if (ml->GetHighlightRecords() > 0) layers_highlighted = true;
             ml->ResetHighlight();
         }
     }
@@ -3117,9 +3248,26 @@ void MapCanvas::update(HLStateInt* o)
             ResetFadedLayer();
         }
 
+        // only the shapes that changed need to be redrawn in the translucent
+        // highlight layer, unless the highlight also draws neighbors, the
+        // weights graph or other layers
+        bool show_graph = display_weights_graph &&
+            boost::uuids::nil_uuid() != weights_id && !w_graph.empty();
+        hl_partial_update = false;
+        if (type == HLStateInt::delta && hl_image_valid &&
+            !layers_highlighted && associated_layers.empty() &&
+            display_map_with_graph && !show_graph && !display_neighbors) {
+            hl_dirty_rect = GetShapesExtent(o->GetNewlyHighlighted(),
+                                            o->GetTotalNewlyHighlighted());
+            hl_dirty_rect.Union(GetShapesExtent(o->GetNewlyUnhighlighted(),
+                                                o->GetTotalNewlyUnhighlighted()));
+            hl_partial_update = true;
+        }
+
         // re-paint highlight layer (layer1_bm)
         layer1_valid = false;
         DrawLayers();
+        hl_partial_update = false;
 
         UpdateStatusBar();
     }
@@ -169,6 +169,7 @@ public:
     void SetNoBasemap();
     void OnIdle(wxIdleEvent& event);
     void TranslucentLayer0(wxMemoryDC& dc);
+    bool RasterizeSelectableShapes(wxMemoryDC& dc);
     void RenderToSVG(wxDC& dc, int svg_w, int svg_h, int map_w, int map_h,
                      int offset_x, int offset_y);
     void SetupColor();
@@ -300,6 +301,18 @@ protected:
     
 	wxBitmap* basemap_bm;
 	Gda::Basemap* basemap;
+
+    // Translucent highlight layer: hl_bm is drawn over the mask colour and
+    // hl_image holds it with the mask-keyed alpha.  After a delta selection
+    // only hl_dirty_rect, the area of the shapes that changed, is redrawn.
+    wxBitmap* hl_bm;
+    wxImage hl_image;
+    bool hl_image_valid;
+    int hl_image_alpha;
+    bool hl_partial_update;
+    wxRect hl_dirty_rect;
+    void DrawTranslucentHighlight(wxMemoryDC& dc, bool revert, int hl_alpha);
+    wxRect GetShapesExtent(std::vector<int>& ids, int n);
     
     void show_empty_shps_msgbox();
     void SaveThumbnail();
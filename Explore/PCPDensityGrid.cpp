@@ -0,0 +1,199 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <boost/bind.hpp>
+#include "../GdaShape.h"
+#include "PCPDensityGrid.h"
+
+/** Orders observation ids by their value on one axis */
+struct pcp_axis_less {
+	const std::vector<double>* x;
+	pcp_axis_less(const std::vector<double>* x_) : x(x_) {}
+	bool operator()(int i, int j) const { return (*x)[i] < (*x)[j]; }
+};
+
+PCPDensityGrid::PCPDensityGrid()
+: n_obs(0)
+{
+	// lines are one pixel wide, as GdaPolyLine draws them
+	spread = 0;
+}
+
+PCPDensityGrid::~PCPDensityGrid()
+{
+}
+
+void PCPDensityGrid::SetLines(std::vector<std::vector<double> >& x,
+							  const std::vector<double>& axis_y,
+							  const std::vector<bool>& undef_)
+{
+	n_obs = x.empty() ? 0 : x[0].size();
+	ax_o.swap(x);
+	x.clear();
+	ay_o = axis_y;
+	undef = undef_;
+	undef.resize(n_obs, false);
+	int n_axes = ax_o.size();
+	ax_px.resize(n_axes);
+	ay_px.resize(n_axes);
+	ax_order.resize(n_axes);
+	for (int a=0; a<n_axes; a++) {
+		ax_px[a].resize(n_obs);
+		ax_order[a].clear();
+		for (int i=0; i<n_obs; i++) {
+			if (!undef[i]) ax_order[a].push_back(i);
+		}
+	}
+	// every axis is sorted by its own thread
+	RunThreads(n_axes, n_obs * n_axes,
+			   boost::bind(&PCPDensityGrid::SortAxes, this, _1, _2));
+	// positions are unknown until the next ApplyScaleTrans
+	width = 0;
+	height = 0;
+}
+
+void PCPDensityGrid::SortAxes(int start, int end)
+{
+	for (int a=start; a<=end; a++) {
+		std::sort(ax_order[a].begin(), ax_order[a].end(),
+				  pcp_axis_less(&ax_o[a]));
+	}
+}
+
+void PCPDensityGrid::ApplyScaleTrans(const GdaScaleTrans& A,
+									 int width_, int height_)
+{
+	width = std::max(width_, 1);
+	height = std::max(height_, 1);
+	for (size_t a=0; a<ay_o.size(); a++) {
+		ay_px[a] = (int) (ay_o[a] * A.scale_y + A.trans_y);
+	}
+	RunThreads(n_obs, n_obs, boost::bind(&PCPDensityGrid::TransformLines,
+										 this, &A, _1, _2));
+	for (int k=0; k<2; k++) {
+		counts[k].resize(width * height);
+		top_cat[k].resize(width * height);
+	}
+}
+
+/** Pixel positions as GdaScaleTrans::transform gives them to the vertices
+ of a GdaPolyLine */
+void PCPDensityGrid::TransformLines(const GdaScaleTrans* A,
+									int start, int end)
+{
+	const double sx = A->scale_x;
+	const double tx = A->trans_x;
+	for (size_t a=0; a<ax_o.size(); a++) {
+		const double* x = &ax_o[a][0];
+		int* px = &ax_px[a][0];
+		for (int i=start; i<=end; i++) px[i] = (int) (x[i] * sx + tx);
+	}
+}
+
+void PCPDensityGrid::Bin(const std::vector<bool>& hl,
+						 const std::vector<int>& cat)
+{
+	if (width == 0 || height == 0 || n_obs == 0) return;
+	RunThreads(height, n_obs, boost::bind(&PCPDensityGrid::BinLineRows, this,
+										  &hl, &cat, _1, _2));
+}
+
+/** Pixel rows start..end of all segments.  The segment between axes a and
+ a+1 covers the rows from the row of axis a up to the row of axis a+1,
+ which belongs to the next segment unless a+1 is the last axis.  In every
+ row it fills the span of pixels up to where it enters the next row. */
+void PCPDensityGrid::BinLineRows(const std::vector<bool>* hl,
+								 const std::vector<int>* cat,
+								 int start, int end)
+{
+	for (int k=0; k<2; k++) {
+		memset(&counts[k][start*width], 0, (end-start+1)*width*sizeof(int));
+		memset(&top_cat[k][start*width], 0, (end-start+1)*width*sizeof(int));
+	}
+	int hl_size = hl->size();
+	int cat_size = cat->size();
+	int n_axes = ax_px.size();
+	for (int a=0; a+1<n_axes; a++) {
+		int ya = ay_px[a];
+		int yb = ay_px[a+1];
+		if (ya == yb) continue;
+		int dir = (yb > ya) ? 1 : -1;
+		int r_lo = std::min(ya, yb);
+		int r_hi = std::max(ya, yb);
+		if (a+2 < n_axes) {
+			if (dir > 0) r_hi--; else r_lo++;
+		}
+		r_lo = std::max(r_lo, start);
+		r_hi = std::min(r_hi, end);
+
+		const int* xa = &ax_px[a][0];
+		const int* xb = &ax_px[a+1][0];
+		const double dy = yb - ya;
+		for (int r=r_lo; r<=r_hi; r++) {
+			double f0 = (r - ya) / dy;
+			double f1 = std::min((r + dir - ya) / dy, 1.0);
+			for (int i=0; i<n_obs; i++) {
+				if (undef[i]) continue;
+				double dx = xb[i] - xa[i];
+				int p0 = (int) floor(xa[i] + dx * f0 + 0.5);
+				int p1 = (int) floor(xa[i] + dx * f1 + 0.5);
+				// the pixel where the line enters the next row is left to it
+				if (p1 > p0) {
+					p1--;
+				} else if (p1 < p0) {
+					std::swap(p0, p1);
+					p0++;
+				}
+				p0 = std::max(p0, 0);
+				p1 = std::min(p1, width-1);
+				if (p0 > p1) continue;
+				int k = (i < hl_size && (*hl)[i]) ? 1 : 0;
+				int c = i < cat_size ? (*cat)[i] : 0;
+				int* cnt = &counts[k][r*width];
+				int* tc = &top_cat[k][r*width];
+				for (int x=p0; x<=p1; x++) {
+					cnt[x]++;
+					if (c > tc[x]) tc[x] = c;
+				}
+			}
+		}
+	}
+}
+
+void PCPDensityGrid::QueryAxisRange(int a, int x0, int x1,
+									std::vector<int>& ids) const
+{
+	ids.clear();
+	if (a < 0 || a >= (int) ax_order.size() || x0 > x1) return;
+	const std::vector<int>& order = ax_order[a];
+	const std::vector<int>& px = ax_px[a];
+	// first position with px >= x0
+	int lo = 0;
+	int hi = order.size();
+	while (lo < hi) {
+		int m = (lo + hi) / 2;
+		if (px[order[m]] < x0) lo = m+1; else hi = m;
+	}
+	for (int j=lo, jend=order.size(); j<jend && px[order[j]] <= x1; j++) {
+		ids.push_back(order[j]);
+	}
+}
@@ -0,0 +1,82 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PCP_DENSITY_GRID_H__
+#define __GEODA_CENTER_PCP_DENSITY_GRID_H__
+
+#include <vector>
+#include "PointDensityGrid.h"
+
+/**
+ Aggregated stand-in for the selectable GdaPolyLine objects of a parallel
+ coordinate plot with many observations.
+
+ Every observation crosses the horizontal axis a at (x[a][i], axis_y[a]).
+ Bin rasterizes the line segments between adjacent axes into the pixel
+ counts of PointDensityGrid, one pixel row per thread range, so that no
+ two threads write to the same pixel.  Render of the base class turns the
+ counts into an image, without spreading the pixels.
+
+ The observation ids are sorted by their position on every axis, so that
+ brushing a range of an axis is a binary search.
+ */
+class PCPDensityGrid : public PointDensityGrid
+{
+public:
+	PCPDensityGrid();
+	virtual ~PCPDensityGrid();
+
+	/** x[a][i] is the position of observation i on axis a, in the same
+	 unscaled coordinates a GdaPolyLine vertex would get.  x is swapped
+	 into the grid and left empty. */
+	void SetLines(std::vector<std::vector<double> >& x,
+				  const std::vector<double>& axis_y,
+				  const std::vector<bool>& undef);
+
+	virtual void ApplyScaleTrans(const GdaScaleTrans& A, int width, int height);
+	virtual void Bin(const std::vector<bool>& hl, const std::vector<int>& cat);
+	/** Number of observations (lines), not of axis points.  The inherited
+	 canvas selection and category code sizes its vectors by this. */
+	virtual int GetNumPoints() const { return n_obs; }
+
+	int GetNumAxes() const { return ax_o.size(); }
+	/** Pixel position of observation i on axis a */
+	wxPoint GetAxisPoint(int a, int i) const {
+		return wxPoint(ax_px[a][i], ay_px[a]); }
+	/** Ids of the defined observations that cross axis a at a pixel x in
+	 [x0, x1], in increasing order of x. */
+	void QueryAxisRange(int a, int x0, int x1, std::vector<int>& ids) const;
+
+protected:
+	void SortAxes(int start, int end);
+	void TransformLines(const GdaScaleTrans* A, int start, int end);
+	void BinLineRows(const std::vector<bool>* hl, const std::vector<int>* cat,
+					 int start, int end);
+
+	int n_obs;
+	// unscaled and pixel positions of the observations on every axis
+	std::vector<std::vector<double> > ax_o;
+	std::vector<std::vector<int> > ax_px;
+	std::vector<double> ay_o;
+	std::vector<int> ay_px;
+	// ids of the defined observations sorted by their position on every axis
+	std::vector<std::vector<int> > ax_order;
+};
+
+#endif
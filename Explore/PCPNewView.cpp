@@ -39,9 +39,11 @@
 #include "../DialogTools/CatClassifDlg.h"
 #include "../GdaConst.h"
 #include "../GeneralWxUtils.h"
+#include "../GenGeomAlgs.h"
 #include "../logger.h"
 #include "../GeoDa.h"
 #include "../Project.h"
+#include "PCPDensityGrid.h"
 #include "PCPNewView.h"
 
 IMPLEMENT_CLASS(PCPCanvas, TemplateCanvas)
@@ -480,8 +482,21 @@ void PCPCanvas::PopulateCanvas()
     last_scale_trans.SetMargin(25, virtual_screen_marg_bottom, 135, 25);
     last_scale_trans.SetView(size.GetWidth(), size.GetHeight());
     
-	selectable_shps.resize(num_obs);
-    selectable_shps_undefs.resize(num_obs);
+	// with many observations the lines go into a density grid instead of
+	// one GdaPolyLine each
+	ClearDensityPoints();
+	bool density = num_obs >= GdaConst::pcp_density_min_obs;
+	std::vector<std::vector<double> > axis_x;
+	std::vector<bool> line_undefs;
+	if (density) {
+		selectable_shps.clear();
+		selectable_shps_undefs.clear();
+		axis_x.resize(num_vars, std::vector<double>(num_obs));
+		line_undefs.resize(num_obs);
+	} else {
+		selectable_shps.resize(num_obs);
+		selectable_shps_undefs.resize(num_obs);
+	}
 	
 	GdaShape* s = 0;
 	wxRealPoint* pts = new wxRealPoint[num_vars];
@@ -515,9 +530,21 @@ void PCPCanvas::PopulateCanvas()
 			}
 			pts[v].y = 100.0-(nvf*((double) v));
 		}
+		if (density) {
+			for (int v=0; v<num_vars; v++) axis_x[v][i] = pts[v].x;
+			line_undefs[i] = !valid_line;
+			continue;
+		}
         selectable_shps_undefs[i] = !valid_line;
         selectable_shps[i] = new GdaPolyLine(num_vars, pts);
 	}
+	if (density) {
+		std::vector<double> axis_y(num_vars);
+		for (int v=0; v<num_vars; v++) axis_y[v] = 100.0-(nvf*((double) v));
+		PCPDensityGrid* grid = new PCPDensityGrid;
+		grid->SetLines(axis_x, axis_y, line_undefs);
+		density_grid = grid;
+	}
 	wxPen control_line_pen(GdaConst::pcp_horiz_line_color);
 	control_line_pen.SetWidth(2);
     
@@ -1051,6 +1078,142 @@ void PCPCanvas::MoveControlLine(int final_y)
 	PopulateCanvas();
 }
 
+/** Same test as GdaPolyLine::pointWithin for one segment */
+static bool pcp_near_segment(const wxPoint& pt, const wxPoint& a,
+							 const wxPoint& b, double r)
+{
+	wxRealPoint hp((a.x + b.x)/2.0, (a.y + b.y)/2.0);
+	double hp_rad = GenUtils::distance(a, b)/2.0;
+	return ((GenUtils::pointToLineDist(pt, a, b) <= r) &&
+			(GenUtils::distance(hp, pt) <= hp_rad + r));
+}
+
+/**
+ In density mode there are no GdaPolyLines to test.  A rectangle that
+ covers one or more axes selects the lines that cross these axes inside
+ the rectangle, found by binary search in the sorted positions of every
+ axis.  Otherwise only the segments between the axes the brush reaches
+ are tested, with the same rules as TemplateCanvas.
+ */
+void PCPCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
+{
+	if (!IsDensityMode()) {
+		TemplateCanvas::UpdateSelectionPolylines(shiftdown, pointsel);
+		return;
+	}
+	PCPDensityGrid* grid = (PCPDensityGrid*) density_grid;
+	vector<bool>& hs = GetSelBitVec();
+	int hl_size = hs.size();
+	if (hl_size != grid->GetNumPoints()) return;
+	int n_axes = grid->GetNumAxes();
+	
+	double radius = 3.0;
+	int y0 = std::min(sel1.y, sel2.y);
+	int y1 = std::max(sel1.y, sel2.y);
+	if (pointsel) {
+		y0 = sel1.y - 3;
+		y1 = sel1.y + 3;
+	} else if (brushtype == circle) {
+		radius = GenUtils::distance(sel1, sel2);
+		y0 = (int) floor(sel1.y - radius);
+		y1 = (int) ceil(sel1.y + radius);
+	}
+	
+	vector<bool> contains(hl_size, false);
+	bool axis_brushed = false;
+	if (!pointsel && brushtype == rectangle) {
+		int x0 = std::min(sel1.x, sel2.x);
+		int x1 = std::max(sel1.x, sel2.x);
+		vector<int> ids;
+		for (int a=0; a<n_axes; a++) {
+			int ay = grid->GetAxisPoint(a, 0).y;
+			if (ay < y0 || ay > y1) continue;
+			axis_brushed = true;
+			grid->QueryAxisRange(a, x0, x1, ids);
+			for (size_t j=0; j<ids.size(); j++) contains[ids[j]] = true;
+		}
+	}
+	
+	wxPoint lleft, uright, uleft, lright;
+	if (brushtype == rectangle) {
+		GenGeomAlgs::StandardizeRect(sel1, sel2, lleft, uright);
+		uleft = wxPoint(lleft.x, uright.y);
+		lright = wxPoint(uright.x, lleft.y);
+	}
+	for (int a=0; a+1<n_axes && !axis_brushed; a++) {
+		int ya = grid->GetAxisPoint(a, 0).y;
+		int yb = grid->GetAxisPoint(a+1, 0).y;
+		if (std::max(ya, yb) < y0 || std::min(ya, yb) > y1) continue;
+		for (int i=0; i<hl_size; i++) {
+			if (contains[i] || grid->IsUndefined(i)) continue;
+			wxPoint pt = grid->GetAxisPoint(a, i);
+			wxPoint next_pt = grid->GetAxisPoint(a+1, i);
+			if (pointsel || brushtype == circle) {
+				contains[i] = pcp_near_segment(sel1, pt, next_pt, radius);
+			} else if (brushtype == line) {
+				contains[i] = GenGeomAlgs::LineSegsIntersect(pt, next_pt,
+															 sel1, sel2);
+			} else {
+				contains[i] =
+					(GenGeomAlgs::LineSegsIntersect(pt, next_pt, lleft, uleft) ||
+					 GenGeomAlgs::LineSegsIntersect(pt, next_pt, uleft, uright) ||
+					 GenGeomAlgs::LineSegsIntersect(pt, next_pt, uright, lright) ||
+					 GenGeomAlgs::LineSegsIntersect(pt, next_pt, lright, lleft));
+			}
+		}
+	}
+	
+    bool selection_changed = false;
+	for (int i=0; i<hl_size; i++) {
+		if (grid->IsUndefined(i)) continue;
+		if (pointsel && contains[i]) {
+			hs[i] = !hs[i];
+			selection_changed = true;
+		} else if (contains[i]) {
+			if (!hs[i]) {
+				hs[i] = true;
+				selection_changed = true;
+			}
+		} else if (!shiftdown && hs[i]) {
+			hs[i] = false;
+			selection_changed = true;
+		}
+	}
+    if (selection_changed) {
+        int total_highlighted = 1; // used for MapCanvas::Drawlayer1
+        highlight_state->SetTotalHighlighted(total_highlighted);
+        highlight_timer->Start(50);
+    }
+}
+
+void PCPCanvas::DetermineMouseHoverObjects(wxPoint pt)
+{
+	if (!IsDensityMode()) {
+		TemplateCanvas::DetermineMouseHoverObjects(pt);
+		return;
+	}
+	total_hover_obs = 0;
+	hover_obs.clear();
+	PCPDensityGrid* grid = (PCPDensityGrid*) density_grid;
+	int n_obs = grid->GetNumPoints();
+	for (int a=0, n_axes=grid->GetNumAxes(); a+1<n_axes; a++) {
+		int ya = grid->GetAxisPoint(a, 0).y;
+		int yb = grid->GetAxisPoint(a+1, 0).y;
+		if (pt.y < std::min(ya, yb) - 3 || pt.y > std::max(ya, yb) + 3) {
+			continue;
+		}
+		for (int i=0; i<n_obs && total_hover_obs<max_hover_obs; i++) {
+			if (grid->IsUndefined(i)) continue;
+			if (pcp_near_segment(pt, grid->GetAxisPoint(a, i),
+								 grid->GetAxisPoint(a+1, i), 3.0)) {
+				hover_obs.push_back(i);
+				total_hover_obs++;
+			}
+		}
+		break;
+	}
+}
+
 CatClassification::CatClassifType PCPCanvas::GetCcType()
 {
 	return cat_classif_def.cat_classif_type;
@@ -85,6 +85,9 @@ public:
 	/** Override PaintControls from TemplateCanvas */
 	virtual void PaintControls(wxDC& dc);
 	void MoveControlLine(int final_y);
+	virtual void UpdateSelectionPolylines(bool shiftdown = false,
+										  bool pointsel = false);
+	virtual void DetermineMouseHoverObjects(wxPoint pt);
 
 	CatClassifDef cat_classif_def;
 	CatClassification::CatClassifType GetCcType();
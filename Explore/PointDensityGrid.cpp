@@ -0,0 +1,253 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include "../GdaConst.h"
+#include "../GdaShape.h"
+#include "../Algorithms/threadpool.h"
+#include "PointDensityGrid.h"
+
+// fewer observations than this per thread are not worth a thread
+static const int density_min_obs_per_thread = 50000;
+
+const int PointDensityGrid::bucket_size;
+
+void PointDensityGrid::RunThreads(int n, int n_obs,
+								  boost::function<void (int, int)> worker)
+{
+	if (n <= 0) return;
+	// items of n per thread that amount to density_min_obs_per_thread obs
+	int min_per_thread = n;
+	if (n_obs > 0) {
+		wxInt64 m = ((wxInt64) n * density_min_obs_per_thread + n_obs - 1)
+			/ n_obs;
+		if (m < n) min_per_thread = (int) m;
+	}
+	run_range_threads(n, min_per_thread, worker);
+}
+
+PointDensityGrid::PointDensityGrid()
+: width(0), height(0), n_buckets_x(0), n_buckets_y(0), spread(1)
+{
+}
+
+PointDensityGrid::~PointDensityGrid()
+{
+}
+
+void PointDensityGrid::SetPoints(const std::vector<double>& x,
+								 const std::vector<double>& y,
+								 const std::vector<bool>& undef_,
+								 double x_min, double scale_x,
+								 double y_min, double scale_y)
+{
+	int n = x.size();
+	x_o.resize(n);
+	y_o.resize(n);
+	for (int i=0; i<n; i++) {
+		x_o[i] = (x[i] - x_min) * scale_x;
+		y_o[i] = (y[i] - y_min) * scale_y;
+	}
+	undef = undef_;
+	undef.resize(n, false);
+	pts.resize(n);
+	pt_bucket.resize(n);
+	// positions are unknown until the next ApplyScaleTrans
+	width = 0;
+	height = 0;
+	n_buckets_x = 0;
+	n_buckets_y = 0;
+	bucket_start.clear();
+	bucket_ids.clear();
+}
+
+void PointDensityGrid::ApplyScaleTrans(const GdaScaleTrans& A,
+									   int width_, int height_)
+{
+	width = std::max(width_, 1);
+	height = std::max(height_, 1);
+	n_buckets_x = (width + bucket_size - 1) / bucket_size;
+	n_buckets_y = (height + bucket_size - 1) / bucket_size;
+
+	int n = x_o.size();
+	RunThreads(n, n, boost::bind(&PointDensityGrid::TransformRange,
+								 this, &A, _1, _2));
+
+	// counting sort of the point ids by bucket
+	int n_buckets = n_buckets_x * n_buckets_y;
+	bucket_start.assign(n_buckets+1, 0);
+	for (int i=0; i<n; i++) {
+		if (pt_bucket[i] >= 0) bucket_start[pt_bucket[i]+1]++;
+	}
+	for (int b=0; b<n_buckets; b++) bucket_start[b+1] += bucket_start[b];
+	bucket_ids.resize(bucket_start[n_buckets]);
+	std::vector<int> pos(bucket_start.begin(), bucket_start.end()-1);
+	for (int i=0; i<n; i++) {
+		if (pt_bucket[i] >= 0) bucket_ids[pos[pt_bucket[i]]++] = i;
+	}
+
+	for (int k=0; k<2; k++) {
+		counts[k].resize(width * height);
+		top_cat[k].resize(width * height);
+	}
+}
+
+/** Pixel positions as GdaScaleTrans::transform gives them to a GdaPoint.
+ Points off the screen go to the nearest bucket on its border, so that a
+ brush dragged past the window still finds them. */
+void PointDensityGrid::TransformRange(const GdaScaleTrans* A,
+									  int start, int end)
+{
+	const double sx = A->scale_x, sy = A->scale_y;
+	const double tx = A->trans_x, ty = A->trans_y;
+	for (int i=start; i<=end; i++) {
+		pts[i].x = (int) (x_o[i] * sx + tx);
+		pts[i].y = (int) (y_o[i] * sy + ty);
+		if (undef[i]) {
+			pt_bucket[i] = -1;
+			continue;
+		}
+		int bx = std::min(std::max(pts[i].x, 0), width-1) / bucket_size;
+		int by = std::min(std::max(pts[i].y, 0), height-1) / bucket_size;
+		pt_bucket[i] = by * n_buckets_x + bx;
+	}
+}
+
+void PointDensityGrid::Bin(const std::vector<bool>& hl,
+						   const std::vector<int>& cat)
+{
+	if (n_buckets_y == 0) return;
+	RunThreads(n_buckets_y, bucket_ids.size(),
+			   boost::bind(&PointDensityGrid::BinRows, this,
+						   &hl, &cat, _1, _2));
+}
+
+/** Bucket rows start..end cover pixel rows no other thread touches */
+void PointDensityGrid::BinRows(const std::vector<bool>* hl,
+							   const std::vector<int>* cat,
+							   int start, int end)
+{
+	int y0 = start * bucket_size;
+	int y1 = std::min((end+1) * bucket_size, height);
+	for (int k=0; k<2; k++) {
+		memset(&counts[k][y0*width], 0, (y1-y0)*width*sizeof(int));
+		memset(&top_cat[k][y0*width], 0, (y1-y0)*width*sizeof(int));
+	}
+	int hl_size = hl->size();
+	int cat_size = cat->size();
+	for (int j=bucket_start[start*n_buckets_x],
+		 j_end=bucket_start[(end+1)*n_buckets_x]; j<j_end; j++) {
+		int i = bucket_ids[j];
+		const wxPoint& pt = pts[i];
+		if (pt.x < 0 || pt.y < 0 || pt.x >= width || pt.y >= height) continue;
+		int k = (i < hl_size && (*hl)[i]) ? 1 : 0;
+		int c = i < cat_size ? (*cat)[i] : 0;
+		int px = pt.y * width + pt.x;
+		counts[k][px]++;
+		if (c > top_cat[k][px]) top_cat[k][px] = c;
+	}
+}
+
+/** A pixel with points gets an alpha that grows with the log of its count,
+ from a visible minimum for a single point to opaque for the densest pixel.
+ Every pixel is then spread to its neighbours (3x3 maximum for a spread of
+ 1), about the size of a GdaPoint circle. */
+void PointDensityGrid::Render(wxImage& image, Layer layer,
+							  const std::vector<wxColour>& cat_colours)
+{
+	if (width == 0 || height == 0 || cat_colours.empty()) return;
+	if (image.GetWidth() != width || image.GetHeight() != height) {
+		image.Create(width, height, false);
+	}
+	if (!image.HasAlpha()) image.InitAlpha();
+	unsigned char* rgb = image.GetData();
+	unsigned char* alpha = image.GetAlpha();
+
+	int n_px = width * height;
+	std::vector<int> cnt(n_px, 0);
+	std::vector<int> c(n_px, 0);
+	int c_max = 0;
+	for (int px=0; px<n_px; px++) {
+		if (layer != highlighted_obs && counts[0][px] > 0) {
+			cnt[px] += counts[0][px];
+			c[px] = top_cat[0][px];
+		}
+		if (layer != unhighlighted_obs && counts[1][px] > 0) {
+			cnt[px] += counts[1][px];
+			c[px] = std::max(c[px], top_cat[1][px]);
+		}
+		if (cnt[px] > c_max) c_max = cnt[px];
+	}
+
+	std::vector<unsigned char> a(n_px, 0);
+	double log_max = log(1.0 + c_max);
+	for (int px=0; px<n_px; px++) {
+		if (cnt[px] == 0) continue;
+		double f = log_max > 0 ? log(1.0 + cnt[px]) / log_max : 1.0;
+		a[px] = (unsigned char) (96 + 159 * f);
+	}
+
+	int n_cats = cat_colours.size();
+	for (int y=0; y<height; y++) {
+		for (int x=0; x<width; x++) {
+			int best = -1;
+			for (int yy=std::max(y-spread, 0);
+				 yy<=std::min(y+spread, height-1); yy++) {
+				for (int xx=std::max(x-spread, 0);
+					 xx<=std::min(x+spread, width-1); xx++) {
+					int q = yy * width + xx;
+					if (a[q] > 0 && (best < 0 || a[q] > a[best])) best = q;
+				}
+			}
+			int px = y * width + x;
+			if (best < 0) {
+				alpha[px] = 0;
+				rgb[3*px] = rgb[3*px+1] = rgb[3*px+2] = 0;
+				continue;
+			}
+			const wxColour& clr = cat_colours[std::min(c[best], n_cats-1)];
+			alpha[px] = a[best];
+			rgb[3*px] = clr.Red();
+			rgb[3*px+1] = clr.Green();
+			rgb[3*px+2] = clr.Blue();
+		}
+	}
+}
+
+void PointDensityGrid::Query(const wxRect& r, std::vector<int>& ids) const
+{
+	ids.clear();
+	if (n_buckets_x == 0 || r.IsEmpty()) return;
+	int bx0 = std::min(std::max(r.GetLeft(), 0), width-1) / bucket_size;
+	int bx1 = std::min(std::max(r.GetRight(), 0), width-1) / bucket_size;
+	int by0 = std::min(std::max(r.GetTop(), 0), height-1) / bucket_size;
+	int by1 = std::min(std::max(r.GetBottom(), 0), height-1) / bucket_size;
+	for (int by=by0; by<=by1; by++) {
+		for (int j=bucket_start[by*n_buckets_x + bx0],
+			 j_end=bucket_start[by*n_buckets_x + bx1 + 1]; j<j_end; j++) {
+			int i = bucket_ids[j];
+			if (r.Contains(pts[i])) ids.push_back(i);
+		}
+	}
+}
@@ -0,0 +1,111 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_POINT_DENSITY_GRID_H__
+#define __GEODA_CENTER_POINT_DENSITY_GRID_H__
+
+#include <vector>
+#include <boost/function.hpp>
+#include <wx/colour.h>
+#include <wx/gdicmn.h>
+#include <wx/image.h>
+
+struct GdaScaleTrans;
+
+/**
+ Aggregated stand-in for the selectable GdaPoint objects of a scatter plot
+ with many observations.
+
+ The points are kept as two flat coordinate arrays in the same unscaled
+ coordinates a GdaPoint would get.  ApplyScaleTrans computes their pixel
+ positions and sorts them into an index of bucket_size x bucket_size
+ pixel buckets.  Bin counts the points of every pixel into two grids, one
+ for unhighlighted and one for highlighted observations, and Render turns
+ a grid into a density image.  Brushing and hovering query the bucket
+ index instead of testing every observation.
+
+ ApplyScaleTrans and Bin run in parallel: the pixel positions by ranges of
+ observations, the counts by rows of buckets, so no two threads write to
+ the same pixel.
+ */
+class PointDensityGrid
+{
+public:
+	enum Layer { all_obs, unhighlighted_obs, highlighted_obs };
+
+	PointDensityGrid();
+	virtual ~PointDensityGrid();
+
+	/** Observation i is at ((x[i]-x_min)*scale_x, (y[i]-y_min)*scale_y)
+	 unless undef[i] is set. */
+	void SetPoints(const std::vector<double>& x, const std::vector<double>& y,
+				   const std::vector<bool>& undef,
+				   double x_min, double scale_x, double y_min, double scale_y);
+	virtual void ApplyScaleTrans(const GdaScaleTrans& A, int width, int height);
+
+	/** Count the points of every pixel.  cat gives the category of every
+	 observation; a pixel takes the colour of the highest category in it,
+	 as the last category drawn by wxDC would cover the others. */
+	virtual void Bin(const std::vector<bool>& hl, const std::vector<int>& cat);
+	/** Fill image (resized to the grid and given an alpha channel) with
+	 the density of layer, coloured by cat_colours. */
+	void Render(wxImage& image, Layer layer,
+				const std::vector<wxColour>& cat_colours);
+
+	/** Ids of the defined points with a pixel position inside r */
+	void Query(const wxRect& r, std::vector<int>& ids) const;
+
+	virtual int GetNumPoints() const { return x_o.size(); }
+	bool IsUndefined(int i) const { return undef[i]; }
+	const wxPoint& GetPoint(int i) const { return pts[i]; }
+
+	static const int bucket_size = 8;
+
+protected:
+	/** Split [0, n) into ranges and run worker on each, in parallel when
+	 n_obs observations are enough work for more than one thread. */
+	static void RunThreads(int n, int n_obs,
+						   boost::function<void (int, int)> worker);
+	void TransformRange(const GdaScaleTrans* A, int start, int end);
+	void BinRows(const std::vector<bool>* hl, const std::vector<int>* cat,
+				 int start, int end);
+
+	std::vector<double> x_o;
+	std::vector<double> y_o;
+	std::vector<bool> undef;
+	std::vector<wxPoint> pts;
+	// bucket of every point, and the point ids sorted by bucket (CSR)
+	std::vector<int> pt_bucket;
+	std::vector<int> bucket_start;
+	std::vector<int> bucket_ids;
+
+	int width;
+	int height;
+	int n_buckets_x;
+	int n_buckets_y;
+	// Render spreads every pixel this far to its neighbours
+	int spread;
+
+	// per pixel counts of unhighlighted / highlighted points, and the
+	// highest category of each
+	std::vector<int> counts[2];
+	std::vector<int> top_cat[2];
+};
+
+#endif
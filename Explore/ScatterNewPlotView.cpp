@@ -153,7 +153,7 @@ show_reg_selected(true), show_reg_excluded(true),
 sse_c(0), sse_sel(0), sse_unsel(0),
 chow_ratio(0), chow_pval(1), chow_valid(false), chow_test_text(0),
 show_linear_smoother(true), show_lowess_smoother(false), enableLowess(true),
-table_display_lines(0),
+regimes_lce(0), table_display_lines(0),
 X(project_s->GetNumRecords()), Y(project_s->GetNumRecords()), Z(0),
 obs_id_to_z_val_order(boost::extents[0][0]), all_init(false),
 bubble_size_scaler(1.0)
@@ -209,7 +209,7 @@ show_origin_axes(true), display_stats(!is_bubble_plot_s),
 show_reg_selected(!is_bubble_plot_s), show_reg_excluded(!is_bubble_plot_s),
 sse_c(0), sse_sel(0), sse_unsel(0),
 show_linear_smoother(!is_bubble_plot_s),
-show_lowess_smoother(false), enableLowess(true),
+show_lowess_smoother(false), enableLowess(true), regimes_lce(0),
 chow_ratio(0), chow_pval(1), chow_valid(false), chow_test_text(0),
 table_display_lines(0),
 X(project_s->GetNumRecords()),
@@ -903,6 +903,7 @@ void ScatterNewPlotCanvas::PopulateCanvas()
                              axis_display_precision, axis_display_fixed_point);
 
 	// Populate TemplateCanvas::selectable_shps
+	ClearDensityPoints();
 	selectable_shps.resize(num_obs);
     selectable_shps_undefs.resize(num_obs);
 	scaleX = 100.0 / (axis_scale_x.scale_range);
@@ -943,6 +944,11 @@ void ScatterNewPlotCanvas::PopulateCanvas()
 				selectable_shps[i] = new GdaCircle(pt, r * bubble_size_scaler);
 			}
 		}
+	} else if (num_obs >= GdaConst::scatterplot_density_min_obs) {
+		selectable_shps.clear();
+		selectable_shps_undefs.clear();
+		SetDensityPoints(X, Y, XYZ_undef, axis_scale_x.scale_min, scaleX,
+						 axis_scale_y.scale_min, scaleY);
 	} else {
 		selectable_shps_type = points;
 		for (int i=0; i<num_obs; i++) {
@@ -1540,21 +1546,44 @@ void ScatterNewPlotCanvas::UpdateLowessOnRegimes()
 		return;
 	}
 	
-	std::vector<double> sel_smthd_srt_x;
-	std::vector<double> sel_smthd_srt_y;
-	std::vector<double> unsel_smthd_srt_x;
-	std::vector<double> unsel_smthd_srt_y;
-	
 	if (IsShowRegimes()) {
-        SmoothingUtils::CalcLowessRegimes(lce, lowess,
-                                          highlight_state->GetHighlight(),
-                                          sel_smthd_srt_x,
-                                          sel_smthd_srt_y,
-                                          unsel_smthd_srt_x,
-                                          unsel_smthd_srt_y,
-                                          XYZ_undef);
+		const std::vector<bool>& hl = highlight_state->GetHighlight();
+		if (lce != regimes_lce || hl != regimes_hl) {
+			SmoothingUtils::CalcLowessRegimes(lce, lowess, hl,
+											  sel_smthd_srt_x,
+											  sel_smthd_srt_y,
+											  unsel_smthd_srt_x,
+											  unsel_smthd_srt_y,
+											  XYZ_undef);
+			regimes_lce = lce;
+			regimes_hl = hl;
+		}
+	}
+	if (lowess_reg_line_selected) {
+		if (sel_smthd_srt_x.size() > 0 && IsShowRegimes()) {
+			lowess_reg_line_selected->reInit(sel_smthd_srt_x, sel_smthd_srt_y,
+											 axis_scale_x.scale_min,
+											 axis_scale_y.scale_min,
+											 scaleX, scaleY);
+			lowess_reg_line_selected->setPen(*pens.GetRegSelPen());
+		} else {
+			lowess_reg_line_selected->operator=(GdaSpline());
+		}
+		ApplyLastResizeToShp(lowess_reg_line_selected);
+	}
+	if (lowess_reg_line_excluded) {
+		if (unsel_smthd_srt_x.size() > 0 && IsShowRegimes()) {
+			lowess_reg_line_excluded->reInit(unsel_smthd_srt_x,
+											 unsel_smthd_srt_y,
+											 axis_scale_x.scale_min,
+											 axis_scale_y.scale_min,
+											 scaleX, scaleY);
+			lowess_reg_line_excluded->setPen(*pens.GetRegExlPen());
+		} else {
+			lowess_reg_line_excluded->operator=(GdaSpline());
+		}
+		ApplyLastResizeToShp(lowess_reg_line_excluded);
 	}
-
 	layer2_valid = false;
 }
 
@@ -1606,6 +1635,8 @@ void ScatterNewPlotCanvas::ComputeChowTest()
 void ScatterNewPlotCanvas::EmptyLowessCache()
 {
 	SmoothingUtils::EmptyLowessCache(lowess_cache);
+	regimes_lce = 0;
+	regimes_hl.clear();
 }
 
 /** This method builds up the display optional stats string from scratch every
@@ -240,6 +240,15 @@ protected:
 	SmoothingUtils::LowessCacheType lowess_cache;
 	void EmptyLowessCache();
 	Lowess lowess;
+	// LOWESS curves of the last regimes computation, and the cache entry
+	// and selection they were computed for: redrawing with a new pen or
+	// after a resize does not refit them
+	SmoothingUtils::LowessCacheEntry* regimes_lce;
+	std::vector<bool> regimes_hl;
+	std::vector<double> sel_smthd_srt_x;
+	std::vector<double> sel_smthd_srt_y;
+	std::vector<double> unsel_smthd_srt_x;
+	std::vector<double> unsel_smthd_srt_y;
 	
 	// this is only used for Bubble Chart as a way to sort circles from
 	// largest to smallest diameter.  This is a map from observation id
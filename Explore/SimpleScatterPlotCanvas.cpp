@@ -579,7 +579,16 @@ void SimpleScatterPlotCanvas::PopulateCanvas()
     scaleX = 100.0 / (axis_scale_x.scale_range);
     scaleY = 100.0 / (axis_scale_y.scale_range);
 
-    if (show_data_points) {
+    ClearDensityPoints();
+    if (show_data_points && !use_larger_filled_circles &&
+        (int) X.size() >= GdaConst::scatterplot_density_min_obs) {
+        std::vector<bool> XY_undef(X.size());
+        for (size_t i=0, sz=X.size(); i<sz; ++i) {
+            XY_undef[i] = X_undef[i] || Y_undef[i];
+        }
+        SetDensityPoints(X, Y, XY_undef, axis_scale_x.scale_min, scaleX,
+                         axis_scale_y.scale_min, scaleY);
+    } else if (show_data_points) {
         selectable_shps.resize(X.size());
         selectable_shps_undefs.resize(X.size());
         
@@ -110,6 +110,8 @@ public:
 	static const int max_dbf_date_len = 8;
 	static const int min_dbf_date_len = 8;
 	static const int default_dbf_date_len = 8;
+	// rows written to an OGR layer in one transaction when exporting
+	static const int ogr_export_batch_size = 10000;
     
     // Resource Files
 	static const wxString gda_prefs_fname_json;
@@ -245,6 +247,8 @@ public:
     static bool gda_draw_map_labels;
     static int gda_map_label_font_size;
     static bool gda_create_csvt;
+    static bool gda_use_geom_snapshot;
+    static bool gda_use_tiled_renderer;
     static wxString gda_basemap_sources;
     static bool gda_use_gpu;
     static int gda_ui_language;
@@ -329,6 +333,9 @@ public:
 	static wxPen* scatterplot_reg_excluded_pen;
 	static wxPen* scatterplot_scale_pen;
 	static wxPen* scatterplot_origin_axes_pen;
+	// above this many observations, scatter plots draw a density image
+	// instead of one point per observation
+	static const int scatterplot_density_min_obs = 100000;
 
 	// Bubble Chart
 	static const wxSize bubble_chart_default_size;
@@ -339,6 +346,9 @@ public:
 	static const wxColour three_d_plot_default_point_colour;
 	static const wxColour three_d_plot_default_background_colour;
 	static const wxSize three_d_default_size;
+	// above this many observations, the 3D plot draws points from vertex
+	// buffers instead of one sphere per observation
+	static const int three_d_plot_point_buffer_min_obs = 10000;
 	
 	// Boxplot
 	static const wxSize boxplot_default_size;
@@ -349,6 +359,9 @@ public:
 	
 	// PCP (Parallel Coordinate Plot)
 	static const wxSize pcp_default_size;
+	// above this many observations, parallel coordinate plots draw a
+	// density image instead of one line per observation
+	static const int pcp_density_min_obs = 100000;
 	static const wxColour pcp_line_color;
 	static const wxColour pcp_horiz_line_color;
 	
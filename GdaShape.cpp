@@ -22,10 +22,14 @@
 #include <cmath> // for math abs and floor function
 #include <cfloat>
 #include <wx/graphics.h>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include "logger.h"
 #include "GdaConst.h"
 #include "GenUtils.h"
+#include "Algorithms/threadpool.h"
 #include "GdaShape.h"
 
 
@@ -348,6 +352,28 @@ void GdaScaleTrans::transform(const Shapefile::Point& src, wxPoint* result) cons
 	result->y = (int) (src.y * scale_y + trans_y);
 }
 
+// The batch transforms read the parameters into locals once, so that the
+// loop has no aliasing with *this and can be vectorized by the compiler.
+void GdaScaleTrans::transform(int n, const wxRealPoint* src,
+							  wxPoint* result) const
+{
+	const double sx = scale_x, sy = scale_y, tx = trans_x, ty = trans_y;
+	for (int i=0; i<n; i++) {
+		result[i].x = (int) (src[i].x * sx + tx);
+		result[i].y = (int) (src[i].y * sy + ty);
+	}
+}
+
+void GdaScaleTrans::transform(int n, const Shapefile::Point* src,
+							  wxPoint* result) const
+{
+	const double sx = scale_x, sy = scale_y, tx = trans_x, ty = trans_y;
+	for (int i=0; i<n; i++) {
+		result[i].x = (int) (src[i].x * sx + tx);
+		result[i].y = (int) (src[i].y * sy + ty);
+	}
+}
+
 void GdaScaleTrans::transform(const double& src, double* result) const
 {
 	*result = src * max_scale;
@@ -762,6 +788,54 @@ void GdaShapeAlgs::getBoundingBoxOrig(const GdaPolygon* p, double& xmin,
 	}
 }
 
+// below this many shapes per thread, starting threads costs more than the
+// transforms themselves
+static const int shape_min_per_thread = 2000;
+
+static void shape_scale_trans_range(std::vector<GdaShape*>* shps,
+									const GdaScaleTrans* A,
+									int start, int end)
+{
+	for (int i=start; i<=end; i++) {
+		GdaShape* ms = (*shps)[i];
+		if (ms) ms->applyScaleTrans(*A);
+	}
+}
+
+static void shape_basemap_range(std::vector<GdaShape*>* shps,
+								Gda::Basemap* basemap, double scale_factor,
+								int start, int end)
+{
+	for (int i=start; i<=end; i++) {
+		GdaShape* ms = (*shps)[i];
+		if (ms) ms->projectToBasemap(basemap, scale_factor);
+	}
+}
+
+void GdaShapeAlgs::applyScaleTrans(std::vector<GdaShape*>& shps,
+								   const GdaScaleTrans& A)
+{
+	run_range_threads(shps.size(), shape_min_per_thread,
+					  boost::bind(shape_scale_trans_range, &shps, &A, _1, _2));
+}
+
+/** The coordinate transformation of a basemap (OGR) is not thread-safe, so
+ shapes are projected in parallel only when there is none, that is when
+ the data is already in lat/lng. */
+void GdaShapeAlgs::projectToBasemap(std::vector<GdaShape*>& shps,
+									Gda::Basemap* basemap, double scale_factor)
+{
+	int n_shps = shps.size();
+	if (n_shps == 0 || basemap == NULL) return;
+	if (basemap->poCT != NULL) {
+		shape_basemap_range(&shps, basemap, scale_factor, 0, n_shps-1);
+		return;
+	}
+	run_range_threads(n_shps, shape_min_per_thread,
+					  boost::bind(shape_basemap_range, &shps, basemap,
+								  scale_factor, _1, _2));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // GdaPoint: point (for rendering)
 //
@@ -1149,7 +1223,10 @@ void GdaRectangle::paintSelf(wxGraphicsContext* gc)
 // GdaPolygon: polygon (for rendering)
 //
 ////////////////////////////////////////////////////////////////////////////////
-GdaPolygon::GdaPolygon() : points(0), points_o(0), count(0)
+GdaPolygon::GdaPolygon()
+: points(0), points_o(0), count(0), n(0), n_count(0), pc(0),
+draw_n(0), draw_n_count(0), draw_count(0), lod_tol(0), lod_ring_size(0),
+all_points_same(false)
 {
 	null_shape = true;
 }
@@ -1158,7 +1235,9 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
 	: GdaShape(s), //region(s.region),
 	n(s.n), pc(s.pc), points_o(s.points_o),
 	n_count(s.n_count), all_points_same(s.all_points_same),
-	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0)
+	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0), points(0),
+	draw_n(s.draw_n), draw_n_count(s.draw_n_count), draw_count(0),
+	lod_tol(0), lod_ring_size(0)
 {
 	if (null_shape) return;
 	points = new wxPoint[n];
@@ -1177,15 +1256,25 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
 	for (int i=0; i<s.n_count; i++) {
 		count[i] = s.count[i];
 	}
+	if (s.draw_count == s.count) {
+		draw_count = count;
+	} else {
+		draw_count = new int[s.n_count];
+		for (int i=0; i<s.draw_n_count; i++) {
+			draw_count[i] = s.draw_count[i];
+		}
+	}
 }
 
 GdaPolygon::GdaPolygon(wxPoint& pt1, wxPoint& pt2)
 : n(2), points_o(0), pc(0), points(0), n_count(1),
-all_points_same(false), count(0)
+all_points_same(false), count(0), draw_n(0), draw_n_count(0), draw_count(0),
+lod_tol(0), lod_ring_size(0)
 {
     n = 2;
     count = new int[1];
     count[0] = n;
+    SetFullDetail();
     points = new wxPoint[n];
     points_o = new wxRealPoint[n];
 
@@ -1217,7 +1306,8 @@ all_points_same(false), count(0)
  will be deleted when the constructor is called. */
 GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
 	: n(n_s), points_o(0), pc(0), points(0), n_count(1),
-	all_points_same(false), count(0)
+	all_points_same(false), count(0), draw_n(0), draw_n_count(0),
+	draw_count(0), lod_tol(0), lod_ring_size(0)
 {
 	if (points_o_s == 0 || n == 0) {
 		null_shape = true;
@@ -1225,6 +1315,7 @@ GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
 	}
 	count = new int[1];
 	count[0] = n_s;
+	SetFullDetail();
 	points = new wxPoint[n_s];
 	points_o = new wxRealPoint[n_s];
 	n = points && points_o_s ? n_s : 0;
@@ -1254,7 +1345,9 @@ GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
  part might contain holes.  Only a pointer to the original data is
  kept, and this memory is not deleted in the destructor. */
 GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s)
-  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0)
+  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0),
+n_count(0), draw_n(0), draw_n_count(0), draw_count(0), lod_tol(0),
+lod_ring_size(0)
 {
 	assert(pc);
 	if (pc->shape_type == 0 || pc->num_points == 0) {
@@ -1266,6 +1359,7 @@ GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s)
 	GdaShapeAlgs::partsToCount(pc->parts, pc->num_points, count);
 	n_count = pc->num_parts;
 	n = pc->num_points;
+	SetFullDetail();
 	points = new wxPoint[n];
 	for (int i=0; i<n; i++) {
 		points[i].x = (int) pc->points[i].x;
@@ -1287,6 +1381,18 @@ GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s)
 
 GdaPolygon::~GdaPolygon()
 {
+	if (draw_count && draw_count != count) {
+		delete [] draw_count;
+	}
+	draw_count = 0;
+	if (lod_tol) {
+		delete [] lod_tol;
+		lod_tol = 0;
+	}
+	if (lod_ring_size) {
+		delete [] lod_ring_size;
+		lod_ring_size = 0;
+	}
 	if (points) {
 		delete [] points;
 		points = 0;
@@ -1323,7 +1429,7 @@ bool GdaPolygon::pointWithin(const wxPoint& pt)
 	if (all_points_same) {
 		return pt == center;
 	} else {
-		return GdaShapeAlgs::pointInPolygon(pt, n, points);
+		return GdaShapeAlgs::pointInPolygon(pt, draw_n, points);
 	}
 }
 
@@ -1335,19 +1441,156 @@ bool GdaPolygon::regionIntersect(const wxRegion& r)
 	return false;
 }
 
+// Polygons with no more points than this are always drawn in full
+static const int lod_min_points = 16;
+// Vertices that move a polygon edge by less than this many pixels are
+// not drawn, and parts smaller than lod_min_pixels are skipped
+static const double lod_pixel_tol = 0.5;
+static const double lod_min_pixels = 1.0;
+
+/** Distance from p to the segment a-b */
+static double lod_seg_dist(const Shapefile::Point& p,
+						   const Shapefile::Point& a,
+						   const Shapefile::Point& b)
+{
+	double dx = b.x - a.x;
+	double dy = b.y - a.y;
+	double len2 = dx*dx + dy*dy;
+	double t = 0;
+	if (len2 > 0) {
+		t = ((p.x - a.x)*dx + (p.y - a.y)*dy) / len2;
+		if (t < 0) t = 0;
+		if (t > 1) t = 1;
+	}
+	double ex = a.x + t*dx - p.x;
+	double ey = a.y + t*dy - p.y;
+	return sqrt(ex*ex + ey*ey);
+}
+
+void GdaPolygon::SetFullDetail()
+{
+	if (draw_count && draw_count != count) delete [] draw_count;
+	draw_count = count;
+	draw_n = n;
+	draw_n_count = n_count;
+}
+
+/** Douglas-Peucker importance of every vertex of pc.  Each part is split
+ recursively at the vertex farthest from the segment between its ends; the
+ distance of that vertex, capped by the distance of the split above it, is
+ the tolerance up to which the vertex is kept.  Keeping the vertices with
+ lod_tol >= tol therefore gives the Douglas-Peucker simplification at tol
+ without recomputing it for every zoom level.  The ends of each part and
+ its two most important vertices are always kept, so that a part that is
+ drawn is never less than a triangle. */
+void GdaPolygon::BuildLOD()
+{
+	lod_tol = new float[n];
+	lod_ring_size = new float[n_count];
+	const std::vector<Shapefile::Point>& pts = pc->points;
+	// segments (first, last) still to be split, with the cap of each
+	std::vector<std::pair<int, int> > segs;
+	std::vector<float> caps;
+	for (int c=0, s=0; c<n_count; s+=count[c], c++) {
+		int e = s + count[c] - 1;
+		double xmin = pts[s].x, xmax = pts[s].x;
+		double ymin = pts[s].y, ymax = pts[s].y;
+		for (int i=s; i<=e; i++) {
+			lod_tol[i] = 0;
+			if (pts[i].x < xmin) xmin = pts[i].x;
+			if (pts[i].x > xmax) xmax = pts[i].x;
+			if (pts[i].y < ymin) ymin = pts[i].y;
+			if (pts[i].y > ymax) ymax = pts[i].y;
+		}
+		lod_ring_size[c] = (float) std::max(xmax - xmin, ymax - ymin);
+		if (e - s < 4) {
+			for (int i=s; i<=e; i++) lod_tol[i] = FLT_MAX;
+			continue;
+		}
+		lod_tol[s] = FLT_MAX;
+		lod_tol[e] = FLT_MAX;
+		segs.push_back(std::make_pair(s, e));
+		caps.push_back(FLT_MAX);
+		while (!segs.empty()) {
+			int a = segs.back().first;
+			int b = segs.back().second;
+			float cap = caps.back();
+			segs.pop_back();
+			caps.pop_back();
+			if (b - a < 2) continue;
+			int k = a+1;
+			double d_max = -1;
+			for (int i=a+1; i<b; i++) {
+				double d = lod_seg_dist(pts[i], pts[a], pts[b]);
+				if (d > d_max) {
+					d_max = d;
+					k = i;
+				}
+			}
+			float d = (float) d_max < cap ? (float) d_max : cap;
+			lod_tol[k] = (a == s && b == e) ? FLT_MAX : d;
+			segs.push_back(std::make_pair(a, k));
+			caps.push_back(d);
+			segs.push_back(std::make_pair(k, b));
+			caps.push_back(d);
+		}
+		int k_2nd = -1;
+		for (int i=s+1; i<e; i++) {
+			if (lod_tol[i] < FLT_MAX &&
+				(k_2nd < 0 || lod_tol[i] > lod_tol[k_2nd])) k_2nd = i;
+		}
+		if (k_2nd >= 0) lod_tol[k_2nd] = FLT_MAX;
+	}
+}
+
+/** Polygons that refer to a PolygonContents are drawn at the level of
+ detail of the scale: a polygon smaller than a pixel is drawn as a point,
+ parts smaller than a pixel are skipped, and only the vertices with a
+ Douglas-Peucker tolerance above half a pixel are transformed. */
 void GdaPolygon::applyScaleTrans(const GdaScaleTrans& A)
 {
 	if (null_shape) return;
 	GdaShape::applyScaleTrans(A); // apply affine transform to base class
 	if (points_o) {
-		for (int i=0; i<n; i++) {
-			A.transform(points_o[i], &(points[i]));
+		A.transform(n, points_o, points);
+		return;
+	}
+	all_points_same = false;
+	double scale = std::max(fabs(A.scale_x), fabs(A.scale_y));
+	double bb_size = std::max(bb_ur_o.x - bb_ll_o.x, bb_ur_o.y - bb_ll_o.y);
+	if (bb_size * scale < lod_min_pixels) {
+		all_points_same = true;
+		return;
+	}
+	if (n <= lod_min_points || scale <= 0) {
+		SetFullDetail();
+		if (n > 0) A.transform(n, &pc->points[0], points);
+		return;
+	}
+	if (!lod_tol) BuildLOD();
+	if (draw_count == count) draw_count = new int[n_count];
+	
+	double tol = lod_pixel_tol / scale;
+	int m = 0; // points projected so far
+	int parts = 0;
+	for (int c=0, s=0; c<n_count; s+=count[c], c++) {
+		if (lod_ring_size[c] * scale < lod_min_pixels) continue;
+		int start = m;
+		for (int i=s, e=s+count[c]; i<e; i++) {
+			if (lod_tol[i] < tol) continue;
+			A.transform(pc->points[i], &(points[m]));
+			if (m > start && points[m] == points[m-1]) continue;
+			m++;
 		}
-	} else {
-		for (int i=0; i<n; i++) {
-			A.transform(pc->points[i], &(points[i]));
+		if (m - start < 3) {
+			m = start;
+			continue;
 		}
+		draw_count[parts++] = m - start;
 	}
+	draw_n = m;
+	draw_n_count = parts;
+	if (parts == 0) all_points_same = true;
 }
 
 
@@ -1357,25 +1600,23 @@ void GdaPolygon::projectToBasemap(Gda::Basemap* basemap, double scale_factor)
         return;
     
 	GdaShape::projectToBasemap(basemap, scale_factor);
+	if (n <= 0) return;
+	// gather into separate lng / lat arrays for the batch projection
+	std::vector<double> lng(n), lat(n);
 	if (points_o) {
 		for (int i=0; i<n; i++) {
-            basemap->LatLngToXY(points_o[i].x, points_o[i].y, 
-                                points[i].x, points[i].y);
-            if (scale_factor != 1) {
-                points[i].x = points[i].x * scale_factor;
-                points[i].y = points[i].y * scale_factor;
-            }
+			lng[i] = points_o[i].x;
+			lat[i] = points_o[i].y;
 		}
 	} else {
+		all_points_same = false;
+		SetFullDetail();
 		for (int i=0; i<n; i++) {
-            basemap->LatLngToXY(pc->points[i].x, pc->points[i].y, 
-                                points[i].x, points[i].y);
-            if (scale_factor != 1) {
-                points[i].x = points[i].x * scale_factor;
-                points[i].y = points[i].y * scale_factor;
-            }
+			lng[i] = pc->points[i].x;
+			lat[i] = pc->points[i].y;
 		}
 	}
+	basemap->LatLngToXY(n, &lng[0], &lat[0], points, scale_factor);
 }
 
 wxRealPoint GdaPolygon::CalculateCentroid(int n, wxRealPoint* pts)
@@ -1398,10 +1639,12 @@ void GdaPolygon::paintSelf(wxDC& dc)
 	if (null_shape) return;
 	dc.SetPen(getPen());
 	dc.SetBrush(getBrush());
-	if (n_count > 1) {
-		dc.DrawPolyPolygon(n_count, count, points);
+	if (all_points_same) {
+		dc.DrawPoint(center.x, center.y);
+	} else if (draw_n_count > 1) {
+		dc.DrawPolyPolygon(draw_n_count, draw_count, points);
 	} else {
-		dc.DrawPolygon(n, points);
+		dc.DrawPolygon(draw_n, points);
 	}
 }
 
@@ -1411,11 +1654,15 @@ void GdaPolygon::paintSelf(wxGraphicsContext* gc)
 	gc->SetPen(getPen());
 	gc->SetBrush(getBrush());
     
-	if (n_count > 1) {
+	if (all_points_same) {
+        wxGraphicsPath path = gc->CreatePath();
+        path.AddCircle(center.x, center.y, 0.2);
+        gc->FillPath(path, wxWINDING_RULE);
+	} else if (draw_n_count > 1) {
         int start = 0;
-        for (int c=0; c<n_count; c++) {
+        for (int c=0; c<draw_n_count; c++) {
             wxGraphicsPath path = gc->CreatePath();
-            int n = count[c];
+            int n = draw_count[c];
             start += n;
             for (int i=0; i<n-1; i++) {
                 path.MoveToPoint(points[start+i].x, points[start+i].y);
@@ -1430,10 +1677,10 @@ void GdaPolygon::paintSelf(wxGraphicsContext* gc)
         
 	} else {
         wxGraphicsPath path = gc->CreatePath();
-        for (int i=0; i<n-1; i++) {
+        for (int i=0; i<draw_n-1; i++) {
             path.MoveToPoint(points[i].x, points[i].y);
             int j = i + 1;
-            if (j < n) {
+            if (j < draw_n) {
                 path.AddLineToPoint(points[j].x, points[j].y);
             }
         }
@@ -1605,13 +1852,13 @@ GdaPolyLine::~GdaPolyLine()
 
 void GdaPolyLine::projectToBasemap(Gda::Basemap* basemap, double scale_factor)
 {
-    for (int i=0; i<n; i++) {
-        basemap->LatLngToXY(points_o[i].x, points_o[i].y, points[i].x, points[i].y);
-        if (scale_factor != 1) {
-            points[i].x = points[i].x * scale_factor;
-            points[i].y = points[i].y * scale_factor;
-        }
-    }
+	if (n <= 0) return;
+	std::vector<double> lng(n), lat(n);
+	for (int i=0; i<n; i++) {
+		lng[i] = points_o[i].x;
+		lat[i] = points_o[i].y;
+	}
+	basemap->LatLngToXY(n, &lng[0], &lat[0], points, scale_factor);
 }
 
 void GdaPolyLine::Offset(double dx, double dy)
@@ -1709,13 +1956,9 @@ void GdaPolyLine::applyScaleTrans(const GdaScaleTrans& A)
 	if (null_shape) return;
 	GdaShape::applyScaleTrans(A); // apply affine transform to base class
 	if (points_o) {
-		for (int i=0; i<n; i++) {
-			A.transform(points_o[i], &(points[i]));
-		}
-	} else {
-		for (int i=0; i<n; i++) {
-			A.transform(pc->points[i], &(points[i]));
-		}
+		A.transform(n, points_o, points);
+	} else if (n > 0) {
+		A.transform(n, &pc->points[0], points);
 	}
 }
 
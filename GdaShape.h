@@ -36,6 +36,7 @@
 #include "GenUtils.h"
 #include "GdaConst.h"
 
+class GdaShape;
 class GdaPolygon;
 
 struct GdaScaleTrans {
@@ -70,6 +71,8 @@ struct GdaScaleTrans {
 	void transform(const wxRealPoint& src, wxRealPoint* result) const;
 	void transform(const wxPoint& src, wxPoint* result) const;
 	void transform(const Shapefile::Point& src, wxPoint* result) const;
+	void transform(int n, const wxRealPoint* src, wxPoint* result) const;
+	void transform(int n, const Shapefile::Point* src, wxPoint* result) const;
 	void transform(const double& src, double* result) const;
 	void transform(const double& src, int* result) const;
 
@@ -147,6 +150,12 @@ namespace GdaShapeAlgs {
 	bool pointInPolygon(const wxPoint& pt, int n, const wxPoint* pts);
 	void getBoundingBoxOrig(const GdaPolygon* p, double& xmin,
 							double& ymin, double& xmax, double& ymax);
+	// applyScaleTrans / projectToBasemap of every shape, split across
+	// threads when there are enough shapes
+	void applyScaleTrans(std::vector<GdaShape*>& shps,
+						 const GdaScaleTrans& A);
+	void projectToBasemap(std::vector<GdaShape*>& shps,
+						  Gda::Basemap* basemap, double scale_factor = 1.0);
 }
 
 struct GdaShapeAttribs {
@@ -328,9 +337,10 @@ public:
 	virtual void paintSelf(wxGraphicsContext* gc);
 
 	// All values in points array are the same.  Can render render
-	// as a single point at points[0]
+	// as a single point at points[0].  Also set by applyScaleTrans when
+	// the whole polygon is smaller than a pixel at the current scale.
 	bool all_points_same;
-	
+
 	wxPoint* points;
 	int n; // size of points array
 	int n_count; // size of count array
@@ -338,13 +348,31 @@ public:
 	//   count stores the number of points in each polygon part
 	//   parts stores the index of the first point for each polygon
 	int* count;
-    
+
+	// Geometry to draw at the current scale: the first draw_n entries of
+	// points, in draw_n_count parts of draw_count[i] points.  This is the
+	// full geometry (draw_count == count) unless applyScaleTrans has
+	// simplified a polygon that refers to a PolygonContents.
+	int draw_n;
+	int draw_n_count;
+	int* draw_count;
+
 	// (pc == 0 && points_o !=0 ) || (pc != 0 && points_o ==0 )
 	Shapefile::PolygonContents* pc;
-    
+
 	wxRealPoint* points_o;
 	wxRealPoint bb_ll_o; // bounding box lower left
 	wxRealPoint bb_ur_o; // bounding box upper right
+
+protected:
+	void SetFullDetail();
+	void BuildLOD();
+	// Level of detail, built on the first applyScaleTrans of a pc polygon.
+	// lod_tol[i] is the largest Douglas-Peucker tolerance (in data units)
+	// at which vertex i is still kept; lod_ring_size[c] is the largest
+	// side of the bounding box of part c.
+	float* lod_tol;
+	float* lod_ring_size;
 };
 
 
@@ -2397,6 +2397,25 @@ wxString GenUtils::GetBasemapDir()
 #endif
 }
 
+wxString GenUtils::GetSnapshotDir()
+{
+#ifdef __linux__
+    wxString confDir = wxStandardPaths::Get().GetUserConfigDir();
+    // Unix: ~ (the home directory)
+    wxString geodaUserDir = confDir + wxFileName::GetPathSeparator() + ".geoda";
+    if (wxDirExists(geodaUserDir) == false) {
+        wxFileName::Mkdir(geodaUserDir);
+    }
+    wxString snapshotDir = geodaUserDir + wxFileName::GetPathSeparator() + "snapshot_cache";
+#else
+    wxString snapshotDir = GetExeDir() + "snapshot_cache";
+#endif
+    if (wxDirExists(snapshotDir) == false) {
+        wxFileName::Mkdir(snapshotDir);
+    }
+    return snapshotDir;
+}
+
 wxString GenUtils::GetCachePath()
 {
 #ifdef __linux__
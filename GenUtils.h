@@ -457,6 +457,7 @@ namespace GenUtils {
     wxString GetUserSamplesDir();
     wxString GetBasemapDir();
     wxString GetCachePath();
+    wxString GetSnapshotDir();
 
     bool less_vectors(const vector<int>& a,const vector<int>& b);
     bool smaller_pair(const std::pair<int, int>& a,
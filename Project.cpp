@@ -61,6 +61,7 @@
 #include "SpatialIndAlgs.h"
 #include "PointSetAlgs.h"
 #include "ShapeOperations/GalWeight.h"
+#include "ShapeOperations/GeomSnapshot.h"
 #include "ShapeOperations/VoronoiUtils.h"
 #include "VarCalc/WeightsManInterface.h"
 #include "ShapeOperations/WeightsManState.h"
@@ -913,7 +914,8 @@ void Project::DisplayPointDupsWarning()
 	point_dups_warn_prev_displayed = true;
 }
 
-void Project::GetVoronoiRookNeighborMap(std::vector<std::set<int> >& nbr_map)
+void Project::GetVoronoiRookNeighborMap(std::vector<int>& nbr_start,
+										std::vector<int>& nbr_ids)
 {
 	wxLogMessage("Project::GetVoronoiRookNeighborMap()");
 
@@ -921,17 +923,18 @@ void Project::GetVoronoiRookNeighborMap(std::vector<std::set<int> >& nbr_map)
 	std::vector<double> x;
 	std::vector<double> y;
 	GetCentroids(x, y);
-	Gda::VoronoiUtils::PointsToContiguity(x, y, false, nbr_map);
+	Gda::VoronoiUtils::PointsToContiguity(x, y, false, nbr_start, nbr_ids);
 }
 
-void Project::GetVoronoiQueenNeighborMap(std::vector<std::set<int> >& nbr_map)
+void Project::GetVoronoiQueenNeighborMap(std::vector<int>& nbr_start,
+										 std::vector<int>& nbr_ids)
 {
 	wxLogMessage("Project::GetVoronoiQueenNeighborMap()");
 
 	std::vector<double> x;
 	std::vector<double> y;
 	GetCentroids(x, y);
-	Gda::VoronoiUtils::PointsToContiguity(x, y, true, nbr_map);
+	Gda::VoronoiUtils::PointsToContiguity(x, y, true, nbr_start, nbr_ids);
 }
 
 GalElement* Project::GetVoronoiRookNeighborGal()
@@ -939,9 +942,10 @@ GalElement* Project::GetVoronoiRookNeighborGal()
 	wxLogMessage("Project::GetVoronoiRookNeighborGal()");
 
 	if (!voronoi_rook_nbr_gal) {
-		std::vector<std::set<int> > nbr_map;
-		GetVoronoiRookNeighborMap(nbr_map);
-		voronoi_rook_nbr_gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_map);
+		std::vector<int> nbr_start, nbr_ids;
+		GetVoronoiRookNeighborMap(nbr_start, nbr_ids);
+		voronoi_rook_nbr_gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_start,
+																	nbr_ids);
 	}
 	return voronoi_rook_nbr_gal;
 }
@@ -981,7 +985,7 @@ CovSpHLStateProxy* Project::GetPairsHLState()
 {
 	if (!pairs_hl_state) {
 		pairs_hl_state = new CovSpHLStateProxy(GetHighlightState(),
-                                               GetSharedPairsBimap());
+                                               GetSharedPairs());
 	}
 	return pairs_hl_state;
 }
@@ -1203,8 +1207,14 @@ const std::vector<GdaPoint*>& Project::GetCentroids()
                 centroids[row_idx] = new GdaPoint(pc->x, pc->y);
             }
         }
-    } else {
-        layer_proxy->GetCentroids(centroids);
+    } else if (centroids.size() == 0 && layer_proxy->n_rows > 0) {
+        wxString ds_name = datasource->GetOGRConnectStr();
+        if (!GeomSnapshot::ReadCentroids(ds_name, layername,
+                                         layer_proxy->n_rows,
+                                         centroids)) {
+            layer_proxy->GetCentroids(centroids);
+            GeomSnapshot::WriteCentroids(ds_name, layername, centroids);
+        }
     }
 
 	return centroids;	
@@ -1416,75 +1426,42 @@ void Project::FillDistances(std::vector<double>& D,
                             WeightsMetaInfo::DistanceUnitsEnum du)
 {
 	wxLogMessage("Project::FillDistances()");
-	const std::vector<GdaPoint*>& c = GetCentroids();
-	const pairs_bimap_type& pbm = GetSharedPairsBimap();
-	typedef pairs_bimap_type::const_iterator pbt_ci;
-    
-    if (D.size() != pbm.size()) {
-        D.resize(pbm.size());
-    }
-    
-	if (dm == WeightsMetaInfo::DM_arc) {
-		if (pbm.size() > cached_arc_dist.size()) {
-			for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
-				// it->left  : data : int
-				// it->right : data : UnOrdIntPair
-				if (cached_arc_dist.find(it->right) == cached_arc_dist.end()) {
-					size_t i = it->right.i;
-					size_t j = it->right.j;
-					double d = GenGeomAlgs::ComputeArcDistRad(c[i]->GetX(),
-                                                              c[i]->GetY(),
-                                                              c[j]->GetX(),
-                                                              c[j]->GetY());
-					cached_arc_dist[it->right] = d;
-				}
-			}
-			if (du == WeightsMetaInfo::DU_km) {
-				for (pbt_ci it=pbm.begin(), iend=pbm.end(); it != iend; ++it) {
-					D[it->left] = GenGeomAlgs::EarthRadToKm(cached_arc_dist[it->right]);
-				}
-			} else {
-				for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it)
-				{
-					D[it->left] = GenGeomAlgs::EarthRadToMi(cached_arc_dist[it->right]);
-				}
-			}
+	const pairs_vec_type& pairs = GetSharedPairs();
+	bool is_arc = dm == WeightsMetaInfo::DM_arc;
+	std::vector<double>& cached = is_arc ? cached_arc_dist : cached_eucl_dist;
+	
+	if (cached.size() != pairs.size()) {
+		const std::vector<GdaPoint*>& c = GetCentroids();
+		std::vector<double> x(c.size()), y(c.size());
+		for (size_t i=0, sz=c.size(); i<sz; ++i) {
+			x[i] = c[i]->GetX();
+			y[i] = c[i]->GetY();
 		}
-	} else { // assume DM_euclidean
-		if (pbm.size() > cached_eucl_dist.size()) {
-			for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
-				// it->left  : data : int
-				// it->right : data : UnOrdIntPair
-				if (cached_eucl_dist.find(it->right) == cached_eucl_dist.end()) {
-					size_t i = it->right.i;
-					size_t j = it->right.j;
-					double d = GenGeomAlgs::ComputeEucDist(c[i]->GetX(), c[i]->GetY(),
-                                                           c[j]->GetX(), c[j]->GetY());
-					cached_eucl_dist[it->right] = d;
-				}
-			}
+		DistancesCalc::PairDistances(pairs, x, y, is_arc, cached);
+	}
+	
+	D.resize(pairs.size());
+	if (is_arc && du == WeightsMetaInfo::DU_km) {
+		for (size_t k=0, sz=pairs.size(); k<sz; ++k) {
+			D[k] = GenGeomAlgs::EarthRadToKm(cached[k]);
 		}
-		for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
-			D[it->left] = cached_eucl_dist[it->right];
+	} else if (is_arc) {
+		for (size_t k=0, sz=pairs.size(); k<sz; ++k) {
+			D[k] = GenGeomAlgs::EarthRadToMi(cached[k]);
 		}
+	} else { // assume DM_euclidean
+		D = cached;
 	}
 }
 
-const pairs_bimap_type& Project::GetSharedPairsBimap()
+const pairs_vec_type& Project::GetSharedPairs()
 {
-	wxLogMessage("Project::GetSharedPairsBimap()");
-	if (pairs_bimap.size() == 0) {
-		// generate bimap int <--> coord pair
+	wxLogMessage("Project::GetSharedPairs()");
+	if (shared_pairs.empty()) {
 		int n_obs = highlight_state->GetHighlight().size();
-		int cnt=0;
-		for (int i=0; i<n_obs; ++i) {
-			for (int j=i+1; j<n_obs; ++j) {
-				pairs_bimap.insert(
-                    pairs_bimap_type::value_type(cnt++, UnOrdIntPair(i,j)));
-			}
-		}
+		DistancesCalc::AllPairs(n_obs, shared_pairs);
 	}
-	return pairs_bimap;
+	return shared_pairs;
 }
 
 void Project::CleanupPairsHLState()
@@ -1722,7 +1699,18 @@ bool Project::InitFromOgrLayer()
 	isTableOnly = layer_proxy->IsTableOnly();
     if (ds_type == GdaConst::ds_dbf) isTableOnly = true;
     if (!isTableOnly) {
-        has_null_geometry = layer_proxy->ReadGeometries(main_data);
+        int geom_type = wkbUnknown;
+        if (GeomSnapshot::ReadGeometries(datasource_name, layername,
+                                         layer_proxy->n_rows, main_data,
+                                         has_null_geometry, geom_type)) {
+            if (layer_proxy->eGType == wkbUnknown)
+                layer_proxy->eGType = (OGRwkbGeometryType) geom_type;
+        } else {
+            has_null_geometry = layer_proxy->ReadGeometries(main_data);
+            GeomSnapshot::WriteGeometries(datasource_name, layername,
+                                          main_data, has_null_geometry,
+                                          layer_proxy->eGType);
+        }
     }
 	return true;
 }
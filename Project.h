@@ -158,8 +158,12 @@ public:
 	void SaveVoronoiDupsToTable();
 	bool IsPointDuplicates();
 	void DisplayPointDupsWarning();
-	void GetVoronoiRookNeighborMap(std::vector<std::set<int> >& nbr_map);
-	void GetVoronoiQueenNeighborMap(std::vector<std::set<int> >& nbr_map);
+	/** Thiessen polygon contiguity of the centroids: the neighbors of
+	 observation i are nbr_ids[nbr_start[i]] to nbr_ids[nbr_start[i+1]-1] */
+	void GetVoronoiRookNeighborMap(std::vector<int>& nbr_start,
+								   std::vector<int>& nbr_ids);
+	void GetVoronoiQueenNeighborMap(std::vector<int>& nbr_start,
+									std::vector<int>& nbr_ids);
 	GalElement* GetVoronoiRookNeighborGal();
 	void AddMeanCenters();
 	void AddCentroids();
@@ -225,7 +229,7 @@ public:
                        WeightsMetaInfo::DistanceMetricEnum dm,
                        WeightsMetaInfo::DistanceUnitsEnum du);
 	
-	const pairs_bimap_type& GetSharedPairsBimap();
+	const pairs_vec_type& GetSharedPairs();
 	void CleanupPairsHLState();
 	
 	i_array_type* GetSharedCategoryScratch(int num_cats, int num_obs);
@@ -333,10 +337,11 @@ protected:
 	WeightsMetaInfo::DistanceMetricEnum dist_metric;
 	WeightsMetaInfo::DistanceUnitsEnum dist_units;
 	
-	pairs_bimap_type pairs_bimap;
+	pairs_vec_type shared_pairs;
     
-	dist_map_type cached_eucl_dist;
-	dist_map_type cached_arc_dist;
+	// distances of shared_pairs, by pair id; arc distances in radians
+	std::vector<double> cached_eucl_dist;
+	std::vector<double> cached_arc_dist;
 };
 
 #endif
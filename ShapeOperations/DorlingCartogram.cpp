@@ -31,10 +31,15 @@
  * comments, and looping logic intact.
  */
 
+#include <cmath>
 #include <wx/msgdlg.h>
 #include <wx/stopwatch.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include "../logger.h"
 #include "../GenUtils.h"
+#include "../GdaConst.h"
+#include "../Algorithms/threadpool.h"
 #include "GalWeight.h"
 #include "DorlingCartogram.h"
 
@@ -112,10 +117,23 @@ secs_per_iter(0.01)
 	radius = new double[bodies];
 	xvector = new double[bodies];
 	yvector = new double[bodies];
-	list = new int[bodies];
-	tree = new leaf[bodies];
 	
 	init_cartogram(orig_x, orig_y, orig_data, orig_data_min, orig_data_max);
+	
+	nbr_start.resize(bodies+1);
+	nbr_start[0] = 0;
+	nbr_start[1] = 0;
+	for (int body=1; body<bodies; body++) {
+		nbr_start[body+1] = nbr_start[body];
+		for (int nb=1; nb<=nbours[body]; nb++) {
+			if (nbour[body][nb] == 0) continue;
+			nbr_id.push_back(nbour[body][nb]);
+			nbr_weight.push_back(border[body][nb]/perimeter[body]);
+			nbr_start[body+1] += 1;
+		}
+	}
+	body_cell.resize(bodies);
+	cell_bodies.resize(bodies);
     
     LOG_MSG("Exiting DorlingCartogram()");
 }
@@ -128,83 +146,149 @@ DorlingCartogram::~DorlingCartogram()
 	if (radius) delete [] radius;
 	if (xvector) delete [] xvector;
 	if (yvector) delete [] yvector;
-	if (list) delete [] list;
-	if (tree) delete [] tree;
 }
 
-// Global variables: tree, x, y, body
-void DorlingCartogram::add_point(int pointer, int axis, int body)
+void DorlingCartogram::build_grid()
 {
-    if (tree[pointer].id == 0) {
-		tree[pointer].id = body;
-		tree[pointer].left = 0;
-		tree[pointer].right = 0;
-		tree[pointer].xpos = x[body];
-		tree[pointer].ypos = y[body];
-    } else {
-		if (axis == 1) {
-			if (x[body] >= tree[pointer].xpos) {
-				if (tree[pointer].left == 0){ 
-					end_pointer += 1;
-					tree[pointer].left = end_pointer;
-				}
-				add_point(tree[pointer].left, 3-axis, body);
-			} else {
-				if (tree[pointer].right == 0) { 
-					end_pointer +=1;
-					tree[pointer].right = end_pointer;
-				}
-				add_point(tree[pointer].right, 3-axis, body);
-			}
-		} else {
-			if (y[body] >= tree[pointer].ypos) {
-				if (tree[pointer].left == 0) {
-					end_pointer += 1;
-					tree[pointer].left = end_pointer;
-				}
-				add_point(tree[pointer].left, 3-axis, body);
-			} else {
-				if (tree[pointer].right == 0) { 
-					end_pointer += 1;
-					tree[pointer].right = end_pointer;
-				}
-				add_point(tree[pointer].right, 3-axis, body);
-			}
-		}
+	if (bodies < 2) return;
+	double xmin = x[1], xmax = x[1], ymin = y[1], ymax = y[1];
+	for (int body=2; body<bodies; body++) {
+		if (x[body] < xmin) xmin = x[body];
+		if (x[body] > xmax) xmax = x[body];
+		if (y[body] < ymin) ymin = y[body];
+		if (y[body] > ymax) ymax = y[body];
+	}
+	grid_xmin = xmin;
+	grid_ymin = ymin;
+	grid_cell = 2*widest;
+	if (grid_cell <= 0) grid_cell = 1.0;
+	// bound the number of cells when circles are small compared to the map
+	double max_cells = 4.0 * bodies;
+	while (((xmax-xmin) / grid_cell + 1) * ((ymax-ymin) / grid_cell + 1)
+		   > max_cells) {
+		grid_cell *= 2;
+	}
+	grid_cols = (int) ((xmax-xmin) / grid_cell) + 1;
+	grid_rows = (int) ((ymax-ymin) / grid_cell) + 1;
+	
+	// counting sort of bodies by cell
+	int n_cells = grid_cols * grid_rows;
+	cell_start.assign(n_cells+1, 0);
+	for (int body=1; body<bodies; body++) {
+		int cx = (int) ((x[body]-grid_xmin) / grid_cell);
+		int cy = (int) ((y[body]-grid_ymin) / grid_cell);
+		if (cx >= grid_cols) cx = grid_cols-1;
+		if (cy >= grid_rows) cy = grid_rows-1;
+		body_cell[body] = cy*grid_cols + cx;
+		cell_start[body_cell[body]+1] += 1;
+	}
+	for (int c=0; c<n_cells; c++) cell_start[c+1] += cell_start[c];
+	std::vector<int> pos(cell_start.begin(), cell_start.end()-1);
+	for (int body=1; body<bodies; body++) {
+		cell_bodies[pos[body_cell[body]]++] = body;
 	}
 }
 
-// Global variables: tree, x, y, body, list, number, distance
-// modified variables: list and number
-void DorlingCartogram::get_point(int pointer, int axis, int body)
+// not worth starting threads for small maps
+static const int dorling_min_per_thread = 1000;
+
+void DorlingCartogram::compute_forces(int start, int end)
 {
-	if (pointer > 0) {
-		if (tree[pointer].id > 0) {
-			if (axis == 1) { 
-				if (x[body]-distance < tree[pointer].xpos) {
-					get_point(tree[pointer].right, 3-axis, body);
-				}
-				if (x[body]+distance >= tree[pointer].xpos) {
-					get_point(tree[pointer].left, 3-axis, body);
+	int other;
+	double closest;
+	double dist;
+	double overlap;
+	double atrdst;
+	double repdst;
+	double xattract;
+	double yattract;
+	double xrepel;
+	double yrepel;
+	double xtotal;
+	double ytotal;
+	double xd;
+	double yd;
+	double distance;
+	
+	for (int body=std::max(start, 1); body<=end; body++) {
+		distance = widest + radius[body];
+		
+		xrepel = yrepel = 0.0;
+		xattract = yattract = 0.0;
+		closest = widest;
+		
+		// work out repelling force of overlapping neighbors within
+		// <distance>, the same square window that get_point used
+		int cx0 = (int) floor((x[body]-distance-grid_xmin) / grid_cell);
+		int cx1 = (int) floor((x[body]+distance-grid_xmin) / grid_cell);
+		int cy0 = (int) floor((y[body]-distance-grid_ymin) / grid_cell);
+		int cy1 = (int) floor((y[body]+distance-grid_ymin) / grid_cell);
+		if (cx0 < 0) cx0 = 0;
+		if (cy0 < 0) cy0 = 0;
+		if (cx1 >= grid_cols) cx1 = grid_cols-1;
+		if (cy1 >= grid_rows) cy1 = grid_rows-1;
+		for (int cy=cy0; cy<=cy1; cy++) {
+			for (int cx=cx0; cx<=cx1; cx++) {
+				int c = cy*grid_cols + cx;
+				for (int k=cell_start[c]; k<cell_start[c+1]; k++) {
+					other = cell_bodies[k];
+					if (other == body) continue;
+					if (!(x[body]-distance < x[other] &&
+						  x[body]+distance >= x[other] &&
+						  y[body]-distance < y[other] &&
+						  y[body]+distance >= y[other])) continue;
+					xd = x[other]-x[body];
+					yd = y[other]-y[body];
+					dist = sqrt(xd*xd+yd*yd);
+					if (dist < closest) closest = dist;
+					overlap = radius[body] + radius[other]-dist;
+					if (overlap > 0 && dist > 1) {
+						xrepel = xrepel-overlap*(x[other]-x[body])/dist;
+						yrepel = yrepel-overlap*(y[other]-y[body])/dist;
+					}
 				}
 			}
-			if (axis == 2) {
-				if (y[body]-distance < tree[pointer].ypos) {
-					get_point(tree[pointer].right, 3-axis, body);
-				}
-				if (y[body] + distance >= tree[pointer].ypos) {
-					get_point(tree[pointer].left, 3-axis, body);
-				}
+		}
+		
+		// work out forces of attraction between neighbours
+		
+		for (int nb=nbr_start[body]; nb<nbr_start[body+1]; nb++) {
+			other = nbr_id[nb];
+			xd = (x[body]-x[other]);
+			yd = (y[body]-y[other]);
+			dist = sqrt(xd*xd+yd*yd);
+			overlap = dist - radius[body] - radius[other];
+			if (overlap > 0.0) {
+				overlap = overlap * nbr_weight[nb];
+				xattract = xattract + overlap*(x[other]-x[body])/dist;
+				yattract = yattract + overlap*(y[other]-y[body])/dist;
 			}
-			if ((x[body]-distance < tree[pointer].xpos) && 
-				(x[body]+distance >= tree[pointer].xpos)) {
-				if ((y[body]-distance < tree[pointer].ypos) &&
-					(y[body]+distance >= tree[pointer].ypos)) { 
-					number += 1;
-					list[number] = tree[pointer].id;
-				}
+		}
+		
+		// now work out the combined effect of attraction and repulsion
+		
+		atrdst = sqrt(xattract * xattract + yattract * yattract);
+		repdst = sqrt(xrepel * xrepel+ yrepel * yrepel);
+		if (repdst > closest) {
+			xrepel = closest * xrepel / (repdst +1.0);
+			yrepel = closest * yrepel / (repdst +1.0);
+			repdst = closest;
+		}
+		if (repdst > 0.0) {
+			xtotal = (1.0-ratio) * xrepel +
+				ratio*(repdst*xattract/(atrdst+1.0));
+			ytotal = (1.0-ratio) * yrepel +
+				ratio*(repdst*yattract/(atrdst+1.0));
+		} else {
+			if (atrdst > closest) {
+				xattract = closest *xattract/(atrdst+1);
+				yattract = closest *yattract/(atrdst+1);
 			}
+			xtotal = xattract;
+			ytotal = yattract;
 		}
+		xvector[body] = friction * (xvector[body]+xtotal);
+		yvector[body] = friction * (yvector[body]+ytotal);
 	}
 }
 
@@ -304,103 +388,16 @@ int DorlingCartogram::improve(int num_iters)
 {
 	wxStopWatch sw;
 	
-	// start the big loop creating the tree each iter
-	
-	int other;
-	double closest;
-	double dist;
-	double overlap;
-	double atrdst;
-	double repdst;
-	double xattract;
-	double yattract;
-	double xrepel;
-	double yrepel;
-	double xtotal;
-	double ytotal;
-	double xd;
-	double yd;
+	// start the big loop creating the grid each iter
 	
     for (int itter=0; itter<num_iters; itter++) {
-        for (int body=1; body<bodies; body++) tree[body].id = 0;
-        end_pointer = 1;
-		
-        for (int body=1; body<bodies; body++) add_point(1,1,body);
+		build_grid();
 		
 		// loop of independent body movements
 		
-        for (int body=1; body<bodies; body++) {
-            // get <number> of neighbors within <distance> into <list[]>
-            number = 0;
-            distance = widest + radius[body];
-            get_point(1,1,body);
-			
-            xrepel = yrepel = 0.0;
-            xattract = yattract = 0.0;
-            closest = widest;
-            //LOG_MSG(wxString::Format("  number %d:", number));
-			
-            // work out repelling force of overlapping neighbors
-            if (number > 0) {
-                for (int nb=1; nb<=number; nb++) {
-                    other = list[nb];
-                    if (other != body) {
-                        xd = x[other]-x[body];
-                        yd = y[other]-y[body];
-                        dist = sqrt(xd*xd+yd*yd);
-                        if (dist < closest) closest = dist;
-                        overlap = radius[body] + radius[other]-dist;
-                        if (overlap > 0 && dist > 1) {
-							xrepel = xrepel-overlap*(x[other]-x[body])/dist;
-							yrepel = yrepel-overlap*(y[other]-y[body])/dist;
-                        }
-                    }
-                }
-            }
-			
-			// work out forces of attraction between neighbours
-			
-            for (int nb=1; nb<=nbours[body]; nb++) {
-                other = nbour[body][nb];
-                if (other != 0) {
-                    xd = (x[body]-x[other]);
-                    yd = (y[body]-y[other]);
-                    dist = sqrt(xd*xd+yd*yd);
-                    overlap = dist - radius[body] - radius[other];
-                    if (overlap > 0.0) {
-						overlap = overlap *
-							border[body][nb]/perimeter[body];
-                        xattract = xattract + overlap*(x[other]-x[body])/dist;
-                        yattract = yattract + overlap*(y[other]-y[body])/dist;
-                    }
-                }
-            }
-			
-			// now work out the combined effect of attraction and repulsion
-			
-            atrdst = sqrt(xattract * xattract + yattract * yattract);
-            repdst = sqrt(xrepel * xrepel+ yrepel * yrepel);
-            if (repdst > closest) {
-                xrepel = closest * xrepel / (repdst +1.0);
-                yrepel = closest * yrepel / (repdst +1.0);
-                repdst = closest;
-            }
-            if (repdst > 0.0) {
-                xtotal = (1.0-ratio) * xrepel +
-					ratio*(repdst*xattract/(atrdst+1.0));
-                ytotal = (1.0-ratio) * yrepel +
-					ratio*(repdst*yattract/(atrdst+1.0));
-            } else {
-                if (atrdst > closest) {
-                    xattract = closest *xattract/(atrdst+1);
-                    yattract = closest *yattract/(atrdst+1);
-                }
-                xtotal = xattract;
-                ytotal = yattract;
-            }
-            xvector[body] = friction * (xvector[body]+xtotal);
-            yvector[body] = friction * (yvector[body]+ytotal);
-        }
+		run_range_threads(bodies, dorling_min_per_thread,
+						  boost::bind(&DorlingCartogram::compute_forces,
+									  this, _1, _2));
 		
 		// update the positions
         
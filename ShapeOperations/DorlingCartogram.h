@@ -92,16 +92,15 @@ protected:
 						const double& orig_data_min,
 						const double& orig_data_max);
 	
-	void add_point(int pointer, int axis, int body);
-	void get_point(int pointer, int axis, int body);
-	
-	struct leaf {
-		int id;
-		double xpos;
-		double ypos;
-		int left;
-		int right;
-	};
+	// Dorling's kd-tree (add_point/get_point) is replaced by a uniform
+	// grid rebuilt every iteration.  Cells are at least 2*widest wide, so
+	// the neighbors within widest+radius[body] of a body are in the 3x3
+	// block of cells around it.
+	void build_grid();
+	// repulsion and attraction for bodies start..end (inclusive, the unused
+	// body 0 is skipped), sets xvector and yvector.  Only reads x, y and the
+	// grid, so ranges can run in parallel
+	void compute_forces(int start, int end);
 	
 	int* nbours;
 	int** nbour;
@@ -135,21 +134,24 @@ protected:
 	//std::vector<double> radius;
 	double* radius;
 	
-	// variables that do change after initialization	
-	int number; // modified by get_point and used as a global variable
-	   // for to index into list array.
-	
-	int end_pointer; // modified by add_point and used as a global variable
-
 	double widest; // also max in output_radius
-	double distance; // read-only in get_point.  Could be passed into
-	// get_point as a parameter
-	
-	int* list; // array that is modified by get_point and used
-	           // in main loop of iterations to keep track of neighbors
-	
 	
-	leaf* tree; // array of leaf structs
+	// neighbors in CSR form: nbr_id[nbr_start[body]..nbr_start[body+1]) with
+	// weights border[body][nb]/perimeter[body]
+	std::vector<int> nbr_start;
+	std::vector<int> nbr_id;
+	std::vector<double> nbr_weight;
+	
+	// spatial grid: bodies in cell c are
+	// cell_bodies[cell_start[c]..cell_start[c+1])
+	double grid_xmin;
+	double grid_ymin;
+	double grid_cell;
+	int grid_cols;
+	int grid_rows;
+	std::vector<int> cell_start;
+	std::vector<int> cell_bodies;
+	std::vector<int> body_cell;
 	
 	static const double friction;
 	static const double ratio;
@@ -0,0 +1,357 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <boost/functional/hash.hpp>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/datetime.h>
+
+#include "../GdaConst.h"
+#include "../GenUtils.h"
+#include "../GdaShape.h"
+#include "GeomSnapshot.h"
+
+namespace {
+	// bump when the layout below changes: old snapshots are then ignored
+	const wxInt32 SNAPSHOT_VERSION = 1;
+	const char SNAPSHOT_MAGIC[8] = { 'G','D','A','S','N','A','P','\0' };
+	// written in native byte order: a snapshot copied from a machine
+	// with the other endianness is rejected
+	const wxInt32 BYTE_ORDER_MARK = 0x01020304;
+
+	enum SectionType { GEOMETRIES = 1, CENTROIDS = 2 };
+	enum ContentsType { POINT_CONTENTS = 0, POLYGON_CONTENTS = 1 };
+
+	struct SnapshotKey {
+		std::string ds_name;
+		std::string layer_name;
+		wxInt64 file_size;
+		wxInt64 mod_time;
+	};
+
+	bool GetKey(const wxString& ds_name, const wxString& layer_name,
+				SnapshotKey& key)
+	{
+		wxFileName fn(ds_name);
+		if (!fn.FileExists()) return false;
+		wxULongLong sz = fn.GetSize();
+		if (sz == wxInvalidSize) return false;
+		wxDateTime mod_time = fn.GetModificationTime();
+		if (!mod_time.IsValid()) return false;
+		key.ds_name = std::string(GET_ENCODED_FILENAME(fn.GetFullPath()));
+		key.layer_name = std::string(GET_ENCODED_FILENAME(layer_name));
+		key.file_size = (wxInt64) sz.GetValue();
+		key.mod_time = (wxInt64) mod_time.GetTicks();
+		return true;
+	}
+
+	wxString GetFileName(const SnapshotKey& key, SectionType section)
+	{
+		std::size_t h = 0;
+		boost::hash_combine(h, key.ds_name);
+		boost::hash_combine(h, key.layer_name);
+		wxString fname = GenUtils::GetSnapshotDir();
+		fname << wxFileName::GetPathSeparator();
+		fname << wxString::Format("%016llx", (unsigned long long) h);
+		fname << (section == GEOMETRIES ? ".geom" : ".cent");
+		return fname;
+	}
+
+	template <class T> void Put(std::ofstream& out, const T& val)
+	{
+		out.write((const char*) &val, sizeof(T));
+	}
+
+	template <class T> bool Get(std::ifstream& in, T& val)
+	{
+		in.read((char*) &val, sizeof(T));
+		return in.good();
+	}
+
+	template <class T> void PutArray(std::ofstream& out,
+									 const std::vector<T>& v)
+	{
+		wxInt32 n = (wxInt32) v.size();
+		Put(out, n);
+		if (n > 0) out.write((const char*) &v[0], sizeof(T) * n);
+	}
+
+	template <class T> bool GetArray(std::ifstream& in, std::vector<T>& v)
+	{
+		wxInt32 n = 0;
+		if (!Get(in, n) || n < 0) return false;
+		v.resize(n);
+		if (n > 0) in.read((char*) &v[0], sizeof(T) * n);
+		return in.good();
+	}
+
+	void PutString(std::ofstream& out, const std::string& s)
+	{
+		wxInt32 n = (wxInt32) s.size();
+		Put(out, n);
+		out.write(s.data(), n);
+	}
+
+	bool GetString(std::ifstream& in, std::string& s)
+	{
+		wxInt32 n = 0;
+		if (!Get(in, n) || n < 0 || n > 65536) return false;
+		s.resize(n);
+		if (n > 0) in.read(&s[0], n);
+		return in.good();
+	}
+
+	void PutHeader(std::ofstream& out, const SnapshotKey& key,
+				   SectionType section, wxInt32 n_rows)
+	{
+		out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		Put(out, SNAPSHOT_VERSION);
+		Put(out, BYTE_ORDER_MARK);
+		Put(out, (wxInt32) section);
+		PutString(out, key.ds_name);
+		PutString(out, key.layer_name);
+		Put(out, key.file_size);
+		Put(out, key.mod_time);
+		Put(out, n_rows);
+	}
+
+	bool CheckHeader(std::ifstream& in, const SnapshotKey& key,
+					 SectionType section, wxInt32 n_rows)
+	{
+		char magic[sizeof(SNAPSHOT_MAGIC)];
+		in.read(magic, sizeof(magic));
+		if (!in.good() || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+			return false;
+		wxInt32 version = 0, bom = 0, sec = 0, n = 0;
+		wxInt64 file_size = 0, mod_time = 0;
+		std::string ds_name, layer_name;
+		if (!Get(in, version) || version != SNAPSHOT_VERSION) return false;
+		if (!Get(in, bom) || bom != BYTE_ORDER_MARK) return false;
+		if (!Get(in, sec) || sec != section) return false;
+		if (!GetString(in, ds_name) || ds_name != key.ds_name) return false;
+		if (!GetString(in, layer_name) || layer_name != key.layer_name)
+			return false;
+		if (!Get(in, file_size) || file_size != key.file_size) return false;
+		if (!Get(in, mod_time) || mod_time != key.mod_time) return false;
+		if (!Get(in, n) || n != n_rows) return false;
+		return true;
+	}
+
+	// write to a temporary file first, so that a snapshot is never seen
+	// half written by another GeoDa instance
+	bool Commit(std::ofstream& out, const wxString& tmp_name,
+				const wxString& fname)
+	{
+		out.close();
+		if (out.fail()) {
+			wxRemoveFile(tmp_name);
+			return false;
+		}
+		if (!wxRenameFile(tmp_name, fname, true)) {
+			wxRemoveFile(tmp_name);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool GeomSnapshot::IsEnabled(const wxString& ds_name)
+{
+	return GdaConst::gda_use_geom_snapshot && wxFileExists(ds_name);
+}
+
+bool GeomSnapshot::ReadGeometries(const wxString& ds_name,
+								  const wxString& layer_name,
+								  int n_rows, Shapefile::Main& main,
+								  bool& has_null_geometry, int& geom_type)
+{
+	if (!IsEnabled(ds_name)) return false;
+	SnapshotKey key;
+	if (!GetKey(ds_name, layer_name, key)) return false;
+	wxString fname = GetFileName(key, GEOMETRIES);
+	if (!wxFileExists(fname)) return false;
+
+	std::ifstream in;
+	in.open(GET_ENCODED_FILENAME(fname), std::ios::in | std::ios::binary);
+	if (!in.is_open()) return false;
+	if (!CheckHeader(in, key, GEOMETRIES, n_rows)) return false;
+
+	wxInt32 g_type = 0, shape_type = 0;
+	char null_geom = 0;
+	Shapefile::Header header;
+	bool ok = (Get(in, g_type) && Get(in, null_geom) &&
+			   Get(in, shape_type) &&
+			   Get(in, header.bbox_x_min) && Get(in, header.bbox_y_min) &&
+			   Get(in, header.bbox_x_max) && Get(in, header.bbox_y_max));
+	if (!ok) return false;
+	header.shape_type = shape_type;
+
+	std::vector<Shapefile::MainRecord> records(n_rows);
+	for (int i=0; ok && i<n_rows; i++) {
+		char contents = 0;
+		wxInt32 st = 0;
+		if (!Get(in, contents) || !Get(in, st)) {
+			ok = false;
+		} else if (contents == POINT_CONTENTS) {
+			Shapefile::PointContents* pc = new Shapefile::PointContents();
+			records[i].contents_p = pc;
+			pc->shape_type = st;
+			ok = Get(in, pc->x) && Get(in, pc->y);
+		} else if (contents == POLYGON_CONTENTS) {
+			Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
+			records[i].contents_p = pc;
+			pc->shape_type = st;
+			ok = (GetArray(in, pc->box) && Get(in, pc->num_parts) &&
+				  Get(in, pc->num_points) && GetArray(in, pc->parts) &&
+				  GetArray(in, pc->points));
+		} else {
+			ok = false;
+		}
+	}
+	// records are only handed over when the whole file was read
+	if (!ok) return false;
+
+	main.header.shape_type = header.shape_type;
+	main.header.bbox_x_min = header.bbox_x_min;
+	main.header.bbox_y_min = header.bbox_y_min;
+	main.header.bbox_x_max = header.bbox_x_max;
+	main.header.bbox_y_max = header.bbox_y_max;
+	main.header.bbox_z_min = 0;
+	main.header.bbox_z_max = 0;
+	main.header.bbox_m_min = 0;
+	main.header.bbox_m_max = 0;
+	// MainRecord deletes its contents: swap the pointers over instead of
+	// copying the records
+	main.records.resize(n_rows);
+	for (int i=0; i<n_rows; i++) {
+		std::swap(main.records[i].contents_p, records[i].contents_p);
+	}
+	has_null_geometry = null_geom != 0;
+	geom_type = g_type;
+	return true;
+}
+
+bool GeomSnapshot::WriteGeometries(const wxString& ds_name,
+								   const wxString& layer_name,
+								   const Shapefile::Main& main,
+								   bool has_null_geometry, int geom_type)
+{
+	if (!IsEnabled(ds_name)) return false;
+	SnapshotKey key;
+	if (!GetKey(ds_name, layer_name, key)) return false;
+	wxString fname = GetFileName(key, GEOMETRIES);
+	wxString tmp_name = fname + ".tmp";
+
+	std::ofstream out;
+	out.open(GET_ENCODED_FILENAME(tmp_name),
+			 std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) return false;
+
+	int n_rows = main.records.size();
+	PutHeader(out, key, GEOMETRIES, n_rows);
+	Put(out, (wxInt32) geom_type);
+	Put(out, (char) (has_null_geometry ? 1 : 0));
+	Put(out, main.header.shape_type);
+	Put(out, main.header.bbox_x_min);
+	Put(out, main.header.bbox_y_min);
+	Put(out, main.header.bbox_x_max);
+	Put(out, main.header.bbox_y_max);
+
+	for (int i=0; i<n_rows; i++) {
+		Shapefile::RecordContents* rc = main.records[i].contents_p;
+		Shapefile::PointContents* pt =
+			dynamic_cast<Shapefile::PointContents*>(rc);
+		Shapefile::PolygonContents* pc =
+			dynamic_cast<Shapefile::PolygonContents*>(rc);
+		if (pt) {
+			Put(out, (char) POINT_CONTENTS);
+			Put(out, pt->shape_type);
+			Put(out, pt->x);
+			Put(out, pt->y);
+		} else if (pc) {
+			Put(out, (char) POLYGON_CONTENTS);
+			Put(out, pc->shape_type);
+			PutArray(out, pc->box);
+			Put(out, pc->num_parts);
+			Put(out, pc->num_points);
+			PutArray(out, pc->parts);
+			PutArray(out, pc->points);
+		} else {
+			// not a layer read by OGRLayerProxy::ReadGeometries
+			out.close();
+			wxRemoveFile(tmp_name);
+			return false;
+		}
+	}
+	return Commit(out, tmp_name, fname);
+}
+
+bool GeomSnapshot::ReadCentroids(const wxString& ds_name,
+								 const wxString& layer_name,
+								 int n_rows, std::vector<GdaPoint*>& centroids)
+{
+	if (!IsEnabled(ds_name)) return false;
+	SnapshotKey key;
+	if (!GetKey(ds_name, layer_name, key)) return false;
+	wxString fname = GetFileName(key, CENTROIDS);
+	if (!wxFileExists(fname)) return false;
+
+	std::ifstream in;
+	in.open(GET_ENCODED_FILENAME(fname), std::ios::in | std::ios::binary);
+	if (!in.is_open()) return false;
+	if (!CheckHeader(in, key, CENTROIDS, n_rows)) return false;
+
+	std::vector<double> xy;
+	if (!GetArray(in, xy) || xy.size() != 2*n_rows) return false;
+	centroids.reserve(centroids.size() + n_rows);
+	for (int i=0; i<n_rows; i++) {
+		centroids.push_back(new GdaPoint(xy[2*i], xy[2*i+1]));
+	}
+	return true;
+}
+
+bool GeomSnapshot::WriteCentroids(const wxString& ds_name,
+								  const wxString& layer_name,
+								  const std::vector<GdaPoint*>& centroids)
+{
+	if (!IsEnabled(ds_name)) return false;
+	SnapshotKey key;
+	if (!GetKey(ds_name, layer_name, key)) return false;
+	wxString fname = GetFileName(key, CENTROIDS);
+	wxString tmp_name = fname + ".tmp";
+
+	std::ofstream out;
+	out.open(GET_ENCODED_FILENAME(tmp_name),
+			 std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) return false;
+
+	int n_rows = centroids.size();
+	std::vector<double> xy(2*n_rows);
+	for (int i=0; i<n_rows; i++) {
+		xy[2*i] = centroids[i]->GetX();
+		xy[2*i+1] = centroids[i]->GetY();
+	}
+	PutHeader(out, key, CENTROIDS, n_rows);
+	PutArray(out, xy);
+	return Commit(out, tmp_name, fname);
+}
@@ -0,0 +1,64 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GEOM_SNAPSHOT_H__
+#define __GEODA_CENTER_GEOM_SNAPSHOT_H__
+
+#include <vector>
+#include <wx/string.h>
+#include "../ShpFile.h"
+
+class GdaPoint;
+
+/**
+ * Binary snapshots of the geometries of a file data source.
+ *
+ * Converting the OGR geometries to Shapefile::Main records and computing
+ * the OGR centroids are the slowest steps of opening a large layer.  The
+ * result of both is written once to a versioned binary sidecar file in
+ * GenUtils::GetSnapshotDir(), and read back with a few large sequential
+ * reads the next time the same layer is opened.
+ *
+ * A snapshot is keyed by the data source path and layer name, and is only
+ * used while the size and modification time of the data source file and
+ * the number of rows are the ones it was written for.  Anything else (a
+ * stale, truncated or foreign file) makes Read* return false, and the
+ * caller falls back to OGR.  Snapshots are only used for local files and
+ * when GdaConst::gda_use_geom_snapshot is set.
+ */
+namespace GeomSnapshot {
+	bool IsEnabled(const wxString& ds_name);
+
+	/** Read the geometry records.  geom_type is the OGRwkbGeometryType of
+	 the layer as found by OGRLayerProxy::ReadGeometries. */
+	bool ReadGeometries(const wxString& ds_name, const wxString& layer_name,
+						int n_rows, Shapefile::Main& main,
+						bool& has_null_geometry, int& geom_type);
+	bool WriteGeometries(const wxString& ds_name, const wxString& layer_name,
+						 const Shapefile::Main& main,
+						 bool has_null_geometry, int geom_type);
+
+	/** Read the OGR centroids, appending n_rows new GdaPoint to centroids */
+	bool ReadCentroids(const wxString& ds_name, const wxString& layer_name,
+					   int n_rows, std::vector<GdaPoint*>& centroids);
+	bool WriteCentroids(const wxString& ds_name, const wxString& layer_name,
+						const std::vector<GdaPoint*>& centroids);
+}
+
+#endif
@@ -10,9 +10,12 @@
 
 #include <string.h> // memset
 #include <cmath>
-#include <algorithm> // for std::partial_sort
+#include <algorithm> // for std::nth_element
 #include <memory>
 #include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "../Algorithms/threadpool.h"
 #include "Lowess.h"
 
 using namespace std;
@@ -21,13 +24,15 @@ using namespace std;
 #define imax2(a,b) std::max(a,b)
 #define fmax2(a,b) std::max(a,b)
 
-#define rPsort(x,n,k) std::partial_sort(&x[0],&x[n],&x[k]);
 
 const double Lowess::default_f = 0.2;
 const int Lowess::default_iter = 5;
 const double Lowess::default_delta_factor = 0.02;
 const int Lowess::max_iter = 10000;
 
+// local fits below this many (anchors x span) operations use one thread
+static const int MIN_FIT_WORK_PER_THREAD = 200000;
+
 Lowess::Lowess(double f, int iter, double delta_factor)
 {
 	SetF(f);
@@ -194,13 +199,47 @@ void Lowess::lowest(const double *x, const double *y, int n,
 	}
 }
 
+void Lowess::fit_range(const FitJob* job, int a, int b)
+{
+	const double* x = job->x;
+	std::vector<double> w(job->n);
+	bool fit_ok;
+	for (int k=a; k<=b; ++k) {
+		int i = (*job->anchors)[3*k];
+		int nleft = (*job->anchors)[3*k+1];
+		int nright = (*job->anchors)[3*k+2];
+		lowest(&x[1], &job->y[1], job->n, &x[i], &job->ys[i],
+			   nleft, nright, &w[0], job->userw, job->rw, &fit_ok);
+		job->ok[k] = fit_ok;
+	}
+}
+
+void Lowess::fit_anchors(const double *x, const double *y, int n, int ns,
+                         const std::vector<int>& anchors,
+                         bool userw, double *rw, double *ys, char *ok)
+{
+	FitJob job;
+	job.x = x;
+	job.y = y;
+	job.ys = ys;
+	job.rw = rw;
+	job.n = n;
+	job.userw = userw;
+	job.anchors = &anchors;
+	job.ok = ok;
+	
+	int n_anchors = anchors.size() / 3;
+	int min_anchors = (MIN_FIT_WORK_PER_THREAD + ns - 1) / std::max(ns, 1);
+	run_range_threads(n_anchors, min_anchors,
+					  boost::bind(&Lowess::fit_range, this, &job, _1, _2));
+}
+
 void Lowess::clowess(const double *x, const double *y, int n,
                      double f, size_t iter, double delta,
                      double *ys, double *rw, double *res)
 {
 	size_t cur_iter;
 	int i, j, last, m1, m2, nleft, nright, ns;
-	bool ok;
 	double alpha, c1, c9, cmad, cut, d1, d2, denom, r, sc;
 	
 	if (n < 2) {
@@ -216,46 +255,72 @@ void Lowess::clowess(const double *x, const double *y, int n,
 	/* at least two, at most n points */
 	ns = imax2(2, imin2(n, (int)(f*n + 1e-7)));
 	
+	/* The points where a local fit is computed (anchors), and their
+	   nleft, nright windows, only depend on x and delta: find them once
+	   for all robustness iterations.  The fits at the anchors are then
+	   independent and run in parallel, and the skipped points are filled
+	   in afterwards in the original order. */
+	std::vector<int> anchors; // (i, nleft, nright) triples
+	nleft = 1;
+	nright = ns;
+	last = 0;       /* index of prev estimated point */
+	i = 1;          /* index of current point */
+	for(;;) {
+		if (nright < n) {
+			
+			/* move nleft,  nright to right */
+			/* if radius decreases */
+			
+			d1 = x[i] - x[nleft];
+			d2 = x[nright+1] - x[i];
+			
+			/* if d1 <= d2 with */
+			/* x[nright+1] == x[nright], */
+			/* lowest fixes */
+			
+			if (d1 > d2) {
+				
+				/* radius will not */
+				/* decrease by */
+				/* move right */
+				
+				nleft++;
+				nright++;
+				continue;
+			}
+		}
+		anchors.push_back(i);
+		anchors.push_back(nleft);
+		anchors.push_back(nright);
+		
+		last = i;
+		cut = x[last]+delta;
+		for (i = last+1; i <= n; i++) {
+			if (x[i] > cut)
+				break;
+			if (x[i] == x[last])
+				last = i;
+		}
+		i = imax2(last+1, i-1);
+		if (last >= n)
+			break;
+	}
+	size_t n_anchors = anchors.size() / 3;
+	std::vector<char> ok(n_anchors);
+	
 	/* robustness iterations */
 	
 	cur_iter = 1;
 	while (cur_iter <= iter+1) {
-		nleft = 1;
-		nright = ns;
-		last = 0;       /* index of prev estimated point */
-		i = 1;          /* index of current point */
+		/* fitted values at the anchors */
 		
-		for(;;) {
-			if (nright < n) {
-				
-				/* move nleft,  nright to right */
-				/* if radius decreases */
-				
-				d1 = x[i] - x[nleft];
-				d2 = x[nright+1] - x[i];
-				
-				/* if d1 <= d2 with */
-				/* x[nright+1] == x[nright], */
-				/* lowest fixes */
-				
-				if (d1 > d2) {
-					
-					/* radius will not */
-					/* decrease by */
-					/* move right */
-					
-					nleft++;
-					nright++;
-					continue;
-				}
-			}
-			
-			/* fitted value at x[i] */
+		fit_anchors(x, y, n, ns, anchors, cur_iter>1, rw, ys, &ok[0]);
+		
+		last = 0;
+		for (size_t k=0; k<n_anchors; ++k) {
+			i = anchors[3*k];
 			
-			lowest(&x[1], &y[1], n, &x[i], &ys[i],
-						 nleft, nright, res, cur_iter>1, rw, &ok);
-            
-			if (!ok) ys[i] = y[i];
+			if (!ok[k]) ys[i] = y[i];
 			
 			/* all weights zero */
 			/* copy over value (all rw==0) */
@@ -277,17 +342,14 @@ void Lowess::clowess(const double *x, const double *y, int n,
 			
 			/* x coord of close points */
 			cut = x[last]+delta;
-			for (i = last+1; i <= n; i++) {
-				if (x[i] > cut)
+			for (j = last+1; j <= n; j++) {
+				if (x[j] > cut)
 					break;
-				if (x[i] == x[last]) {
-					ys[i] = ys[last];
-					last = i;
+				if (x[j] == x[last]) {
+					ys[j] = ys[last];
+					last = j;
 				}
 			}
-			i = imax2(last+1, i-1);
-			if (last >= n)
-				break;
 		}
 		/* residuals */
 		for(i = 0; i < n; i++)
@@ -310,12 +372,11 @@ void Lowess::clowess(const double *x, const double *y, int n,
 		/* Compute   cmad := 6 * median(rw[], n)  ---- */
 		m1 = n/2;
 		/* partial sort, for m1 & m2 */
-		//rPsort(rw, n, m1);
-		rPsort(rw, m1, n);
+		std::nth_element(rw, rw+m1, rw+n);
 		if (n % 2 == 0) {
 			m2 = n-m1-1;
-			//rPsort(rw, n, m2);
-			rPsort(rw, m2, n);
+			/* rw[0..m1-1] <= rw[m1]: m2 is the largest of these */
+			std::nth_element(rw, rw+m2, rw+m1);
 			cmad = 3.*(rw[m1]+rw[m2]);
 		}
 		else { /* n odd */
@@ -339,5 +400,3 @@ void Lowess::clowess(const double *x, const double *y, int n,
 	}
 }
 //see also ..R-2.11.0/src/library/stats/R/lowess.R
-
-
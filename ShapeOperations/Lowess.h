@@ -73,6 +73,25 @@ private:
 							int nleft, int nright, double *w,
 							bool userw, double *rw, bool *ok);
 	
+	/** Arguments of the local fits of one robustness iteration */
+	struct FitJob {
+		const double *x; // 1-based, as in clowess
+		const double *y;
+		double *ys;
+		double *rw;
+		int n;
+		bool userw;
+		const std::vector<int>* anchors; // (i, nleft, nright) triples
+		char *ok;
+	};
+	
+	// anchors a..b, b inclusive
+	void fit_range(const FitJob* job, int a, int b);
+	
+	void fit_anchors(const double *x, const double *y, int n, int ns,
+					 const std::vector<int>& anchors,
+					 bool userw, double *rw, double *ys, char *ok);
+	
 	void clowess(const double  *x, const double *y, int n,
 							 double f, size_t iter, double delta,
 							 double *ys, double *rw, double *res);
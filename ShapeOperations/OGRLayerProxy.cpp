@@ -17,11 +17,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <string>
 #include <time.h>
 #include <vector>
 #include <ogrsf_frmts.h>
 #include <climits>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/date_time.hpp>
 #include <boost/unordered_map.hpp>
@@ -31,6 +33,7 @@
 #include "../GeneralWxUtils.h"
 #include "../GdaShape.h"
 #include "../GdaCartoDB.h"
+#include "../Algorithms/threadpool.h"
 #include "../GdaException.h"
 
 #include "OGRLayerProxy.h"
@@ -748,6 +751,90 @@ Shapefile::ShapeType OGRLayerProxy::GetGdaGeometries(vector<GdaShape*>& geoms,
     return shape_type;
 }
 
+/**
+ * Column data of one exported field, read from the table once per export
+ */
+struct OGRExportColumn {
+    int field_idx;
+    GdaConst::FieldType type;
+    vector<wxInt64> l_data;
+    vector<double> d_data;
+    vector<unsigned long long> t_data;
+    vector<wxString> s_data;
+    vector<bool> undefs;
+};
+
+/**
+ * Create the features of the selected rows start..end-1 in batch.  It runs
+ * on its own thread while the previous batch is written to the layer, so it
+ * must not touch the layer itself.
+ */
+static void ogr_create_feature_batch(OGRFeatureDefn* featureDefn,
+                                     vector<OGRGeometry*>* geometries,
+                                     vector<OGRExportColumn>* cols,
+                                     vector<int>* selected_rows,
+                                     wxCSConv* encoding,
+                                     int start, int end,
+                                     vector<OGRFeature*>* batch)
+{
+    batch->clear();
+    batch->reserve(end - start);
+    for (int k=start; k<end; k++) {
+        OGRFeature *poFeature = OGRFeature::CreateFeature(featureDefn);
+        if (k < (int) geometries->size()) {
+            poFeature->SetGeometryDirectly( (*geometries)[k] );
+        }
+        int orig_id = (*selected_rows)[k];
+        for (size_t c=0; c<cols->size(); c++) {
+            OGRExportColumn& col = (*cols)[c];
+            int j = col.field_idx;
+            if (col.undefs[orig_id]) {
+                poFeature->UnsetField(j);
+            } else if (col.type == GdaConst::long64_type) {
+                poFeature->SetField(j, (GIntBig)(col.l_data[orig_id]));
+            } else if (col.type == GdaConst::double_type) {
+                poFeature->SetField(j, col.d_data[orig_id]);
+            } else if (col.type == GdaConst::date_type ||
+                       col.type == GdaConst::time_type ||
+                       col.type == GdaConst::datetime_type ) {
+                unsigned long long t = col.t_data[orig_id];
+                int year = t / 10000000000;
+                int month = (t % 10000000000) / 100000000;
+                int day = (t % 100000000) / 1000000;
+                int hour = (t % 1000000) / 10000;
+                int minute = (t % 10000) / 100;
+                int second = t % 100;
+                poFeature->SetField(j, year, month, day, hour, minute, second);
+            } else {
+                // others are treated as string_type
+                // XXX encodings
+                if (encoding == NULL)
+                    poFeature->SetField(j, col.s_data[orig_id].mb_str().data());
+                else
+                    poFeature->SetField(j, col.s_data[orig_id].mb_str(*encoding).data());
+            }
+        }
+        batch->push_back(poFeature);
+    }
+}
+
+/**
+ * Destroy the geometries from start on, which no feature has taken over
+ */
+static void ogr_destroy_geometries(vector<OGRGeometry*>& geometries, int start)
+{
+    for (int k=start; k<(int) geometries.size(); k++) {
+        if (geometries[k]) OGRGeometryFactory::destroyGeometry(geometries[k]);
+        geometries[k] = NULL;
+    }
+}
+
+/**
+ * Rows are written in batches of GdaConst::ogr_export_batch_size, each in
+ * its own transaction if the layer supports transactions.  Only two batches
+ * of OGRFeature objects exist at a time: the next batch is created on a
+ * worker thread while the current one is written.
+ */
 void
 OGRLayerProxy::AddFeatures(vector<OGRGeometry*>& geometries,
                            TableInterface* table,
@@ -758,27 +845,22 @@ OGRLayerProxy::AddFeatures(vector<OGRGeometry*>& geometries,
     wxCSConv* encoding = NULL;
     if (table) table->GetEncoding();
 
-    // Create features in memory first
-    for (size_t i=0; i<selected_rows.size();++i) {
-        if (stop_exporting) return;
-        OGRFeature *poFeature = OGRFeature::CreateFeature(featureDefn);
-        if ( !geometries.empty()) {
-            poFeature->SetGeometryDirectly( geometries[i] );
-        }
-        data.push_back(poFeature);
-    }
-    
-    int export_size = data.size();
-    export_progress = export_size / 4;
+    int n_rows = selected_rows.size();
+    int export_size = n_rows;
+    if (table != NULL && export_size == 0) export_size = table->GetNumberRows();
 
-    // Fill the feature with content
+    // read the columns of all fields once
+    vector<OGRExportColumn> cols;
     if (table != NULL) {
-        if (export_size == 0) export_size = table->GetNumberRows();
-        export_progress = export_size / 4;
         // fields already have been created by OGRDatasourceProxy::CreateLayer()
+        cols.reserve(fields.size());
         for (int j=0; j< fields.size(); j++) {
             wxString fname = fields[j]->GetName();
             GdaConst::FieldType ftype = fields[j]->GetType();
+            // KML case: there are by default two fields:
+            // [Name, Description], so if placeholder that
+            // means table is empty. Then do nothing
+            if (ftype == GdaConst::placeholder_type) continue;
             // get underneath column position (no group and time =0)
             int col_pos = table->GetColIdx(fname);
 			// check if field name can be found in current opened layer
@@ -786,117 +868,100 @@ OGRLayerProxy::AddFeatures(vector<OGRGeometry*>& geometries,
 				wxString msg = wxString::Format(" Failed to create field %s.\n", fname);
 				error_message << msg << CPLGetLastErrorMsg();
 				export_progress = -1;
+				ogr_destroy_geometries(geometries, 0);
 				return;
 			}
-            vector<bool> undefs;
+            cols.push_back(OGRExportColumn());
+            OGRExportColumn& col = cols.back();
+            col.field_idx = j;
+            col.type = ftype;
             if ( ftype == GdaConst::long64_type) {
-                vector<wxInt64> col_data;
-                table->GetDirectColData(col_pos, col_data);
-                table->GetDirectColUndefined(col_pos, undefs);
-                
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    int orig_id = selected_rows[k];
-                    
-                    if (undefs[orig_id]) {
-                        data[k]->UnsetField(j);
-                    } else {
-                        data[k]->SetField(j, (GIntBig)(col_data[orig_id]));
-                    }
-                    if (stop_exporting) return;
-                }
-                
+                table->GetDirectColData(col_pos, col.l_data);
             } else if (ftype == GdaConst::double_type) {
-                vector<double> col_data;
-                table->GetDirectColData(col_pos, col_data);
-                table->GetDirectColUndefined(col_pos, undefs);
-                
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    int orig_id = selected_rows[k];
-                    
-                    if (undefs[orig_id]) {
-                        data[k]->UnsetField(j);
-                    } else {
-                        data[k]->SetField(j, col_data[orig_id]);
-                    }
-                    if (stop_exporting) return;
-                }
+                table->GetDirectColData(col_pos, col.d_data);
             } else if (ftype == GdaConst::date_type ||
                        ftype == GdaConst::time_type ||
                        ftype == GdaConst::datetime_type ) {
-                
-                vector<unsigned long long> col_data;
-                table->GetDirectColData(col_pos, col_data);
-                table->GetDirectColUndefined(col_pos, undefs);
-               
-                int year, month, day, hour, minute, second;
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    int orig_id = selected_rows[k];
-                   
-                    year = col_data[ orig_id ] / 10000000000;
-                    month = (col_data[ orig_id ] % 10000000000) / 100000000;
-                    day = (col_data[ orig_id ] % 100000000) / 1000000;
-                    hour = (col_data[ orig_id ] % 1000000) / 10000;
-                    minute = (col_data[ orig_id ] % 10000) / 100;
-                    second = col_data[ orig_id ] % 100;
-                    
-                    if (undefs[orig_id]) {
-                        data[k]->UnsetField(j);
-                    } else {
-                        data[k]->SetField(j, year, month, day, hour, minute, second);
-                    }
-                    if (stop_exporting) return;
-                }
-            } else if (ftype == GdaConst::placeholder_type) {
-                // KML case: there are by default two fields:
-                // [Name, Description], so if placeholder that
-                // means table is empty. Then do nothing
-                
+                table->GetDirectColData(col_pos, col.t_data);
             } else {
-                // others are treated as string_type
-                // XXX encodings
-                vector<wxString> col_data;
-                table->GetDirectColData(col_pos, col_data);
-                table->GetDirectColUndefined(col_pos, undefs);
-
-                if (ds_type == GdaConst::ds_csv) {
-                    for (int m=0; m<col_data.size(); m++) {
-                        undefs[m] = false; // no undefs in csv file
-                        if (col_data[m].IsEmpty())
-                            col_data[m] = " ";
-                    }
-                }
-                for (size_t k=0; k<selected_rows.size();++k) {
-                    int orig_id = selected_rows[k];
-                    
-                    if (undefs[orig_id]) {
-                        data[k]->UnsetField(j);
-                    } else {
-                        char* val = NULL;
-                        if (encoding == NULL)
-                            val = (char*)col_data[orig_id].mb_str().data();
-                        else
-                            val = (char*)col_data[orig_id].mb_str(*encoding).data();
-                        data[k]->SetField(j, val);
-                    }
-                    if (stop_exporting) return;
+                table->GetDirectColData(col_pos, col.s_data);
+            }
+            table->GetDirectColUndefined(col_pos, col.undefs);
+            if (ds_type == GdaConst::ds_csv && !col.s_data.empty()) {
+                for (int m=0; m<col.s_data.size(); m++) {
+                    col.undefs[m] = false; // no undefs in csv file
+                    if (col.s_data[m].IsEmpty())
+                        col.s_data[m] = " ";
                 }
             }
-            if (stop_exporting) return;
+            if (stop_exporting) {
+                ogr_destroy_geometries(geometries, 0);
+                return;
+            }
         }
     }
-    export_progress = export_size / 2;
-   
-    int n_data = data.size();
-    for (int i=0; i<n_data; i++) {
-        if (stop_exporting) return;
-        if ( (i+1)%2 ==0 ) export_progress++;
-        if( layer->CreateFeature( data[i] ) != OGRERR_NONE ) {
-            wxString msg = wxString::Format(" Failed to create feature (%d/%d).\n",
-                                            i + 1, n_data);
+
+    bool use_transactions = layer->TestCapability(OLCTransactions) != 0;
+    int batch_size = GdaConst::ogr_export_batch_size;
+    vector<OGRFeature*> batch, next_batch;
+    ogr_create_feature_batch(featureDefn, &geometries, &cols, &selected_rows,
+                             encoding, 0, std::min(batch_size, n_rows), &batch);
+
+    for (int start=0; start<n_rows; start+=batch_size) {
+        int end = std::min(start + batch_size, n_rows);
+        int next_end = std::min(end + batch_size, n_rows);
+        boost::thread* worker = NULL;
+        if (end < n_rows) {
+            worker = new boost::thread(boost::bind(&ogr_create_feature_batch,
+                                                   featureDefn, &geometries,
+                                                   &cols, &selected_rows,
+                                                   encoding, end, next_end,
+                                                   &next_batch));
+        }
+        bool in_transaction = use_transactions &&
+            layer->StartTransaction() == OGRERR_NONE;
+        bool failed = false;
+        for (int i=0; i<batch.size(); i++) {
+            if (stop_exporting) {
+                failed = true;
+                break;
+            }
+            if( layer->CreateFeature( batch[i] ) != OGRERR_NONE ) {
+                wxString msg = wxString::Format(" Failed to create feature (%d/%d).\n",
+                                                start + i + 1, n_rows);
+                error_message << msg << CPLGetLastErrorMsg();
+                failed = true;
+                break;
+            }
+        }
+        if (!failed && in_transaction &&
+            layer->CommitTransaction() != OGRERR_NONE) {
+            wxString msg = wxString::Format(" Failed to commit features (%d-%d).\n",
+                                            start + 1, end);
             error_message << msg << CPLGetLastErrorMsg();
-            export_progress = -1;
-			return;
+            failed = true;
         }
+        if (failed && in_transaction) layer->RollbackTransaction();
+        for (size_t i=0; i<batch.size(); i++) {
+            OGRFeature::DestroyFeature(batch[i]);
+        }
+        batch.clear();
+        if (worker) {
+            worker->join();
+            delete worker;
+            batch.swap(next_batch);
+        }
+        if (failed) {
+            for (size_t i=0; i<batch.size(); i++) {
+                OGRFeature::DestroyFeature(batch[i]);
+            }
+            // the features of rows up to next_end own their geometries
+            ogr_destroy_geometries(geometries, end < n_rows ? next_end : end);
+            if (!stop_exporting) export_progress = -1;
+            return;
+        }
+        // stay below export_size until the layer is saved
+        export_progress = std::min(end, export_size - 1);
     }
     Save();
     export_progress = export_size;
@@ -951,12 +1016,17 @@ bool OGRLayerProxy::ReadData()
     }
 	int row_idx = 0;
 	OGRFeature *feature = NULL;
-    boost::unordered_map<int, OGRFeature*> feature_dict;
+    if (n_rows > 0) data.reserve(n_rows);
     layer->ResetReading();
 	while ((feature = layer->GetNextFeature()) != NULL) {
         // thread feature: user can stop reading
-		if (stop_reading) break;
-        feature_dict[row_idx] = feature;
+		if (stop_reading) {
+            OGRFeature::DestroyFeature(feature);
+            break;
+        }
+        // features from GetNextFeature() are owned by the caller: keep them
+        // in this class, no need to store a copy
+        data.push_back(feature);
 		load_progress = row_idx++;
 	}
     if (row_idx == 0) {
@@ -967,16 +1037,17 @@ bool OGRLayerProxy::ReadData()
     if (stop_reading) {
         error_message << "Reading data was interrupted.";
         // clean just read OGRFeatures
-        for (int i = 0; i < row_idx; i++) {
-            OGRFeature::DestroyFeature(feature_dict[i]);
+        for (size_t i = 0; i < data.size(); i++) {
+            OGRFeature::DestroyFeature(data[i]);
         }
+        data.clear();
         return false;
     }
 	n_rows = row_idx;
     // check empty rows at the end of table -- this often occurs in a csv file
     // , then remove empty rows see issue#563
-    for (int i = n_rows-1; i >= 0; --i) {
-        OGRFeature* my_feature = feature_dict[i];
+    while (n_rows > 0) {
+        OGRFeature* my_feature = data[n_rows-1];
         bool is_empty = true;
         for (int j= 0; j<n_cols; j++) {
             if (my_feature->IsFieldSet(j)) {
@@ -984,27 +1055,15 @@ bool OGRLayerProxy::ReadData()
                 break;
             }
         }
-        if (is_empty) {
-            OGRGeometry* my_geom = my_feature->GetGeometryRef();
-            if (my_geom == NULL) {
-                n_rows -= 1;
-            }
-        } else {
-            // visit starts from the bottom of the table, so interupt if
-            // non-empty row is detected
-            break;
-        }
-    }
-    // create copies of OGRFeatures* from OGR,
-    // and manage the copies in this class
-    for (int i = 0; i < n_rows; i++) {
-        OGRFeature* my_feature = feature_dict[i]->Clone();
-        data.push_back(my_feature);
-        OGRFeature::DestroyFeature(feature_dict[i]);
+        // visit starts from the bottom of the table, so interupt if
+        // non-empty row is detected
+        if (!is_empty || my_feature->GetGeometryRef() != NULL) break;
+        OGRFeature::DestroyFeature(my_feature);
+        data.pop_back();
+        n_rows -= 1;
     }
     // Set load_progress 100% to continue
     load_progress = row_idx;
-    feature_dict.clear();
 	return true;
 }
 
@@ -1428,48 +1487,67 @@ bool OGRLayerProxy::ReadGeometries(Shapefile::Main& p_main)
     
 	// resize geometry records
 	p_main.records.resize(n_rows);
-	bool noExtent = (pEnvelope.MinX == pEnvelope.MaxX) &&
-                    (pEnvelope.MinY == pEnvelope.MaxY);
-    noExtent = false;
     
-	//read OGR geometry features
-	int feature_counter =0;
+    // geometry type of each row: null geometries take the layer type
+	vector<OGRwkbGeometryType> types(n_rows);
 	for ( int row_idx=0; row_idx < n_rows; row_idx++ ) {
-		OGRFeature* feature = data[row_idx];
-		OGRGeometry* geometry= feature->GetGeometryRef();
+		OGRGeometry* geometry= data[row_idx]->GetGeometryRef();
 		OGRwkbGeometryType eType = geometry ? wkbFlatten(geometry->getGeometryType()) : eGType;
 		// sometime OGR can't return correct value from GetGeomType() call
 		if (eGType == wkbUnknown) eGType = eType;
+        if (eType != wkbPoint && eType != wkbMultiPoint &&
+            eType != wkbPolygon && eType != wkbCurvePolygon &&
+            eType != wkbMultiPolygon) {
+            string open_err_msg = "GeoDa does not support datasource with line data at this time.  Please choose a datasource with either point or polygon data.";
+            throw GdaException(open_err_msg.c_str());
+        }
+        if (geometry == NULL) {
+            has_null_geometry = true;
+        } else if (row_idx == 0) {
+            if (eType == wkbPoint || eType == wkbMultiPoint)
+                p_main.header.shape_type = Shapefile::POINT_TYP;
+            else
+                p_main.header.shape_type = Shapefile::POLYGON;
+        }
+        types[row_idx] = eType;
+	}
+    
+	// read OGR geometry features: each row is converted independently
+    run_range_threads(n_rows, 10000,
+                      boost::bind(&OGRLayerProxy::ReadGeometryRange, this,
+                                  &p_main, &types, _1, _2));
+	return has_null_geometry;
+}
+
+void OGRLayerProxy::ReadGeometryRange(Shapefile::Main* p_main,
+                                      const vector<OGRwkbGeometryType>* types,
+                                      int start, int end)
+{
+	for ( int row_idx=start; row_idx <= end; row_idx++ ) {
+		OGRFeature* feature = data[row_idx];
+		OGRGeometry* geometry= feature->GetGeometryRef();
+		OGRwkbGeometryType eType = (*types)[row_idx];
         
 		if (eType == wkbPoint) {
 			Shapefile::PointContents* pc = new Shapefile::PointContents();
 			pc->shape_type = Shapefile::POINT_TYP;
             if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POINT_TYP;
-                
                 OGRPoint* p = (OGRPoint *) geometry;
                 if (p->IsEmpty()) {
                     pc->shape_type = Shapefile::NULL_SHAPE;
                 } else {
                     pc->x = p->getX();
                     pc->y = p->getY();
-                    
-                    if (noExtent)
-                        GetExtent(p_main, pc, row_idx);
                 }
             } else {
-                has_null_geometry = true;
                 pc->shape_type = Shapefile::NULL_SHAPE;
             }
-			p_main.records[feature_counter++].contents_p = pc;
+			p_main->records[row_idx].contents_p = pc;
 			
 		} else if (eType == wkbMultiPoint) {
 			Shapefile::PointContents* pc = new Shapefile::PointContents();
 			pc->shape_type = Shapefile::POINT_TYP;
 			if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POINT_TYP;
                 OGRMultiPoint* mp = (OGRMultiPoint*) geometry;
 				int n_geom = mp->getNumGeometries();
 				for (size_t i = 0; i < n_geom; i++ )
@@ -1479,20 +1557,16 @@ bool OGRLayerProxy::ReadGeometries(Shapefile::Main& p_main)
                     OGRPoint* p = static_cast<OGRPoint*>(ogrGeom);
 					pc->x = p->getX();
 					pc->y = p->getY();
-					if (noExtent) GetExtent(p_main, pc, row_idx);
 				}
             } else {
-                has_null_geometry = true;
                 pc->shape_type = Shapefile::NULL_SHAPE;
             }
-			p_main.records[feature_counter++].contents_p = pc;
+			p_main->records[row_idx].contents_p = pc;
 			
 		} else if (eType == wkbPolygon || eType == wkbCurvePolygon ) {
 			Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
 			pc->shape_type = Shapefile::POLYGON;
             if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POLYGON;
                 OGRPolygon* p = (OGRPolygon *) geometry;
                 CopyEnvelope(p, pc);
                 OGRLinearRing* pLinearRing = NULL;
@@ -1523,19 +1597,15 @@ bool OGRLayerProxy::ReadGeometries(Shapefile::Main& p_main)
                             pc->points[i++].y =  pLinearRing->getY(k);
                         }
                 }
-                if (noExtent) GetExtent(p_main, pc, row_idx);
             } else {
-                has_null_geometry = true;
                 pc->shape_type = Shapefile::NULL_SHAPE;
             }
-			p_main.records[feature_counter++].contents_p = pc;
+			p_main->records[row_idx].contents_p = pc;
             
 		} else if (eType == wkbMultiPolygon) {
 			Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
 			pc->shape_type = Shapefile::POLYGON;
             if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POLYGON;
                 OGRMultiPolygon* mpolygon = (OGRMultiPolygon *) geometry;
                 int n_geom = mpolygon->getNumGeometries();
                 // if there is more than one polygon, then we need to count
@@ -1577,19 +1647,11 @@ bool OGRLayerProxy::ReadGeometries(Shapefile::Main& p_main)
                             pc->points[pidx++].y = pLinearRing->getY(k);
                         }
                     }
-                    if (noExtent) GetExtent(p_main, pc, row_idx);
                 }
             }  else {
-                has_null_geometry = true;
                 pc->shape_type = Shapefile::NULL_SHAPE;
             }
-			p_main.records[feature_counter++].contents_p = pc;
-            
-        } else {
-            string open_err_msg = "GeoDa does not support datasource with line data at this time.  Please choose a datasource with either point or polygon data.";
-            throw GdaException(open_err_msg.c_str());
-        }
+			p_main->records[row_idx].contents_p = pc;
+		}
 	}
-    
-	return has_null_geometry;
 }
@@ -256,6 +256,15 @@ protected:
     void GetExtent(Shapefile::Main& p_main, Shapefile::PolygonContents* pc, int row_idx);
     
     void CopyEnvelope(OGRPolygon* p, Shapefile::PolygonContents* pc);
+    
+    /**
+     * Convert the geometries of rows start..end (inclusive) to Shapefile
+     * records.
+     * Called from ReadGeometries(), possibly from several threads.
+     */
+    void ReadGeometryRange(Shapefile::Main* p_main,
+                           const vector<OGRwkbGeometryType>* types,
+                           int start, int end);
 	
     /**
 	 * Read field information and save to OGRFieldProxy array.
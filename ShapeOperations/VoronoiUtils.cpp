@@ -22,8 +22,12 @@
 //   Voronoi Library.  Many thanks to Andrii Sydorchuk for contributing
 //   this high-quality Voronoi Diagram library to Boost.
 #include <algorithm>
-#include <map>
+#include <cmath>
 #include <utility>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/point_xy.hpp>
 #include <boost/geometry/geometries/polygon.hpp>
@@ -35,7 +39,9 @@
 #include "GalWeight.h"
 #include "../GenUtils.h"
 #include "../GenGeomAlgs.h"
+#include "../GdaConst.h"
 #include "../GdaShape.h"
+#include "../Algorithms/threadpool.h"
 #include "../logger.h"
 #include "VoronoiUtils.h"
 
@@ -96,88 +102,896 @@ namespace Gda {
 		typedef voronoi_builder<int> VB;
 		typedef voronoi_diagram<double> VD;
 		
-		std::list<int>* getCellList(
-							const VD::cell_type& cell,
-							std::map<std::pair<int,int>,
-							std::list<int>* >& pt_to_id_list,
-							std::vector<std::pair<int,int> >& int_pts);
 		bool isVertexOutsideBB(const VD::vertex_type& vertex,
 							   const double& xmin, const double& ymin,
 							   const double& xmax, const double& ymax);
 		bool clipEdge(const VD::edge_type& edge,
-					  std::vector<std::pair<int,int> >& int_pts,
+					  const std::vector<std::pair<int,int> >& int_pts,
 					  const double& xmin, const double& ymin,
 					  const double& xmax, const double& ymax,
 					  double& x0, double& y0, double& x1, double& y1);
 		bool clipInfiniteEdge(const VD::edge_type& edge,
-							  std::vector<std::pair<int,int> >& int_pts,
+							  const std::vector<std::pair<int,int> >& int_pts,
 							  const double& xmin, const double& ymin,
 							  const double& xmax, const double& ymax,
 							  double& x0, double& y0, double& x1, double& y1);
 		bool clipFiniteEdge(const VD::edge_type& edge,
-							std::vector<std::pair<int,int> >& int_pts,
+							const std::vector<std::pair<int,int> >& int_pts,
 							const double& xmin, const double& ymin,
 							const double& xmax, const double& ymax,
 							double& x0, double& y0, double& x1, double& y1);
 	}
 }
 
-/** Input: double precision x/y coordinates, indexed by observation record id
- Output: list of list of duplicates
- */
-void Gda::VoronoiUtils::FindPointDuplicates(const std::vector<double>& x,
-											  const std::vector<double>& y,
-										std::list<std::list<int> >& duplicates)
+using Gda::VoronoiUtils::VB;
+using Gda::VoronoiUtils::VD;
+typedef std::pair<int,int> int_pair;
+
+// distinct points per tile of the partitioned Voronoi diagram
+static const int voronoi_tile_points = 100000;
+// grid cells searched for points in an empty circle of a Voronoi vertex
+static const int voronoi_max_circle_cells = 4096;
+// corners of the convex hull added to the diagram of every tile
+static const size_t voronoi_max_hull_sites = 1024;
+
+/** Translate the points to the origin and scale them up to integers with
+ the larger extent at 2^30 for the Voronoi builder.  Returns the scale. */
+static double voronoi_int_coords(const std::vector<double>& x,
+								 const std::vector<double>& y,
+								 std::vector<int_pair>& int_pts,
+								 double& x_orig_min, double& x_orig_max,
+								 double& y_orig_min, double& y_orig_max)
 {
-	typedef std::pair<int,int> int_pair;
 	int num_obs = x.size();
-	double x_orig_min=0, x_orig_max=0;
-	double y_orig_min=0, y_orig_max=0;
 	SampleStatistics::CalcMinMax(x, x_orig_min, x_orig_max);
 	SampleStatistics::CalcMinMax(y, y_orig_min, y_orig_max);
 	double orig_scale = std::max(x_orig_max-x_orig_min,
-											  y_orig_max-y_orig_min);
+								 y_orig_max-y_orig_min);
 	if (orig_scale == 0) orig_scale = 1;
 	double big_dbl = 1073741824; // 2^30
-	double p = (big_dbl/orig_scale);
-
-	std::map<int, std::list<int> > dups;
-	std::map<int, std::list<int> >::iterator dups_iter;
-	std::map<int_pair, int> pt_map;
-	std::map<int_pair, int>::iterator map_iter;
-	std::vector<int> x_int(num_obs);
-	std::vector<int> y_int(num_obs);
-	bool duplicates_exist = false;
+	double p = big_dbl / orig_scale;
+	int_pts.resize(num_obs);
 	for (int i=0; i<num_obs; i++) {
-		x_int[i] = (int) ((x[i]-x_orig_min)*p);
-		y_int[i] = (int) ((y[i]-y_orig_min)*p);
-		int_pair key(std::make_pair(x_int[i], y_int[i]));
-		map_iter = pt_map.find(key);
-		if (map_iter == pt_map.end()) {
-			pt_map[key] = i;
+		int_pts[i].first = (int) ((x[i]-x_orig_min)*p);
+		int_pts[i].second = (int) ((y[i]-y_orig_min)*p);
+	}
+	return p;
+}
+
+/** Distinct points (sites) of int_pts, numbered in the order of their first
+ observation.  obs_site[i] is the site of observation i, and the
+ observations at site s are site_obs[site_obs_start[s]] (the first) to
+ site_obs[site_obs_start[s+1]-1] in increasing order. */
+static void voronoi_sites(const std::vector<int_pair>& int_pts,
+						  std::vector<int>& obs_site,
+						  std::vector<int_pair>& site_pts,
+						  std::vector<int>& site_obs_start,
+						  std::vector<int>& site_obs)
+{
+	int num_obs = int_pts.size();
+	boost::unordered_map<int_pair, int> pt_site;
+	pt_site.rehash(num_obs);
+	obs_site.resize(num_obs);
+	site_pts.clear();
+	for (int i=0; i<num_obs; i++) {
+		std::pair<boost::unordered_map<int_pair, int>::iterator, bool> r =
+			pt_site.insert(std::make_pair(int_pts[i], (int) site_pts.size()));
+		if (r.second) site_pts.push_back(int_pts[i]);
+		obs_site[i] = r.first->second;
+	}
+	int n_sites = site_pts.size();
+	site_obs_start.assign(n_sites+1, 0);
+	for (int i=0; i<num_obs; i++) site_obs_start[obs_site[i]+1]++;
+	for (int s=0; s<n_sites; s++) site_obs_start[s+1] += site_obs_start[s];
+	site_obs.resize(num_obs);
+	std::vector<int> pos(site_obs_start.begin(), site_obs_start.end()-1);
+	for (int i=0; i<num_obs; i++) site_obs[pos[obs_site[i]]++] = i;
+}
+
+static inline long long voronoi_cross(const int_pair& o, const int_pair& a,
+									  const int_pair& b)
+{
+	return ((long long) (a.first - o.first)) * (b.second - o.second) -
+		((long long) (a.second - o.second)) * (b.first - o.first);
+}
+
+/** Orders site ids by x, then y */
+struct voronoi_xy_less {
+	const std::vector<int_pair>* pts;
+	voronoi_xy_less(const std::vector<int_pair>* p) : pts(p) {}
+	bool operator()(int i, int j) const { return (*pts)[i] < (*pts)[j]; }
+};
+
+/** Orders site ids by y, then x */
+struct voronoi_yx_less {
+	const std::vector<int_pair>* pts;
+	voronoi_yx_less(const std::vector<int_pair>* p) : pts(p) {}
+	bool operator()(int i, int j) const {
+		const int_pair& a = (*pts)[i];
+		const int_pair& b = (*pts)[j];
+		return a.second < b.second ||
+			(a.second == b.second && a.first < b.first);
+	}
+};
+
+/**
+ Voronoi diagram of the distinct points (sites), built per tile.
+
+ The sites are cut into tiles of about voronoi_tile_points sites by x and
+ then y quantiles.  A tile builds the diagram of all sites in the bounding
+ box of its own sites, grown by a margin, and the corners of the convex
+ hull of all sites.  It keeps the cells of its own sites that are certain
+ to equal their cells in the diagram of all sites: no site outside the box
+ is in or on the circle of a Voronoi vertex of the cell, and every
+ infinite edge lies on a supporting line of the hull.  The cell of a site
+ only depends on the sites in the circles of the vertices of any larger
+ cell, so every other site with its infinite edges on the hull is done
+ again in the box of these circles, grown by the margin.  Sites of a tile
+ whose boxes mostly overlap share one diagram over both boxes.  The
+ rest of the tile is done again with twice the margin, until the boxes
+ cover all sites.
+ Tiles run in parallel and hand every kept cell to a CellFunc, which only
+ writes the output of its own site.
+ */
+class VoronoiTiles
+{
+public:
+	/** (tile, cell, coordinates and site ids of the cells of the tile) */
+	typedef boost::function<void (int, const VD::cell_type&,
+								  const std::vector<int_pair>&,
+								  const std::vector<int>&)> CellFunc;
+	
+	VoronoiTiles(const std::vector<int_pair>& sites);
+	int GetNumTiles() const { return tiles.size(); }
+	void Run(CellFunc cell_func);
+	
+protected:
+	/** Box of site coordinates, empty if x0 > x1 */
+	struct Box {
+		long long x0, y0, x1, y1;
+		Box() : x0(1), y0(1), x1(0), y1(0) {}
+		Box(long long x0_, long long y0_, long long x1_, long long y1_)
+		: x0(x0_), y0(y0_), x1(x1_), y1(y1_) {}
+		bool IsEmpty() const { return x0 > x1; }
+		void Add(const Box& b);
+		void Grow(long long m) { x0 -= m; y0 -= m; x1 += m; y1 += m; }
+		double Area() const {
+			return IsEmpty() ? 0 : ((double) x1-x0+1) * ((double) y1-y0+1);
+		}
+	};
+	
+	struct Tile {
+		std::vector<int> pending; // own sites not done yet
+		std::vector<Box> pending_box; // box of a site to do by itself
+		double margin;
+	};
+	
+	void SortStrips(std::vector<int>* order, int start, int end);
+	void RunTiles(CellFunc cell_func, int start, int end);
+	void RunTile(CellFunc cell_func, int t);
+	void RunBox(CellFunc cell_func, int t, const Box& box,
+				const std::vector<int>& own, bool own_boxes,
+				std::vector<int>& pending, std::vector<Box>& pending_box);
+	bool IsCellGlobal(const VD::cell_type& cell,
+					  const std::vector<int_pair>& local_pts,
+					  const Box& box, Box& flower) const;
+	bool IsCircleEmpty(double cx, double cy, double r,
+					   long long x0, long long y0,
+					   long long x1, long long y1) const;
+	bool IsHullEdge(const int_pair& s, const int_pair& t) const;
+	void QueryRect(long long x0, long long y0, long long x1, long long y1,
+				   std::vector<int>& ids) const;
+	
+	const std::vector<int_pair>& sites;
+	int x_max;
+	int y_max;
+	// vertices of the convex hull of all sites, without collinear ones
+	std::vector<int_pair> hull;
+	std::vector<int> hull_ids;
+	std::vector<char> site_in_hull;
+	std::vector<Tile> tiles;
+	std::vector<int> site_tile;
+	// 0 done, 1 pending, 2 pending in the diagram being done
+	std::vector<char> site_pending;
+	int strip_size;
+	
+	// uniform grid of the sites (CSR) for the boxes of the tiles
+	int grid_n;
+	double grid_cell_w;
+	double grid_cell_h;
+	std::vector<int> grid_start;
+	std::vector<int> grid_ids;
+};
+
+VoronoiTiles::VoronoiTiles(const std::vector<int_pair>& sites_)
+: sites(sites_), x_max(0), y_max(0), strip_size(0), grid_n(1),
+grid_cell_w(1), grid_cell_h(1)
+{
+	int n = sites.size();
+	for (int i=0; i<n; i++) {
+		if (sites[i].first > x_max) x_max = sites[i].first;
+		if (sites[i].second > y_max) y_max = sites[i].second;
+	}
+	site_tile.assign(n, 0);
+	site_pending.assign(n, 1);
+	
+	int g = 1;
+	if (n >= 2*voronoi_tile_points) {
+		g = (int) ceil(sqrt(((double) n) / voronoi_tile_points));
+	}
+	std::vector<int> order;
+	if (g > 1) {
+		order.resize(n);
+		for (int i=0; i<n; i++) order[i] = i;
+		std::sort(order.begin(), order.end(), voronoi_xy_less(&sites));
+		// monotone chain, leaving out collinear points
+		std::vector<int> h(2*n);
+		int k = 0;
+		for (int i=0; i<n; i++) {
+			while (k >= 2 && voronoi_cross(sites[h[k-2]], sites[h[k-1]],
+										   sites[order[i]]) <= 0) k--;
+			h[k++] = order[i];
+		}
+		for (int i=n-2, lower=k+1; i>=0; i--) {
+			while (k >= lower && voronoi_cross(sites[h[k-2]], sites[h[k-1]],
+											   sites[order[i]]) <= 0) k--;
+			h[k++] = order[i];
+		}
+		for (int i=0; i<k-1; i++) {
+			hull.push_back(sites[h[i]]);
+			hull_ids.push_back(h[i]);
+		}
+		// too many to add to every tile
+		if (hull_ids.size() > voronoi_max_hull_sites) hull_ids.clear();
+		site_in_hull.assign(n, 0);
+		for (size_t i=0; i<hull_ids.size(); i++) site_in_hull[hull_ids[i]] = 1;
+		// all sites on a line: no tiles
+		if (hull.size() < 3) g = 1;
+	}
+	
+	if (g == 1) {
+		tiles.resize(1);
+		tiles[0].pending.resize(n);
+		tiles[0].pending_box.resize(n);
+		for (int i=0; i<n; i++) tiles[0].pending[i] = i;
+		// the box of the only tile covers all sites
+		tiles[0].margin = ((double) std::max(x_max, y_max)) + 1;
+		return;
+	}
+	
+	// strips of equal size by x, cut into tiles of equal size by y
+	strip_size = (n + g - 1) / g;
+	run_range_threads(g, 1, boost::bind(&VoronoiTiles::SortStrips, this,
+										  &order, _1, _2));
+	tiles.resize(g*g);
+	for (int a=0; a<g; a++) {
+		int s_begin = std::min(a*strip_size, n);
+		int s_end = std::min(s_begin + strip_size, n);
+		int s_n = s_end - s_begin;
+		for (int b=0; b<g; b++) {
+			Tile& tile = tiles[a*g + b];
+			int t_begin = s_begin + (s_n*b)/g;
+			int t_end = s_begin + (s_n*(b+1))/g;
+			tile.pending.assign(order.begin()+t_begin, order.begin()+t_end);
+			tile.pending_box.resize(tile.pending.size());
+			for (int j=t_begin; j<t_end; j++) site_tile[order[j]] = a*g + b;
+			// a few times the mean distance of the sites in the tile
+			double area = 1;
+			if (t_end > t_begin) {
+				int x0 = x_max, y0 = y_max, x1 = 0, y1 = 0;
+				for (int j=t_begin; j<t_end; j++) {
+					const int_pair& pt = sites[order[j]];
+					x0 = std::min(x0, pt.first);
+					x1 = std::max(x1, pt.first);
+					y0 = std::min(y0, pt.second);
+					y1 = std::max(y1, pt.second);
+				}
+				area = std::max(((double) x1-x0) * ((double) y1-y0), 1.0);
+			}
+			tile.margin = 4*sqrt(area / std::max(t_end-t_begin, 1)) + 2;
+		}
+	}
+	
+	// about 8 sites per grid cell
+	grid_n = std::max(1, std::min(4096, (int) sqrt(n / 8.0)));
+	grid_cell_w = (((double) x_max) + 1) / grid_n;
+	grid_cell_h = (((double) y_max) + 1) / grid_n;
+	std::vector<int> site_cell(n);
+	grid_start.assign(grid_n*grid_n + 1, 0);
+	for (int i=0; i<n; i++) {
+		int cx = std::min(grid_n-1, (int) (sites[i].first / grid_cell_w));
+		int cy = std::min(grid_n-1, (int) (sites[i].second / grid_cell_h));
+		site_cell[i] = cy*grid_n + cx;
+		grid_start[site_cell[i]+1]++;
+	}
+	for (int c=0; c<grid_n*grid_n; c++) grid_start[c+1] += grid_start[c];
+	grid_ids.resize(n);
+	std::vector<int> pos(grid_start.begin(), grid_start.end()-1);
+	for (int i=0; i<n; i++) grid_ids[pos[site_cell[i]]++] = i;
+}
+
+void VoronoiTiles::SortStrips(std::vector<int>* order, int start, int end)
+{
+	int n = order->size();
+	for (int a=start; a<=end; a++) {
+		int s_begin = std::min(a*strip_size, n);
+		int s_end = std::min(s_begin + strip_size, n);
+		std::sort(order->begin()+s_begin, order->begin()+s_end,
+				  voronoi_yx_less(&sites));
+	}
+}
+
+void VoronoiTiles::QueryRect(long long x0, long long y0,
+							 long long x1, long long y1,
+							 std::vector<int>& ids) const
+{
+	ids.clear();
+	if (grid_start.empty()) {
+		// one tile: every site
+		ids.resize(sites.size());
+		for (size_t i=0; i<sites.size(); i++) ids[i] = i;
+		return;
+	}
+	if (x1 < 0 || y1 < 0 || x0 > x_max || y0 > y_max) return;
+	int cx0 = std::min(grid_n-1, (int) (std::max(x0, 0LL) / grid_cell_w));
+	int cx1 = std::min(grid_n-1, (int) (std::min(x1, (long long) x_max) /
+										grid_cell_w));
+	int cy0 = std::min(grid_n-1, (int) (std::max(y0, 0LL) / grid_cell_h));
+	int cy1 = std::min(grid_n-1, (int) (std::min(y1, (long long) y_max) /
+										grid_cell_h));
+	for (int cy=cy0; cy<=cy1; cy++) {
+		for (int j=grid_start[cy*grid_n + cx0],
+			 j_end=grid_start[cy*grid_n + cx1 + 1]; j<j_end; j++) {
+			const int_pair& pt = sites[grid_ids[j]];
+			if (pt.first >= x0 && pt.first <= x1 &&
+				pt.second >= y0 && pt.second <= y1) ids.push_back(grid_ids[j]);
+		}
+	}
+}
+
+/** True if all sites are on one side of the line through s and t */
+bool VoronoiTiles::IsHullEdge(const int_pair& s, const int_pair& t) const
+{
+	bool left = false;
+	bool right = false;
+	for (size_t k=0; k<hull.size(); k++) {
+		long long c = voronoi_cross(s, t, hull[k]);
+		if (c > 0) left = true;
+		if (c < 0) right = true;
+		if (left && right) return false;
+	}
+	return true;
+}
+
+/** True if no site outside the diagram of the tile is inside or on the
+ circle.  The sites in the box x0..y1 of the tile and the corners of the
+ hull are in the diagram, so only the part of the circle outside the box
+ is searched.  Gives up on circles over too many cells of the grid. */
+bool VoronoiTiles::IsCircleEmpty(double cx, double cy, double r,
+								 long long x0, long long y0,
+								 long long x1, long long y1) const
+{
+	double qx0 = std::max(cx - r, 0.0);
+	double qy0 = std::max(cy - r, 0.0);
+	double qx1 = std::min(cx + r, (double) x_max);
+	double qy1 = std::min(cy + r, (double) y_max);
+	if (qx0 > qx1 || qy0 > qy1) return true;
+	if (qx0 >= x0 && qx1 <= x1 && qy0 >= y0 && qy1 <= y1) return true;
+	if (grid_start.empty()) return false;
+	int cx0 = std::min(grid_n-1, (int) (qx0 / grid_cell_w));
+	int cx1 = std::min(grid_n-1, (int) (qx1 / grid_cell_w));
+	int cy0 = std::min(grid_n-1, (int) (qy0 / grid_cell_h));
+	int cy1 = std::min(grid_n-1, (int) (qy1 / grid_cell_h));
+	if (((long long) (cx1-cx0+1)) * (cy1-cy0+1) > voronoi_max_circle_cells) {
+		return false;
+	}
+	for (int gy=cy0; gy<=cy1; gy++) {
+		for (int gx=cx0; gx<=cx1; gx++) {
+			double gx0 = gx*grid_cell_w, gx1 = (gx+1)*grid_cell_w;
+			double gy0 = gy*grid_cell_h, gy1 = (gy+1)*grid_cell_h;
+			// grid cells in the box or away from the circle
+			if (gx0 >= x0 && gx1 <= x1 && gy0 >= y0 && gy1 <= y1) continue;
+			double dx = std::max(std::max(gx0 - cx, cx - gx1), 0.0);
+			double dy = std::max(std::max(gy0 - cy, cy - gy1), 0.0);
+			if (dx*dx + dy*dy > r*r) continue;
+			for (int j=grid_start[gy*grid_n + gx],
+				 j_end=grid_start[gy*grid_n + gx + 1]; j<j_end; j++) {
+				const int_pair& pt = sites[grid_ids[j]];
+				if (pt.first >= x0 && pt.first <= x1 &&
+					pt.second >= y0 && pt.second <= y1) continue;
+				if (site_in_hull[grid_ids[j]]) continue;
+				double px = pt.first - cx;
+				double py = pt.second - cy;
+				if (px*px + py*py <= r*r) return false;
+			}
+		}
+	}
+	return true;
+}
+
+void VoronoiTiles::Box::Add(const Box& b)
+{
+	if (b.IsEmpty()) return;
+	if (IsEmpty()) {
+		*this = b;
+		return;
+	}
+	x0 = std::min(x0, b.x0);
+	y0 = std::min(y0, b.y0);
+	x1 = std::max(x1, b.x1);
+	y1 = std::max(y1, b.y1);
+}
+
+/** box is the box of the diagram.  flower is set to the box of the
+ circles of the vertices of the cell over the sites, or left empty if an
+ infinite edge is not on the hull.  No site is beyond a supporting line,
+ so the circles of the points on the infinite edges add no sites. */
+bool VoronoiTiles::IsCellGlobal(const VD::cell_type& cell,
+								const std::vector<int_pair>& local_pts,
+								const Box& box, Box& flower) const
+{
+	flower = Box();
+	const VD::edge_type* edge = cell.incident_edge();
+	if (!edge) return false;
+	const int_pair& s = local_pts[cell.source_index()];
+	Box f(s.first, s.second, s.first, s.second);
+	bool global = true;
+	do {
+		if (!edge->vertex0() && !edge->vertex1()) return false;
+		if (edge->is_infinite()) {
+			const int_pair& t = local_pts[edge->twin()->cell()->source_index()];
+			if (!IsHullEdge(s, t)) return false;
+		}
+		const VD::vertex_type* v = edge->vertex0();
+		if (v) {
+			double dx = v->x() - s.first;
+			double dy = v->y() - s.second;
+			// slightly larger than the circle, for rounding of the vertex
+			double r = sqrt(dx*dx + dy*dy) * (1 + 1e-9) + 1;
+			f.Add(Box((long long) std::max(floor(v->x() - r), 0.0),
+					  (long long) std::max(floor(v->y() - r), 0.0),
+					  (long long) std::min(ceil(v->x() + r), (double) x_max),
+					  (long long) std::min(ceil(v->y() + r), (double) y_max)));
+			if (global && !IsCircleEmpty(v->x(), v->y(), r, box.x0, box.y0,
+										 box.x1, box.y1)) {
+				global = false;
+			}
+		}
+		edge = edge->next();
+	} while (edge != cell.incident_edge());
+	flower = f;
+	return global;
+}
+
+/** Diagram of the sites in box and the corners of the hull, keeping the
+ cells of the sites in own.  The other sites of own go to pending, with
+ the box to do them again or an empty box.  If own_boxes, box is a box
+ of the sites of own alone, and their next boxes contain it. */
+void VoronoiTiles::RunBox(CellFunc cell_func, int t, const Box& box,
+						  const std::vector<int>& own, bool own_boxes,
+						  std::vector<int>& pending,
+						  std::vector<Box>& pending_box)
+{
+	long long m = (long long) tiles[t].margin;
+	bool covers_all = (box.x0 <= 0 && box.y0 <= 0 &&
+					   box.x1 >= x_max && box.y1 >= y_max);
+	
+	std::vector<int> local_ids;
+	QueryRect(box.x0, box.y0, box.x1, box.y1, local_ids);
+	// with the corners of the hull, the sites near the hull have their
+	// infinite edges and far vertices without a box over all sites
+	for (size_t j=0; j<hull_ids.size(); j++) {
+		const int_pair& pt = sites[hull_ids[j]];
+		if (pt.first < box.x0 || pt.first > box.x1 ||
+			pt.second < box.y0 || pt.second > box.y1) {
+			local_ids.push_back(hull_ids[j]);
+		}
+	}
+	std::vector<int_pair> local_pts(local_ids.size());
+	VB vb;
+	for (size_t j=0; j<local_ids.size(); j++) {
+		local_pts[j] = sites[local_ids[j]];
+		vb.insert_point(local_pts[j].first, local_pts[j].second);
+	}
+	VD vd;
+	vb.construct(&vd);
+	
+	for (size_t j=0; j<own.size(); j++) site_pending[own[j]] = 2;
+	for (VD::const_cell_iterator it = vd.cells().begin();
+		 it != vd.cells().end(); ++it) {
+		const VD::cell_type& cell = *it;
+		int s = local_ids[cell.source_index()];
+		if (site_tile[s] != t || site_pending[s] != 2) continue;
+		Box flower;
+		if (covers_all || IsCellGlobal(cell, local_pts, box, flower)) {
+			cell_func(t, cell, local_pts, local_ids);
+			site_pending[s] = 0;
 		} else {
-			duplicates_exist = true;
-			int ind1 = map_iter->second;
-			int ind2 = i;
-			dups_iter = dups.find(ind1);
-			if (dups_iter == dups.end()) {
-				std::list<int> l;
-				l.push_back(ind1);
-				l.push_back(ind2);
-				dups[ind1] = l;
-			} else {
-				dups_iter->second.push_back(ind2);
+			// a box that grows every time, until it covers all sites
+			if (!flower.IsEmpty()) {
+				if (own_boxes) flower.Add(box);
+				flower.Grow(m);
 			}
+			site_pending[s] = 1;
+			pending.push_back(s);
+			pending_box.push_back(flower);
 		}
 	}
-	duplicates.clear();
-	if (duplicates_exist) {
-		for (dups_iter = dups.begin(); dups_iter != dups.end(); dups_iter++) {
-			duplicates.push_back(dups_iter->second);
+	for (size_t j=0; j<own.size(); j++) {
+		if (site_pending[own[j]] == 2) {
+			site_pending[own[j]] = 1;
+			pending.push_back(own[j]);
+			pending_box.push_back(Box());
 		}
 	}
 }
 
+void VoronoiTiles::RunTile(CellFunc cell_func, int t)
+{
+	Tile& tile = tiles[t];
+	if (tile.pending.empty()) return;
+	std::vector<int> pending;
+	std::vector<Box> pending_box;
+	std::vector<int> own;
+	Box box;
+	// boxes of single sites, merged while the merged box is not larger than
+	// the two boxes together, so that sites with about the same large box
+	// are done in one diagram
+	std::vector<Box> groups;
+	std::vector<std::vector<int> > group_sites;
+	for (size_t j=0; j<tile.pending.size(); j++) {
+		int s = tile.pending[j];
+		if (tile.pending_box[j].IsEmpty()) {
+			own.push_back(s);
+			box.Add(Box(sites[s].first, sites[s].second,
+						sites[s].first, sites[s].second));
+			continue;
+		}
+		Box b = tile.pending_box[j];
+		std::vector<int> b_sites(1, s);
+		size_t g = 0;
+		while (g < groups.size()) {
+			Box u = b;
+			u.Add(groups[g]);
+			if (u.Area() > b.Area() + groups[g].Area()) {
+				g++;
+				continue;
+			}
+			b = u;
+			b_sites.insert(b_sites.end(), group_sites[g].begin(),
+						   group_sites[g].end());
+			groups[g] = groups.back();
+			groups.pop_back();
+			group_sites[g].swap(group_sites.back());
+			group_sites.pop_back();
+			// b has grown: look at the other groups again
+			g = 0;
+		}
+		groups.push_back(b);
+		group_sites.push_back(std::vector<int>());
+		group_sites.back().swap(b_sites);
+	}
+	for (size_t g=0; g<groups.size(); g++) {
+		RunBox(cell_func, t, groups[g], group_sites[g], true,
+			   pending, pending_box);
+	}
+	if (!own.empty()) {
+		box.Grow((long long) tile.margin);
+		RunBox(cell_func, t, box, own, false, pending, pending_box);
+	}
+	tile.pending.swap(pending);
+	tile.pending_box.swap(pending_box);
+	tile.margin *= 2;
+}
+
+void VoronoiTiles::RunTiles(CellFunc cell_func, int start, int end)
+{
+	for (int t=start; t<=end; t++) RunTile(cell_func, t);
+}
+
+void VoronoiTiles::Run(CellFunc cell_func)
+{
+	for (;;) {
+		bool done = true;
+		for (size_t t=0; t<tiles.size(); t++) {
+			if (!tiles[t].pending.empty()) done = false;
+		}
+		if (done) break;
+		run_range_threads(tiles.size(), 1,
+						  boost::bind(&VoronoiTiles::RunTiles, this,
+									  cell_func, _1, _2));
+	}
+}
+
+/**
+ Thiessen neighbors of the sites, collected per tile and then turned into
+ neighbors of the observations in compressed sparse row form.
+ */
+class VoronoiContiguity
+{
+public:
+	VoronoiContiguity(int n_tiles, bool queen,
+					  double bb_xmin, double bb_ymin,
+					  double bb_xmax, double bb_ymax);
+	
+	void AddCell(int t, const VD::cell_type& cell,
+				 const std::vector<int_pair>& local_pts,
+				 const std::vector<int>& local_ids);
+	void MakeSiteNbrs(int n_sites);
+	void MakeObsNbrs(const std::vector<int>& obs_site,
+					 const std::vector<int>& site_obs_start,
+					 const std::vector<int>& site_obs,
+					 std::vector<int>& nbr_start, std::vector<int>& nbr_ids);
+	
+protected:
+	void FillObsNbrs(int start, int end);
+	
+	bool queen;
+	double bb_xmin, bb_ymin, bb_xmax, bb_ymax;
+	// sites done by every tile, their numbers of neighbors and the neighbors
+	std::vector<std::vector<int> > tile_sites;
+	std::vector<std::vector<int> > tile_nbr_cnt;
+	std::vector<std::vector<int> > tile_nbrs;
+	std::vector<int> site_nbr_start;
+	std::vector<int> site_nbrs;
+	
+	const std::vector<int>* obs_site;
+	const std::vector<int>* site_obs_start;
+	const std::vector<int>* site_obs;
+	std::vector<int>* nbr_start;
+	std::vector<int>* nbr_ids;
+};
+
+VoronoiContiguity::VoronoiContiguity(int n_tiles, bool queen_,
+									 double bb_xmin_, double bb_ymin_,
+									 double bb_xmax_, double bb_ymax_)
+: queen(queen_), bb_xmin(bb_xmin_), bb_ymin(bb_ymin_), bb_xmax(bb_xmax_),
+bb_ymax(bb_ymax_), tile_sites(n_tiles), tile_nbr_cnt(n_tiles),
+tile_nbrs(n_tiles)
+{
+}
+
+/** Rook neighbors share an edge that meets the bounding box, queen
+ neighbors also share a vertex inside the bounding box. */
+void VoronoiContiguity::AddCell(int t, const VD::cell_type& cell,
+								const std::vector<int_pair>& local_pts,
+								const std::vector<int>& local_ids)
+{
+	using namespace Gda::VoronoiUtils;
+	int s = local_ids[cell.source_index()];
+	std::vector<int>& nbrs = tile_nbrs[t];
+	size_t start = nbrs.size();
+	const VD::edge_type* edge = cell.incident_edge();
+	std::vector<const VD::vertex_type*> verts;
+	if (edge) do {
+		double x0, y0, x1, y1;
+		if (clipEdge(*edge, local_pts, bb_xmin, bb_ymin, bb_xmax, bb_ymax,
+					 x0, y0, x1, y1)) {
+			nbrs.push_back(local_ids[edge->twin()->cell()->source_index()]);
+		}
+		if (queen) { // add all cells that share each edge vertex
+			if (edge->vertex0() &&
+				!isVertexOutsideBB(*edge->vertex0(), bb_xmin, bb_ymin,
+								   bb_xmax, bb_ymax)) {
+				verts.push_back(edge->vertex0());
+			}
+			if (edge->vertex1() &&
+				!isVertexOutsideBB(*edge->vertex1(), bb_xmin, bb_ymin,
+								   bb_xmax, bb_ymax)) {
+				verts.push_back(edge->vertex1());
+			}
+		}
+		edge = edge->next();
+	} while (edge != cell.incident_edge());
+	
+	for (size_t i=0; i<verts.size(); i++) {
+		const VD::edge_type* v_edge = verts[i]->incident_edge();
+		do {
+			nbrs.push_back(local_ids[v_edge->cell()->source_index()]);
+			v_edge = v_edge->rot_next();
+		} while (v_edge != verts[i]->incident_edge());
+	}
+	
+	std::sort(nbrs.begin()+start, nbrs.end());
+	nbrs.erase(std::unique(nbrs.begin()+start, nbrs.end()), nbrs.end());
+	nbrs.erase(std::remove(nbrs.begin()+start, nbrs.end(), s), nbrs.end());
+	tile_sites[t].push_back(s);
+	tile_nbr_cnt[t].push_back(nbrs.size() - start);
+}
+
+void VoronoiContiguity::MakeSiteNbrs(int n_sites)
+{
+	site_nbr_start.assign(n_sites+1, 0);
+	for (size_t t=0; t<tile_sites.size(); t++) {
+		for (size_t j=0; j<tile_sites[t].size(); j++) {
+			site_nbr_start[tile_sites[t][j]+1] = tile_nbr_cnt[t][j];
+		}
+	}
+	for (int s=0; s<n_sites; s++) site_nbr_start[s+1] += site_nbr_start[s];
+	site_nbrs.resize(site_nbr_start[n_sites]);
+	for (size_t t=0; t<tile_sites.size(); t++) {
+		int k = 0;
+		for (size_t j=0; j<tile_sites[t].size(); j++) {
+			int* dst = &site_nbrs[0] + site_nbr_start[tile_sites[t][j]];
+			for (int c=0; c<tile_nbr_cnt[t][j]; c++) dst[c] = tile_nbrs[t][k++];
+		}
+		std::vector<int>().swap(tile_sites[t]);
+		std::vector<int>().swap(tile_nbr_cnt[t]);
+		std::vector<int>().swap(tile_nbrs[t]);
+	}
+}
+
+/** The neighbors of an observation are all observations at the sites of
+ the neighboring cells and the other observations at its own site. */
+void VoronoiContiguity::MakeObsNbrs(const std::vector<int>& obs_site_,
+									const std::vector<int>& site_obs_start_,
+									const std::vector<int>& site_obs_,
+									std::vector<int>& nbr_start_,
+									std::vector<int>& nbr_ids_)
+{
+	obs_site = &obs_site_;
+	site_obs_start = &site_obs_start_;
+	site_obs = &site_obs_;
+	nbr_start = &nbr_start_;
+	nbr_ids = &nbr_ids_;
+	int num_obs = obs_site_.size();
+	nbr_start_.assign(num_obs+1, 0);
+	for (int i=0; i<num_obs; i++) {
+		int s = obs_site_[i];
+		int cnt = site_obs_start_[s+1] - site_obs_start_[s] - 1;
+		for (int j=site_nbr_start[s]; j<site_nbr_start[s+1]; j++) {
+			int w = site_nbrs[j];
+			cnt += site_obs_start_[w+1] - site_obs_start_[w];
+		}
+		nbr_start_[i+1] = nbr_start_[i] + cnt;
+	}
+	nbr_ids_.resize(nbr_start_[num_obs]);
+	run_range_threads(num_obs, 1,
+					  boost::bind(&VoronoiContiguity::FillObsNbrs,
+								  this, _1, _2));
+}
+
+void VoronoiContiguity::FillObsNbrs(int start, int end)
+{
+	const std::vector<int>& so_start = *site_obs_start;
+	const std::vector<int>& so = *site_obs;
+	for (int i=start; i<=end; i++) {
+		int s = (*obs_site)[i];
+		int k = (*nbr_start)[i];
+		for (int j=site_nbr_start[s]; j<site_nbr_start[s+1]; j++) {
+			int w = site_nbrs[j];
+			for (int o=so_start[w]; o<so_start[w+1]; o++) {
+				(*nbr_ids)[k++] = so[o];
+			}
+		}
+		for (int o=so_start[s]; o<so_start[s+1]; o++) {
+			if (so[o] != i) (*nbr_ids)[k++] = so[o];
+		}
+		std::sort(nbr_ids->begin()+(*nbr_start)[i], nbr_ids->begin()+k);
+	}
+}
+
+/**
+ Clipped Thiessen polygons of the sites.  The coordinates are collected
+ by the tiles; the GdaPolygon objects are made afterwards on the calling
+ thread.
+ */
+class VoronoiPolygons
+{
+public:
+	VoronoiPolygons(int n_sites, double p,
+					double x_orig_min, double y_orig_min,
+					double bb_xmin, double bb_ymin,
+					double bb_xmax, double bb_ymax);
+	
+	void AddCell(int t, const VD::cell_type& cell,
+				 const std::vector<int_pair>& local_pts,
+				 const std::vector<int>& local_ids);
+	
+	std::vector<std::vector<wxRealPoint> > site_poly;
+	
+protected:
+	double p;
+	double x_orig_min, y_orig_min;
+	double bb_xmin, bb_ymin, bb_xmax, bb_ymax;
+};
+
+VoronoiPolygons::VoronoiPolygons(int n_sites, double p_,
+								 double x_orig_min_, double y_orig_min_,
+								 double bb_xmin_, double bb_ymin_,
+								 double bb_xmax_, double bb_ymax_)
+: site_poly(n_sites), p(p_), x_orig_min(x_orig_min_), y_orig_min(y_orig_min_),
+bb_xmin(bb_xmin_), bb_ymin(bb_ymin_), bb_xmax(bb_xmax_), bb_ymax(bb_ymax_)
+{
+}
+
+/** The polygon is the convex hull of the clipped edges of the cell and the
+ point of the cell. */
+void VoronoiPolygons::AddCell(int t, const VD::cell_type& cell,
+							  const std::vector<int_pair>& local_pts,
+							  const std::vector<int>& local_ids)
+{
+	using namespace Gda::VoronoiUtils;
+	using boost::geometry::model::d2::point_xy;
+	using boost::geometry::append;
+	using boost::geometry::make;
+	boost::geometry::model::multi_point<point_xy<double> > h_pts;
+	typedef boost::geometry::model::polygon<point_xy<double> > my_polygon;
+	typedef boost::geometry::ring_type<my_polygon>::type ring_type;
+	my_polygon hull;
+	
+	const VD::edge_type* edge = cell.incident_edge();
+	if (!edge) {
+		// the only point: its cell is the whole bounding box
+		append(h_pts, make<point_xy<double> >(bb_xmin, bb_ymin));
+		append(h_pts, make<point_xy<double> >(bb_xmax, bb_ymax));
+		append(h_pts, make<point_xy<double> >(bb_xmin, bb_ymax));
+		append(h_pts, make<point_xy<double> >(bb_xmax, bb_ymin));
+	} else do {
+		// The following ensures that the same edge is always clipped.
+		// This ensurues that adjacent polygons have the exact same
+		// shared-edge descriptions.
+		double edge_x0, edge_y0, edge_x1, edge_y1;
+		bool intersects_e = false;
+		if (edge < edge->twin()) {
+			intersects_e = clipEdge(*edge, local_pts,
+									bb_xmin, bb_ymin, bb_xmax, bb_ymax,
+									edge_x0, edge_y0, edge_x1, edge_y1);
+		} else {
+			intersects_e = clipEdge(*edge->twin(), local_pts,
+									bb_xmin, bb_ymin, bb_xmax, bb_ymax,
+									edge_x0, edge_y0, edge_x1, edge_y1);
+		}
+		if (intersects_e) {
+			append(h_pts, make<point_xy<double> >(edge_x0, edge_y0));
+			append(h_pts, make<point_xy<double> >(edge_x1, edge_y1));
+		}
+		edge = edge->next();
+	} while (edge != cell.incident_edge());
+	
+	// make sure that the cell's internal point is also within the
+	// convex hull.
+	const int_pair& pt = local_pts[cell.source_index()];
+	append(h_pts, make<point_xy<double> >(pt.first, pt.second));
+	
+	boost::geometry::convex_hull(h_pts, hull);
+	
+	ring_type& outer_ring = hull.outer();
+	std::vector<wxRealPoint>& poly = site_poly[local_ids[cell.source_index()]];
+	poly.reserve(outer_ring.size());
+	for (ring_type::iterator it=outer_ring.begin();
+		 it != outer_ring.end(); it++) {
+		double x = boost::geometry::get<0>(*it);
+		double y = boost::geometry::get<1>(*it);
+		poly.push_back(wxRealPoint((x / p) + x_orig_min, (y / p) + y_orig_min));
+	}
+}
+
+/** Input: double precision x/y coordinates, indexed by observation record id
+ Output: list of list of duplicates
+ */
+void Gda::VoronoiUtils::FindPointDuplicates(const std::vector<double>& x,
+											  const std::vector<double>& y,
+										std::list<std::list<int> >& duplicates)
+{
+	double x_orig_min=0, x_orig_max=0;
+	double y_orig_min=0, y_orig_max=0;
+	std::vector<int_pair> int_pts;
+	voronoi_int_coords(x, y, int_pts, x_orig_min, x_orig_max,
+					   y_orig_min, y_orig_max);
+	std::vector<int> obs_site, site_obs_start, site_obs;
+	std::vector<int_pair> site_pts;
+	voronoi_sites(int_pts, obs_site, site_pts, site_obs_start, site_obs);
+	
+	// sites are numbered by their first observation
+	duplicates.clear();
+	for (int s=0, n_sites=site_pts.size(); s<n_sites; s++) {
+		if (site_obs_start[s+1] - site_obs_start[s] < 2) continue;
+		duplicates.push_back(std::list<int>(site_obs.begin()+site_obs_start[s],
+										   site_obs.begin()+site_obs_start[s+1]));
+	}
+}
+
 /** If success, returns true. Else, if returns false, then duplicates or
    near duplicates were found and duplicate_ind1 and duplicate_ind2 will
    indicate which two points are near duplicates. */
@@ -190,72 +1004,21 @@ bool Gda::VoronoiUtils::MakePolygons(const std::vector<double>& x,
 									   double& voronoi_bb_ymax)
 {
 	LOG_MSG("Entering Gda::VoronoiUtils::MakePolygons");
-	using namespace boost::polygon;
-	typedef std::pair<int,int> int_pair;
 	
 	int num_obs = x.size();
 	polys.clear();
 	polys.resize(num_obs);
 	double x_orig_min=0, x_orig_max=0;
 	double y_orig_min=0, y_orig_max=0;
-	SampleStatistics::CalcMinMax(x, x_orig_min, x_orig_max);
-	SampleStatistics::CalcMinMax(y, y_orig_min, y_orig_max);
-	double orig_scale = std::max(x_orig_max-x_orig_min,
-                                 y_orig_max-y_orig_min);
-	if (orig_scale == 0) orig_scale = 1;
-	double big_dbl = 1073741824; // 2^30 should be replaced with DBL_MAX
-	double p = big_dbl / orig_scale;
+	std::vector<int_pair> int_pts;
+	double p = voronoi_int_coords(x, y, int_pts, x_orig_min, x_orig_max,
+								  y_orig_min, y_orig_max);
+	double big_dbl = 1073741824; // 2^30
 	
-	std::map<int, std::list<int> > dups;
-	std::map<int, std::list<int> >::iterator dups_iter;
-	std::map<int_pair, int> pt_map;
-	std::map<int_pair, int>::iterator map_iter;
-	std::vector<int> x_int(num_obs);
-	std::vector<int> y_int(num_obs);
-	bool duplicates_exist = false;
-	std::list<std::list<int> > duplicates;
-	for (int i=0; i<num_obs; i++) {
-		x_int[i] = (int) ((x[i]-x_orig_min)*p);
-		y_int[i] = (int) ((y[i]-y_orig_min)*p);
-		int_pair key(std::make_pair(x_int[i], y_int[i]));
-		map_iter = pt_map.find(key);
-		if (map_iter == pt_map.end()) {
-			pt_map[key] = i;
-		} else {
-			duplicates_exist = true;
-			int ind1 = map_iter->second;
-			int ind2 = i;
-			dups_iter = dups.find(ind1);
-			if (dups_iter == dups.end()) {
-				std::list<int> l;
-				l.push_back(ind1);
-				l.push_back(ind2);
-				dups[ind1] = l;
-			} else {
-				dups_iter->second.push_back(ind2);
-			}
-		}
-	}
-	if (duplicates_exist) {
-		for (dups_iter = dups.begin(); dups_iter != dups.end(); dups_iter++) {
-			duplicates.push_back(dups_iter->second);
-		}
-	}
-	
-	VD vd;
-	wxStopWatch sw_vd;
-	VB vb;
-	std::vector<int_pair> int_pts(num_obs);
-	for (int i=0; i<num_obs; i++) {
-		int_pts[i].first = x_int[i];
-		int_pts[i].second = y_int[i];
-	}
-	for (int i=0; i<num_obs; i++) {
-		int index = vb.insert_point(x_int[i], y_int[i]);
-	}
-	vb.construct(&vd);
-	LOG_MSG(wxString::Format("Voronoi diagram construction on %d points "
-							 "took %ld ms", num_obs, sw_vd.Time()));
+	std::vector<int> obs_site, site_obs_start, site_obs;
+	std::vector<int_pair> site_pts;
+	voronoi_sites(int_pts, obs_site, site_pts, site_obs_start, site_obs);
+	std::vector<int_pair>().swap(int_pts);
 	
 	// Add 2% offset to the bounding rectangle
 	const double bb_pad = 0.02;
@@ -270,190 +1033,30 @@ bool Gda::VoronoiUtils::MakePolygons(const std::vector<double>& x,
 	voronoi_bb_ymin = (bbox_ymin / p) + y_orig_min;
 	voronoi_bb_ymax = (bbox_ymax / p) + y_orig_min;
 	
-	wxStopWatch sw_vd_processing;
-	int cell_cnt = 0;
-	int max_pts = 1000;
-	wxRealPoint* pts = new wxRealPoint[max_pts];
-	for (VD::const_cell_iterator it = vd.cells().begin();
-		 it != vd.cells().end(); ++it) {
-		bool boundary_cell = false;
-		int edge_cnt = 0;
-		const VD::cell_type &cell = *it;
-		
-		int_pair key = std::make_pair(x_int[cell.source_index()],
-									  y_int[cell.source_index()]);
-		int ind = pt_map.find(key)->second;
-		
-		const VD::edge_type *edge = cell.incident_edge();
-		double x_init = 0;
-		double y_init = 0;
-		do {
-			if (!edge->is_finite() || !edge->is_primary()) {
-				//LOG_MSG("cell intersects boundary");
-				boundary_cell = true;
-				break;
-			}
-			// The following ensures that the same edge is always clipped.
-			// This ensurues that adjacent polygons have the exact same
-			// shared-edge descriptions.
-			double edge_x0, edge_y0, edge_x1, edge_y1;
-			bool intersects_e = false;
-			if (edge < edge->twin()) {
-				intersects_e = clipEdge(*edge, int_pts, bbox_xmin, bbox_ymin,
-										bbox_xmax, bbox_ymax,
-										edge_x0, edge_y0, edge_x1, edge_y1);
-			} else {
-				intersects_e = clipEdge(*edge->twin(), int_pts, bbox_xmin,
-										bbox_ymin, bbox_xmax, bbox_ymax,
-										edge_x0, edge_y0, edge_x1, edge_y1);
-			}
-			if (!intersects_e) {
-				boundary_cell = true;
-				break;
-			}
-			if (edge_cnt-1 > max_pts) {
-				delete [] pts;
-				max_pts = 2*edge_cnt;
-				pts = new wxRealPoint[max_pts];
-			}
-			double x0 = (edge_x0 / p) + x_orig_min;
-			double y0 = (edge_y0 / p) + y_orig_min;
-			double x1 = (edge_x1 / p) + x_orig_min;
-			double y1 = (edge_y1 / p) + y_orig_min;
-			if (edge_cnt == 0) {
-				x_init == x0; // ???
-				y_init == y0;
-			}
-			//wxString msg;
-			//msg << "edge: (" << x0 << ", " << y0 << ") -> (";
-			//msg << x1 << ", " << y1 << ")";
-			//LOG_MSG(msg);
-			pts[edge_cnt].x = x0;
-			pts[edge_cnt].y = y0;
-			edge_cnt++;
-			edge = edge->next();
-			if (edge == cell.incident_edge()) {
-				if (x1 == x_init && y1 == y_init) {
-					pts[edge_cnt].x = x1;
-					pts[edge_cnt].y = y1;
-					edge_cnt++;
-				} else {
-					boundary_cell = true;
-					break;
-				}
-			}
-		} while (edge != cell.incident_edge());
-		
-		if (!boundary_cell) {
-			polys[ind] = new GdaPolygon(edge_cnt, pts);
-			//wxString msg;
-			//msg << "added non-boundary polygon with ";
-			//msg << edge_cnt-1 << " edges";
-			//LOG_MSG(msg);
-		} else {
-			// boundary cell, need to determine clipped polygon
-			edge = cell.incident_edge();
-			edge_cnt = 0;
-			
-			using boost::geometry::model::d2::point_xy;
-			using boost::geometry::append;
-			using boost::geometry::make;
-			boost::geometry::model::multi_point<point_xy<double> > h_pts;
-			typedef boost::geometry::model::polygon<point_xy<double> > my_polygon;
-			typedef boost::geometry::ring_type<my_polygon>::type ring_type;
-			my_polygon hull;
-			
-			do {
-				// The following ensures that the same edge is always clipped.
-				// This ensurues that adjacent polygons have the exact same
-				// shared-edge descriptions.
-				double edge_x0, edge_y0, edge_x1, edge_y1;
-				bool intersects_e = false;
-				if (edge < edge->twin()) {
-					intersects_e = clipEdge(*edge, int_pts,
-											bbox_xmin, bbox_ymin,
-											bbox_xmax, bbox_ymax,
-											edge_x0, edge_y0, edge_x1, edge_y1);
-				} else {
-					intersects_e = clipEdge(*edge->twin(), int_pts,
-											bbox_xmin, bbox_ymin,
-											bbox_xmax, bbox_ymax,
-											edge_x0, edge_y0, edge_x1, edge_y1);
-				}
-				if (intersects_e) {
-					double x0 = (edge_x0 / p) + x_orig_min;
-					double y0 = (edge_y0 / p) + y_orig_min;
-					append(h_pts, make<point_xy<double> >(x0, y0));
-					double x1 = (edge_x1 / p) + x_orig_min;
-					double y1 = (edge_y1 / p) + y_orig_min;
-					append(h_pts, make<point_xy<double> >(x1, y1));
-				}
-				edge_cnt++;
-				edge = edge->next();
-			} while (edge != cell.incident_edge());
-			
-			// make sure that the cell's internal point is also within the
-			// convex hull.
-			double x0 = (((double) x_int[cell.source_index()]) / p) + x_orig_min;
-            double y0 = (((double) y_int[cell.source_index()]) / p) + y_orig_min;
-            append(h_pts, make<point_xy<double> >(x0, y0));
-			
-			boost::geometry::convex_hull(h_pts, hull);
-			
-            ring_type outer_ring = hull.outer();
-			int pts_cnt = 0;
-			for (ring_type::iterator it=outer_ring.begin();
-				 it != outer_ring.end(); it++) {
-				double x = boost::geometry::get<0>(*it);
-				double y = boost::geometry::get<1>(*it);
-				pts[pts_cnt].x = x;
-				pts[pts_cnt].y = y;
-				pts_cnt++;
-			}
-			polys[ind] = new GdaPolygon(pts_cnt, pts);
-		}
-	}
+	wxStopWatch sw_vd;
+	VoronoiTiles vt(site_pts);
+	VoronoiPolygons vp(site_pts.size(), p, x_orig_min, y_orig_min,
+					   bbox_xmin, bbox_ymin, bbox_xmax, bbox_ymax);
+	vt.Run(boost::bind(&VoronoiPolygons::AddCell, &vp, _1, _2, _3, _4));
+	LOG_MSG(wxString::Format("Voronoi diagram construction on %d points "
+							 "in %d tiles took %ld ms", num_obs,
+							 vt.GetNumTiles(), sw_vd.Time()));
 	
-	if (duplicates_exist) {
-		// Must fill in missing entries in poly vector with copies
-		// of duplicate shapes.
-		for (dups_iter = dups.begin(); 
-			 dups_iter != dups.end(); dups_iter++) {
-			int head_id = dups_iter->first;
-			for (std::list<int>::iterator iter=dups_iter->second.begin();
-				 iter != dups_iter->second.end(); iter++) {
-				if (*iter == head_id) continue;
-				polys[*iter] = new GdaPolygon(*(GdaPolygon*)polys[head_id]);
-			}			
+	// duplicate points get copies of the polygon of their site
+	for (int s=0, n_sites=site_pts.size(); s<n_sites; s++) {
+		std::vector<wxRealPoint>& poly = vp.site_poly[s];
+		int head_id = site_obs[site_obs_start[s]];
+		polys[head_id] = new GdaPolygon(poly.size(), &poly[0]);
+		for (int o=site_obs_start[s]+1; o<site_obs_start[s+1]; o++) {
+			polys[site_obs[o]] = new GdaPolygon(*(GdaPolygon*)polys[head_id]);
 		}
+		std::vector<wxRealPoint>().swap(poly);
 	}
-			
-	if (pts) delete [] pts;
-	
-	//LOG_MSG(wxString::Format("Voronoi diagram processing on %d points "
-	//						 "took %ld ms", num_obs, sw_vd_processing.Time()));
-	//LOG_MSG(wxString::Format("#obs: %d, #voronoi cells: %d", num_obs,
-	//						 polys.size()));
 	
 	LOG_MSG("Exiting Gda::VoronoiUtils::MakePolygons");
 	return true;
 }
 
-std::list<int>* Gda::VoronoiUtils::getCellList(
-				const VD::cell_type& cell,
-				std::map<std::pair<int,int>, std::list<int>* >& pt_to_id_list,
-				std::vector<std::pair<int,int> >& int_pts)
-{
-	std::map<std::pair<int,int>, std::list<int>* >::iterator iter;
-	//iter = pt_to_id_list.find(std::make_pair(cell.point0().x(),
-	//										 cell.point0().y()));
-	iter = pt_to_id_list.find(int_pts[cell.source_index()]);
-	if (iter == pt_to_id_list.end()) {
-		return 0;
-	}
-	return iter->second;
-}
-
 bool Gda::VoronoiUtils::isVertexOutsideBB(const VD::vertex_type& vertex,
 											const double& xmin,
 											const double& ymin,
@@ -469,7 +1072,7 @@ bool Gda::VoronoiUtils::isVertexOutsideBB(const VD::vertex_type& vertex,
  return true if intersection or if edge is contained within bounding box,
  otherwise return false */
 bool Gda::VoronoiUtils::clipEdge(const VD::edge_type& edge,
-								   std::vector<std::pair<int,int> >& int_pts,
+								   const std::vector<std::pair<int,int> >& int_pts,
 								   const double& xmin, const double& ymin,
 								   const double& xmax, const double& ymax,
 								   double& x0, double& y0,
@@ -486,7 +1089,7 @@ bool Gda::VoronoiUtils::clipEdge(const VD::edge_type& edge,
 
 /** Clip infinite edge to bounding rectangle */
 bool Gda::VoronoiUtils::clipInfiniteEdge(const VD::edge_type& edge,
-									std::vector<std::pair<int,int> >& int_pts,
+									const std::vector<std::pair<int,int> >& int_pts,
 									const double& xmin, const double& ymin,
 									const double& xmax, const double& ymax,
 									double& x0, double& y0,
@@ -532,7 +1135,7 @@ bool Gda::VoronoiUtils::clipInfiniteEdge(const VD::edge_type& edge,
 
 /** Clip finite edge to bounding rectangle */
 bool Gda::VoronoiUtils::clipFiniteEdge(const VD::edge_type& edge,
-									std::vector<std::pair<int,int> >& int_pts,
+									const std::vector<std::pair<int,int> >& int_pts,
 									const double& xmin, const double& ymin,
 									const double& xmax, const double& ymax,
 									double& x0, double& y0,
@@ -546,29 +1149,32 @@ bool Gda::VoronoiUtils::clipFiniteEdge(const VD::edge_type& edge,
 	return GenGeomAlgs::ClipToBB(x0, y0, x1, y1, xmin, ymin, xmax, ymax);
 }
 
-/** If false returned, then an unexpected error.  Otherwise, neighbor map
- created successfully.  The presence of duplicates is indicated in
- duplicates_exists and the list of duplicates is filled in.
+
+/** If false returned, then an unexpected error.  Otherwise, the neighbors
+ of observation i are nbr_ids[nbr_start[i]] to nbr_ids[nbr_start[i+1]-1]
+ in increasing order.  Observations at the same point are neighbors of
+ each other and share the neighbors of that point.
  */
 bool Gda::VoronoiUtils::PointsToContiguity(const std::vector<double>& x,
 									const std::vector<double>& y,
 									bool queen,
-									std::vector<std::set<int> >& nbr_map)
+									std::vector<int>& nbr_start,
+									std::vector<int>& nbr_ids)
 {
 	LOG_MSG("Entering Gda::VoronoiUtils::PointsToContiguity");
-	typedef std::pair<int,int> int_pair;
-	typedef std::list<int> id_list;
 	
 	int num_obs = x.size();
+	nbr_start.assign(num_obs+1, 0);
+	nbr_ids.clear();
+	if (y.size() != x.size()) return false;
+	if (num_obs == 0) return true;
+	
 	double x_orig_min=0, x_orig_max=0;
 	double y_orig_min=0, y_orig_max=0;
-	SampleStatistics::CalcMinMax(x, x_orig_min, x_orig_max);
-	SampleStatistics::CalcMinMax(y, y_orig_min, y_orig_max);
-	double orig_scale = std::max(x_orig_max-x_orig_min,
-											  y_orig_max-y_orig_min);
-	if (orig_scale == 0) orig_scale = 1;
+	std::vector<int_pair> int_pts;
+	double p = voronoi_int_coords(x, y, int_pts, x_orig_min, x_orig_max,
+								  y_orig_min, y_orig_max);
 	double big_dbl = 1073741824; // 2^30
-	double p = (big_dbl/orig_scale);
 	
 	// Add 2% offset to the bounding rectangle
 	const double bb_pad = 0.02;
@@ -577,124 +1183,24 @@ bool Gda::VoronoiUtils::PointsToContiguity(const std::vector<double>& x,
 	double bb_xmax = (x_orig_max-x_orig_min)*p + bb_pad*big_dbl;
 	double bb_ymin = -bb_pad*big_dbl;
 	double bb_ymax = (y_orig_max-y_orig_min)*p + bb_pad*big_dbl;
-		
-	std::map<int_pair, id_list* > pt_to_id_list;
-	// for each unique point, the list of cells at that point
-	std::map<int_pair, id_list* >::iterator pt_to_id_list_iter;
 	
-	std::map<int_pair, std::set<id_list* > > pt_to_nbr_sets;
-	// for each unique point, the set of lists of points that are neighbors
-	std::map<int_pair, std::set<id_list* > >::iterator pt_to_nbr_sets_iter;
+	std::vector<int> obs_site, site_obs_start, site_obs;
+	std::vector<int_pair> site_pts;
+	voronoi_sites(int_pts, obs_site, site_pts, site_obs_start, site_obs);
+	std::vector<int_pair>().swap(int_pts);
 	
-	std::vector<int_pair> int_pts(num_obs);
-	for (int i=0; i<num_obs; i++) {
-		int_pts[i].first = (int) ((x[i]-x_orig_min)*p);
-		int_pts[i].second = (int) ((y[i]-y_orig_min)*p);
-	}		
-	
-	for (int i=0; i<num_obs; i++) {
-		pt_to_id_list_iter = pt_to_id_list.find(int_pts[i]);
-		if (pt_to_id_list_iter == pt_to_id_list.end()) {
-			pt_to_id_list[int_pts[i]] = new id_list;
-		}
-		pt_to_id_list[int_pts[i]]->push_back(i);
-	}
-		
-	nbr_map.clear();
-	nbr_map.resize(num_obs);
-	
-	VD vd;
 	wxStopWatch sw_vd;
-	VB vb;
-	for (int i=0; i<num_obs; i++) {
-		int index = vb.insert_point(int_pts[i].first, int_pts[i].second);
-	}
-	vb.construct(&vd);
-		
-	wxStopWatch sw_vd_processing;
-	for (VD::const_cell_iterator it = vd.cells().begin();
-		 it != vd.cells().end(); ++it) {
-		const VD::cell_type &cell = *it;
-		
-		int_pair key = int_pts[cell.source_index()];
-		
-		std::set<id_list* >& nbr_set = pt_to_nbr_sets[key];
-		
-		const VD::edge_type* edge = cell.incident_edge();
-		typedef std::list<const VD::vertex_type*> v_list;
-		v_list verts;
-		do {
-			id_list* nbr_list = getCellList(*(edge->twin()->cell()),
-											pt_to_id_list, int_pts);
-			if (!nbr_list) {
-				return false;
-			}
-			
-			double x0, y0, x1, y1;
-			if (clipEdge(*edge, int_pts,
-						 bb_xmin, bb_ymin, bb_xmax, bb_ymax,
-						 x0, y0, x1, y1)) {
-				nbr_set.insert(nbr_list);
-			}
-			
-			if (queen) { // add all cells that share each edge vertex
-				if (edge->vertex0() &&
-					!isVertexOutsideBB(*edge->vertex0(), bb_xmin, bb_ymin,
-									   bb_xmax, bb_ymax)) {
-						verts.push_back(edge->vertex0());
-					}
-				if (edge->vertex1() &&
-					!isVertexOutsideBB(*edge->vertex1(), bb_xmin, bb_ymin,
-									   bb_xmax, bb_ymax)) {
-					verts.push_back(edge->vertex1());
-				}
-			}
-			edge = edge->next();
-		} while (edge != cell.incident_edge());
-		
-		// add all neighboring cells.  List will be empty if !queen
-		for (v_list::iterator it = verts.begin(); it != verts.end(); it++) {
-			const VD::edge_type *edge =
-				(*it)->incident_edge();
-			do {
-				id_list* nbr_list = getCellList(*(edge->cell()),
-												 pt_to_id_list, int_pts);
-				if (!nbr_list) {
-					return false;
-				}
-				nbr_set.insert(nbr_list);
-				
-				edge = edge->rot_next();
-			} while (edge != (*it)->incident_edge());
-		}
-	}
-	
-	for (int i=0; i<num_obs; i++) {
-		std::set<id_list* >& nbr_set = pt_to_nbr_sets[int_pts[i]];
-		//LOG_MSG(wxString::Format("obs %d has %d neighbors",
-		//        i, nbr_set.size()));
-		
-		for (std::set<id_list* >::iterator set_iter = nbr_set.begin();
-			 set_iter != nbr_set.end(); set_iter++) {
-			for (id_list::iterator list_iter = (*set_iter)->begin();
-				 list_iter != (*set_iter)->end(); list_iter++) {
-				if (*list_iter != i) nbr_map[i].insert(*list_iter);
-			}
-		}
-		// for each set of points, make every point a neighbor of the
-		// other points in the set, excluding self
-		id_list* pl = pt_to_id_list[int_pts[i]];
-		for (id_list::iterator it=pl->begin(); it!=pl->end(); it++) {
-			if (*it != i) nbr_map[i].insert(*it);
-		}
-	}
-	
-	for (pt_to_id_list_iter = pt_to_id_list.begin();
-		 pt_to_id_list_iter != pt_to_id_list.end();
-		 pt_to_id_list_iter++) {
-		delete pt_to_id_list_iter->second;
-	}
+	VoronoiTiles vt(site_pts);
+	VoronoiContiguity vc(vt.GetNumTiles(), queen,
+						 bb_xmin, bb_ymin, bb_xmax, bb_ymax);
+	vt.Run(boost::bind(&VoronoiContiguity::AddCell, &vc, _1, _2, _3, _4));
+	LOG_MSG(wxString::Format("Voronoi diagram construction on %d points "
+							 "in %d tiles took %ld ms", num_obs,
+							 vt.GetNumTiles(), sw_vd.Time()));
 	
+	wxStopWatch sw_vd_processing;
+	vc.MakeSiteNbrs(site_pts.size());
+	vc.MakeObsNbrs(obs_site, site_obs_start, site_obs, nbr_start, nbr_ids);
 	LOG_MSG(wxString::Format("Voronoi diagram processing on %d points "
 							 "took %ld ms", num_obs, sw_vd_processing.Time()));
 	
@@ -702,6 +1208,40 @@ bool Gda::VoronoiUtils::PointsToContiguity(const std::vector<double>& x,
 	return true;
 }
 
+bool Gda::VoronoiUtils::PointsToContiguity(const std::vector<double>& x,
+									const std::vector<double>& y,
+									bool queen,
+									std::vector<std::set<int> >& nbr_map)
+{
+	std::vector<int> nbr_start, nbr_ids;
+	nbr_map.clear();
+	if (!PointsToContiguity(x, y, queen, nbr_start, nbr_ids)) return false;
+	nbr_map.resize(x.size());
+	for (int i=0, iend=x.size(); i<iend; i++) {
+		nbr_map[i].insert(nbr_ids.begin()+nbr_start[i],
+						  nbr_ids.begin()+nbr_start[i+1]);
+	}
+	return true;
+}
+
+GalElement* Gda::VoronoiUtils::NeighborMapToGal(
+										const std::vector<int>& nbr_start,
+										const std::vector<int>& nbr_ids)
+{
+	if (nbr_start.size() < 2) return 0;
+	int num_obs = nbr_start.size()-1;
+	GalElement* gal = new GalElement[num_obs];
+	if (!gal) return 0;
+	for (int i=0; i<num_obs; i++) {
+		gal[i].SetSizeNbrs(nbr_start[i+1] - nbr_start[i]);
+		long cnt = 0;
+		for (int j=nbr_start[i]; j<nbr_start[i+1]; j++) {
+			gal[i].SetNbr(cnt++, nbr_ids[j]);
+		}
+	}
+	return gal;
+}
+
 GalElement* Gda::VoronoiUtils::NeighborMapToGal(
 										std::vector<std::set<int> >& nbr_map)
 {
@@ -43,7 +43,16 @@ namespace Gda {
 								const std::vector<double>& y,
 								bool queen, // if false, then rook only
 								std::vector<std::set<int> >& nbr_map);
+		/** Neighbors of observation i are nbr_ids[nbr_start[i]] to
+		 nbr_ids[nbr_start[i+1]-1], in increasing order */
+		bool PointsToContiguity(const std::vector<double>& x,
+								const std::vector<double>& y,
+								bool queen, // if false, then rook only
+								std::vector<int>& nbr_start,
+								std::vector<int>& nbr_ids);
 		GalElement* NeighborMapToGal(std::vector<std::set<int> >& nbr_map);
+		GalElement* NeighborMapToGal(const std::vector<int>& nbr_start,
+									 const std::vector<int>& nbr_ids);
 	}
 }
 
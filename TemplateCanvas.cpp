@@ -45,6 +45,7 @@
 
 #include "DialogTools/SaveToTableDlg.h"
 #include "Explore/CatClassifManager.h"
+#include "Explore/PointDensityGrid.h"
 
 
 #include "GdaShape.h"
@@ -101,7 +102,7 @@ selectable_outline_color(GdaConst::selectable_outline_color),
 selectable_fill_color(GdaConst::selectable_fill_color),
 highlight_color(GdaConst::highlight_color),
 canvas_background_color(GdaConst::canvas_background_color),
-selectable_shps_type(mixed), use_category_brushes(false),
+selectable_shps_type(mixed), density_grid(0), use_category_brushes(false),
 draw_sel_shps_by_z_val(false),
 isResize(false),
 layer0_bm(0), layer1_bm(0), layer2_bm(0), faded_layer_bm(0),
@@ -145,6 +146,7 @@ TemplateCanvas::~TemplateCanvas()
 	BOOST_FOREACH( GdaShape* shp, background_shps ) delete shp;
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) delete shp;
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) delete shp;
+    if (density_grid) delete density_grid;
 
     if (HasCapture()) {
         ReleaseMouse();
@@ -342,12 +344,13 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
 		BOOST_FOREACH( GdaShape* ms, background_shps ) {
 			if (ms) ms->applyScaleTrans(last_scale_trans);
 		}
-		BOOST_FOREACH( GdaShape* ms, selectable_shps ) {
-			if (ms) ms->applyScaleTrans(last_scale_trans);
-		}
+		GdaShapeAlgs::applyScaleTrans(selectable_shps, last_scale_trans);
     	BOOST_FOREACH( GdaShape* ms, foreground_shps ) {
     		if (ms) ms->applyScaleTrans(last_scale_trans);
     	}
+        if (density_grid) {
+            density_grid->ApplyScaleTrans(last_scale_trans, vs_w, vs_h);
+        }
 	}
     layer0_valid = false;
     layer1_valid = false;
@@ -841,6 +844,10 @@ bool TemplateCanvas::_IsShpValid(int idx)
 // using wxDC only since windows platform has poor wxGC support
 void TemplateCanvas::DrawSelectableShapes(wxMemoryDC &dc)
 {
+    if (density_grid) {
+        DrawDensity(dc, highlight_state->GetHighlight(), false, false);
+        return;
+    }
 	if (selectable_shps.size() == 0)
         return;
 
@@ -859,6 +866,10 @@ void TemplateCanvas::DrawSelectableShapes(wxMemoryDC &dc)
 // draw highlighted selectable shapes
 void TemplateCanvas::DrawHighlightedShapes(wxMemoryDC &dc)
 {
+    if (density_grid) {
+        DrawDensity(dc, highlight_state->GetHighlight(), true, false);
+        return;
+    }
 	if (selectable_shps.size() == 0)
         return;
    
@@ -894,6 +905,10 @@ void TemplateCanvas::helper_DrawSelectableShapes_dc(wxDC &dc, vector<bool>& hs,
                                                     bool is_print,
                                                     const wxColour& fixed_pen_color)
 {
+    if (density_grid) {
+        DrawDensity(dc, hs, hl_only, revert, fixed_pen_color);
+        return;
+    }
 	int cc_ts = cat_data.curr_canvas_tm_step;
 	int num_cats = cat_data.GetNumCategories(cc_ts);
 	int w;
@@ -967,10 +982,11 @@ void TemplateCanvas::helper_DrawSelectableShapes_dc(wxDC &dc, vector<bool>& hs,
 				if (p->all_points_same) {
 					dc.DrawPoint(p->center.x, p->center.y);
 				} else {
-					if (p->n_count > 1) {
-						dc.DrawPolyPolygon(p->n_count, p->count, p->points);
+					if (p->draw_n_count > 1) {
+						dc.DrawPolyPolygon(p->draw_n_count, p->draw_count,
+										   p->points);
 					} else {
-						dc.DrawPolygon(p->n, p->points);
+						dc.DrawPolygon(p->draw_n, p->points);
 					}
 				}
 			}
@@ -1041,6 +1057,66 @@ void TemplateCanvas::helper_DrawSelectableShapes_dc(wxDC &dc, vector<bool>& hs,
 	}
 }
 
+void TemplateCanvas::SetDensityPoints(const vector<double>& x,
+                                      const vector<double>& y,
+                                      const vector<bool>& undef,
+                                      double x_min, double scale_x,
+                                      double y_min, double scale_y)
+{
+    if (density_grid == NULL) density_grid = new PointDensityGrid;
+    density_grid->SetPoints(x, y, undef, x_min, scale_x, y_min, scale_y);
+    selectable_shps_type = points;
+}
+
+void TemplateCanvas::ClearDensityPoints()
+{
+    if (density_grid) delete density_grid;
+    density_grid = 0;
+}
+
+// Draw the points of density_grid as an image: all of them, or with hl_only
+// the highlighted ones (the unhighlighted ones if revert), coloured as
+// helper_DrawSelectableShapes_dc would colour their circles.
+void TemplateCanvas::DrawDensity(wxDC &dc, vector<bool>& hs, bool hl_only,
+                                 bool revert, const wxColour& fixed_pen_color)
+{
+    if (density_grid == NULL) return;
+    int cc_ts = cat_data.curr_canvas_tm_step;
+    int num_cats = use_category_brushes ? cat_data.GetNumCategories(cc_ts) : 1;
+    if (num_cats <= 0) return;
+    
+    vector<wxColour> colours(num_cats, selectable_outline_color);
+    vector<int> obs_cat(density_grid->GetNumPoints(), 0);
+    if (use_category_brushes) {
+        for (int cat=0; cat<num_cats; cat++) {
+            if (fixed_pen_color != *wxWHITE) {
+                colours[cat] = fixed_pen_color;
+            } else if (selectable_outline_visible) {
+                colours[cat] = cat_data.GetCategoryPen(cc_ts, cat).GetColour();
+            } else {
+                colours[cat] = cat_data.GetCategoryColor(cc_ts, cat);
+            }
+            vector<int>& ids = cat_data.GetIdsRef(cc_ts, cat);
+            for (size_t i=0, iend=ids.size(); i<iend; i++) {
+                if (ids[i] < (int) obs_cat.size()) obs_cat[ids[i]] = cat;
+            }
+        }
+    } else if (hl_only && !revert) {
+        colours[0] = highlight_color;
+    }
+    
+    density_grid->Bin(hs, obs_cat);
+    PointDensityGrid::Layer layer = PointDensityGrid::all_obs;
+    if (hl_only) {
+        layer = revert ? PointDensityGrid::unhighlighted_obs :
+                         PointDensityGrid::highlighted_obs;
+    }
+    wxImage image;
+    density_grid->Render(image, layer, colours);
+    if (!image.IsOk()) return;
+    dc.DrawBitmap(wxBitmap(image), 0, 0, true);
+}
+
 void TemplateCanvas::DrawPoints(wxGCDC& dc, CatClassifData& cat_data,
                                 vector<bool>& hs, double radius, int alpha,
                                 wxColour fixed_pen_color, bool cross_hatch)
@@ -1141,10 +1217,11 @@ void TemplateCanvas::DrawPolygons(wxGCDC& dc, CatClassifData& cat_data,
             if (p->all_points_same) {
                 dc.DrawPoint(p->center.x, p->center.y);
             } else {
-                if (p->n_count > 1) {
-                    dc.DrawPolyPolygon(p->n_count, p->count, p->points);
+                if (p->draw_n_count > 1) {
+                    dc.DrawPolyPolygon(p->draw_n_count, p->draw_count,
+                                       p->points);
                 } else {
-                    dc.DrawPolygon(p->n, p->points);
+                    dc.DrawPolygon(p->draw_n, p->points);
                 }
             }
         }
@@ -1320,15 +1397,16 @@ void TemplateCanvas::helper_DrawSelectableShapes_gc(wxGraphicsContext &gc,
                 if (p->all_points_same) {
                     path.AddCircle(p->center.x, p->center.y, 0.2);
                 } else {
-                    for (int c=0, s=0, t=p->count[0]; c<p->n_count; c++) {
+                    for (int c=0, s=0, t=p->draw_count[0];
+                         c<p->draw_n_count; c++) {
                         path.MoveToPoint(p->points[s]);
-                        for (int pt=s+1; pt<t && pt<p->n; pt++) {
+                        for (int pt=s+1; pt<t && pt<p->draw_n; pt++) {
                             path.AddLineToPoint(p->points[pt]);
                         }
                         path.CloseSubpath();
                         s = t;
-                        if (c+1 < p->n_count) {
-                            t += p->count[c+1];
+                        if (c+1 < p->draw_n_count) {
+                            t += p->draw_count[c+1];
                         }
                     }
                 }
@@ -1829,6 +1907,10 @@ void TemplateCanvas::UpdateSelection(bool shiftdown, bool pointsel)
 // all GdaShape selectable objects.
 void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 {
+    if (density_grid) {
+        UpdateSelectionDensity(shiftdown, pointsel);
+        return;
+    }
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
     
@@ -1967,6 +2049,76 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
     }
 }
 
+// Same selection as UpdateSelectionPoints, but only the points the bucket
+// index of density_grid finds near the brush are tested.
+void TemplateCanvas::UpdateSelectionDensity(bool shiftdown, bool pointsel)
+{
+	vector<bool>& hs = GetSelBitVec();
+	int hl_size = hs.size();
+	if (hl_size != density_grid->GetNumPoints()) return;
+	
+	vector<int> ids;
+	if (pointsel) {
+		// GdaPoint::pointWithin
+		density_grid->Query(wxRect(sel1.x-1, sel1.y-1, 3, 3), ids);
+	} else if (brushtype == rectangle) {
+		density_grid->Query(wxRect(sel1, sel2), ids);
+	} else if (brushtype == circle) {
+		double radius = GenUtils::distance(sel1, sel2);
+		int r = (int) ceil(radius);
+		vector<int> cands;
+		density_grid->Query(wxRect(sel1.x-r, sel1.y-r, 2*r+1, 2*r+1), cands);
+		for (size_t j=0; j<cands.size(); j++) {
+			if (GenUtils::distance(sel1, density_grid->GetPoint(cands[j]))
+				<= radius) ids.push_back(cands[j]);
+		}
+	} else if (brushtype == line) {
+		double p1x = sel1.x;
+		double p1y = sel1.y;
+		double p2xMp1x = sel2.x - p1x;
+		double p2yMp1y = sel2.y - p1y;
+		double delta = 3.0 * GenUtils::distance(sel1, sel2);
+		vector<int> cands;
+		density_grid->Query(wxRect(sel1, sel2), cands);
+		for (size_t j=0; j<cands.size(); j++) {
+			const wxPoint& p0 = density_grid->GetPoint(cands[j]);
+			if (fabs(p2xMp1x * (p1y-p0.y) - (p1x-p0.x) * p2yMp1y) <= delta) {
+				ids.push_back(cands[j]);
+			}
+		}
+	} else {
+		return;
+	}
+	
+	bool selection_changed = false;
+	vector<bool> contains(hl_size, false);
+	for (size_t j=0; j<ids.size(); j++) {
+		int i = ids[j];
+		contains[i] = true;
+		if (pointsel) {
+			hs[i] = !hs[i];
+			selection_changed = true;
+		} else if (!hs[i]) {
+			hs[i] = true;
+			selection_changed = true;
+		}
+	}
+	if (!shiftdown) {
+		for (int i=0; i<hl_size; i++) {
+			if (hs[i] && !contains[i] && !density_grid->IsUndefined(i)) {
+				hs[i] = false;
+				selection_changed = true;
+			}
+		}
+	}
+    if (selection_changed) {
+        int total_highlighted = 0;
+        for (int i=0; i<hl_size; i++) if (hs[i]) total_highlighted += 1;
+        highlight_state->SetTotalHighlighted(total_highlighted);
+        highlight_timer->Start(50);
+    }
+}
+
 // The following function assumes that the set of selectable objects
 // being selected against are all GdaCircle objects.
 void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
@@ -2312,7 +2464,12 @@ void TemplateCanvas::SelectAllInCategory(int category,
 		return;
 	}	
 	int hl_size = highlight_state->GetHighlightSize();
-	if (hl_size != selectable_shps.size()) return;
+    if (density_grid) {
+        // density mode keeps no selectable_shps, only the grid's points
+        if (hl_size != density_grid->GetNumPoints()) return;
+    } else if (hl_size != selectable_shps.size()) {
+        return;
+    }
     
 	vector<bool>& hs = highlight_state->GetHighlight();
     bool selection_changed = false;
@@ -2345,6 +2502,18 @@ void TemplateCanvas::DetermineMouseHoverObjects(wxPoint pt)
 {
 	total_hover_obs = 0;
     hover_obs.clear();
+    if (density_grid) {
+        vector<int> cands;
+        density_grid->Query(wxRect(pt.x-4, pt.y-4, 9, 9), cands);
+        for (size_t j=0; j<cands.size() && total_hover_obs<max_hover_obs; j++) {
+            if (GenUtils::distance_sqrd(density_grid->GetPoint(cands[j]), pt)
+                <= 16.5) {
+                hover_obs.push_back(cands[j]);
+                total_hover_obs++;
+            }
+        }
+        return;
+    }
 	int total_obs = selectable_shps.size();
 	if (selectable_shps_type == circles) {
 		// slightly faster than GdaCircle::pointWithin
@@ -2434,12 +2603,14 @@ std::vector<wxString> TemplateCanvas::SaveCategories(const wxString& title,
                                     vector<bool>& undefs)
 {
     std::vector<wxString> new_fields;
-	if (project->GetNumRecords() != selectable_shps.size()) return new_fields;
+    int num_obs = selectable_shps.size();
+    if (density_grid) num_obs = density_grid->GetNumPoints();
+	if (project->GetNumRecords() != num_obs) return new_fields;
 	vector<SaveToTableEntry> data(1);
 	
 	int cc_ts = cat_data.curr_canvas_tm_step;
 	int num_cats = cat_data.GetNumCategories(cc_ts);
-	vector<wxInt64> dt(selectable_shps.size());
+	vector<wxInt64> dt(num_obs);
 	
 	data[0].type = GdaConst::long64_type;
 	data[0].l_val = &dt;
@@ -43,6 +43,7 @@ typedef boost::multi_array<GdaShape*, 2> shp_array_type;
 typedef boost::multi_array<int, 2> i_array_type;
 
 class CatClassifManager;
+class PointDensityGrid;
 class Project;
 class TemplateFrame;
 
@@ -155,6 +156,8 @@ public:
 										bool pointsel = false);
 	virtual void UpdateSelectionPolylines(bool shiftdown = false,
 										  bool pointsel = false);
+	/** UpdateSelectionPoints for the points of density_grid */
+	void UpdateSelectionDensity(bool shiftdown, bool pointsel);
 	virtual void UpdateSelectRegion(bool translate = false,
 									wxPoint diff = wxPoint(0,0) );
 	/** Assumes selectable_shps.size() == num obs **/
@@ -213,6 +216,18 @@ public:
     virtual void DrawSelectableShapes_dc(wxMemoryDC &dc,
                                          bool hl_only=false,
                                          bool revert=false);
+    // Selectable points drawn as a density image instead of one GdaPoint
+    // per observation.  Used by scatter plots with more than
+    // GdaConst::scatterplot_density_min_obs observations.
+    void SetDensityPoints(const std::vector<double>& x,
+                          const std::vector<double>& y,
+                          const std::vector<bool>& undef,
+                          double x_min, double scale_x,
+                          double y_min, double scale_y);
+    void ClearDensityPoints();
+    bool IsDensityMode() { return density_grid != 0; }
+    void DrawDensity(wxDC& dc, std::vector<bool>& hs, bool hl_only,
+                     bool revert, const wxColour& fixed_pen_color = *wxWHITE);
 
     
     virtual wxString GetVariableNames() = 0;
@@ -339,6 +354,10 @@ protected:
 	SelectableShpType      selectable_shps_type;
 	std::list<GdaShape*>   foreground_shps;
     
+	// when not NULL, selectable_shps is empty and the selectable points
+	// are in density_grid
+	PointDensityGrid* density_grid;
+    
 	// corresponds to the selectable color categories: generally between
 	// 1 and 10 permitted.  Selectable shape drawing routines use brushes
 	// from this list.
@@ -0,0 +1,474 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "../Algorithms/threadpool.h"
+#include "../logger.h"
+#include "GdaParser.h"
+#include "GdaExpr.h"
+
+GdaExprNode::GdaExprNode()
+	: type(LEAF), op(ADD), func(SUM), f1(0), f2(0), column(0)
+{
+}
+
+GdaExprPtr GdaExprNode::Leaf(GdaFVSmtPtr value)
+{
+	GdaExprPtr n(new GdaExprNode());
+	n->value = value;
+	return n;
+}
+
+GdaExprPtr GdaExprNode::Column(const GdaFlexValue* column)
+{
+	GdaExprPtr n(new GdaExprNode());
+	n->column = column;
+	return n;
+}
+
+GdaExprPtr GdaExprNode::Negate(GdaExprPtr arg)
+{
+	GdaExprPtr n(new GdaExprNode());
+	n->type = NEG;
+	n->args.push_back(arg);
+	return n;
+}
+
+GdaExprPtr GdaExprNode::Uni(double (*f)(double), GdaExprPtr arg)
+{
+	GdaExprPtr n(new GdaExprNode());
+	n->type = UNI;
+	n->f1 = f;
+	n->args.push_back(arg);
+	return n;
+}
+
+GdaExprPtr GdaExprNode::Bin(BinOp op, GdaExprPtr left, GdaExprPtr right)
+{
+	GdaExprPtr n(new GdaExprNode());
+	n->type = BIN;
+	n->op = op;
+	n->args.push_back(left);
+	n->args.push_back(right);
+	return n;
+}
+
+GdaExprPtr GdaExprNode::BinF(double (*f)(double, double),
+							 GdaExprPtr left, GdaExprPtr right)
+{
+	GdaExprPtr n = Bin(BIN_F, left, right);
+	n->f2 = f;
+	return n;
+}
+
+GdaExprPtr GdaExprNode::Func(FuncId id, const std::vector<GdaExprPtr>& args,
+							 const wxString& name)
+{
+	GdaExprPtr n(new GdaExprNode());
+	n->type = FUNC;
+	n->func = id;
+	n->func_name = name;
+	n->args = args;
+	return n;
+}
+
+/**
+ Register program for one elementwise subtree.  Compile() walks the subtree
+ in the order the old parser evaluated it: non-elementwise children are
+ evaluated on the way, and operand types and shapes are checked after both
+ operands of a node, so the same error is reported first.  Every node is
+ evaluated over the shape of the whole subtree, which gives the same values
+ as evaluating it at its own shape and broadcasting afterwards.
+ */
+class GdaExprProgram
+{
+public:
+	GdaExprProgram() : obs(1), tms(1), n_regs(0) {}
+
+	void Compile(GdaExprNode* root, WeightsManInterface* w_man_int);
+
+	GdaFVSmtPtr Run();
+
+private:
+	enum { CHUNK = 2048, MIN_PARALLEL = 65536 };
+	enum OperandKind { K_CONST, K_LEAF, K_REG };
+	enum InstrOp { I_NEG, I_UNI, I_ADD, I_SUB, I_MUL, I_DIV, I_POW, I_BINF };
+
+	struct Operand {
+		OperandKind kind;
+		double c; // K_CONST
+		int idx; // leaf or register
+		size_t obs;
+		size_t tms;
+	};
+	struct LeafRef {
+		const GdaFlexValue* v;
+		const double* data;
+		int reg; // -1 if read in place
+	};
+	struct Instr {
+		InstrOp op;
+		double (*f1)(double);
+		double (*f2)(double, double);
+		Operand a;
+		Operand b;
+		int dst;
+	};
+
+	Operand compile(GdaExprNode* node, WeightsManInterface* w_man_int);
+	Operand add_leaf(const GdaFlexValue& v);
+	static void check_data(const GdaFlexValue* v);
+	const GdaFlexValue* leaf_of(const Operand& x) const;
+
+	void run_range(int c_start, int c_end, double* out) const;
+	void run_chunk(size_t start, size_t len, double* regs, double* out) const;
+	const double* fetch(const Operand& x, size_t start, double* regs) const;
+
+	std::vector<GdaFVSmtPtr> owned; // values of non-elementwise children
+	std::vector<LeafRef> leaves;
+	std::vector<Instr> prog;
+	size_t obs;
+	size_t tms;
+	int n_regs;
+};
+
+GdaExprProgram::Operand GdaExprProgram::add_leaf(const GdaFlexValue& v)
+{
+	Operand x;
+	x.obs = v.GetObs();
+	x.tms = v.GetTms();
+	x.c = 0;
+	if (v.IsData() && v.GetConstValArrayRef().size() == 1) {
+		x.kind = K_CONST;
+		x.c = v.GetDouble();
+		x.idx = -1;
+		return x;
+	}
+	LeafRef l;
+	l.v = &v;
+	l.data = 0;
+	l.reg = -1;
+	if (v.GetConstValArrayRef().size() > 0) {
+		// valarray<T>::operator[] const returns by value before C++11
+		l.data = &const_cast<GdaFlexValue&>(v).GetValArrayRef()[0];
+	}
+	x.kind = K_LEAF;
+	x.idx = (int) leaves.size();
+	leaves.push_back(l);
+	return x;
+}
+
+const GdaFlexValue* GdaExprProgram::leaf_of(const Operand& x) const
+{
+	return x.kind == K_LEAF ? leaves[x.idx].v : 0;
+}
+
+void GdaExprProgram::check_data(const GdaFlexValue* v)
+{
+	if (v && !v->IsData()) {
+		throw GdaFVException("value expected data expression");
+	}
+}
+
+GdaExprProgram::Operand GdaExprProgram::compile(GdaExprNode* node,
+												WeightsManInterface* w_man_int)
+{
+	if (node->type == GdaExprNode::LEAF) {
+		return add_leaf(node->LeafValue());
+	}
+	if (!node->IsElementwise()) {
+		owned.push_back(node->Evaluate(w_man_int));
+		return add_leaf(*owned.back());
+	}
+	Instr in;
+	in.f1 = node->f1;
+	in.f2 = node->f2;
+	in.a = compile(node->args[0].get(), w_man_int);
+	size_t n_obs = in.a.obs, n_tms = in.a.tms;
+	if (node->type == GdaExprNode::NEG) {
+		check_data(leaf_of(in.a));
+		in.op = I_NEG;
+		in.b = in.a;
+	} else if (node->type == GdaExprNode::UNI) {
+		check_data(leaf_of(in.a));
+		in.op = I_UNI;
+		in.b = in.a;
+	} else {
+		// both operands are evaluated before either is checked
+		in.b = compile(node->args[1].get(), w_man_int);
+		check_data(leaf_of(in.a));
+		check_data(leaf_of(in.b));
+		// same rules as GdaFlexValue::grow_if_smaller
+		size_t v_obs = in.b.obs, v_tms = in.b.tms;
+		if (!(n_obs == v_obs && n_tms == v_tms)) {
+			if (n_obs > 1 && v_obs > 1 && n_obs != v_obs) {
+				throw GdaFVException("number of obs mismatch");
+			}
+			if (n_tms > 1 && v_tms > 1 && n_tms != v_tms) {
+				throw GdaFVException("number of tms mismatch");
+			}
+			if (v_obs > n_obs) n_obs = v_obs;
+			if (v_tms > n_tms) n_tms = v_tms;
+		}
+		switch (node->op) {
+			case GdaExprNode::ADD: in.op = I_ADD; break;
+			case GdaExprNode::SUB: in.op = I_SUB; break;
+			case GdaExprNode::MUL: in.op = I_MUL; break;
+			case GdaExprNode::DIV: in.op = I_DIV; break;
+			case GdaExprNode::POW: in.op = I_POW; break;
+			default: in.op = I_BINF; break;
+		}
+	}
+	in.dst = n_regs++;
+	prog.push_back(in);
+
+	Operand x;
+	x.kind = K_REG;
+	x.c = 0;
+	x.idx = in.dst;
+	x.obs = n_obs;
+	x.tms = n_tms;
+	return x;
+}
+
+void GdaExprProgram::Compile(GdaExprNode* root, WeightsManInterface* w_man_int)
+{
+	Operand r = compile(root, w_man_int);
+	obs = r.obs;
+	tms = r.tms;
+	// leaves smaller than the result are broadcast into a register
+	for (size_t i=0; i<leaves.size(); ++i) {
+		const GdaFlexValue* v = leaves[i].v;
+		if (v->GetObs() != obs || v->GetTms() != tms) {
+			leaves[i].reg = n_regs++;
+		}
+	}
+}
+
+const double* GdaExprProgram::fetch(const Operand& x, size_t start,
+									double* regs) const
+{
+	if (x.kind == K_REG) return regs + x.idx * CHUNK;
+	const LeafRef& l = leaves[x.idx];
+	if (l.reg >= 0) return regs + l.reg * CHUNK;
+	return l.data + start;
+}
+
+void GdaExprProgram::run_chunk(size_t start, size_t len, double* regs,
+							   double* out) const
+{
+	for (size_t i=0; i<leaves.size(); ++i) {
+		const LeafRef& l = leaves[i];
+		if (l.reg < 0) continue;
+		double* r = regs + l.reg * CHUNK;
+		size_t l_obs = l.v->GetObs(), l_tms = l.v->GetTms();
+		for (size_t k=0; k<len; ++k) {
+			size_t e = start + k;
+			size_t row = l_obs == 1 ? 0 : e / tms;
+			size_t col = l_tms == 1 ? 0 : e % tms;
+			r[k] = l.data[row * l_tms + col];
+		}
+	}
+	for (size_t p=0, n_prog=prog.size(); p<n_prog; ++p) {
+		const Instr& in = prog[p];
+		double* d = p == n_prog-1 ? out + start : regs + in.dst * CHUNK;
+		bool a_c = in.a.kind == K_CONST, b_c = in.b.kind == K_CONST;
+		const double* a = a_c ? 0 : fetch(in.a, start, regs);
+		const double* b = b_c ? 0 : fetch(in.b, start, regs);
+		double ac = in.a.c, bc = in.b.c;
+		size_t k;
+		switch (in.op) {
+			case I_NEG:
+				if (a_c) for (k=0; k<len; ++k) d[k] = -ac;
+				else for (k=0; k<len; ++k) d[k] = -a[k];
+				break;
+			case I_UNI:
+				if (a_c) {
+					double v = in.f1(ac);
+					for (k=0; k<len; ++k) d[k] = v;
+				} else {
+					for (k=0; k<len; ++k) d[k] = in.f1(a[k]);
+				}
+				break;
+#define GDA_EXPR_BIN_LOOP(EXPR) \
+				if (a_c && b_c) { \
+					double x = ac, y = bc, v = (EXPR); \
+					for (k=0; k<len; ++k) d[k] = v; \
+				} else if (a_c) { \
+					double x = ac; \
+					for (k=0; k<len; ++k) { double y = b[k]; d[k] = (EXPR); } \
+				} else if (b_c) { \
+					double y = bc; \
+					for (k=0; k<len; ++k) { double x = a[k]; d[k] = (EXPR); } \
+				} else { \
+					for (k=0; k<len; ++k) { \
+						double x = a[k], y = b[k]; d[k] = (EXPR); \
+					} \
+				}
+			case I_ADD: GDA_EXPR_BIN_LOOP(x + y); break;
+			case I_SUB: GDA_EXPR_BIN_LOOP(x - y); break;
+			case I_MUL: GDA_EXPR_BIN_LOOP(x * y); break;
+			case I_DIV: GDA_EXPR_BIN_LOOP(x / y); break;
+			case I_POW: GDA_EXPR_BIN_LOOP(pow(x, y)); break;
+			case I_BINF: GDA_EXPR_BIN_LOOP(in.f2(x, y)); break;
+#undef GDA_EXPR_BIN_LOOP
+		}
+	}
+}
+
+/** Evaluate chunks c_start..c_end, c_end inclusive */
+void GdaExprProgram::run_range(int c_start, int c_end, double* out) const
+{
+	size_t n = obs * tms;
+	std::vector<double> regs((n_regs > 0 ? n_regs : 1) * CHUNK);
+	for (int c=c_start; c<=c_end; ++c) {
+		size_t start = (size_t) c * CHUNK;
+		size_t len = n - start < CHUNK ? n - start : CHUNK;
+		run_chunk(start, len, &regs[0], out);
+	}
+}
+
+GdaFVSmtPtr GdaExprProgram::Run()
+{
+	GdaFVSmtPtr result(new GdaFlexValue(obs, tms));
+	size_t n = obs * tms;
+	if (n == 0) return result;
+	double* out = &result->GetValArrayRef()[0];
+	int n_chunks = (n + CHUNK - 1) / CHUNK;
+
+	if (n < MIN_PARALLEL) {
+		run_range(0, n_chunks-1, out);
+		return result;
+	}
+	run_range_threads(n_chunks, 1,
+					  boost::bind(&GdaExprProgram::run_range, this, _1, _2, out));
+	return result;
+}
+
+GdaFVSmtPtr GdaExprNode::Evaluate(WeightsManInterface* w_man_int)
+{
+	if (type == LEAF) {
+		GdaFVSmtPtr p(new GdaFlexValue(LeafValue()));
+		return p;
+	}
+	if (type == FUNC) return EvaluateFunc(w_man_int);
+	GdaExprProgram prog;
+	prog.Compile(this, w_man_int);
+	return prog.Run();
+}
+
+GdaFVSmtPtr GdaExprNode::EvaluateFunc(WeightsManInterface* w_man_int)
+{
+	LOG(func_name);
+	if (func == LAG || func == COUNTS) {
+		// weights and data leaves are read in place
+		std::vector<GdaFVSmtPtr> vals;
+		std::vector<const GdaFlexValue*> ptrs;
+		for (size_t i=0; i<args.size(); ++i) {
+			if (args[i]->type == LEAF) {
+				ptrs.push_back(&args[i]->LeafValue());
+			} else {
+				vals.push_back(args[i]->Evaluate(w_man_int));
+				ptrs.push_back(vals.back().get());
+			}
+		}
+		const GdaFlexValue* arg1 = ptrs[0];
+		if (func == COUNTS) {
+			if (!w_man_int) {
+				throw GdaParserException("no weights available.");
+			}
+			if (!arg1->IsWeights()) {
+				throw GdaParserException("first argument of counts must be weights");
+			}
+			std::vector<long> counts;
+			if (!w_man_int->GetCounts(arg1->GetWUuid(), counts)) {
+				throw GdaParserException("could not find neighbor counts");
+			}
+			GdaFVSmtPtr p(new GdaFlexValue(counts));
+			return p;
+		}
+		const GdaFlexValue* arg2 = ptrs[1];
+		if (!w_man_int) {
+			throw GdaParserException("no weights available.");
+		}
+		if (!arg1->IsWeights()) {
+			throw GdaParserException("first argument of lag must be weights.");
+		}
+		if (!arg2->IsData()) {
+			throw GdaParserException("second argument of lag must be data.");
+		}
+		if (!w_man_int->WeightsExists(arg1->GetWUuid())) {
+			throw GdaParserException("invalid weights.");
+		}
+		LOG(arg1->ToStr());
+		GdaFVSmtPtr p(new GdaFlexValue());
+		if (!w_man_int->Lag(arg1->GetWUuid(), *arg2, *p)) {
+			throw GdaParserException("error computing spatial lag");
+		}
+		return p;
+	}
+
+	std::vector<GdaFVSmtPtr> vals;
+	for (size_t i=0; i<args.size(); ++i) {
+		vals.push_back(args[i]->Evaluate(w_man_int));
+	}
+	GdaFVSmtPtr arg1 = vals[0];
+	if (vals.size() == 3) {
+		GdaFVSmtPtr arg2 = vals[1], arg3 = vals[2];
+		if (arg2->GetObs() != 1 || arg2->GetTms() != 1) {
+			throw GdaParserException("second argument of " + func_name
+									 + " must be a constant.");
+		}
+		if (arg3->GetObs() != 1 || arg3->GetTms() != 1) {
+			throw GdaParserException("third argument of " + func_name
+									 + " must be a constant.");
+		}
+		if (func == ENUMERATE) {
+			arg1->Enumerate(arg2->GetDouble(), arg3->GetDouble());
+		} else {
+			double sd = arg3->GetDouble();
+			if (sd-sd != 0 || sd < 0) {
+				// x-x == 0 is a reliable test for double being finite
+				throw GdaParserException("third argument of " + func_name
+										 + " must be a non-negative finite real.");
+			}
+			arg1->GaussianDist(arg2->GetDouble(), sd);
+		}
+		return arg1;
+	}
+	switch (func) {
+		case SUM: arg1->Sum(); break;
+		case MEAN: arg1->Mean(); break;
+		case STDDEV: arg1->StdDev(); break;
+		case DEV_FR_MEAN: arg1->DevFromMean(); break;
+		case STANDARDIZE: arg1->Standardize(); break;
+		case SHUFFLE: arg1->Shuffle(); break;
+		case ROT_DOWN: arg1->Rotate(-1); break;
+		case ROT_UP: arg1->Rotate(1); break;
+		case UNIF_DIST: arg1->UniformDist(); break;
+		case NORM_DIST: arg1->GaussianDist(0,1); break;
+		case ENUMERATE: arg1->Enumerate(1, 1); break;
+		case MAX: arg1->Max(); break;
+		case MIN: arg1->Min(); break;
+		default: break;
+	}
+	return arg1;
+}
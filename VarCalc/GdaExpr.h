@@ -0,0 +1,101 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_EXPR_H__
+#define __GEODA_CENTER_GDA_EXPR_H__
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "WeightsManInterface.h"
+#include "GdaFlexValue.h"
+
+class GdaExprNode;
+typedef boost::shared_ptr<GdaExprNode> GdaExprPtr;
+
+/**
+ Expression tree produced by GdaParser.
+
+ Elementwise operators and functions (arithmetic, comparisons, logical
+ operators, sqrt, log, ...) are not evaluated one at a time.  Each maximal
+ elementwise subtree is compiled into a small register program that runs
+ over the output in chunks of a few thousand values, split across threads,
+ so that a + b * log(c) reads a, b and c once and writes one result column
+ without any full-length temporaries.
+
+ Only the other nodes produce a GdaFlexValue of their own: data and
+ weights leaves, functions that need the whole column (sum, mean, stddev,
+ standardize, shuffle, lag, ...) and the random generators.  Broadcasting
+ between values of different obs x tms shapes and all error messages are
+ the same as with the GdaFlexValue operators.
+ */
+class GdaExprNode
+{
+public:
+	enum NodeType {
+		LEAF, // a value: number, string, weights or a data_table column
+		NEG, // unary minus
+		UNI, // elementwise double f(double)
+		BIN, // elementwise + - * / ^ or double f(double, double)
+		FUNC // a function over the whole value
+	};
+	enum BinOp { ADD, SUB, MUL, DIV, POW, BIN_F };
+	enum FuncId {
+		SUM, MEAN, STDDEV, DEV_FR_MEAN, STANDARDIZE, SHUFFLE, ROT_DOWN,
+		ROT_UP, UNIF_DIST, NORM_DIST, ENUMERATE, MAX, MIN, COUNTS, LAG
+	};
+
+	/** A value owned by the node */
+	static GdaExprPtr Leaf(GdaFVSmtPtr value);
+	/** A column of the parser data table, read in place */
+	static GdaExprPtr Column(const GdaFlexValue* column);
+	static GdaExprPtr Negate(GdaExprPtr arg);
+	static GdaExprPtr Uni(double (*f)(double), GdaExprPtr arg);
+	static GdaExprPtr Bin(BinOp op, GdaExprPtr left, GdaExprPtr right);
+	static GdaExprPtr BinF(double (*f)(double, double),
+						   GdaExprPtr left, GdaExprPtr right);
+	static GdaExprPtr Func(FuncId id, const std::vector<GdaExprPtr>& args,
+						   const wxString& name);
+
+	/** Evaluate the tree into a new value.  Throws GdaParserException and
+	 GdaFVException. */
+	GdaFVSmtPtr Evaluate(WeightsManInterface* w_man_int);
+
+	NodeType type;
+	BinOp op;
+	FuncId func;
+	wxString func_name;
+	double (*f1)(double);
+	double (*f2)(double, double);
+	std::vector<GdaExprPtr> args;
+	GdaFVSmtPtr value; // LEAF
+	const GdaFlexValue* column; // LEAF, not owned
+
+	const GdaFlexValue& LeafValue() const {
+		return column ? *column : *value;
+	}
+	bool IsElementwise() const {
+		return type == NEG || type == UNI || type == BIN;
+	}
+
+private:
+	GdaExprNode();
+	GdaFVSmtPtr EvaluateFunc(WeightsManInterface* w_man_int);
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include <wx/string.h>
 #include "WeightsManInterface.h"
 #include "GdaFlexValue.h"
+#include "GdaExpr.h"
 #include "GdaLexer.h"
 #include "NumericTests.h"
 
@@ -48,7 +49,8 @@ public:
 	/** If no errors during evaluation, then true is returned and GetEvalVal
 	 retuns the final output value.  If errors occurred, then GetErrorMsg
 	 returns a helpful error message.  Regardless of success, GetEvalTokens
-	 returns the list of tokens that were evaluated. */ 
+	 returns the list of tokens that were evaluated.  The tokens are first
+	 parsed into a GdaExprNode tree, which is then evaluated. */ 
 	bool eval(const std::vector<GdaTokenDetails>& tokens,
 			  std::map<wxString, GdaFVSmtPtr>* data_table,
 			  WeightsManInterface* w_man_int);
@@ -60,17 +62,17 @@ public:
 	std::vector<GdaTokenDetails> GetEvalTokens() { return eval_toks; }
 	
 private:
-	GdaFVSmtPtr expression();
-	GdaFVSmtPtr logical_xor_expr();
-	GdaFVSmtPtr logical_or_expr();
-	GdaFVSmtPtr logical_and_expr();
-	GdaFVSmtPtr logical_not_expr();
-	GdaFVSmtPtr comp_expr();
-	GdaFVSmtPtr add_expr();
-	GdaFVSmtPtr mult_expr();
-	GdaFVSmtPtr pow_expr();
-	GdaFVSmtPtr func_expr();
-	GdaFVSmtPtr primary();
+	GdaExprPtr expression();
+	GdaExprPtr logical_xor_expr();
+	GdaExprPtr logical_or_expr();
+	GdaExprPtr logical_and_expr();
+	GdaExprPtr logical_not_expr();
+	GdaExprPtr comp_expr();
+	GdaExprPtr add_expr();
+	GdaExprPtr mult_expr();
+	GdaExprPtr pow_expr();
+	GdaExprPtr func_expr();
+	GdaExprPtr primary();
 
 	Gda::TokenEnum curr_token();
 	double curr_tok_num_val();
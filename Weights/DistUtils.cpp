@@ -20,7 +20,6 @@ DistUtils::DistUtils(const std::vector<std::vector<double> >& input_data,
                      int distance_metric)
 {
     eps = 0.0;
-    ANN_DIST_TYPE = distance_metric;
     
     n_cols = input_data.size();
     if (n_cols > 0) {
@@ -55,15 +54,16 @@ DistUtils::DistUtils(const std::vector<std::vector<double> >& input_data,
         cnt += 1;
     }
 
-    // create a kdtree
+    // create a kdtree: the metric is kept by the tree and used by its
+    // reentrant searches, instead of the global ANN_DIST_TYPE
     kdTree = new ANNkd_tree(data, n_valid_rows, n_cols /*dim*/);
+    kdTree->setDistType(distance_metric);
 }
 
 DistUtils::DistUtils(double** input_data, int nrows, int ncols,
                      int distance_metric)
 {
     eps = 0.0;
-    ANN_DIST_TYPE = distance_metric;
 
     n_cols = ncols;
     n_rows = nrows;
@@ -83,8 +83,10 @@ DistUtils::DistUtils(double** input_data, int nrows, int ncols,
         cnt += 1;
     }
 
-    // create a kdtree
+    // create a kdtree: the metric is kept by the tree and used by its
+    // reentrant searches, instead of the global ANN_DIST_TYPE
     kdTree = new ANNkd_tree(data, n_valid_rows, n_cols /*dim*/);
+    kdTree->setDistType(distance_metric);
 }
 
 DistUtils::~DistUtils()
@@ -93,9 +95,15 @@ DistUtils::~DistUtils()
     delete[] data;
     
     if (kdTree) delete kdTree;
+}
 
-    // reset this global variable, so it won't impact using ANN in other code
-    ANN_DIST_TYPE = ANNuse_euclidean_dist;
+void DistUtils::SearchAll(int k, std::vector<ANNidx>& nn_idx,
+                          std::vector<ANNdist>& dists)
+{
+    nn_idx.resize(n_valid_rows * k);
+    dists.resize(n_valid_rows * k);
+    if (n_valid_rows == 0) return;
+    kdTree->annkSearchAll(k, &nn_idx[0], &dists[0], eps);
 }
 
 double DistUtils::GetMinThreshold()
@@ -103,18 +111,17 @@ double DistUtils::GetMinThreshold()
     double max_1nn_dist = 0;
     
     int k = 2; // the first one is alway the query point itself
-    ANNidxArray nnIdx = new ANNidx[k];
-    ANNdistArray dists = new ANNdist[k];
-    for (size_t i=0; i<n_valid_rows; i++) { // find nn for every valid row
-        kdTree->annkSearch(data[i], k, nnIdx, dists);
-        if (dists[1] > max_1nn_dist) {
-            max_1nn_dist = dists[1];
+    if (n_valid_rows < k) return 0;
+    std::vector<ANNidx> nnIdx;
+    std::vector<ANNdist> dists;
+    SearchAll(k, nnIdx, dists); // find nn for every valid row
+    for (size_t i=0; i<n_valid_rows; i++) {
+        if (dists[i*k + 1] > max_1nn_dist) {
+            max_1nn_dist = dists[i*k + 1];
         }
     }
-    delete[] nnIdx;
-    delete[] dists;
 
-    return ANN_ROOT(max_1nn_dist);
+    return kdTree->distRoot(max_1nn_dist);
 }
 
 /*
@@ -142,9 +149,9 @@ double DistUtils::GetMaxThreshold()
     ANNdistArray dists = new ANNdist[k];
     for (size_t i=0; i<n_iter; i++) {
         x_idx = rand() % n_valid_rows;
-        kdTree->annkSearch(data[x_idx], k, nnIdx, dists);
+        kdTree->annkSearch_r(data[x_idx], k, nnIdx, dists);
         y_idx = nnIdx[k-1];
-        kdTree->annkSearch(data[y_idx], k, nnIdx, dists);
+        kdTree->annkSearch_r(data[y_idx], k, nnIdx, dists);
         if (dists[k-1] > dist_cand) {
             dist_cand = dists[k-1];
         }
@@ -152,7 +159,7 @@ double DistUtils::GetMaxThreshold()
     delete[] nnIdx;
     delete[] dists;
 
-    return ANN_ROOT(dist_cand);
+    return kdTree->distRoot(dist_cand);
 }
 
 Gda::Weights DistUtils::CreateDistBandWeights(double band, bool is_inverse,
@@ -160,22 +167,22 @@ Gda::Weights DistUtils::CreateDistBandWeights(double band, bool is_inverse,
 {
     Gda::Weights weights;
     
-    double radius = ANN_POW(band);
+    double radius = kdTree->distPow(band);
     double w;
     
     for (size_t i=0; i<n_rows; i++) {
         std::vector<std::pair<int, double> > nbrs;
         if (row_mask[i] == false) {
             int ann_idx = row_to_ann_idx[i];
-            int k = kdTree->annkFRSearch(data[ann_idx], radius, 0, NULL, NULL);
+            int k = kdTree->annkFRSearch_r(data[ann_idx], radius, 0);
             ANNidxArray nnIdx = new ANNidx[k];
             ANNdistArray dists = new ANNdist[k];
-            kdTree->annkFRSearch(data[ann_idx], radius, k, nnIdx, dists);
+            kdTree->annkFRSearch_r(data[ann_idx], radius, k, nnIdx, dists);
             for (size_t j=0; j<k; j++) {
                 // iter each neighbor
                 int nbr_id = ann_idx_to_row[ nnIdx[j] ];
                 if (nbr_id != i) {
-                    w = ANN_ROOT(dists[j]);
+                    w = kdTree->distRoot(dists[j]);
                     if (is_inverse) {
                         w = pow(w, power);
                     }
@@ -196,19 +203,21 @@ Gda::Weights DistUtils::CreateKNNWeights(int k, bool is_inverse, int power)
     Gda::Weights weights;
     
     double w;
-    ANNidxArray nnIdx = new ANNidx[k+1];
-    ANNdistArray dists = new ANNdist[k+1];
+    // k+1, because data[i] will be always returned
+    std::vector<ANNidx> nn_all;
+    std::vector<ANNdist> dd_all;
+    SearchAll(k+1, nn_all, dd_all);
     for (size_t i=0; i<n_rows; i++) {
         std::vector<std::pair<int, double> > nbrs;
         if (row_mask[i] == false) {
             int ann_idx = row_to_ann_idx[i];
-            // k+1, because data[i] will be always returned
-            kdTree->annkSearch(data[ann_idx], k+1, nnIdx, dists);
+            const ANNidx* nnIdx = &nn_all[(size_t)ann_idx * (k+1)];
+            const ANNdist* dists = &dd_all[(size_t)ann_idx * (k+1)];
             for (size_t j=0; j<k+1; j++) {
                 // iter each neighbor
                 int nbr_id = ann_idx_to_row[ nnIdx[j] ];
                 if (nbr_id != i && nbrs.size() < k) {
-                    w = ANN_ROOT(dists[j]);
+                    w = kdTree->distRoot(dists[j]);
                     if (is_inverse) {
                         w = pow(w, power);
                     }
@@ -218,8 +227,6 @@ Gda::Weights DistUtils::CreateKNNWeights(int k, bool is_inverse, int power)
         }
         weights.push_back(nbrs);
     }
-    delete[] nnIdx;
-    delete[] dists;
     
     return weights;
 }
@@ -231,16 +238,18 @@ Gda::Weights DistUtils::CreateAdaptiveKernelWeights(int kernel_type, int k,
     Gda::Weights weights;
     double w;
     double max_knn_bandwidth = 0;
-    ANNidxArray nnIdx = new ANNidx[k+1];
-    ANNdistArray dists = new ANNdist[k+1];
+    // k+1, because data[i] will be always returned
+    std::vector<ANNidx> nn_all;
+    std::vector<ANNdist> dd_all;
+    SearchAll(k+1, nn_all, dd_all);
     
     if (is_adaptive_bandwidth) {
         for (size_t i=0; i<n_rows; i++) {
             std::vector<std::pair<int, double> > nbrs;
             if (row_mask[i] == false) {
                 int ann_idx = row_to_ann_idx[i];
-                // k+1, because data[i] will be always returned
-                kdTree->annkSearch(data[ann_idx], k+1, nnIdx, dists);
+                const ANNidx* nnIdx = &nn_all[(size_t)ann_idx * (k+1)];
+                const ANNdist* dists = &dd_all[(size_t)ann_idx * (k+1)];
                 double local_band = 0;
                 for (size_t j=0; j<k+1; j++) {
                     // iter each neighbor, include itself
@@ -248,10 +257,10 @@ Gda::Weights DistUtils::CreateAdaptiveKernelWeights(int kernel_type, int k,
                         local_band = dists[j];
                     }
                 }
-                local_band = ANN_ROOT(local_band);
+                local_band = kdTree->distRoot(local_band);
                 for (size_t j=0; j<k+1; j++) {
                     // iter each neighbor
-                    w = ANN_ROOT(dists[j]);
+                    w = kdTree->distRoot(dists[j]);
                     w = local_band > 0 ? w / local_band : 0;
                     int nbr_id = ann_idx_to_row[ nnIdx[j] ];
                     nbrs.push_back(std::make_pair(nbr_id, w));
@@ -265,11 +274,11 @@ Gda::Weights DistUtils::CreateAdaptiveKernelWeights(int kernel_type, int k,
             std::vector<std::pair<int, double> > nbrs;
             if (row_mask[i] == false) {
                 int ann_idx = row_to_ann_idx[i];
-                // k+1, because data[i] will be always returned
-                kdTree->annkSearch(data[ann_idx], k+1, nnIdx, dists);
+                const ANNidx* nnIdx = &nn_all[(size_t)ann_idx * (k+1)];
+                const ANNdist* dists = &dd_all[(size_t)ann_idx * (k+1)];
                 for (size_t j=0; j<k+1; j++) {
                     // iter each neighbor
-                    w = ANN_ROOT(dists[j]);
+                    w = kdTree->distRoot(dists[j]);
                     int nbr_id = ann_idx_to_row[ nnIdx[j] ];
                     nbrs.push_back(std::make_pair(nbr_id, w));
                     if (w > max_knn_bandwidth) {
@@ -286,9 +295,6 @@ Gda::Weights DistUtils::CreateAdaptiveKernelWeights(int kernel_type, int k,
         }
     }
     
-    delete[] nnIdx;
-    delete[] dists;
-    
     ApplyKernel(weights, kernel_type, apply_kernel_to_diag);
     
     return weights;
@@ -298,22 +304,22 @@ Gda::Weights DistUtils::CreateAdaptiveKernelWeights(int kernel_type, double band
                                            bool apply_kernel_to_diag)
 {
     Gda::Weights weights;
-    double radius = ANN_POW(band);
+    double radius = kdTree->distPow(band);
     double w;
     
     for (size_t i=0; i<n_rows; i++) {
         std::vector<std::pair<int, double> > nbrs;
         if (row_mask[i] == false) {
             int ann_idx = row_to_ann_idx[i];
-            int k = kdTree->annkFRSearch(data[ann_idx], radius, 0, NULL, NULL);
+            int k = kdTree->annkFRSearch_r(data[ann_idx], radius, 0);
             ANNidxArray nnIdx = new ANNidx[k];
             ANNdistArray dists = new ANNdist[k];
-            kdTree->annkFRSearch(data[ann_idx], radius, k, nnIdx, dists);
+            kdTree->annkFRSearch_r(data[ann_idx], radius, k, nnIdx, dists);
 
             for (size_t j=0; j<k; j++) {
                 // iter each neighbor
                 int nbr_id = ann_idx_to_row[ nnIdx[j] ];
-                w = ANN_ROOT(dists[j]) / band;
+                w = kdTree->distRoot(dists[j]) / band;
                 nbrs.push_back(std::make_pair(nbr_id,w));
             }
 
@@ -31,6 +31,11 @@ namespace Gda {
         // for any undefined rows, re-mapping memory row to table row
         std::map<unsigned long, unsigned long> ann_idx_to_row;
         std::map<unsigned long, unsigned long> row_to_ann_idx;
+
+        // k nearest neighbors of every valid row, searched in parallel:
+        // the results of ann_idx i are at [i * k]
+        void SearchAll(int k, std::vector<ANNidx>& nn_idx,
+                       std::vector<ANNdist>& dists);
     public:
         DistUtils(const std::vector<std::vector<double> >& input_data,
                   const std::vector<std::vector<bool> >& mask,
@@ -344,6 +344,21 @@ double ANN_ROOT(double x);
 double ANN_SUM(double x, double y);
 double ANN_DIFF(double x, double y);
 
+// Same as ANN_POW and ANN_ROOT for a given metric instead of the global
+// ANN_DIST_TYPE; used by the reentrant searches of ANNkd_tree.
+inline double annDistPow(int dist_type, double v)
+{
+	if (dist_type == ANNuse_manhattan_dist) return v < 0 ? -v : v;
+	if (dist_type == ANNuse_euclidean_dist) return v * v;
+	return pow(fabs(v), dist_type);
+}
+inline double annDistRoot(int dist_type, double x)
+{
+	if (dist_type == ANNuse_manhattan_dist) return x;
+	if (dist_type == ANNuse_euclidean_dist) return sqrt(x);
+	return pow(fabs(x), 1.0/dist_type);
+}
+
 //----------------------------------------------------------------------
 //	Use the following for the Euclidean norm
 //----------------------------------------------------------------------
@@ -726,6 +741,7 @@ protected:
 	ANNkd_ptr		root;				// root of kd-tree
 	ANNpoint		bnd_box_lo;			// bounding box low point
 	ANNpoint		bnd_box_hi;			// bounding box high point
+	int				dist_type;			// metric of the reentrant searches
 
 	void SkeletonTree(					// construct skeleton tree
 		int				n,				// number of points
@@ -774,6 +790,50 @@ public:
 		ANNdistArray	dd = NULL,		// dist to near neighbors (modified)
 		double			eps=0.0);		// error bound
 
+	//------------------------------------------------------------------
+	//	Reentrant searches
+	//		annkSearch() and annkFRSearch() keep the query in globals and
+	//		use the global ANN_DIST_TYPE, so only one search can run at a
+	//		time.  The _r versions keep the query state in a context on
+	//		the caller's stack and use the tree's own metric (the value
+	//		of ANN_DIST_TYPE when the tree was built, or setDistType()),
+	//		so any number of threads can search the same tree, and trees
+	//		with different metrics can be used side by side.  They are
+	//		not counted in the ANNperf statistics.
+	//------------------------------------------------------------------
+	void annkSearch_r(					// reentrant k near neighbor search
+		ANNpoint		q,				// query point
+		int				k,				// number of near neighbors to return
+		ANNidxArray		nn_idx,			// nearest neighbor array (modified)
+		ANNdistArray	dd,				// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound
+
+	int annkFRSearch_r(					// reentrant fixed-radius kNN search
+		ANNpoint		q,				// the query point
+		ANNdist			sqRad,			// squared radius of query ball
+		int				k,				// number of neighbors to return
+		ANNidxArray		nn_idx = NULL,	// nearest neighbor array (modified)
+		ANNdistArray	dd = NULL,		// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound
+
+	void annkSearchAll(					// k near neighbors of every point
+		int				k,				// number of near neighbors per point
+		ANNidxArray		nn_idx,			// n_pts*k, point i at nn_idx[i*k]
+		ANNdistArray	dd,				// n_pts*k, point i at dd[i*k]
+		double			eps=0.0);		// error bound
+
+	void setDistType(int type)			// metric of the reentrant searches
+		{ dist_type = type; }
+
+	int getDistType()
+		{ return dist_type; }
+
+	ANNdist distPow(double v)			// ANN_POW in the tree's metric
+		{ return annDistPow(dist_type, v); }
+
+	double distRoot(ANNdist x)			// ANN_ROOT in the tree's metric
+		{ return annDistRoot(dist_type, x); }
+
 	int theDim()						// return dimension of space
 		{ return dim; }
 
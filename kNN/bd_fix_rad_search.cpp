@@ -59,3 +59,30 @@ void ANNbd_shrink::ann_FR_search(ANNdist box_dist)
 	ANN_FLOP(3*n_bnds)							// increment floating ops
 	ANN_SHR(1)									// one more shrinking node
 }
+
+//----------------------------------------------------------------------
+//	bd_shrink::ann_FR_search_r - reentrant fixed-radius search of a shrinking node
+//----------------------------------------------------------------------
+
+void ANNbd_shrink::ann_FR_search_r(ANNdist box_dist, ANNkdQuery &ctx)
+{
+												// check dist calc term cond.
+	if (ANNmaxPtsVisited != 0 && ctx.ptsVisited > ANNmaxPtsVisited) return;
+
+	ANNdist inner_dist = 0;						// distance to inner box
+	for (int i = 0; i < n_bnds; i++) {			// is query point in the box?
+		if (bnds[i].out(ctx.q)) {				// outside this bounding side?
+												// add to inner distance
+			inner_dist = (ANNdist) (inner_dist +
+				annDistPow(ctx.dist_type, ctx.q[bnds[i].cd] - bnds[i].cv));
+		}
+	}
+	if (inner_dist <= box_dist) {				// if inner box is closer
+		child[ANN_IN]->ann_FR_search_r(inner_dist, ctx);
+		child[ANN_OUT]->ann_FR_search_r(box_dist, ctx);
+	}
+	else {										// if outer box is closer
+		child[ANN_OUT]->ann_FR_search_r(box_dist, ctx);
+		child[ANN_IN]->ann_FR_search_r(inner_dist, ctx);
+	}
+}
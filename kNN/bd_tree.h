@@ -95,6 +95,8 @@ public:
 	virtual void ann_search(ANNdist);			// standard search
 	virtual void ann_pri_search(ANNdist);		// priority search
 	virtual void ann_FR_search(ANNdist); 		// fixed-radius search
+	virtual void ann_search_r(ANNdist, ANNkdQuery&);
+	virtual void ann_FR_search_r(ANNdist, ANNkdQuery&);
 };
 
 #endif
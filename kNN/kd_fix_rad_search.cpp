@@ -181,3 +181,111 @@ void ANNkd_leaf::ann_FR_search(ANNdist box_dist)
 	ANN_PTS(n_pts)						// increment points visited
 	ANNkdFRPtsVisited += n_pts;			// increment number of points visited
 }
+
+//----------------------------------------------------------------------
+//	Reentrant fixed-radius search
+//		Same search as above, with the globals replaced by an
+//		ANNkdQuery context and the global metric by the tree's own.
+//----------------------------------------------------------------------
+
+int ANNkd_tree::annkFRSearch_r(
+	ANNpoint			q,				// the query point
+	ANNdist				sqRad,			// squared radius search bound
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	ANNdistArray		dd,				// the approximate nearest neighbor
+	double				eps)			// the error bound
+{
+	ANNmin_k pointMK(k);				// set for closest k points
+
+	ANNkdQuery ctx;
+	ctx.dim = dim;
+	ctx.dist_type = dist_type;
+	ctx.q = q;
+	ctx.maxErr = annDistPow(dist_type, 1.0 + eps);
+	ctx.pts = pts;
+	ctx.pointMK = &pointMK;
+	ctx.ptsVisited = 0;
+	ctx.sqRad = sqRad;
+	ctx.ptsInRange = 0;
+
+	if (root != NULL) {
+		root->ann_FR_search_r(annBoxDistance_r(q, bnd_box_lo, bnd_box_hi,
+											   dim, dist_type), ctx);
+	}
+	for (int i = 0; i < k; i++) {		// extract the k-th closest points
+		if (dd != NULL)
+			dd[i] = pointMK.ith_smallest_key(i);
+		if (nn_idx != NULL)
+			nn_idx[i] = pointMK.ith_smallest_info(i);
+	}
+	return ctx.ptsInRange;				// return final point count
+}
+
+void ANNkd_split::ann_FR_search_r(ANNdist box_dist, ANNkdQuery &ctx)
+{
+	if (ANNmaxPtsVisited != 0 && ctx.ptsVisited > ANNmaxPtsVisited) return;
+
+	ANNcoord cut_diff = ctx.q[cut_dim] - cut_val;
+
+	if (cut_diff < 0) {					// left of cutting plane
+		child[ANN_LO]->ann_FR_search_r(box_dist, ctx);// visit closer child first
+
+		ANNcoord box_diff = cd_bnds[ANN_LO] - ctx.q[cut_dim];
+		if (box_diff < 0)				// within bounds - ignore
+			box_diff = 0;
+		box_dist = (ANNdist) (box_dist +
+				(annDistPow(ctx.dist_type, cut_diff) -
+				 annDistPow(ctx.dist_type, box_diff)));
+
+		if (box_dist * ctx.maxErr <= ctx.sqRad)
+			child[ANN_HI]->ann_FR_search_r(box_dist, ctx);
+
+	}
+	else {								// right of cutting plane
+		child[ANN_HI]->ann_FR_search_r(box_dist, ctx);// visit closer child first
+
+		ANNcoord box_diff = ctx.q[cut_dim] - cd_bnds[ANN_HI];
+		if (box_diff < 0)				// within bounds - ignore
+			box_diff = 0;
+		box_dist = (ANNdist) (box_dist +
+				(annDistPow(ctx.dist_type, cut_diff) -
+				 annDistPow(ctx.dist_type, box_diff)));
+
+		if (box_dist * ctx.maxErr <= ctx.sqRad)
+			child[ANN_LO]->ann_FR_search_r(box_dist, ctx);
+
+	}
+}
+
+void ANNkd_leaf::ann_FR_search_r(ANNdist box_dist, ANNkdQuery &ctx)
+{
+	ANNdist dist;						// distance to data point
+	ANNcoord* pp;						// data coordinate pointer
+	ANNcoord* qq;						// query coordinate pointer
+	ANNcoord t;
+	int d;
+	const int dim = ctx.dim;
+	const int dist_type = ctx.dist_type;
+
+	for (int i = 0; i < n_pts; i++) {	// check points in bucket
+
+		pp = ctx.pts[bkt[i]];			// first coord of next data point
+		qq = ctx.q;						// first coord of query point
+		dist = 0;
+
+		for(d = 0; d < dim; d++) {
+			t = *(qq++) - *(pp++);		// compute length and adv coordinate
+			if( (dist = dist + annDistPow(dist_type, t)) > ctx.sqRad) {
+				break;
+			}
+		}
+
+		if (d >= dim &&							// among the k best?
+		   (ANN_ALLOW_SELF_MATCH || dist!=0)) { // and no self-match problem
+			ctx.pointMK->insert(dist, bkt[i]);
+			ctx.ptsInRange++;					// increment point count
+		}
+	}
+	ctx.ptsVisited += n_pts;			// increment number of points visited
+}
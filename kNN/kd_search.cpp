@@ -26,6 +26,11 @@
 
 #include "kd_search.h"					// kd-search declarations
 
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "../Algorithms/threadpool.h"
+
 //----------------------------------------------------------------------
 //	Approximate nearest neighbor searching by kd-tree search
 //		The kd-tree is searched for an approximate nearest neighbor.
@@ -208,3 +213,201 @@ void ANNkd_leaf::ann_search(ANNdist box_dist)
 	ANN_PTS(n_pts)						// increment points visited
 	ANNptsVisited += n_pts;				// increment number of points visited
 }
+
+//----------------------------------------------------------------------
+//	Reentrant search
+//		Same search as above, with the globals replaced by an
+//		ANNkdQuery context and the global metric by the tree's own, so
+//		that several threads can search the same tree at once.
+//----------------------------------------------------------------------
+
+static void annkSearchQuery(			// search with a prepared context
+	ANNkd_ptr			root,			// root of the tree
+	ANNpoint			bnd_lo,			// bounding box of the tree
+	ANNpoint			bnd_hi,
+	ANNkdQuery			&ctx,			// query context
+	int					k,				// number of near neighbors
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	ANNdistArray		dd)				// the approximate nearest neighbor
+{
+	ctx.ptsVisited = 0;
+	ctx.pointMK->reset();
+	if (root != NULL) {
+		root->ann_search_r(annBoxDistance_r(ctx.q, bnd_lo, bnd_hi,
+							ctx.dim, ctx.dist_type), ctx);
+	}
+	for (int i = 0; i < k; i++) {		// extract the k-th closest points
+		dd[i] = ctx.pointMK->ith_smallest_key(i);
+		nn_idx[i] = ctx.pointMK->ith_smallest_info(i);
+	}
+}
+
+void ANNkd_tree::annkSearch_r(
+	ANNpoint			q,				// the query point
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	ANNdistArray		dd,				// the approximate nearest neighbor
+	double				eps)			// the error bound
+{
+	if (k > n_pts) {					// too many near neighbors?
+		annError("Requesting more near neighbors than data points", ANNabort);
+	}
+	ANNmin_k pointMK(k);				// set for closest k points
+
+	ANNkdQuery ctx;
+	ctx.dim = dim;
+	ctx.dist_type = dist_type;
+	ctx.q = q;
+	ctx.maxErr = annDistPow(dist_type, 1.0 + eps);
+	ctx.pts = pts;
+	ctx.pointMK = &pointMK;
+	ctx.sqRad = 0;
+	ctx.ptsInRange = 0;
+
+	annkSearchQuery(root, bnd_box_lo, bnd_box_hi, ctx, k, nn_idx, dd);
+}
+
+//----------------------------------------------------------------------
+//	annkSearchAll - k nearest neighbors of every point of the tree
+//		The points are split into one contiguous range per thread;
+//		each thread keeps one context and one k-element queue, and
+//		writes the results of point i to nn_idx[i*k] and dd[i*k].
+//----------------------------------------------------------------------
+
+struct ANNkdBatch {						// arguments shared by the threads
+	ANNkd_ptr			root;
+	ANNpoint			bnd_lo;
+	ANNpoint			bnd_hi;
+	ANNpointArray		pts;
+	int					dim;
+	int					dist_type;
+	double				maxErr;
+	int					k;
+	ANNidxArray			nn_idx;
+	ANNdistArray		dd;
+};
+
+// queries start..end, end inclusive
+static void annkSearchRange(const ANNkdBatch* b, int start, int end)
+{
+	ANNmin_k pointMK(b->k);
+
+	ANNkdQuery ctx;
+	ctx.dim = b->dim;
+	ctx.dist_type = b->dist_type;
+	ctx.maxErr = b->maxErr;
+	ctx.pts = b->pts;
+	ctx.pointMK = &pointMK;
+	ctx.sqRad = 0;
+	ctx.ptsInRange = 0;
+
+	for (int i = start; i <= end; i++) {
+		ctx.q = b->pts[i];
+		annkSearchQuery(b->root, b->bnd_lo, b->bnd_hi, ctx, b->k,
+						b->nn_idx + (size_t)i * b->k,
+						b->dd + (size_t)i * b->k);
+	}
+}
+
+void ANNkd_tree::annkSearchAll(
+	int					k,				// number of near neighbors per point
+	ANNidxArray			nn_idx,			// n_pts*k nearest neighbor indices
+	ANNdistArray		dd,				// n_pts*k distances
+	double				eps)			// the error bound
+{
+	if (k > n_pts) {					// too many near neighbors?
+		annError("Requesting more near neighbors than data points", ANNabort);
+	}
+	ANNkdBatch b;
+	b.root = root;
+	b.bnd_lo = bnd_box_lo;
+	b.bnd_hi = bnd_box_hi;
+	b.pts = pts;
+	b.dim = dim;
+	b.dist_type = dist_type;
+	b.maxErr = annDistPow(dist_type, 1.0 + eps);
+	b.k = k;
+	b.nn_idx = nn_idx;
+	b.dd = dd;
+
+	run_range_threads(n_pts, 1, boost::bind(&annkSearchRange, &b, _1, _2));
+}
+
+void ANNkd_split::ann_search_r(ANNdist box_dist, ANNkdQuery &ctx)
+{
+										// check dist calc term condition
+	if (ANNmaxPtsVisited != 0 && ctx.ptsVisited > ANNmaxPtsVisited) return;
+
+										// distance to cutting plane
+	ANNcoord cut_diff = ctx.q[cut_dim] - cut_val;
+
+	if (cut_diff < 0) {					// left of cutting plane
+		child[ANN_LO]->ann_search_r(box_dist, ctx);// visit closer child first
+
+		ANNcoord box_diff = cd_bnds[ANN_LO] - ctx.q[cut_dim];
+		if (box_diff < 0)				// within bounds - ignore
+			box_diff = 0;
+										// distance to further box
+		box_dist = (ANNdist) (box_dist +
+				(annDistPow(ctx.dist_type, cut_diff) -
+				 annDistPow(ctx.dist_type, box_diff)));
+
+										// visit further child if close enough
+		if (box_dist * ctx.maxErr < ctx.pointMK->max_key())
+			child[ANN_HI]->ann_search_r(box_dist, ctx);
+
+	}
+	else {								// right of cutting plane
+		child[ANN_HI]->ann_search_r(box_dist, ctx);// visit closer child first
+
+		ANNcoord box_diff = ctx.q[cut_dim] - cd_bnds[ANN_HI];
+		if (box_diff < 0)				// within bounds - ignore
+			box_diff = 0;
+										// distance to further box
+		box_dist = (ANNdist) (box_dist +
+				(annDistPow(ctx.dist_type, cut_diff) -
+				 annDistPow(ctx.dist_type, box_diff)));
+
+										// visit further child if close enough
+		if (box_dist * ctx.maxErr < ctx.pointMK->max_key())
+			child[ANN_LO]->ann_search_r(box_dist, ctx);
+
+	}
+}
+
+void ANNkd_leaf::ann_search_r(ANNdist box_dist, ANNkdQuery &ctx)
+{
+	ANNdist dist;						// distance to data point
+	ANNcoord* pp;						// data coordinate pointer
+	ANNcoord* qq;						// query coordinate pointer
+	ANNdist min_dist;					// distance to k-th closest point
+	ANNcoord t;
+	int d;
+	const int dim = ctx.dim;
+	const int dist_type = ctx.dist_type;
+
+	min_dist = ctx.pointMK->max_key();	// k-th smallest distance so far
+
+	for (int i = 0; i < n_pts; i++) {	// check points in bucket
+
+		pp = ctx.pts[bkt[i]];			// first coord of next data point
+		qq = ctx.q;						// first coord of query point
+		dist = 0;
+
+		for(d = 0; d < dim; d++) {
+			t = *(qq++) - *(pp++);		// compute length and adv coordinate
+										// exceeds dist to k-th smallest?
+			if( (dist = dist + annDistPow(dist_type, t)) > min_dist) {
+				break;
+			}
+		}
+
+		if (d >= dim &&							// among the k best?
+		   (ANN_ALLOW_SELF_MATCH || dist!=0)) { // and no self-match problem
+												// add it to the list
+			ctx.pointMK->insert(dist, bkt[i]);
+			min_dist = ctx.pointMK->max_key();
+		}
+	}
+	ctx.ptsVisited += n_pts;			// increment number of points visited
+}
@@ -266,6 +266,7 @@ void ANNkd_tree::SkeletonTree(			// construct skeleton tree
 	}
 
 	bnd_box_lo = bnd_box_hi = NULL;		// bounding box is nonexistent
+	dist_type = ANN_DIST_TYPE;			// metric of the reentrant searches
 	if (KD_TRIVIAL == NULL)				// no trivial leaf node yet?
 		KD_TRIVIAL = new ANNkd_leaf(0, IDX_TRIVIAL);	// allocate it
 }
@@ -43,6 +43,25 @@ using namespace std;					// make std:: available
 //		this.
 //----------------------------------------------------------------------
 
+class ANNmin_k;
+
+//----------------------------------------------------------------------
+//	Query context of the reentrant searches (annkSearch_r and
+//	annkFRSearch_r): everything the standard searches keep in globals.
+//----------------------------------------------------------------------
+
+struct ANNkdQuery {
+	int				dim;				// dimension of space
+	int				dist_type;			// metric (see ANN_DIST_TYPE)
+	ANNpoint		q;					// query point
+	double			maxErr;				// max tolerable squared error
+	ANNpointArray	pts;				// the points
+	ANNmin_k*		pointMK;			// set of k closest points
+	int				ptsVisited;			// number of points visited
+	ANNdist			sqRad;				// squared radius (fixed-radius)
+	int				ptsInRange;			// points in range (fixed-radius)
+};
+
 class ANNkd_node{						// generic kd-tree node (empty shell)
 public:
 	virtual ~ANNkd_node() {}					// virtual distroyer
@@ -50,6 +69,9 @@ public:
 	virtual void ann_search(ANNdist) = 0;		// tree search
 	virtual void ann_pri_search(ANNdist) = 0;	// priority search
 	virtual void ann_FR_search(ANNdist) = 0;	// fixed-radius search
+												// reentrant versions
+	virtual void ann_search_r(ANNdist, ANNkdQuery&) = 0;
+	virtual void ann_FR_search_r(ANNdist, ANNkdQuery&) = 0;
 
 	virtual void getStats(						// get tree statistics
 				int dim,						// dimension of space
@@ -113,6 +135,8 @@ public:
 	virtual void ann_search(ANNdist);			// standard search
 	virtual void ann_pri_search(ANNdist);		// priority search
 	virtual void ann_FR_search(ANNdist);		// fixed-radius search
+	virtual void ann_search_r(ANNdist, ANNkdQuery&);
+	virtual void ann_FR_search_r(ANNdist, ANNkdQuery&);
 };
 
 //----------------------------------------------------------------------
@@ -179,6 +203,8 @@ public:
 	virtual void ann_search(ANNdist);			// standard search
 	virtual void ann_pri_search(ANNdist);		// priority search
 	virtual void ann_FR_search(ANNdist);		// fixed-radius search
+	virtual void ann_search_r(ANNdist, ANNkdQuery&);
+	virtual void ann_FR_search_r(ANNdist, ANNkdQuery&);
 };
 
 //----------------------------------------------------------------------
@@ -145,6 +145,26 @@ ANNdist annBoxDistance(			// compute distance from point to box
 	return dist;
 }
 
+ANNdist annBoxDistance_r(		// annBoxDistance for a given metric
+	const ANNpoint		q,				// the point
+	const ANNpoint		lo,				// low point of box
+	const ANNpoint		hi,				// high point of box
+	int					dim,			// dimension of space
+	int					dist_type)		// metric (see ANN_DIST_TYPE)
+{
+	ANNdist dist = 0.0;
+
+	for (int d = 0; d < dim; d++) {
+		if (q[d] < lo[d]) {				// q is left of box
+			dist += annDistPow(dist_type, ANNdist(lo[d]) - ANNdist(q[d]));
+		}
+		else if (q[d] > hi[d]) {		// q is right of box
+			dist += annDistPow(dist_type, ANNdist(q[d]) - ANNdist(hi[d]));
+		}
+	}
+	return dist;
+}
+
 //----------------------------------------------------------------------
 //	annSpread - find spread along given dimension
 //	annMinMax - find min and max coordinates along given dimension
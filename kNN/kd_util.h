@@ -55,6 +55,13 @@ ANNdist annBoxDistance(			// compute distance from point to box
 	const ANNpoint		hi,				// high point of box
 	int					dim);			// dimension of space
 
+ANNdist annBoxDistance_r(		// annBoxDistance for a given metric
+	const ANNpoint		q,				// the point
+	const ANNpoint		lo,				// low point of box
+	const ANNpoint		hi,				// high point of box
+	int					dim,			// dimension of space
+	int					dist_type);		// metric (see ANN_DIST_TYPE)
+
 ANNcoord annSpread(				// compute point spread along dimension
 	ANNpointArray		pa,				// point array
 	ANNidxArray			pidx,			// point indices
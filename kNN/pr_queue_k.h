@@ -83,6 +83,9 @@ public:
 
 	~ANNmin_k()							// destructor
 		{ delete [] mk; }
+
+	void reset()						// remove all items
+		{ n = 0; }
 	
 	PQKkey ANNmin_key()					// return minimum key
 		{ return (n > 0 ? mk[0].key : PQ_NULL_KEY); }